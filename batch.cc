@@ -0,0 +1,160 @@
+﻿  // @file batch
+  // @brief Definitions of sprite batch related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 10:12:31
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include <vector>
+#include "./batch_internal.h"
+namespace sys {
+  //
+  // These are internal structures related to batch
+  //
+BatchKey::BatchKey() : texture(nullptr), alpha(1.0f) { }
+BatchKey::BatchKey(const void* texture, float alpha) : texture(texture),
+    alpha(alpha) { }
+bool BatchKey::operator==(const BatchKey& key) const {
+  return ((texture == key.texture) && (alpha == key.alpha));
+}
+bool BatchKey::operator!=(const BatchKey& key) const {
+  return !(*this == key);
+}
+BatchStats::BatchStats() : quad_num(0), draw_num(0), flush_num(0),
+    vertex_num(0), max_flush_vertex_num(0) { }
+void BatchStats::Reset() {
+  quad_num = 0;
+  draw_num = 0;
+  flush_num = 0;
+  vertex_num = 0;
+  max_flush_vertex_num = 0;
+}
+RecordingBatchBackend::RecordingBatchBackend() : upload_records_(),
+    draw_records_() { }
+bool RecordingBatchBackend::Upload(const VertexInputData* vertices,
+                                   int vertex_num) {
+  assert(vertices);
+  upload_records_.push_back(vertex_num);
+  return true;
+}
+bool RecordingBatchBackend::Draw(const BatchKey& key, int first_vertex,
+                                 int vertex_num) {
+  DrawRecord record;
+  record.key = key;
+  record.first_vertex = first_vertex;
+  record.vertex_num = vertex_num;
+  draw_records_.push_back(record);
+  return true;
+}
+void RecordingBatchBackend::Clear() {
+  upload_records_.clear();
+  draw_records_.clear();
+}
+SpriteBatch::SpriteBatch() : backend_(nullptr), vertices_(), runs_(),
+    frame_stats_(), last_frame_stats_() {
+  // The stream is reserved once, no allocation happens in frames.
+  vertices_.reserve(SYS_BATCH_VERTEX_NUM);
+  runs_.reserve(SYS_BATCH_VERTEX_NUM / SYS_BATCH_QUAD_VERTEX_NUM);
+}
+void SpriteBatch::SetBackend(BatchBackend* backend) {
+  backend_ = backend;
+}
+bool SpriteBatch::AddQuad(const BatchKey& key, const VertexInputData* quad,
+                          float offset_x, float offset_y) {
+  assert(quad);
+  if (static_cast<int>(vertices_.size()) + SYS_BATCH_QUAD_VERTEX_NUM >
+      SYS_BATCH_VERTEX_NUM) {
+    if (!Flush()) return false;  // The stream is full.
+  }
+  // The triangle strip 0-1-2-3 is expanded to the list 0-1-2, 2-1-3, which
+  // keeps the clockwise winding of the strip.
+  const int order[SYS_BATCH_QUAD_VERTEX_NUM] = {0, 1, 2, 2, 1, 3};
+  const int first_vertex = static_cast<int>(vertices_.size());
+  for (int i = 0; i < SYS_BATCH_QUAD_VERTEX_NUM; ++i) {
+    VertexInputData vertex = quad[order[i]];
+    vertex.position[0] += offset_x;
+    vertex.position[1] += offset_y;
+    vertices_.push_back(vertex);
+  }
+  if (!runs_.empty() && (runs_.back().key == key)) {
+    runs_.back().vertex_num += SYS_BATCH_QUAD_VERTEX_NUM;
+  } else {
+    Run run;
+    run.key = key;
+    run.first_vertex = first_vertex;
+    run.vertex_num = SYS_BATCH_QUAD_VERTEX_NUM;
+    runs_.push_back(run);
+  }
+  ++frame_stats_.quad_num;
+  return true;
+}
+bool SpriteBatch::Flush() {
+  if (vertices_.empty()) return true;
+  bool result = (backend_ != nullptr);
+  const int vertex_num = static_cast<int>(vertices_.size());
+  if (result) result = backend_->Upload(&vertices_[0], vertex_num);
+  for (size_t i = 0; result && (i < runs_.size()); ++i) {
+    result = backend_->Draw(runs_[i].key, runs_[i].first_vertex,
+                            runs_[i].vertex_num);
+    ++frame_stats_.draw_num;
+  }
+  ++frame_stats_.flush_num;
+  frame_stats_.vertex_num += vertex_num;
+  if (vertex_num > frame_stats_.max_flush_vertex_num) {
+    frame_stats_.max_flush_vertex_num = vertex_num;
+  }
+  // The stream is emptied even when the backend fails, or it overflows.
+  vertices_.clear();
+  runs_.clear();
+  return result;
+}
+void SpriteBatch::EndFrame() {
+  last_frame_stats_ = frame_stats_;
+  frame_stats_.Reset();
+}
+
+  //
+  // These are internal functions related to batch
+  //
+void SetImageQuad(SYS_IMAGEMODE image_mode, double w, double h,
+                  int screen_w, int screen_h, float u0, float v0,
+                  float u1, float v1, VertexInputData* quad) {
+  assert(quad);
+  // Image polygon rectangle size in window set.
+  const float e_x = static_cast<float>(1.0f / screen_w * 2.0f);
+  const float e_y = static_cast<float>(1.0f / screen_h * 2.0f);
+  const float b_x = static_cast<float>(w * e_x);
+  const float b_y = -static_cast<float>(h * e_y);
+  const float position[SYS_VERTEX_INPUT_NUM][2] = {
+    { 0.0f, 0.0f },
+    { b_x, 0.0f },
+    { 0.0f, b_y },
+    { b_x, b_y },
+  };
+  const float def_coord[SYS_VERTEX_INPUT_NUM][2] = {
+    { u0, v0 },
+    { u1, v0 },
+    { u0, v1 },
+    { u1, v1 },
+  };
+  // Corners of the texture at the corners of the strip.
+  static const int kCorners[][SYS_VERTEX_INPUT_NUM] = {
+    {0, 1, 2, 3},  // DEFAULT
+    {1, 0, 3, 2},  // HINVERT
+    {2, 3, 0, 1},  // VINVERT
+    {2, 0, 3, 1},  // ROT90
+    {3, 2, 1, 0},  // ROT180
+    {1, 3, 0, 2},  // ROT270
+  };
+  const int mode_num = sizeof(kCorners) / sizeof(kCorners[0]);
+  const bool is_valid = (image_mode >= 0) && (image_mode < mode_num);
+  for (int i = 0; i < SYS_VERTEX_INPUT_NUM; ++i) {
+    quad[i].position[0] = position[i][0];
+    quad[i].position[1] = position[i][1];
+    quad[i].position[2] = 0.5f;
+    // An unknown mode samples the first texel.
+    const int corner = is_valid ? kCorners[image_mode][i] : 0;
+    quad[i].texcoord[0] = is_valid ? def_coord[corner][0] : 0.0f;
+    quad[i].texcoord[1] = is_valid ? def_coord[corner][1] : 0.0f;
+  }
+}
+}  // namespace sys
@@ -0,0 +1,23 @@
+﻿  // @file batch
+  // @brief Declaration of sprite batch related structures.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-19 10:05:14
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef BATCH_H_
+#define BATCH_H_
+  //
+  // These are public macros related to batch
+  //
+
+  //
+  // These are public enumerations and constants related to batch
+  //
+enum SYS_IMAGEMODE {
+  SYS_IMAGEMODE_DEFAULT,
+  SYS_IMAGEMODE_HINVERT,
+  SYS_IMAGEMODE_VINVERT,
+  SYS_IMAGEMODE_ROT90,
+  SYS_IMAGEMODE_ROT180,
+  SYS_IMAGEMODE_ROT270,
+};
+#endif  // BATCH_H_
@@ -0,0 +1,113 @@
+﻿  // @file batch_internal.h
+  // @brief Declaration of sprite batch related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 10:12:31
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef BATCH_INTERNAL_H_
+#define BATCH_INTERNAL_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "./batch.h"
+  //
+  // These are internal macros related to batch
+  //
+#define SYS_VERTEX_INPUT_NUM          (4)  // Fixed.
+#define SYS_BATCH_QUAD_VERTEX_NUM     (6)  // Two triangles, fixed.
+#define SYS_BATCH_VERTEX_NUM          (6 * 4096)  // Vertices in one flush.
+
+  //
+  // These are internal enumerations and constants related to batch
+  //
+
+namespace sys {
+  //
+  // These are internal structures related to batch
+  //
+struct VertexInputData {
+  float position[3];  // SV_POSITION
+  float texcoord[2];  // TEXCOORD0
+};
+struct BatchKey {
+  const void* texture;  // Backend specific texture, e.g. TextureData.
+  float alpha;
+  BatchKey();
+  BatchKey(const void* texture, float alpha);
+  bool operator==(const BatchKey& key) const;
+  bool operator!=(const BatchKey& key) const;
+};
+struct BatchStats {
+  int quad_num;  // Quads added.
+  int draw_num;  // Draw calls issued.
+  int flush_num;  // Vertex uploads issued.
+  int vertex_num;  // Vertices uploaded.
+  int max_flush_vertex_num;  // The largest upload.
+  BatchStats();
+  void Reset();
+};
+  // The backend receives the vertices of a flush by one upload, then draws
+  // each run of vertices that share a key.
+class BatchBackend {
+ public:
+  virtual ~BatchBackend() { }
+  virtual bool Upload(const VertexInputData* vertices, int vertex_num) = 0;
+  virtual bool Draw(const BatchKey& key, int first_vertex, int vertex_num) = 0;
+};
+  // This backend only records calls, it is used to check and benchmark the
+  // batch builder without a graphic device.
+class RecordingBatchBackend : public BatchBackend {
+ public:
+  struct DrawRecord {
+    BatchKey key;
+    int first_vertex;
+    int vertex_num;
+  };
+  RecordingBatchBackend();
+  bool Upload(const VertexInputData* vertices, int vertex_num);
+  bool Draw(const BatchKey& key, int first_vertex, int vertex_num);
+  void Clear();
+  const std::vector<int>& upload_records() const { return upload_records_; }
+  const std::vector<DrawRecord>& draw_records() const {
+    return draw_records_;
+  }
+ private:
+  std::vector<int> upload_records_;  // Vertex number of each upload.
+  std::vector<DrawRecord> draw_records_;
+};
+  // Quads are collected into one vertex stream in the order of calls.
+  // Consecutive quads with the same key share a draw call, so the order of
+  // alpha blending is kept.
+class SpriteBatch {
+ public:
+  SpriteBatch();
+  void SetBackend(BatchBackend* backend);
+  bool AddQuad(const BatchKey& key, const VertexInputData* quad,
+               float offset_x, float offset_y);
+  bool Flush();
+  void EndFrame();
+  bool IsEmpty() const { return vertices_.empty(); }
+  const BatchStats& GetLastFrameStats() const { return last_frame_stats_; }
+ private:
+  struct Run {
+    BatchKey key;
+    int first_vertex;
+    int vertex_num;
+  };
+  BatchBackend* backend_;
+  std::vector<VertexInputData> vertices_;
+  std::vector<Run> runs_;
+  BatchStats frame_stats_;
+  BatchStats last_frame_stats_;
+};
+
+  //
+  // These are internal functions related to batch
+  //
+  // The strip of an image of w x h pixels from the top left corner of a
+  // screen of screen_w x screen_h, in clip space. The texture rectangle u0,
+  // v0 to u1, v1 is turned by the mode.
+void SetImageQuad(SYS_IMAGEMODE image_mode, double w, double h,
+                  int screen_w, int screen_h, float u0, float v0,
+                  float u1, float v1, VertexInputData* quad);
+}  // namespace sys
+#endif  // BATCH_INTERNAL_H_
@@ -0,0 +1,160 @@
+﻿// @file batch_check.cc
+// @brief Runs of the sprite batch checked, and quads batched a second.
+// @author Mamoru Kaminaga
+// @date 2026-10-19 11:32:08
+// Copyright 2026 Mamoru Kaminaga
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../batch_internal.h"
+#include "../clock_internal.h"
+#define BENCH_GLYPH_NUM     (40)  // A text line.
+#define BENCH_SPRITE_NUM    (200)  // Of each texture in a scene.
+#define BENCH_TEXTURE_NUM   (8)
+#define BENCH_FRAME_NUM     (1000)
+#define BENCH_REPEAT_NUM    (3)  // The fastest run is taken.
+namespace {
+int error_num = 0;
+void Expect(bool condition, const char* name) {
+  if (condition) return;
+  fprintf(stderr, "failed: %s\n", name);
+  ++error_num;
+}
+void MakeQuad(sys::VertexInputData* quad) {
+  sys::SetImageQuad(SYS_IMAGEMODE_DEFAULT, 16.0, 16.0, 640, 480, 0.0f, 0.0f,
+                    1.0f, 1.0f, quad);
+}
+  // Each key is added count times in the order, then flushed.
+struct Step {
+  int texture;
+  float alpha;
+  int count;
+};
+bool Draw(const Step* steps, int step_num, sys::SpriteBatch* batch) {
+  static const char kTextures[BENCH_TEXTURE_NUM] = {0};
+  sys::VertexInputData quad[SYS_VERTEX_INPUT_NUM];
+  MakeQuad(quad);
+  for (int i = 0; i < step_num; ++i) {
+    const sys::BatchKey key(&kTextures[steps[i].texture], steps[i].alpha);
+    for (int j = 0; j < steps[i].count; ++j) {
+      if (!batch->AddQuad(key, quad, 0.0f, 0.0f)) return false;
+    }
+  }
+  return batch->Flush();
+}
+  // Runs of the same texture and alpha are merged in the order of the
+  // calls, and a flush is one upload.
+void CheckRuns() {
+  sys::RecordingBatchBackend backend;
+  sys::SpriteBatch batch;
+  batch.SetBackend(&backend);
+  // A text line is one draw.
+  const Step text[] = {{0, 1.0f, BENCH_GLYPH_NUM}};
+  Expect(Draw(text, 1, &batch), "text drawn");
+  Expect(backend.upload_records().size() == 1, "text uploaded once");
+  Expect(backend.draw_records().size() == 1, "text drawn once");
+  Expect(backend.upload_records()[0] ==
+         BENCH_GLYPH_NUM * SYS_BATCH_QUAD_VERTEX_NUM, "text vertices");
+  // The texture and the alpha are keys, and A B A is not reordered.
+  backend.Clear();
+  const Step keys[] = {
+    {0, 1.0f, 3}, {1, 1.0f, 2}, {1, 0.5f, 4}, {0, 1.0f, 1}, {0, 1.0f, 5},
+  };
+  Expect(Draw(keys, 5, &batch), "keys drawn");
+  const std::vector<sys::RecordingBatchBackend::DrawRecord>& draws =
+    backend.draw_records();
+  const int expected_quads[] = {3, 2, 4, 6};
+  Expect(backend.upload_records().size() == 1, "keys uploaded once");
+  Expect(draws.size() == 4, "keys drawn in 4 runs");
+  int first_vertex = 0;
+  for (size_t i = 0; (i < draws.size()) && (i < 4); ++i) {
+    Expect(draws[i].first_vertex == first_vertex, "runs contiguous");
+    Expect(draws[i].vertex_num ==
+           expected_quads[i] * SYS_BATCH_QUAD_VERTEX_NUM, "run vertices");
+    first_vertex += draws[i].vertex_num;
+  }
+  Expect((draws.size() == 4) && (draws[1].key.texture != draws[0].key.texture)
+         && (draws[2].key.alpha == 0.5f) && (draws[3].key == draws[0].key),
+         "run keys");
+  Expect(backend.upload_records()[0] == first_vertex, "keys vertices");
+  // A full stream is flushed, and a run goes on in the next upload.
+  backend.Clear();
+  const int quad_num = SYS_BATCH_VERTEX_NUM / SYS_BATCH_QUAD_VERTEX_NUM * 2 +
+    10;
+  const Step many[] = {{2, 1.0f, quad_num}};
+  Expect(Draw(many, 1, &batch), "many drawn");
+  Expect(backend.upload_records().size() == 3, "many uploaded 3 times");
+  Expect(backend.draw_records().size() == 3, "many drawn once an upload");
+  for (size_t i = 0; i < backend.upload_records().size(); ++i) {
+    Expect(backend.upload_records()[i] <= SYS_BATCH_VERTEX_NUM,
+           "upload in the stream");
+  }
+  // The stats are of the last frame.
+  batch.EndFrame();
+  const sys::BatchStats& stats = batch.GetLastFrameStats();
+  Expect(stats.quad_num == BENCH_GLYPH_NUM + 15 + quad_num, "quads counted");
+  Expect(stats.flush_num == 5, "flushes counted");
+  Expect(stats.draw_num == 1 + 4 + 3, "draws counted");
+  Expect(stats.max_flush_vertex_num == SYS_BATCH_VERTEX_NUM,
+         "largest flush counted");
+  // Nothing is uploaded without quads, and a failed backend empties it.
+  backend.Clear();
+  Expect(batch.Flush() && backend.upload_records().empty(), "empty flush");
+  batch.SetBackend(nullptr);
+  Expect(!Draw(text, 1, &batch) && batch.IsEmpty(), "no backend");
+}
+  // A scene of sprites of some textures, interleaved as a game draws them,
+  // and a text line.
+const sys::BatchStats& DrawScene(sys::SpriteBatch* batch, int64_t* ns) {
+  static const char kTextures[BENCH_TEXTURE_NUM + 1] = {0};
+  sys::VertexInputData quad[SYS_VERTEX_INPUT_NUM];
+  MakeQuad(quad);
+  const int64_t start_ns = sys::GetClockNanoSecond();
+  for (int frame = 0; frame < BENCH_FRAME_NUM; ++frame) {
+    // Layers of one texture each, back to front.
+    for (int i = 0; i < BENCH_TEXTURE_NUM; ++i) {
+      const sys::BatchKey key(&kTextures[i], 1.0f);
+      for (int j = 0; j < BENCH_SPRITE_NUM; ++j) {
+        batch->AddQuad(key, quad, j * 0.001f, i * 0.01f);
+      }
+    }
+    const sys::BatchKey font(&kTextures[BENCH_TEXTURE_NUM], 1.0f);
+    for (int j = 0; j < BENCH_GLYPH_NUM; ++j) {
+      batch->AddQuad(font, quad, j * 0.02f, 0.9f);
+    }
+    batch->Flush();
+    batch->EndFrame();
+  }
+  *ns = sys::GetClockNanoSecond() - start_ns;
+  return batch->GetLastFrameStats();
+}
+}  // namespace
+int main() {
+  CheckRuns();
+  printf("runs %s\n", (error_num == 0) ? "ok" : "failed");
+  sys::RecordingBatchBackend backend;
+  sys::SpriteBatch batch;
+  batch.SetBackend(&backend);
+  int64_t best_ns = INT64_MAX;
+  sys::BatchStats stats;
+  for (int i = 0; i < BENCH_REPEAT_NUM; ++i) {
+    int64_t ns = 0;
+    stats = DrawScene(&batch, &ns);
+    backend.Clear();
+    if (ns < best_ns) best_ns = ns;
+  }
+  const int quad_num = BENCH_TEXTURE_NUM * BENCH_SPRITE_NUM + BENCH_GLYPH_NUM;
+  if ((stats.quad_num != quad_num) ||
+      (stats.draw_num != BENCH_TEXTURE_NUM + 1)) {
+    fprintf(stderr, "%d quads in %d draws\n", stats.quad_num,
+            stats.draw_num);
+    ++error_num;
+  }
+  printf("quads  draws/frame  flushes/frame  vertices/flush  quads/s\n");
+  printf("%5d %12d %14d %15.0f %8.0f\n", stats.quad_num, stats.draw_num,
+         stats.flush_num,
+         static_cast<double>(stats.vertex_num) / stats.flush_num,
+         static_cast<double>(quad_num) * BENCH_FRAME_NUM * 1e9 / best_ns);
+  return (error_num == 0) ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+﻿// @file bus_check.cc
+// @brief Buses checked for routing, fades and ducking, and the cost of them.
+// @author Mamoru Kaminaga
+// @date 2026-10-19 18:47:13
+// Copyright 2026 Mamoru Kaminaga
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+#include "../mixer_internal.h"
+#define CHECK_LEVEL         (4000)  // Of a constant voice.
+#define CHECK_FADE_MS       (100.0f)
+#define CHECK_DIALOGUE      (0.3f)  // The peak of the sidechain.
+#define CHECK_SECONDS       (2)  // Longer than the release.
+#define BENCH_BLOCK_NUM     (1000)  // Mixed in a run.
+namespace {
+int error_num = 0;
+void Expect(bool condition, const char* name) {
+  if (condition) return;
+  fprintf(stderr, "failed: %s\n", name);
+  ++error_num;
+}
+  // A looped mono wave of a second, constant or a sine.
+std::shared_ptr<const sys::SampleBuffer> MakeSamples(int level, bool is_sine) {
+  std::shared_ptr<sys::SampleBuffer> samples(new sys::SampleBuffer());
+  samples->format = SYS_SAMPLEFORMAT_INT16;
+  samples->channel_num = 1;
+  samples->frame_num = SYS_MIXER_SAMPLE_RATE;
+  samples->loop_end = SYS_MIXER_SAMPLE_RATE;
+  for (int i = 0; i < SYS_MIXER_SAMPLE_RATE; ++i) {
+    const float v = is_sine ? sinf(static_cast<float>(i) * 0.0627f) : 1.0f;
+    samples->int16_samples.push_back(static_cast<int16_t>(v * level));
+  }
+  return samples;
+}
+int Play(sys::Mixer* mixer, const std::shared_ptr<const sys::SampleBuffer>& s,
+         int bus, float gain) {
+  sys::VoiceDesc desc;
+  desc.bus = bus;
+  desc.gain = gain;
+  return mixer->Play(s, 0, desc);
+}
+std::vector<int16_t> Render(sys::Mixer* mixer, int frame_num) {
+  sys::MemorySink sink;
+  sink.Open();
+  sys::RenderMixer(mixer, &sink, frame_num);
+  return sink.GetSamples();
+}
+  // Voices of the default buses sound as they did before the buses, when
+  // all were mixed to the master.
+void CheckRouting() {
+  const int buses[] = {SYS_BUS_MUSIC, SYS_BUS_SFX, SYS_BUS_VOICE};
+  std::unique_ptr<sys::Mixer> routed(new sys::Mixer());
+  std::unique_ptr<sys::Mixer> master(new sys::Mixer());
+  for (int i = 0; i < 3; ++i) {
+    const std::shared_ptr<const sys::SampleBuffer> samples =
+      MakeSamples(8000 + i * 1000, true);
+    Play(routed.get(), samples, buses[i], 0.5f);
+    Play(master.get(), samples, SYS_BUS_MASTER, 0.5f);
+  }
+  const std::vector<int16_t> a = Render(routed.get(), SYS_MIXER_SAMPLE_RATE);
+  const std::vector<int16_t> b = Render(master.get(), SYS_MIXER_SAMPLE_RATE);
+  const bool is_same = (a.size() == b.size()) &&
+    (memcmp(&a[0], &b[0], a.size() * sizeof(int16_t)) == 0);
+  printf("default routing %s\n", is_same ? "bit-exact" : "differs");
+  Expect(is_same, "default routing bit-exact");
+}
+  // A fade of the sfx bus moves a frame by a step at most, and a mute
+  // silences the bus and makes its voice virtual.
+void CheckFade() {
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  Play(mixer.get(), MakeSamples(CHECK_LEVEL, false), SYS_BUS_SFX, 1.0f);
+  Render(mixer.get(), SYS_MIXER_BLOCK_FRAMES);
+  sys::BusDesc desc;
+  desc.gain = 0.0f;
+  desc.ramp_ms = CHECK_FADE_MS;
+  Expect(mixer->SetBus(SYS_BUS_SFX, desc), "fade set");
+  const std::vector<int16_t> out = Render(mixer.get(), SYS_MIXER_SAMPLE_RATE);
+  int max_step = 0;
+  for (size_t i = 1; i < out.size() / 2; ++i) {
+    const int step = abs(out[i * 2] - out[(i - 1) * 2]);
+    if (step > max_step) max_step = step;
+  }
+  printf("a %.0f ms fade of %d: %d LSB a frame at most, %d at the end\n",
+         CHECK_FADE_MS, CHECK_LEVEL, max_step, out[out.size() - 2]);
+  Expect((max_step <= 1) && (out[0] != 0) && (out[out.size() - 2] == 0),
+         "fade smooth");
+  std::unique_ptr<sys::Mixer> muted(new sys::Mixer());
+  Play(muted.get(), MakeSamples(CHECK_LEVEL, false), SYS_BUS_SFX, 1.0f);
+  sys::BusDesc mute;
+  mute.is_muted = true;
+  Expect(muted->SetBus(SYS_BUS_SFX, mute), "mute set");
+  const std::vector<int16_t> silence =
+    Render(muted.get(), SYS_MIXER_BLOCK_FRAMES * 4);
+  const sys::MixerStats stats = muted->GetStats();
+  Expect((silence[silence.size() - 2] == 0) && (stats.virtual_num == 1),
+         "mute silent and virtual");
+}
+  // Dialogue over the threshold ducks the music to duck_gain, and the music
+  // comes back to unity when it stops.
+void CheckDucking() {
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  sys::BusDesc music;
+  music.sidechain = SYS_BUS_VOICE;
+  Expect(mixer->SetBus(SYS_BUS_MUSIC, music), "sidechain set");
+  Play(mixer.get(), MakeSamples(CHECK_LEVEL, true), SYS_BUS_MUSIC, 1.0f);
+  const int dialogue = Play(mixer.get(), MakeSamples(32767, false),
+                            SYS_BUS_VOICE, CHECK_DIALOGUE);
+  Render(mixer.get(), SYS_MIXER_SAMPLE_RATE);
+  const float ducked = mixer->GetBusStats(SYS_BUS_MUSIC).duck_gain;
+  mixer->Stop(dialogue);
+  Render(mixer.get(), SYS_MIXER_SAMPLE_RATE * CHECK_SECONDS);
+  const float released = mixer->GetBusStats(SYS_BUS_MUSIC).duck_gain;
+  printf("dialogue at %.2f: music ducked to %.4f, released to %.4f\n",
+         CHECK_DIALOGUE, ducked, released);
+  Expect(ducked == music.duck_gain, "music ducked to duck_gain");
+  Expect(released == 1.0f, "music released");
+}
+  // A user bus under the sfx bus is lowered by both gains.
+void CheckChain() {
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  sys::BusDesc sfx;
+  sfx.gain = 0.5f;
+  sys::BusDesc user;
+  user.parent = SYS_BUS_SFX;
+  user.gain = 0.5f;
+  Expect(mixer->SetBus(SYS_BUS_SFX, sfx) &&
+         mixer->SetBus(SYS_BUS_USER, user), "chain set");
+  Play(mixer.get(), MakeSamples(CHECK_LEVEL * 4, false), SYS_BUS_USER, 1.0f);
+  const std::vector<int16_t> out =
+    Render(mixer.get(), SYS_MIXER_BLOCK_FRAMES * 4);
+  const int v = out[out.size() - 2];
+  printf("user bus under sfx, 0.5 and 0.5: %d of %d\n", v, CHECK_LEVEL * 4);
+  Expect(abs(v - CHECK_LEVEL) <= 1, "chained gains multiplied");
+}
+  // A parent must be before the bus and a sidechain after it, so the graph
+  // has no loop, and the values must be in range.
+void CheckInvalid() {
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  sys::BusDesc desc;
+  sys::BusDesc after = desc;
+  after.parent = SYS_BUS_VOICE;
+  sys::BusDesc self = desc;
+  self.parent = SYS_BUS_SFX;
+  sys::BusDesc before = desc;
+  before.sidechain = SYS_BUS_MUSIC;
+  sys::BusDesc outside = desc;
+  outside.sidechain = SYS_BUS_NUM;
+  sys::BusDesc negative = desc;
+  negative.gain = -1.0f;
+  sys::BusDesc loud = desc;
+  loud.duck_gain = 2.0f;
+  const bool is_rejected = !mixer->SetBus(SYS_BUS_SFX, after) &&
+    !mixer->SetBus(SYS_BUS_SFX, self) && !mixer->SetBus(SYS_BUS_SFX, before) &&
+    !mixer->SetBus(SYS_BUS_SFX, outside) &&
+    !mixer->SetBus(SYS_BUS_SFX, negative) &&
+    !mixer->SetBus(SYS_BUS_SFX, loud) && !mixer->SetBus(SYS_BUS_NUM, desc) &&
+    !mixer->SetBus(-1, desc);
+  printf("invalid graphs %s\n", is_rejected ? "rejected" : "accepted");
+  Expect(is_rejected, "invalid graphs rejected");
+}
+  // A stream is mixed through its bus.
+void CheckStream() {
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  std::shared_ptr<sys::StreamBuffer> stream(
+      new sys::StreamBuffer(SYS_MIXER_BLOCK_FRAMES * 4));
+  std::vector<float> samples(SYS_MIXER_BLOCK_FRAMES * 4 * 2, 0.25f);
+  stream->Write(&samples[0], SYS_MIXER_BLOCK_FRAMES * 4);
+  stream->bus = SYS_BUS_MUSIC;
+  stream->ready.store(true);
+  sys::BusDesc music;
+  music.gain = 0.5f;
+  Expect(mixer->SetBus(SYS_BUS_MUSIC, music) && mixer->AddStream(stream),
+         "stream added");
+  const std::vector<int16_t> out =
+    Render(mixer.get(), SYS_MIXER_BLOCK_FRAMES * 2);
+  const int v = out[out.size() - 2];
+  printf("stream of 0.25 on music at 0.5: %d\n", v);
+  Expect(abs(v - 4096) <= 1, "stream on its bus");
+}
+  // Microseconds a block of the processing of the buses, with a voice on 4
+  // buses and the music ducked.
+double Measure() {
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  sys::BusDesc music;
+  music.sidechain = SYS_BUS_VOICE;
+  sys::BusDesc user;
+  user.parent = SYS_BUS_SFX;
+  mixer->SetBus(SYS_BUS_MUSIC, music);
+  mixer->SetBus(SYS_BUS_USER, user);
+  const std::shared_ptr<const sys::SampleBuffer> samples =
+    MakeSamples(8000, true);
+  const int buses[] = {
+    SYS_BUS_MUSIC, SYS_BUS_SFX, SYS_BUS_VOICE, SYS_BUS_USER,
+  };
+  for (int bus : buses) Play(mixer.get(), samples, bus, 0.25f);
+  int16_t out[SYS_MIXER_BLOCK_FRAMES * SYS_MIXER_CHANNEL_NUM];
+  for (int i = 0; i < BENCH_BLOCK_NUM; ++i) {
+    mixer->Mix(SYS_MIXER_BLOCK_FRAMES, out);
+  }
+  int64_t process_ns = 0;
+  for (int i = 0; i < SYS_BUS_NUM; ++i) {
+    process_ns += mixer->GetBusStats(i).process_ns;
+  }
+  Expect(mixer->GetBusStats(SYS_BUS_MUSIC).duck_gain < 1.0f, "music ducked");
+  return process_ns / 1e3 / BENCH_BLOCK_NUM;
+}
+}  // namespace
+int main() {
+  CheckRouting();
+  CheckFade();
+  CheckDucking();
+  CheckChain();
+  CheckInvalid();
+  CheckStream();
+  printf("4 buses and a sidechain: %.1f us a block\n", Measure());
+  return (error_num == 0) ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+﻿// @file clock_check.cc
+// @brief Voices checked to start on the frames of the sound clock.
+// @author Mamoru Kaminaga
+// @date 2026-10-19 16:20:09
+// Copyright 2026 Mamoru Kaminaga
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "../mixer_internal.h"
+#define CHECK_IMPULSE_NUM   (60)
+#define CHECK_SECONDS       (10)  // The impulses are in them.
+#define CHECK_PART_FRAMES   (100)  // Rendered at once, not of the block.
+#define CHECK_AHEAD_FRAMES  (4410)  // An impulse is sent 100 ms before.
+#define CHECK_LATE_FRAMES   (50)
+#define CHECK_ROUND_FRAMES  (5000000)  // From 0 and from a year.
+namespace {
+int error_num = 0;
+void Expect(bool condition, const char* name) {
+  if (condition) return;
+  fprintf(stderr, "failed: %s\n", name);
+  ++error_num;
+}
+  // One frame of half the full scale.
+std::shared_ptr<const sys::SampleBuffer> MakeImpulse() {
+  std::shared_ptr<sys::SampleBuffer> samples(new sys::SampleBuffer());
+  samples->format = SYS_SAMPLEFORMAT_INT16;
+  samples->channel_num = 1;
+  samples->frame_num = 1;
+  samples->int16_samples.push_back(16384);
+  return samples;
+}
+  // Impulses at pseudo random frames are sent a little before their frames,
+  // and rendered in parts that do not end on blocks. Each must be heard on
+  // its frame, and nothing else.
+void CheckImpulses() {
+  std::vector<int64_t> frames;
+  uint32_t seed = 7;
+  while (frames.size() < CHECK_IMPULSE_NUM) {
+    seed = seed * 1664525u + 1013904223u;
+    const int64_t frame = CHECK_AHEAD_FRAMES +
+      (seed >> 8) % (SYS_MIXER_SAMPLE_RATE * CHECK_SECONDS);
+    if (std::find(frames.begin(), frames.end(), frame) == frames.end()) {
+      frames.push_back(frame);
+    }
+  }
+  std::sort(frames.begin(), frames.end());
+  const std::shared_ptr<const sys::SampleBuffer> impulse = MakeImpulse();
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  sys::MemorySink sink;
+  sink.Open();
+  const int frame_num = SYS_MIXER_SAMPLE_RATE * CHECK_SECONDS +
+    CHECK_AHEAD_FRAMES * 2;
+  size_t sent_num = 0;
+  for (int i = 0; i < frame_num; i += CHECK_PART_FRAMES) {
+    while ((sent_num < frames.size()) &&
+           (frames[sent_num] < mixer->GetFrame() + CHECK_AHEAD_FRAMES)) {
+      sys::VoiceDesc desc;
+      desc.start_frame = frames[sent_num];
+      Expect(mixer->Play(impulse, 0, desc) != SYS_MIXER_INVALID_VOICE,
+             "impulse played");
+      ++sent_num;
+    }
+    sys::RenderMixer(mixer.get(), &sink, CHECK_PART_FRAMES);
+  }
+  std::vector<int64_t> heard;
+  const std::vector<int16_t>& out = sink.GetSamples();
+  for (size_t i = 0; i < out.size() / 2; ++i) {
+    if ((out[i * 2] != 0) || (out[i * 2 + 1] != 0)) heard.push_back(i);
+  }
+  int64_t max_error = 0;
+  for (size_t i = 0; (i < heard.size()) && (i < frames.size()); ++i) {
+    const int64_t error = (heard[i] > frames[i]) ?
+      heard[i] - frames[i] : frames[i] - heard[i];
+    if (error > max_error) max_error = error;
+  }
+  printf("%d impulses in %d frame parts, %d heard, %lld frames of error\n",
+         CHECK_IMPULSE_NUM, CHECK_PART_FRAMES,
+         static_cast<int>(heard.size()), static_cast<long long>(max_error));
+  Expect(heard.size() == frames.size(), "every impulse heard once");
+  Expect(max_error == 0, "impulses on their frames");
+  const sys::MixerStats stats = mixer->GetStats();
+  Expect(stats.late_num == 0, "no impulse late");
+}
+  // A start already mixed is played at once, and counted as late.
+void CheckLate() {
+  const std::shared_ptr<const sys::SampleBuffer> impulse = MakeImpulse();
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  sys::MemorySink sink;
+  sink.Open();
+  sys::RenderMixer(mixer.get(), &sink, CHECK_PART_FRAMES * 10);
+  const int64_t frame = mixer->GetFrame();
+  sys::VoiceDesc desc;
+  desc.start_frame = frame - CHECK_LATE_FRAMES;
+  Expect(mixer->Play(impulse, 0, desc) != SYS_MIXER_INVALID_VOICE,
+         "late impulse played");
+  sys::RenderMixer(mixer.get(), &sink, CHECK_PART_FRAMES);
+  const sys::MixerStats stats = mixer->GetStats();
+  const std::vector<int16_t>& out = sink.GetSamples();
+  printf("a start %d frames ago: %lld late, %lld late frames\n",
+         CHECK_LATE_FRAMES, static_cast<long long>(stats.late_num),
+         static_cast<long long>(stats.late_frames));
+  Expect(out[frame * 2] != 0, "late impulse heard at once");
+  Expect((stats.late_num == 1) && (stats.late_frames == CHECK_LATE_FRAMES),
+         "late impulse counted");
+}
+  // A frame comes back from its time as the same frame, from the start and
+  // after a year.
+void CheckConversion() {
+  const int64_t year_frame = static_cast<int64_t>(SYS_MIXER_SAMPLE_RATE) *
+    60 * 60 * 24 * 365;
+  int round_error_num = 0;
+  for (int64_t base : {static_cast<int64_t>(0), year_frame}) {
+    for (int64_t i = 0; i < CHECK_ROUND_FRAMES; ++i) {
+      const int64_t frame = base + i;
+      if (sys::NanoSecondToFrames(sys::FramesToNanoSecond(frame)) != frame) {
+        ++round_error_num;
+      }
+    }
+  }
+  printf("%d frames from 0 and a year converted, %d errors\n",
+         CHECK_ROUND_FRAMES, round_error_num);
+  Expect(round_error_num == 0, "frames converted both ways");
+  Expect(sys::FramesToNanoSecond(SYS_MIXER_SAMPLE_RATE) == 1000000000LL,
+         "a second of frames");
+}
+}  // namespace
+int main() {
+  CheckImpulses();
+  CheckLate();
+  CheckConversion();
+  return (error_num == 0) ? 0 : 1;
+}
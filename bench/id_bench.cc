@@ -0,0 +1,386 @@
+﻿// @file id_bench.cc
+// @brief Checks and speed of IdServer and the slot maps.
+// @author Mamoru Kaminaga
+// @date 2026-10-17 21:26:40
+// Copyright 2026 Mamoru Kaminaga
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../clock_internal.h"
+#include "../slot_map_internal.h"
+#define BENCH_CHURN_NUM     (10000000)  // Release and create pairs.
+#define BENCH_LIVE_NUM      (1000)  // Ids used while churning.
+#define BENCH_SEQUENCE_NUM  (4000000)  // Ids created in order.
+#define BENCH_RANGE_NUM     (64)  // Ids of a range.
+#define BENCH_STRESS_NUM    (400000)  // Operations of a thread.
+#define BENCH_RESERVE_NUM   (8000)  // Ids reserved by a thread.
+#define BENCH_CONTENTION_NUM  (500000)  // Pairs of a thread.
+namespace {
+  // The IdServer before the hierarchical bitmap, a 32 x 32 table of 1024
+  // ids, which is compared with the current one.
+class TableIdServer {
+ public:
+  TableIdServer() : m_flag_(0) {
+    for (int i = 0; i < 32; ++i) n_flag_[i] = 0;
+  }
+  int CreateId() {
+    if (m_flag_ == 0xffffffff) return SYS_ID_SERVER_EXCEEDS_LIMIT;
+    const int m = SearchClearBitFoward32(0, m_flag_);
+    const int n = SearchClearBitFoward32(0, n_flag_[m]);
+    n_flag_[m] |= 1u << n;
+    if (n_flag_[m] == 0xffffffff) m_flag_ |= 1u << m;
+    return (m << 5) | n;
+  }
+  int ReleaseId(int id) {
+    n_flag_[id >> 5] &= ~(1u << (id & 0x1f));
+    m_flag_ &= ~(1u << (id >> 5));
+    return id;
+  }
+ private:
+  static int CountSetBits32(uint32_t v) {
+    uint32_t count = (v & 0x55555555) + ((v >> 1) & 0x55555555);
+    count = (count & 0x33333333) + ((count >> 2) & 0x33333333);
+    count = (count & 0x0f0f0f0f) + ((count >> 4) & 0x0f0f0f0f);
+    count = (count & 0x00ff00ff) + ((count >> 8) & 0x00ff00ff);
+    return ((count & 0x0000ffff) + ((count >> 16) & 0x0000ffff));
+  }
+  static int GetLSB32(uint32_t v) {
+    if (v == 0) return -1;
+    v |= (v << 1);
+    v |= (v << 2);
+    v |= (v << 4);
+    v |= (v << 8);
+    v |= (v << 16);
+    return (32 - CountSetBits32(v));
+  }
+  static int SearchClearBitFoward32(int n, uint32_t v) {
+    v = ~v & (0xffffffff << n);
+    if (v) return GetLSB32(v);
+    return -1;
+  }
+  uint32_t m_flag_;
+  uint32_t n_flag_[32];
+};
+  // The ids of one thread, given as the slot map gives released slots.
+class OwnerIdServer {
+ public:
+  OwnerIdServer() : free_slots_(), next_(0) { }
+  int CreateId() {
+    const int id = free_slots_.TakeLowest();
+    return (id >= 0) ? id : next_++;
+  }
+  int ReleaseId(int id) {
+    free_slots_.Add(static_cast<uint32_t>(id));
+    return id;
+  }
+ private:
+  sys::FreeSlotSet free_slots_;
+  int next_;
+};
+uint32_t random_state = 1;
+volatile int id_sink = 0;  // Ids are used, so the calls are not removed.
+int Random(int n) {
+  random_state = random_state * 1103515245u + 12345u;
+  return static_cast<int>((random_state >> 8) % static_cast<uint32_t>(n));
+}
+bool Fail(const char* message, int value) {
+  fprintf(stderr, "%s: %d\n", message, value);
+  exit(1);
+  return false;
+}
+  // Single ids and ranges are checked against a plain array, the lowest
+  // free id or the lowest free run is given.
+void CheckLowestFree() {
+  sys::IdServer server;
+  std::vector<char> used;
+  for (int i = 0; i < 100000; ++i) {
+    const int op = Random(10);
+    if (op < 5) {
+      const int id = server.CreateId();
+      int lowest = 0;
+      while ((lowest < static_cast<int>(used.size())) && used[lowest]) {
+        ++lowest;
+      }
+      if (id != lowest) Fail("CreateId is not the lowest", id);
+      if (id >= static_cast<int>(used.size())) used.resize(id + 1, 0);
+      used[id] = 1;
+    } else if (op < 6) {
+      const int num = 1 + Random(200);
+      const int first = server.CreateIds(num);
+      int lowest = 0;
+      for (int j = 0; j < num; ++j) {
+        if ((lowest + j < static_cast<int>(used.size())) &&
+            used[lowest + j]) {
+          lowest += j + 1;
+          j = -1;
+        }
+      }
+      if (first != lowest) Fail("CreateIds is not the lowest", first);
+      if (first + num > static_cast<int>(used.size())) {
+        used.resize(first + num, 0);
+      }
+      for (int j = 0; j < num; ++j) used[first + j] = 1;
+    } else if (used.empty()) {
+      continue;
+    } else if (op < 7) {
+      const int first = Random(static_cast<int>(used.size()));
+      int num = 1 + Random(100);
+      if (first + num > static_cast<int>(used.size())) {
+        num = static_cast<int>(used.size()) - first;
+      }
+      server.ReleaseIds(first, num);
+      for (int j = 0; j < num; ++j) used[first + j] = 0;
+    } else {
+      const int id = Random(static_cast<int>(used.size()));
+      server.ReleaseId(id);
+      used[id] = 0;
+    }
+  }
+  for (int i = 0; i < static_cast<int>(used.size()); ++i) {
+    if (server.IsUsed(i) != (used[i] != 0)) Fail("IsUsed is wrong", i);
+  }
+  printf("lowest free ids: ok, %d ids\n", static_cast<int>(used.size()));
+}
+template <typename Server>
+double MeasureChurn(Server* server) {
+  for (int i = 0; i < BENCH_LIVE_NUM; ++i) server->CreateId();
+  const int64_t start_ns = sys::GetClockNanoSecond();
+  for (int i = 0; i < BENCH_CHURN_NUM; ++i) {
+    server->ReleaseId((i * 7) % BENCH_LIVE_NUM);
+    id_sink = id_sink + server->CreateId();
+  }
+  return static_cast<double>(sys::GetClockNanoSecond() - start_ns) /
+    BENCH_CHURN_NUM;
+}
+void MeasureIdServer() {
+  TableIdServer table;
+  sys::IdServer server;
+  OwnerIdServer owner;
+  printf("release and create, %d ids used:\n", BENCH_LIVE_NUM);
+  printf("  table    %6.1f ns\n", MeasureChurn(&table));
+  printf("  bitmap   %6.1f ns\n", MeasureChurn(&server));
+  printf("  owner    %6.1f ns\n", MeasureChurn(&owner));
+  // The table stops at 1024 ids.
+  sys::IdServer large;
+  int64_t start_ns = sys::GetClockNanoSecond();
+  for (int i = 0; i < BENCH_SEQUENCE_NUM; ++i) {
+    if (large.CreateId() != i) Fail("CreateId is not in order", i);
+  }
+  printf("create %d ids in order: %6.1f ns\n", BENCH_SEQUENCE_NUM,
+         static_cast<double>(sys::GetClockNanoSecond() - start_ns) /
+         BENCH_SEQUENCE_NUM);
+  // Ranges are taken after the ids used.
+  sys::IdServer range;
+  for (int i = 0; i < BENCH_LIVE_NUM; ++i) range.CreateId();
+  const int range_num = BENCH_CHURN_NUM / BENCH_RANGE_NUM;
+  start_ns = sys::GetClockNanoSecond();
+  for (int i = 0; i < range_num; ++i) {
+    const int first = range.CreateIds(BENCH_RANGE_NUM);
+    if (first != BENCH_LIVE_NUM) Fail("CreateIds is not the lowest", first);
+    range.ReleaseIds(first, BENCH_RANGE_NUM);
+  }
+  printf("create and release %d ids at once: %6.1f ns\n", BENCH_RANGE_NUM,
+         static_cast<double>(sys::GetClockNanoSecond() - start_ns) /
+         range_num);
+}
+  // Slots released by the owner are reused from the lowest, and their old
+  // ids and ids never given are rejected.
+void CheckSlotReuse() {
+  sys::SlotMap<int> slot_map;
+  std::vector<int> ids;
+  for (int i = 0; i < 100; ++i) ids.push_back(slot_map.Create(nullptr));
+  const int released[] = {50, 10, 30};
+  for (int slot : released) slot_map.Release(ids[slot]);
+  const int reused[] = {10, 30, 50};
+  for (int slot : reused) {
+    const int id = slot_map.Create(nullptr);
+    if ((id & SYS_SLOT_INDEX_MASK) != slot) Fail("Not the lowest slot", id);
+    if ((id == ids[slot]) || slot_map.IsValid(ids[slot])) {
+      Fail("An old id is valid", ids[slot]);
+    }
+    ids[slot] = id;
+  }
+  // The next id of a released slot is not reserved, though the server
+  // still has the slot.
+  slot_map.Release(ids[20]);
+  const int next_id = ids[20] + (1 << SYS_SLOT_INDEX_BITS);
+  if (slot_map.Insert(next_id) || slot_map.Release(next_id)) {
+    Fail("An id never given is taken", next_id);
+  }
+  // A reservation takes a new slot, the owner's slot is given by Create.
+  const int reserved_id = slot_map.Reserve();
+  if ((reserved_id & SYS_SLOT_INDEX_MASK) != 100) {
+    Fail("Reserve took a slot of the owner", reserved_id);
+  }
+  if (slot_map.Create(nullptr) != next_id) Fail("Slot 20 not reused", 20);
+  printf("slot reuse: ok\n");
+}
+void MeasureSlotMap() {
+  sys::SlotMap<int> slot_map;
+  std::vector<int> ids;
+  for (int i = 0; i < BENCH_LIVE_NUM; ++i) {
+    int* value = nullptr;
+    ids.push_back(slot_map.Create(&value));
+    *value = i;
+  }
+  const int64_t start_ns = sys::GetClockNanoSecond();
+  for (int i = 0; i < BENCH_CHURN_NUM; ++i) {
+    const int index = (i * 7) % BENCH_LIVE_NUM;
+    if (!slot_map.Release(ids[index])) Fail("Release failed", i);
+    int* value = nullptr;
+    ids[index] = slot_map.Create(&value);
+    if (ids[index] < 0) Fail("Create failed", i);
+    *value = i;
+  }
+  printf("slot map release and create: %6.1f ns\n",
+         static_cast<double>(sys::GetClockNanoSecond() - start_ns) /
+         BENCH_CHURN_NUM);
+}
+  // Threads create and release single ids and ranges at the same time, and
+  // each id is counted by its owner, so an id given twice is found.
+void CheckConcurrentIds(int thread_num) {
+  sys::IdServer server;
+  std::vector<std::atomic<int>> owners(1 << 20);
+  for (auto& owner : owners) owner.store(0);
+  std::atomic<int> duplicate_num(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < thread_num; ++i) {
+    threads.push_back(std::thread([&server, &owners, &duplicate_num, i] {
+      uint32_t state = static_cast<uint32_t>(i) * 7 + 1;
+      std::vector<std::pair<int, int>> ranges;  // First and number.
+      for (int j = 0; j < BENCH_STRESS_NUM; ++j) {
+        state = state * 1103515245u + 12345u;
+        const int op = (state >> 16) % 10;
+        if ((op < 5) || ranges.empty()) {
+          const int num = (op == 0) ? 1 + (state >> 8) % 70 : 1;
+          const int first = (num == 1) ? server.CreateId() :
+            server.CreateIds(num);
+          if (first < 0) Fail("Ids ran out", first);
+          for (int k = 0; k < num; ++k) {
+            if (owners[first + k].fetch_add(1) != 0) duplicate_num++;
+          }
+          ranges.push_back(std::make_pair(first, num));
+        } else {
+          const size_t index = (state >> 4) % ranges.size();
+          const std::pair<int, int> range = ranges[index];
+          ranges[index] = ranges.back();
+          ranges.pop_back();
+          for (int k = 0; k < range.second; ++k) {
+            owners[range.first + k].fetch_sub(1);
+          }
+          server.ReleaseIds(range.first, range.second);
+        }
+      }
+      for (auto& range : ranges) {
+        for (int k = 0; k < range.second; ++k) {
+          owners[range.first + k].fetch_sub(1);
+        }
+        server.ReleaseIds(range.first, range.second);
+      }
+    }));
+  }
+  for (auto& thread : threads) thread.join();
+  if (duplicate_num.load() != 0) {
+    Fail("Ids given twice", duplicate_num.load());
+  }
+  // The upper bits are consistent again, so ids restart at 0.
+  for (int i = 0; i < 100000; ++i) {
+    if (server.CreateId() != i) Fail("Ids do not restart at 0", i);
+  }
+  printf("concurrent ids: ok, %d threads\n", thread_num);
+}
+  // Threads reserve ids while the owner inserts and releases values, and
+  // the reserved ids are inserted by the owner after them.
+void CheckConcurrentSlotMap(int thread_num) {
+  sys::SlotMap<int> slot_map;
+  std::vector<std::vector<int>> reserved(thread_num);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < thread_num; ++i) {
+    threads.push_back(std::thread([&slot_map, &reserved, i] {
+      for (int j = 0; j < BENCH_RESERVE_NUM; ++j) {
+        const int id = slot_map.Reserve();
+        if (id < 0) Fail("Reserve failed", j);
+        reserved[i].push_back(id);
+      }
+    }));
+  }
+  std::vector<int> ids;
+  for (int i = 0; i < BENCH_STRESS_NUM; ++i) {
+    if (ids.empty() || ((ids.size() < 20000) && (Random(3) != 0))) {
+      int* value = nullptr;
+      ids.push_back(slot_map.Create(&value));
+      if (ids.back() < 0) Fail("Create failed", i);
+      *value = ids.back();
+    } else {
+      const int index = Random(static_cast<int>(ids.size()));
+      if (!slot_map.Release(ids[index])) Fail("Release failed", i);
+      ids[index] = ids.back();
+      ids.pop_back();
+    }
+  }
+  for (auto& thread : threads) thread.join();
+  for (auto& thread_ids : reserved) {
+    for (int id : thread_ids) {
+      if (slot_map.Get(id)) Fail("A reserved id has a value", id);
+      int* value = slot_map.Insert(id);
+      if (!value) Fail("Insert failed", id);
+      *value = id;
+      ids.push_back(id);
+    }
+  }
+  for (int id : ids) {
+    const int* value = slot_map.Get(id);
+    if (!value || (*value != id)) Fail("An id is given twice", id);
+  }
+  if (slot_map.size() != static_cast<int>(ids.size())) {
+    Fail("Values are lost", slot_map.size());
+  }
+  printf("concurrent slot map: ok, %d threads\n", thread_num);
+}
+double MeasureContention(int thread_num, bool use_mutex) {
+  sys::IdServer server;
+  std::mutex mutex;
+  std::vector<std::thread> threads;
+  const int64_t start_ns = sys::GetClockNanoSecond();
+  for (int i = 0; i < thread_num; ++i) {
+    threads.push_back(std::thread([&server, &mutex, use_mutex] {
+      for (int j = 0; j < BENCH_CONTENTION_NUM; ++j) {
+        if (use_mutex) {
+          std::lock_guard<std::mutex> lock(mutex);
+          server.ReleaseId(server.CreateId());
+        } else {
+          server.ReleaseId(server.CreateId());
+        }
+      }
+    }));
+  }
+  for (auto& thread : threads) thread.join();
+  return static_cast<double>(sys::GetClockNanoSecond() - start_ns) /
+    BENCH_CONTENTION_NUM;
+}
+}  // namespace
+  // The threads are given as the argument, 4 by default, so threads are
+  // switched in the middle of the calls even on one core.
+int main(int argc, char* argv[]) {
+  int thread_num = (argc > 1) ? atoi(argv[1]) : 4;
+  if (thread_num <= 0) thread_num = 4;
+  CheckLowestFree();
+  CheckConcurrentIds(thread_num);
+  CheckConcurrentSlotMap(thread_num);
+  CheckSlotReuse();
+  MeasureIdServer();
+  MeasureSlotMap();
+  printf("release and create at once, ns of a pair on a thread:\n");
+  printf("threads      atomic      mutex\n");
+  for (int i = 1; i <= thread_num; ++i) {
+    const double atomic_ns = MeasureContention(i, false);
+    const double mutex_ns = MeasureContention(i, true);
+    printf("%7d %11.1f %10.1f\n", i, atomic_ns, mutex_ns);
+  }
+  return 0;
+}
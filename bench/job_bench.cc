@@ -0,0 +1,90 @@
+﻿// @file job_bench.cc
+// @brief Throughput of the job system with 1 to N workers.
+// @author Mamoru Kaminaga
+// @date 2026-10-17 21:05:12
+// Copyright 2026 Mamoru Kaminaga
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include "../clock_internal.h"
+#include "../job.h"
+#include "../job_internal.h"
+#define BENCH_TASK_NUM      (256)  // Jobs run from the main thread.
+#define BENCH_CHILD_NUM     (64)  // Jobs run from each of them.
+#define BENCH_REPEAT_NUM    (5)  // The fastest run is taken.
+namespace {
+std::atomic<int64_t> done_num(0);
+volatile uint32_t sink = 0;
+  // A job of about 2 us, the size of a small decode or cull.
+void Work(void* data) {
+  uint32_t x = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(data));
+  for (int i = 0; i < 2000; ++i) x = x * 1664525u + 1013904223u;
+  sink = sink + x;
+  done_num.fetch_add(1, std::memory_order_relaxed);
+}
+  // Jobs run from a worker are stolen by the others.
+void Spawn(void* data) {
+  sys::JobSystem* job_system = static_cast<sys::JobSystem*>(data);
+  sys::JobDesc jobs[BENCH_CHILD_NUM];
+  for (int i = 0; i < BENCH_CHILD_NUM; ++i) {
+    jobs[i] = sys::JobDesc(Work, reinterpret_cast<void*>(
+        static_cast<uintptr_t>(i)));
+  }
+  sys::JobCounter counter;
+  job_system->Run(jobs, BENCH_CHILD_NUM, &counter);
+  job_system->Wait(&counter);
+  done_num.fetch_add(1, std::memory_order_relaxed);
+}
+int64_t Measure(int worker_num) {
+  sys::JobSystem job_system;
+  job_system.Start(worker_num);
+  static sys::JobDesc jobs[BENCH_TASK_NUM];
+  for (int i = 0; i < BENCH_TASK_NUM; ++i) {
+    jobs[i] = sys::JobDesc(Spawn, &job_system);
+  }
+  int64_t best_ns = INT64_MAX;
+  for (int i = 0; i < BENCH_REPEAT_NUM; ++i) {
+    done_num.store(0);
+    const int64_t start_ns = sys::GetClockNanoSecond();
+    sys::JobCounter counter;
+    sys::JobCounter after_counter;
+    sys::JobDesc after(Work, nullptr);
+    job_system.Run(jobs, BENCH_TASK_NUM, &counter);
+    job_system.RunAfter(&counter, &after, 1, &after_counter);
+    job_system.Wait(&counter);
+    job_system.Wait(&after_counter);
+    const int64_t ns = sys::GetClockNanoSecond() - start_ns;
+    if (done_num.load() != BENCH_TASK_NUM * (BENCH_CHILD_NUM + 1) + 1) {
+      fprintf(stderr, "%d jobs lost\n",
+              BENCH_TASK_NUM * (BENCH_CHILD_NUM + 1) + 1 -
+              static_cast<int>(done_num.load()));
+      exit(1);
+    }
+    if (ns < best_ns) best_ns = ns;
+  }
+  job_system.Stop();
+  return best_ns;
+}
+}  // namespace
+  // The workers are given as the argument, one for each core by default.
+int main(int argc, char* argv[]) {
+  int max_worker_num = (argc > 1) ? atoi(argv[1]) : 0;
+  if (max_worker_num <= 0) {
+    max_worker_num = static_cast<int>(std::thread::hardware_concurrency());
+    if (max_worker_num <= 0) max_worker_num = 1;
+  }
+  const int job_num = BENCH_TASK_NUM * (BENCH_CHILD_NUM + 1) + 1;
+  printf("%d jobs, %d cores\n", job_num,
+         static_cast<int>(std::thread::hardware_concurrency()));
+  printf("workers        ms      jobs/s   speedup\n");
+  int64_t base_ns = 0;
+  for (int worker_num = 1; worker_num <= max_worker_num; ++worker_num) {
+    const int64_t ns = Measure(worker_num);
+    if (worker_num == 1) base_ns = ns;
+    printf("%7d %9.2f %11.0f %9.2f\n", worker_num, ns / 1e6,
+           job_num * 1e9 / ns, static_cast<double>(base_ns) / ns);
+  }
+  return 0;
+}
@@ -0,0 +1,188 @@
+﻿// @file load_bench.cc
+// @brief Waves decoded through the load queue against a sequential loop.
+// @author Mamoru Kaminaga
+// @date 2026-10-19 20:11:37
+// Copyright 2026 Mamoru Kaminaga
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <utility>
+#include <thread>
+#include <vector>
+#include "../clock_internal.h"
+#include "../job_internal.h"
+#include "../load_internal.h"
+#include "../mixer_internal.h"
+#include "../wave_internal.h"
+#define BENCH_ASSET_NUM     (256)  // Waves of a level.
+#define BENCH_SAMPLE_RATE   (22050)  // Resampled to the mixer rate.
+#define BENCH_WAVE_FRAMES   (22050)  // 1 second.
+#define BENCH_REPEAT_NUM    (3)  // The fastest run is taken.
+namespace {
+  // A stereo 16 bit wave of a sine of its own pitch, with the chunks of PCM.
+std::vector<uint8_t> MakeWave(int asset) {
+  std::vector<uint8_t> wave;
+  auto put = [&wave](uint32_t value, int size) {
+    for (int i = 0; i < size; ++i) {
+      wave.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+  };
+  auto put_id = [&wave](const char* id) {
+    wave.insert(wave.end(), id, id + 4);
+  };
+  put_id("RIFF");
+  put(36 + BENCH_WAVE_FRAMES * 4, 4);
+  put_id("WAVE");
+  put_id("fmt ");
+  put(16, 4);
+  put(1, 2);  // PCM
+  put(2, 2);
+  put(BENCH_SAMPLE_RATE, 4);
+  put(BENCH_SAMPLE_RATE * 4, 4);
+  put(4, 2);
+  put(16, 2);
+  put_id("data");
+  put(BENCH_WAVE_FRAMES * 4, 4);
+  const double pitch = 220.0 + asset * 3.0;
+  for (int i = 0; i < BENCH_WAVE_FRAMES; ++i) {
+    const double phase = 2.0 * 3.14159265358979 * pitch * i /
+      BENCH_SAMPLE_RATE;
+    const int16_t v = static_cast<int16_t>(8192.0 * sin(phase));
+    put(static_cast<uint16_t>(v), 2);
+    put(static_cast<uint16_t>(-v), 2);
+  }
+  return wave;
+}
+  // The decode of CreateWave on the portable path: the wave is parsed, read
+  // and resampled on a worker, and the samples are handed over on the main
+  // thread as the wave slot is filled.
+class WaveRequest : public sys::LoadRequest {
+ public:
+  WaveRequest(const std::vector<uint8_t>* wave,
+              std::vector<sys::SampleBuffer>* results) :
+      wave_(wave), results_(results), samples_() { }
+  bool Decode() {
+    sys::WaveFile file;
+    sys::WaveDecoder decoder;
+    if (!file.Open(&(*wave_)[0], wave_->size()) ||
+        !decoder.Reset(file.GetView())) {
+      return false;
+    }
+    const sys::WaveView& view = file.GetView();
+    const void* pcm = nullptr;
+    const int frame_num = decoder.Read(view.frame_num, &pcm);
+    return sys::ConvertPcm(view.format, pcm,
+                           static_cast<size_t>(frame_num) * view.frame_bytes,
+                           -1, SYS_RESAMPLEQUALITY_MEDIUM, &samples_);
+  }
+  bool Finish() {
+    std::swap((*results_)[id], samples_);
+    return true;
+  }
+ private:
+  const std::vector<uint8_t>* wave_;
+  std::vector<sys::SampleBuffer>* results_;
+  sys::SampleBuffer samples_;
+};
+bool IsSame(const sys::SampleBuffer& a, const sys::SampleBuffer& b) {
+  return (a.frame_num > 0) && (a.frame_num == b.frame_num) &&
+    (a.channel_num == b.channel_num) && (a.int16_samples == b.int16_samples) &&
+    (a.float_samples == b.float_samples);
+}
+  // Each wave is decoded and finished on the main thread, as CreateWave
+  // does.
+int64_t MeasureSequential(const std::vector<std::vector<uint8_t>>& waves,
+                          std::vector<sys::SampleBuffer>* results) {
+  int64_t best_ns = INT64_MAX;
+  for (int i = 0; i < BENCH_REPEAT_NUM; ++i) {
+    results->assign(waves.size(), sys::SampleBuffer());
+    const int64_t start_ns = sys::GetClockNanoSecond();
+    for (size_t j = 0; j < waves.size(); ++j) {
+      WaveRequest request(&waves[j], results);
+      request.id = static_cast<int>(j);
+      if (!request.Decode() || !request.Finish()) {
+        fprintf(stderr, "wave %d not decoded\n", static_cast<int>(j));
+        exit(1);
+      }
+    }
+    const int64_t ns = sys::GetClockNanoSecond() - start_ns;
+    if (ns < best_ns) best_ns = ns;
+  }
+  return best_ns;
+}
+  // All waves are submitted at once, and the main thread updates the queue
+  // as it does once a frame until they are done. The frames are counted.
+int64_t MeasureQueue(const std::vector<std::vector<uint8_t>>& waves,
+                     int worker_num, std::vector<sys::SampleBuffer>* results,
+                     int* update_num) {
+  sys::JobSystem job_system;
+  if (!job_system.Start(worker_num)) {
+    fprintf(stderr, "%d workers not started\n", worker_num);
+    exit(1);
+  }
+  sys::LoadQueue& load_queue = sys::load_data.load_queue;
+  load_queue.SetJobSystem(&job_system);
+  int64_t best_ns = INT64_MAX;
+  for (int i = 0; i < BENCH_REPEAT_NUM; ++i) {
+    results->assign(waves.size(), sys::SampleBuffer());
+    const int done_num = load_queue.GetStats().done_num;
+    *update_num = 0;
+    const int64_t start_ns = sys::GetClockNanoSecond();
+    for (size_t j = 0; j < waves.size(); ++j) {
+      WaveRequest* request = new WaveRequest(&waves[j], results);
+      request->id = static_cast<int>(j);
+      load_queue.Submit(request);
+    }
+    while (load_queue.GetStats().loading_num > 0) {
+      load_queue.Update();
+      ++*update_num;
+    }
+    const int64_t ns = sys::GetClockNanoSecond() - start_ns;
+    if (load_queue.GetStats().done_num - done_num !=
+        static_cast<int>(waves.size())) {
+      fprintf(stderr, "waves failed with %d workers\n", worker_num);
+      exit(1);
+    }
+    if (ns < best_ns) best_ns = ns;
+  }
+  load_queue.SetJobSystem(nullptr);
+  job_system.Stop();
+  return best_ns;
+}
+}  // namespace
+  // The workers are given as the argument, the cores by default.
+int main(int argc, char* argv[]) {
+  int max_worker_num = (argc > 1) ? atoi(argv[1]) : 0;
+  if (max_worker_num <= 0) {
+    max_worker_num = static_cast<int>(std::thread::hardware_concurrency());
+    if (max_worker_num <= 0) max_worker_num = 1;
+  }
+  std::vector<std::vector<uint8_t>> waves;
+  for (int i = 0; i < BENCH_ASSET_NUM; ++i) waves.push_back(MakeWave(i));
+  std::vector<sys::SampleBuffer> expected;
+  const int64_t base_ns = MeasureSequential(waves, &expected);
+  printf("%d waves of %d Hz stereo, 1 s each, resampled, %d cores\n",
+         BENCH_ASSET_NUM, BENCH_SAMPLE_RATE,
+         static_cast<int>(std::thread::hardware_concurrency()));
+  printf("path        workers        ms   updates   speedup\n");
+  printf("sequential %8d %9.2f %9d %9.2f\n", 1, base_ns / 1e6, 0, 1.0);
+  bool is_ok = true;
+  for (int worker_num = 1; worker_num <= max_worker_num; ++worker_num) {
+    std::vector<sys::SampleBuffer> results;
+    int update_num = 0;
+    const int64_t ns = MeasureQueue(waves, worker_num, &results, &update_num);
+    int differ_num = 0;
+    for (size_t i = 0; i < waves.size(); ++i) {
+      if (!IsSame(results[i], expected[i])) ++differ_num;
+    }
+    printf("load queue %8d %9.2f %9d %9.2f\n", worker_num, ns / 1e6,
+           update_num, static_cast<double>(base_ns) / ns);
+    if (differ_num != 0) {
+      fprintf(stderr, "%d waves differ from the sequential ones\n",
+              differ_num);
+      is_ok = false;
+    }
+  }
+  return is_ok ? 0 : 1;
+}
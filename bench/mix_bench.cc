@@ -0,0 +1,104 @@
+﻿// @file mix_bench.cc
+// @brief Voices mixed by a core in real time, through the null sink.
+// @author Mamoru Kaminaga
+// @date 2026-10-18 11:02:47
+// Copyright 2026 Mamoru Kaminaga
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory>
+#include "../clock_internal.h"
+#include "../mixer_internal.h"
+#define BENCH_WAVE_FRAMES   (44100)  // A looped wave of 1 second.
+#define BENCH_MIX_FRAMES    (44100 * 4)  // Rendered in a run.
+#define BENCH_REPEAT_NUM    (3)  // The fastest run is taken.
+namespace {
+struct Source {
+  const char* name;
+  SYS_SAMPLEFORMAT format;
+  int channel_num;
+};
+const Source kSources[] = {
+  {"mono int16", SYS_SAMPLEFORMAT_INT16, 1},
+  {"stereo int16", SYS_SAMPLEFORMAT_INT16, 2},
+  {"mono float", SYS_SAMPLEFORMAT_FLOAT, 1},
+  {"stereo float", SYS_SAMPLEFORMAT_FLOAT, 2},
+};
+const int kVoiceNums[] = {1, 16, SYS_MIXER_REAL_VOICE_NUM};
+std::shared_ptr<const sys::SampleBuffer> MakeSamples(const Source& source) {
+  std::shared_ptr<sys::SampleBuffer> samples(new sys::SampleBuffer());
+  samples->format = source.format;
+  samples->channel_num = source.channel_num;
+  samples->frame_num = BENCH_WAVE_FRAMES;
+  samples->loop_start = 0;
+  samples->loop_end = BENCH_WAVE_FRAMES;
+  const int sample_num = BENCH_WAVE_FRAMES * source.channel_num;
+  for (int i = 0; i < sample_num; ++i) {
+    const float v = 0.5f * sinf(static_cast<float>(i) * 0.0627f);
+    if (source.format == SYS_SAMPLEFORMAT_INT16) {
+      samples->int16_samples.push_back(static_cast<int16_t>(v * 32767.0f));
+    } else {
+      samples->float_samples.push_back(v);
+    }
+  }
+  return samples;
+}
+  // Nanoseconds to mix a second, the fastest of the runs.
+int64_t Measure(const Source& source, int voice_num, bool use_effect) {
+  const std::shared_ptr<const sys::SampleBuffer> samples = MakeSamples(source);
+  int64_t best_ns = INT64_MAX;
+  for (int i = 0; i < BENCH_REPEAT_NUM; ++i) {
+    std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+    sys::EffectDesc effect;
+    effect.type = SYS_EFFECTTYPE_LOWPASS;
+    sys::VoiceDesc desc;
+    desc.gain = 1.0f / voice_num;
+    if (use_effect) {
+      desc.effects = &effect;
+      desc.effect_num = 1;
+    }
+    for (int j = 0; j < voice_num; ++j) {
+      desc.pan = -1.0f + 2.0f * j / voice_num;
+      if (mixer->Play(samples, 0, desc) == SYS_MIXER_INVALID_VOICE) {
+        fprintf(stderr, "voice %d not played\n", j);
+        exit(1);
+      }
+    }
+    sys::NullSink sink;
+    sink.Open();
+    const int64_t start_ns = sys::GetClockNanoSecond();
+    sys::RenderMixer(mixer.get(), &sink, BENCH_MIX_FRAMES);
+    const int64_t ns = sys::GetClockNanoSecond() - start_ns;
+    const sys::MixerStats stats = mixer->GetStats();
+    if ((sink.GetWrittenFrames() != BENCH_MIX_FRAMES) ||
+        (stats.active_num != voice_num)) {
+      fprintf(stderr, "%d of %d voices mixed\n", stats.active_num, voice_num);
+      exit(1);
+    }
+    if (ns < best_ns) best_ns = ns;
+  }
+  return best_ns * SYS_MIXER_SAMPLE_RATE / BENCH_MIX_FRAMES;
+}
+void Print(const char* name, int voice_num, int64_t ns) {
+  // A second of a voice costs ns / voice_num, a core has 1e9 ns a second.
+  printf("%-22s %6d %10.3f %12.0f\n", name, voice_num, ns / 1e6,
+         1e9 * voice_num / ns);
+}
+}  // namespace
+int main() {
+#ifdef SYS_MIXER_USE_SSE2
+  printf("SSE2 kernels, %d frames a block\n", SYS_MIXER_BLOCK_FRAMES);
+#else
+  printf("scalar kernels, %d frames a block\n", SYS_MIXER_BLOCK_FRAMES);
+#endif
+  printf("source                 voices  ms per 1 s  voices/core\n");
+  for (const Source& source : kSources) {
+    for (int voice_num : kVoiceNums) {
+      Print(source.name, voice_num, Measure(source, voice_num, false));
+    }
+  }
+  Print("stereo int16 + lowpass", SYS_MIXER_REAL_VOICE_NUM,
+        Measure(kSources[1], SYS_MIXER_REAL_VOICE_NUM, true));
+  return 0;
+}
@@ -0,0 +1,75 @@
+﻿// @file pacer_bench.cc
+// @brief Frames paced at 60 and 144 fps, and the errors to their deadlines.
+// @author Mamoru Kaminaga
+// @date 2026-10-19 21:02:16
+// Copyright 2026 Mamoru Kaminaga
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "../clock_internal.h"
+#define BENCH_SECONDS       (3)  // Paced at a rate.
+namespace {
+int error_num = 0;
+void Expect(bool condition, const char* name) {
+  if (condition) return;
+  fprintf(stderr, "failed: %s\n", name);
+  ++error_num;
+}
+double Percentile(const std::vector<int64_t>& sorted, int percent) {
+  const size_t i = (sorted.size() - 1) * percent / 100;
+  return sorted[i] / 1e3;
+}
+  // The main loop of the system with no work in a frame. The error is from
+  // the deadline to the time Wait returns. The deadlines must be base + n *
+  // period with the fraction of the period, and a frame more than a period
+  // late restarts them from that frame.
+void Measure(int numerator, int denominator, int64_t spin_ns) {
+  sys::FramePacer pacer;
+  pacer.SetRate(numerator, denominator);
+  pacer.SetSpinNanoSecond(spin_ns);
+  int64_t base_ns = sys::GetClockNanoSecond();
+  pacer.Reset(base_ns);
+  const int frame_num = BENCH_SECONDS * numerator / denominator;
+  std::vector<int64_t> errors;
+  int64_t frame = 0;
+  int reset_num = 0;
+  int drift_num = 0;
+  for (int i = 0; i < frame_num; ++i) {
+    const int64_t now = pacer.Wait();
+    ++frame;
+    const int64_t expected = base_ns +
+      frame * denominator * SYS_NS_PER_SECOND / numerator;
+    if (pacer.GetLastDeadline() == now && now - expected >=
+        pacer.GetPeriodNanoSecond()) {
+      // Restarted from now.
+      ++reset_num;
+      base_ns = now;
+      frame = 0;
+      continue;
+    }
+    if (pacer.GetLastDeadline() != expected) ++drift_num;
+    errors.push_back(now - pacer.GetLastDeadline());
+  }
+  Expect(!errors.empty(), "frames on their deadlines");
+  if (errors.empty()) return;
+  std::sort(errors.begin(), errors.end());
+  printf("%4d/%d %8lld %8d %8.1f %8.1f %8.1f %8.1f %6d\n", numerator,
+         denominator, static_cast<long long>(spin_ns / SYS_NS_PER_MILLISECOND),
+         frame_num, Percentile(errors, 50), Percentile(errors, 90),
+         Percentile(errors, 99), Percentile(errors, 100), reset_num);
+  Expect(drift_num == 0, "deadlines of the exact period");
+  Expect(errors.front() >= 0, "no frame before its deadline");
+}
+}  // namespace
+int main() {
+  printf("%d s a rate, errors in us after the deadlines\n", BENCH_SECONDS);
+  printf("  rate  spin ms   frames      p50      p90      p99      max");
+  printf(" resets\n");
+  for (int numerator : {60, 144}) {
+    Measure(numerator, 1, SYS_FRAME_SPIN_NS);
+    Measure(numerator, 1, 0);  // Sleeps only.
+  }
+  return (error_num == 0) ? 0 : 1;
+}
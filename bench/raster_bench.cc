@@ -0,0 +1,198 @@
+﻿// @file raster_bench.cc
+// @brief Pixels of the software raster checked, and quads filled a second.
+// @author Mamoru Kaminaga
+// @date 2026-10-19 10:40:26
+// Copyright 2026 Mamoru Kaminaga
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "../batch_internal.h"
+#include "../clock_internal.h"
+#include "../raster_internal.h"
+#define BENCH_CHECK_W       (64)
+#define BENCH_CHECK_H       (48)
+#define BENCH_CHECK_TEXELS  (5)  // A square, so the turned image is the same.
+#define BENCH_CHECK_SCALE   (3)  // 15 pixels, SSE2 and the scalar tail.
+#define BENCH_SCREEN_W      (640)
+#define BENCH_SCREEN_H      (480)
+#define BENCH_SPRITE_SIZE   (32)
+#define BENCH_QUAD_NUM      (2000)  // In a frame.
+#define BENCH_FRAME_NUM     (60)
+#define BENCH_REPEAT_NUM    (3)  // The fastest run is taken.
+namespace {
+const char* const kModeNames[] = {
+  "DEFAULT", "HINVERT", "VINVERT", "ROT90", "ROT180", "ROT270",
+};
+struct Position {
+  int x;
+  int y;
+};
+  // Inside, and over the top left and the bottom right edges.
+const Position kPositions[] = {{7, 5}, {-7, -4}, {56, 40}};
+uint32_t MakePixel(int r, int g, int b, int a) {
+  const uint8_t rgba[4] = {static_cast<uint8_t>(r), static_cast<uint8_t>(g),
+                           static_cast<uint8_t>(b), static_cast<uint8_t>(a)};
+  uint32_t pixel = 0;
+  memcpy(&pixel, rgba, sizeof(pixel));
+  return pixel;
+}
+int GetChannel(uint32_t pixel, int channel) {
+  uint8_t rgba[4];
+  memcpy(rgba, &pixel, sizeof(rgba));
+  return rgba[channel];
+}
+void MakeTexture(int size, bool is_translucent, sys::RasterTexture* texture) {
+  texture->w = size;
+  texture->h = size;
+  texture->pixels.resize(size * size);
+  for (int y = 0; y < size; ++y) {
+    for (int x = 0; x < size; ++x) {
+      const int a = is_translucent ? (x * 37 + y * 11) % 256 : 255;
+      texture->pixels[y * size + x] = MakePixel((x * 53 + 10) % 256,
+                                                (y * 47 + 20) % 256,
+                                                (x + y) * 19 % 256, a);
+    }
+  }
+}
+  // The quad of the whole texture at a pixel, as DrawImage queues it.
+bool AddImage(sys::SpriteBatch* batch, const sys::RasterTexture& texture,
+              SYS_IMAGEMODE mode, double scale, int x, int y, int screen_w,
+              int screen_h, float alpha) {
+  sys::VertexInputData quad[SYS_VERTEX_INPUT_NUM];
+  sys::SetImageQuad(mode, texture.w * scale, texture.h * scale, screen_w,
+                    screen_h, 0.0f, 0.0f, 1.0f, 1.0f, quad);
+  return batch->AddQuad(sys::BatchKey(&texture, alpha), quad,
+                        static_cast<float>(x * 2.0 / screen_w - 1.0),
+                        static_cast<float>(-y * 2.0 / screen_h + 1.0));
+}
+  // The texel of a mode at the texel i, j of the image on the screen.
+void GetTexel(SYS_IMAGEMODE mode, int i, int j, int* x, int* y) {
+  const int n = BENCH_CHECK_TEXELS - 1;
+  switch (mode) {
+    case SYS_IMAGEMODE_HINVERT: *x = n - i; *y = j; break;
+    case SYS_IMAGEMODE_VINVERT: *x = i; *y = n - j; break;
+    case SYS_IMAGEMODE_ROT90: *x = j; *y = n - i; break;
+    case SYS_IMAGEMODE_ROT180: *x = n - i; *y = n - j; break;
+    case SYS_IMAGEMODE_ROT270: *x = n - j; *y = i; break;
+    default: *x = i; *y = j; break;
+  }
+}
+  // x / 255 rounded.
+int Round255(int x) {
+  return (x * 2 + 255) / 510;
+}
+  // Every pixel of the frame buffer is compared with the texel expected,
+  // blended over the clear color with the alpha of the key.
+int CheckMode(SYS_IMAGEMODE mode, bool is_translucent, int alpha) {
+  sys::RasterTexture texture;
+  MakeTexture(BENCH_CHECK_TEXELS, is_translucent, &texture);
+  sys::RasterBatchBackend backend;
+  backend.Resize(BENCH_CHECK_W, BENCH_CHECK_H);
+  sys::SpriteBatch batch;
+  batch.SetBackend(&backend);
+  int error_num = 0;
+  for (const Position& position : kPositions) {
+    const uint32_t clear = MakePixel(200, 100, 50, 255);
+    backend.Clear(200, 100, 50, 255);
+    if (!AddImage(&batch, texture, mode, BENCH_CHECK_SCALE, position.x,
+                  position.y, BENCH_CHECK_W, BENCH_CHECK_H, alpha / 255.0f) ||
+        !batch.Flush()) {
+      return -1;
+    }
+    std::vector<uint32_t> pixels(BENCH_CHECK_W * BENCH_CHECK_H);
+    memcpy(&pixels[0], backend.pixels(), pixels.size() * sizeof(uint32_t));
+    const int size = BENCH_CHECK_TEXELS * BENCH_CHECK_SCALE;
+    for (int py = 0; py < BENCH_CHECK_H; ++py) {
+      for (int px = 0; px < BENCH_CHECK_W; ++px) {
+        const int ix = px - position.x;
+        const int iy = py - position.y;
+        uint32_t expected = clear;
+        if ((ix >= 0) && (ix < size) && (iy >= 0) && (iy < size)) {
+          int tx = 0;
+          int ty = 0;
+          GetTexel(mode, ix / BENCH_CHECK_SCALE, iy / BENCH_CHECK_SCALE, &tx,
+                   &ty);
+          const uint32_t src = texture.pixels[ty * BENCH_CHECK_TEXELS + tx];
+          const int sa = Round255(GetChannel(src, 3) * alpha);
+          int rgb[3];
+          for (int c = 0; c < 3; ++c) {
+            rgb[c] = Round255(GetChannel(src, c) * sa +
+                              GetChannel(clear, c) * (255 - sa));
+          }
+          expected = MakePixel(rgb[0], rgb[1], rgb[2], sa);
+        }
+        if (pixels[py * BENCH_CHECK_W + px] != expected) ++error_num;
+      }
+    }
+  }
+  return error_num;
+}
+  // Sprites of the same texture and alpha are drawn at pseudo random
+  // places, so the frame is one run of quads.
+int64_t Measure(int* pixel_num) {
+  sys::RasterTexture texture;
+  MakeTexture(BENCH_SPRITE_SIZE, true, &texture);
+  sys::RasterBatchBackend backend;
+  backend.Resize(BENCH_SCREEN_W, BENCH_SCREEN_H);
+  sys::SpriteBatch batch;
+  batch.SetBackend(&backend);
+  int64_t best_ns = INT64_MAX;
+  for (int i = 0; i < BENCH_REPEAT_NUM; ++i) {
+    uint32_t seed = 1;
+    const int64_t start_ns = sys::GetClockNanoSecond();
+    for (int frame = 0; frame < BENCH_FRAME_NUM; ++frame) {
+      backend.Clear(0, 0, 0, 255);
+      for (int j = 0; j < BENCH_QUAD_NUM; ++j) {
+        seed = seed * 1664525u + 1013904223u;
+        const int x = (seed >> 8) % (BENCH_SCREEN_W - BENCH_SPRITE_SIZE);
+        const int y = (seed >> 20) % (BENCH_SCREEN_H - BENCH_SPRITE_SIZE);
+        if (!AddImage(&batch, texture, SYS_IMAGEMODE_DEFAULT, 1.0, x, y,
+                      BENCH_SCREEN_W, BENCH_SCREEN_H, 0.75f)) {
+          fprintf(stderr, "quad %d not added\n", j);
+          exit(1);
+        }
+      }
+      if (!batch.Flush()) {
+        fprintf(stderr, "frame %d not drawn\n", frame);
+        exit(1);
+      }
+      batch.EndFrame();
+    }
+    const int64_t ns = sys::GetClockNanoSecond() - start_ns;
+    if (ns < best_ns) best_ns = ns;
+  }
+  *pixel_num = BENCH_SPRITE_SIZE * BENCH_SPRITE_SIZE;
+  return best_ns;
+}
+}  // namespace
+int main() {
+#ifdef SYS_RASTER_USE_SSE2
+  printf("SSE2 blending\n");
+#else
+  printf("scalar blending\n");
+#endif
+  printf("mode       alpha  errors\n");
+  bool is_ok = true;
+  for (int mode = SYS_IMAGEMODE_DEFAULT; mode <= SYS_IMAGEMODE_ROT270;
+       ++mode) {
+    // Opaque texels fully drawn, then translucent texels at half alpha.
+    for (int alpha : {255, 128}) {
+      const int error_num = CheckMode(static_cast<SYS_IMAGEMODE>(mode),
+                                      alpha < 255, alpha);
+      printf("%-10s %5d %7d\n", kModeNames[mode], alpha, error_num);
+      if (error_num != 0) is_ok = false;
+    }
+  }
+  int pixel_num = 0;
+  const int64_t ns = Measure(&pixel_num);
+  const double quad_num = static_cast<double>(BENCH_QUAD_NUM) *
+    BENCH_FRAME_NUM;
+  printf("%dx%d sprites on %dx%d, %d a frame\n", BENCH_SPRITE_SIZE,
+         BENCH_SPRITE_SIZE, BENCH_SCREEN_W, BENCH_SCREEN_H, BENCH_QUAD_NUM);
+  printf("%.0f quads/s, %.1f Mpixels/s, %.1f frames/s\n",
+         quad_num * 1e9 / ns, quad_num * pixel_num * 1e3 / ns,
+         BENCH_FRAME_NUM * 1e9 / ns);
+  return is_ok ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+﻿// @file render_check.cc
+// @brief Offline renders checked to be the same, and the times of real time.
+// @author Mamoru Kaminaga
+// @date 2026-10-19 15:12:44
+// Copyright 2026 Mamoru Kaminaga
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+#include "../clock_internal.h"
+#include "../mixer_internal.h"
+#include "../streaming_internal.h"
+#define CHECK_SAMPLE_RATE   (48000)  // Of the streams, resampled.
+#define CHECK_WAVE_SECONDS  (2)  // A looped wave.
+#define CHECK_STREAM_NUM    (16)
+#define CHECK_VOICE_NUM     (32)
+#define CHECK_VOICE_ONLY    (SYS_MIXER_REAL_VOICE_NUM)  // Without streams.
+#define CHECK_SECONDS       (60)  // Rendered in a run.
+#define CHECK_CALL_FRAMES   (735)  // RenderSound of a 60 Hz frame.
+namespace {
+  // A stereo 16 bit wave of a sine, with the chunks of PCM.
+std::vector<uint8_t> MakeWave() {
+  const int frame_num = CHECK_SAMPLE_RATE * CHECK_WAVE_SECONDS;
+  std::vector<uint8_t> wave;
+  auto put = [&wave](uint32_t value, int size) {
+    for (int i = 0; i < size; ++i) {
+      wave.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+  };
+  auto put_id = [&wave](const char* id) {
+    wave.insert(wave.end(), id, id + 4);
+  };
+  put_id("RIFF");
+  put(36 + frame_num * 4, 4);
+  put_id("WAVE");
+  put_id("fmt ");
+  put(16, 4);
+  put(1, 2);  // PCM
+  put(2, 2);
+  put(CHECK_SAMPLE_RATE, 4);
+  put(CHECK_SAMPLE_RATE * 4, 4);
+  put(4, 2);
+  put(16, 2);
+  put_id("data");
+  put(frame_num * 4, 4);
+  for (int i = 0; i < frame_num; ++i) {
+    const double phase = 2.0 * 3.14159265358979 * 480.0 * i /
+      CHECK_SAMPLE_RATE;
+    const int16_t v = static_cast<int16_t>(8192.0 * sin(phase));
+    put(static_cast<uint16_t>(v), 2);
+    put(static_cast<uint16_t>(-v), 2);
+  }
+  return wave;
+}
+  // A looped mono wave of a second in the mixer rate.
+std::shared_ptr<const sys::SampleBuffer> MakeSamples() {
+  std::shared_ptr<sys::SampleBuffer> samples(new sys::SampleBuffer());
+  samples->format = SYS_SAMPLEFORMAT_INT16;
+  samples->channel_num = 1;
+  samples->frame_num = SYS_MIXER_SAMPLE_RATE;
+  samples->loop_start = 0;
+  samples->loop_end = SYS_MIXER_SAMPLE_RATE;
+  for (int i = 0; i < SYS_MIXER_SAMPLE_RATE; ++i) {
+    const float v = 0.5f * sinf(static_cast<float>(i) * 0.0627f);
+    samples->int16_samples.push_back(static_cast<int16_t>(v * 32767.0f));
+  }
+  return samples;
+}
+struct Render {
+  std::vector<int16_t> samples;
+  int64_t ns;
+  int64_t underrun_num;
+};
+  // The loop of RenderSound, called with call_frames frames each time as a
+  // game calls it once a frame. Streams are read before each block, so time
+  // only advances by the frames rendered.
+void RenderScene(const std::vector<uint8_t>& wave, int stream_num,
+                 int voice_num, int call_frames, Render* render) {
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  sys::StreamingScheduler scheduler;
+  std::vector<std::shared_ptr<sys::StreamingData>> streams;
+  for (int i = 0; i < stream_num; ++i) {
+    std::shared_ptr<sys::StreamingData> streaming(new sys::StreamingData());
+    streaming->mem = &wave[0];
+    streaming->mem_size = wave.size();
+    streaming->in_loop = true;
+    streaming->start_frame = 1 + i * 331;  // Not kept, so it is decoded.
+    streaming->buffer->gain = 0.5f / stream_num;
+    if (!mixer->AddStream(streaming->buffer)) {
+      fprintf(stderr, "stream %d not added\n", i);
+      exit(1);
+    }
+    scheduler.Add(streaming);
+    streams.push_back(streaming);
+  }
+  const std::shared_ptr<const sys::SampleBuffer> samples = MakeSamples();
+  sys::VoiceDesc desc;
+  desc.gain = 0.5f / voice_num;
+  for (int i = 0; i < voice_num; ++i) {
+    desc.pan = -1.0f + 2.0f * i / voice_num;
+    desc.start_frame = i * 1234;
+    if (mixer->Play(samples, 0, desc) == SYS_MIXER_INVALID_VOICE) {
+      fprintf(stderr, "voice %d not played\n", i);
+      exit(1);
+    }
+  }
+  sys::MemorySink sink;
+  sink.Open();
+  const int64_t start_ns = sys::GetClockNanoSecond();
+  for (int left = SYS_MIXER_SAMPLE_RATE * CHECK_SECONDS; left > 0;) {
+    int frame_num = (left < call_frames) ? left : call_frames;
+    left -= frame_num;
+    while (frame_num > 0) {
+      const int n = (frame_num < SYS_MIXER_BLOCK_FRAMES) ?
+        frame_num : SYS_MIXER_BLOCK_FRAMES;
+      scheduler.Fill(n);
+      sys::RenderMixer(mixer.get(), &sink, n);
+      frame_num -= n;
+    }
+  }
+  render->ns = sys::GetClockNanoSecond() - start_ns;
+  render->samples = sink.GetSamples();
+  render->underrun_num = 0;
+  for (const auto& streaming : streams) {
+    render->underrun_num += streaming->buffer->underrun_num.load();
+    scheduler.Remove(streaming.get());
+  }
+}
+bool IsSame(const Render& a, const Render& b) {
+  return (a.samples.size() == b.samples.size()) && !a.samples.empty() &&
+    (memcmp(&a.samples[0], &b.samples[0],
+            a.samples.size() * sizeof(int16_t)) == 0);
+}
+void Print(const char* name, int stream_num, int voice_num,
+           const Render& render) {
+  const double seconds = render.ns / 1e9;
+  printf("%-16s %7d %6d %8.2f %10.1f %12.0f\n", name, stream_num, voice_num,
+         seconds, CHECK_SECONDS / seconds,
+         SYS_MIXER_SAMPLE_RATE * CHECK_SECONDS / seconds);
+}
+}  // namespace
+int main() {
+  const std::vector<uint8_t> wave = MakeWave();
+  // The same calls twice, and the same frames in calls of another size.
+  Render first;
+  Render second;
+  Render parts;
+  RenderScene(wave, CHECK_STREAM_NUM, CHECK_VOICE_NUM, CHECK_CALL_FRAMES,
+              &first);
+  RenderScene(wave, CHECK_STREAM_NUM, CHECK_VOICE_NUM, CHECK_CALL_FRAMES,
+              &second);
+  RenderScene(wave, CHECK_STREAM_NUM, CHECK_VOICE_NUM, SYS_MIXER_BLOCK_FRAMES,
+              &parts);
+  Render voices;
+  RenderScene(wave, 0, CHECK_VOICE_ONLY, CHECK_CALL_FRAMES, &voices);
+  printf("%d s rendered\n", CHECK_SECONDS);
+  printf("render           streams voices        s  x realtime     frames/s\n");
+  Print("first", CHECK_STREAM_NUM, CHECK_VOICE_NUM, first);
+  Print("second", CHECK_STREAM_NUM, CHECK_VOICE_NUM, second);
+  Print("in blocks", CHECK_STREAM_NUM, CHECK_VOICE_NUM, parts);
+  Print("voices only", 0, CHECK_VOICE_ONLY, voices);
+  const bool is_same = IsSame(first, second);
+  const bool is_same_parts = IsSame(first, parts);
+  const int64_t underrun_num = first.underrun_num + second.underrun_num +
+    parts.underrun_num;
+  printf("second %s, in blocks %s, %lld underruns\n",
+         is_same ? "the same" : "differs",
+         is_same_parts ? "the same" : "differs",
+         static_cast<long long>(underrun_num));
+  return (is_same && is_same_parts && (underrun_num == 0)) ? 0 : 1;
+}
@@ -0,0 +1,196 @@
+﻿// @file resample_bench.cc
+// @brief Samples converted a second and the error of each preset.
+// @author Mamoru Kaminaga
+// @date 2026-10-18 12:20:33
+// Copyright 2026 Mamoru Kaminaga
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../clock_internal.h"
+#include "../mixer_internal.h"
+#include "../resample_internal.h"
+#define BENCH_SOURCE_SECONDS  (4)
+#define BENCH_PIECE_FRAMES    (4096)  // As the streaming thread reads.
+#define BENCH_REPEAT_NUM      (3)  // The fastest run is taken.
+#define BENCH_TONE_HZ         (1000.0)
+#define BENCH_SEAM_FRAMES     (64)  // Around the loop end, in the mixer rate.
+namespace {
+struct Conversion {
+  int source_rate;
+  int target_rate;
+  int channel_num;
+};
+const Conversion kConversions[] = {
+  {48000, 44100, 2},
+  {22050, 44100, 2},
+  {32000, 44100, 1},
+};
+  // Loops of whole cycles of the tone, which are whole frames in the mixer
+  // rate too, so the looped tone is the tone itself.
+struct Loop {
+  int source_rate;
+  int loop_start;
+  int frame_num;
+};
+const Loop kLoops[] = {
+  {22050, 0, 22050},
+  {48000, 0, 48000},
+  {22050, 4410, 4410 + 22050},  // After frames played once.
+};
+const char* const kPresetNames[] = {"LOW", "MEDIUM", "HIGH"};
+const double kPi = 3.14159265358979323846;
+  // The tone is converted piece by piece, and the output is compared with
+  // the tone in the target rate. An output frame n is the source time
+  // n / target_rate, so there is no delay to take out.
+bool Convert(const Conversion& conversion, SYS_RESAMPLEQUALITY quality,
+             int64_t* ns, double* snr_db, int* out_frame_num) {
+  const int source_frame_num = conversion.source_rate * BENCH_SOURCE_SECONDS;
+  const int channel_num = conversion.channel_num;
+  std::vector<float> source(source_frame_num * channel_num);
+  for (int i = 0; i < source_frame_num; ++i) {
+    const double v = 0.5 * sin(2.0 * kPi * BENCH_TONE_HZ * i /
+                               conversion.source_rate);
+    for (int c = 0; c < channel_num; ++c) {
+      source[i * channel_num + c] = static_cast<float>(v);
+    }
+  }
+  std::vector<float> out;
+  std::vector<float> piece;
+  *ns = INT64_MAX;
+  for (int r = 0; r < BENCH_REPEAT_NUM; ++r) {
+    sys::Resampler resampler;
+    if (!resampler.Reset(conversion.source_rate, conversion.target_rate,
+                         channel_num, quality)) {
+      return false;
+    }
+    out.clear();
+    const int64_t start_ns = sys::GetClockNanoSecond();
+    for (int i = 0; i < source_frame_num; i += BENCH_PIECE_FRAMES) {
+      const int n = (source_frame_num - i < BENCH_PIECE_FRAMES) ?
+        source_frame_num - i : BENCH_PIECE_FRAMES;
+      resampler.Process(&source[i * channel_num], n, &piece);
+      out.insert(out.end(), piece.begin(), piece.end());
+    }
+    resampler.Flush(&piece);
+    out.insert(out.end(), piece.begin(), piece.end());
+    const int64_t time_ns = sys::GetClockNanoSecond() - start_ns;
+    if (time_ns < *ns) *ns = time_ns;
+  }
+  *out_frame_num = static_cast<int>(out.size()) / channel_num;
+  // The edges are skipped, where the tone starts and ends from silence.
+  double signal = 0.0;
+  double noise = 0.0;
+  const int margin = conversion.target_rate / 10;
+  for (int i = margin; i < *out_frame_num - margin; ++i) {
+    const double e = 0.5 * sin(2.0 * kPi * BENCH_TONE_HZ * i /
+                               conversion.target_rate);
+    for (int c = 0; c < channel_num; ++c) {
+      const double d = out[i * channel_num + c] - e;
+      signal += e * e;
+      noise += d * d;
+    }
+  }
+  *snr_db = 10.0 * log10(signal / noise);
+  return true;
+}
+  // A mono float wave is converted as a looped wave is created, and it is
+  // played twice through the loop. The largest error from the tone near the
+  // loop end is compared with the one in the middle of the loop.
+bool CheckLoop(const Loop& loop, SYS_RESAMPLEQUALITY quality,
+               double* seam_db, double* middle_db) {
+  std::vector<float> source(loop.frame_num);
+  for (int i = 0; i < loop.frame_num; ++i) {
+    source[i] = static_cast<float>(
+        0.5 * sin(2.0 * kPi * BENCH_TONE_HZ * i / loop.source_rate));
+  }
+  sys::PcmFormat format;
+  format.sample_rate = loop.source_rate;
+  format.channel_num = 1;
+  format.bits = 32;
+  format.is_float = true;
+  sys::SampleBuffer samples;
+  if (!sys::ConvertPcm(format, &source[0], source.size() * sizeof(float),
+                       loop.loop_start, quality, &samples) ||
+      (samples.format != SYS_SAMPLEFORMAT_FLOAT) ||
+      (samples.loop_end <= samples.loop_start)) {
+    return false;
+  }
+  const int loop_frame_num = samples.loop_end - samples.loop_start;
+  double seam_error = 0.0;
+  double middle_error = 0.0;
+  for (int i = -BENCH_SEAM_FRAMES; i < BENCH_SEAM_FRAMES; ++i) {
+    // Frames of the second pass are after the loop end.
+    const int position = samples.loop_end + i;
+    const int frame = (position < samples.loop_end) ? position :
+      samples.loop_start + (position - samples.loop_end) % loop_frame_num;
+    const double e = 0.5 * sin(2.0 * kPi * BENCH_TONE_HZ * position /
+                               SYS_MIXER_SAMPLE_RATE);
+    const double d = fabs(samples.float_samples[frame] - e);
+    if (d > seam_error) seam_error = d;
+    const int middle = samples.loop_start + loop_frame_num / 2 + i;
+    const double m = fabs(samples.float_samples[middle] - 0.5 *
+        sin(2.0 * kPi * BENCH_TONE_HZ * middle / SYS_MIXER_SAMPLE_RATE));
+    if (m > middle_error) middle_error = m;
+  }
+  *seam_db = 20.0 * log10(seam_error / 0.5);
+  *middle_db = 20.0 * log10(middle_error / 0.5);
+  return true;
+}
+}  // namespace
+int main() {
+#ifdef SYS_RESAMPLE_USE_SSE2
+  printf("SSE2 filters, a %g Hz tone in pieces of %d frames\n",
+         BENCH_TONE_HZ, BENCH_PIECE_FRAMES);
+#else
+  printf("scalar filters, a %g Hz tone in pieces of %d frames\n",
+         BENCH_TONE_HZ, BENCH_PIECE_FRAMES);
+#endif
+  printf("conversion         ch  preset   M samples/s  SNR dB\n");
+  for (const Conversion& conversion : kConversions) {
+    for (int q = SYS_RESAMPLEQUALITY_LOW; q <= SYS_RESAMPLEQUALITY_HIGH;
+         ++q) {
+      int64_t ns = 0;
+      double snr_db = 0.0;
+      int out_frame_num = 0;
+      if (!Convert(conversion, static_cast<SYS_RESAMPLEQUALITY>(q), &ns,
+                   &snr_db, &out_frame_num)) {
+        fprintf(stderr, "not converted\n");
+        return 1;
+      }
+      // The output must be the length of the source in the target rate.
+      const int64_t expected = static_cast<int64_t>(conversion.target_rate) *
+        BENCH_SOURCE_SECONDS;
+      if (llabs(out_frame_num - expected) > 1) {
+        fprintf(stderr, "%d frames for %d\n", out_frame_num,
+                static_cast<int>(expected));
+        return 1;
+      }
+      // Samples are of the output, each channel counted.
+      printf("%5d -> %5d Hz %3d  %-7s %12.1f %7.1f\n",
+             conversion.source_rate, conversion.target_rate,
+             conversion.channel_num, kPresetNames[q],
+             1e3 * out_frame_num * conversion.channel_num / ns, snr_db);
+    }
+  }
+  // A seam louder than the middle by 6 dB is heard as a click.
+  printf("loop               start  preset   seam dB  middle dB\n");
+  for (const Loop& loop : kLoops) {
+    for (int q = SYS_RESAMPLEQUALITY_LOW; q <= SYS_RESAMPLEQUALITY_HIGH;
+         ++q) {
+      double seam_db = 0.0;
+      double middle_db = 0.0;
+      if (!CheckLoop(loop, static_cast<SYS_RESAMPLEQUALITY>(q), &seam_db,
+                     &middle_db)) {
+        fprintf(stderr, "not converted\n");
+        return 1;
+      }
+      printf("%5d -> %5d Hz %6d  %-7s %8.1f %10.1f\n", loop.source_rate,
+             SYS_MIXER_SAMPLE_RATE, loop.loop_start, kPresetNames[q],
+             seam_db, middle_db);
+      if (seam_db > middle_db + 6.0) return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,171 @@
+﻿// @file stream_bench.cc
+// @brief Streams read by the scheduler a core, and streams mixed in real time.
+// @author Mamoru Kaminaga
+// @date 2026-10-19 14:05:31
+// Copyright 2026 Mamoru Kaminaga
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../clock_internal.h"
+#include "../mixer_internal.h"
+#include "../streaming_internal.h"
+#define BENCH_SAMPLE_RATE   (48000)  // Resampled to the mixer rate.
+#define BENCH_WAVE_SECONDS  (2)  // A looped wave.
+#define BENCH_COST_FRAMES   (44100 * 4)  // Rendered offline for the cost.
+#define BENCH_LIVE_FRAMES   (44100 * 2)  // Mixed in real time.
+#define BENCH_LIVE_NUM      (256)  // Streams mixed in real time.
+#define BENCH_REPEAT_NUM    (3)  // The fastest run is taken.
+namespace {
+const int kStreamNums[] = {1, 16, 64, SYS_MIXER_STREAM_NUM};
+  // A stereo 16 bit wave of a sine, with the chunks of PCM.
+std::vector<uint8_t> MakeWave() {
+  const int frame_num = BENCH_SAMPLE_RATE * BENCH_WAVE_SECONDS;
+  std::vector<uint8_t> wave;
+  auto put = [&wave](uint32_t value, int size) {
+    for (int i = 0; i < size; ++i) {
+      wave.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+  };
+  auto put_id = [&wave](const char* id) {
+    wave.insert(wave.end(), id, id + 4);
+  };
+  put_id("RIFF");
+  put(36 + frame_num * 4, 4);
+  put_id("WAVE");
+  put_id("fmt ");
+  put(16, 4);
+  put(1, 2);  // PCM
+  put(2, 2);
+  put(BENCH_SAMPLE_RATE, 4);
+  put(BENCH_SAMPLE_RATE * 4, 4);
+  put(4, 2);
+  put(16, 2);
+  put_id("data");
+  put(frame_num * 4, 4);
+  for (int i = 0; i < frame_num; ++i) {
+    const double phase = 2.0 * 3.14159265358979 * 480.0 * i /
+      BENCH_SAMPLE_RATE;
+    const int16_t v = static_cast<int16_t>(8192.0 * sin(phase));
+    put(static_cast<uint16_t>(v), 2);
+    put(static_cast<uint16_t>(-v), 2);
+  }
+  return wave;
+}
+  // Looping streams of the wave in memory. Each starts at another frame, so
+  // the loop is not kept and every piece is decoded and resampled.
+bool AddStreams(const std::vector<uint8_t>& wave, int stream_num,
+                sys::Mixer* mixer, sys::StreamingScheduler* scheduler,
+                std::vector<std::shared_ptr<sys::StreamingData>>* streams) {
+  for (int i = 0; i < stream_num; ++i) {
+    std::shared_ptr<sys::StreamingData> streaming(new sys::StreamingData());
+    streaming->mem = &wave[0];
+    streaming->mem_size = wave.size();
+    streaming->in_loop = true;
+    streaming->start_frame = 1 + i * 331;
+    streaming->buffer->gain = 1.0f / stream_num;
+    if (!mixer->AddStream(streaming->buffer)) return false;
+    scheduler->Add(streaming);
+    streams->push_back(streaming);
+  }
+  return true;
+}
+struct Result {
+  int64_t fill_ns;  // Of the scheduler, to read a second of all streams.
+  int64_t underrun_num;
+};
+  // The streams are read before each block as the offline backend does, so
+  // the time of Fill is the time of the scheduler.
+Result Measure(const std::vector<uint8_t>& wave, int stream_num) {
+  Result result = {INT64_MAX, 0};
+  for (int i = 0; i < BENCH_REPEAT_NUM; ++i) {
+    std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+    sys::StreamingScheduler scheduler;
+    std::vector<std::shared_ptr<sys::StreamingData>> streams;
+    if (!AddStreams(wave, stream_num, mixer.get(), &scheduler, &streams)) {
+      fprintf(stderr, "%d streams not added\n", stream_num);
+      exit(1);
+    }
+    sys::NullSink sink;
+    sink.Open();
+    int64_t fill_ns = 0;
+    for (int j = 0; j < BENCH_COST_FRAMES; j += SYS_MIXER_BLOCK_FRAMES) {
+      const int64_t start_ns = sys::GetClockNanoSecond();
+      scheduler.Fill(SYS_MIXER_BLOCK_FRAMES);
+      fill_ns += sys::GetClockNanoSecond() - start_ns;
+      sys::RenderMixer(mixer.get(), &sink, SYS_MIXER_BLOCK_FRAMES);
+    }
+    for (const auto& streaming : streams) {
+      result.underrun_num += streaming->buffer->underrun_num.load();
+      scheduler.Remove(streaming.get());
+    }
+    if (fill_ns < result.fill_ns) result.fill_ns = fill_ns;
+  }
+  result.fill_ns = result.fill_ns * SYS_MIXER_SAMPLE_RATE / BENCH_COST_FRAMES;
+  return result;
+}
+  // The scheduler thread reads the streams while a block is mixed at each
+  // block time, as the mixing thread does.
+bool MixLive(const std::vector<uint8_t>& wave, int64_t* underrun_num,
+             int* min_fill_frames) {
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  sys::StreamingScheduler scheduler;
+  std::vector<std::shared_ptr<sys::StreamingData>> streams;
+  if (!AddStreams(wave, BENCH_LIVE_NUM, mixer.get(), &scheduler, &streams)) {
+    return false;
+  }
+  // The rings are filled first, as a stream is ready before it is played.
+  scheduler.Fill(SYS_STREAM_RING_FRAMES);
+  if (!scheduler.Start()) return false;
+  int16_t samples[SYS_MIXER_BLOCK_FRAMES * SYS_MIXER_CHANNEL_NUM];
+  const std::chrono::nanoseconds block_time(
+      1000000000LL * SYS_MIXER_BLOCK_FRAMES / SYS_MIXER_SAMPLE_RATE);
+  std::chrono::steady_clock::time_point time =
+    std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_LIVE_FRAMES; i += SYS_MIXER_BLOCK_FRAMES) {
+    mixer->Mix(SYS_MIXER_BLOCK_FRAMES, samples);
+    time += block_time;
+    std::this_thread::sleep_until(time);
+  }
+  scheduler.Stop();
+  *underrun_num = 0;
+  *min_fill_frames = SYS_STREAM_RING_FRAMES;
+  for (const auto& streaming : streams) {
+    const sys::StreamBuffer& buffer = *streaming->buffer;
+    *underrun_num += buffer.underrun_num.load();
+    if (buffer.min_fill_frames.load() < *min_fill_frames) {
+      *min_fill_frames = buffer.min_fill_frames.load();
+    }
+  }
+  return true;
+}
+}  // namespace
+int main() {
+  const std::vector<uint8_t> wave = MakeWave();
+  printf("%d Hz stereo looping streams, resampled\n", BENCH_SAMPLE_RATE);
+  printf("streams  ms per 1 s  streams/core  underruns\n");
+  bool is_ok = true;
+  for (int stream_num : kStreamNums) {
+    const Result result = Measure(wave, stream_num);
+    // A second of a stream costs fill_ns / stream_num.
+    printf("%7d %11.3f %13.0f %10lld\n", stream_num, result.fill_ns / 1e6,
+           1e9 * stream_num / result.fill_ns,
+           static_cast<long long>(result.underrun_num));
+    if (result.underrun_num != 0) is_ok = false;
+  }
+  int64_t underrun_num = 0;
+  int min_fill_frames = 0;
+  if (!MixLive(wave, &underrun_num, &min_fill_frames)) {
+    fprintf(stderr, "not mixed\n");
+    return 1;
+  }
+  printf("%d streams in real time: %lld underruns, %d frames filled at "
+         "least\n", BENCH_LIVE_NUM, static_cast<long long>(underrun_num),
+         min_fill_frames);
+  if (underrun_num != 0) is_ok = false;
+  return is_ok ? 0 : 1;
+}
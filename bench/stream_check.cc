@@ -0,0 +1,386 @@
+﻿// @file stream_check.cc
+// @brief Streams checked to be contiguous through the sinks, and ADPCM cost.
+// @author Mamoru Kaminaga
+// @date 2026-10-18 11:40:15
+// Copyright 2026 Mamoru Kaminaga
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../clock_internal.h"
+#include "../mixer_internal.h"
+#include "../streaming_internal.h"
+#include "../wave_internal.h"
+#define CHECK_WAVE_SECONDS  (2)  // Several pieces of the scheduler.
+#define CHECK_TAIL_FRAMES   (8192)  // Rendered after the end.
+#define CHECK_ADPCM_BYTES   (512)  // A block of a channel.
+#define CHECK_ADPCM_FRAMES  (1 + (CHECK_ADPCM_BYTES - 4) / 4 * 8)  // 1017.
+#define CHECK_COST_SECONDS  (10)  // Of the wave decoded for the cost.
+#define CHECK_DECODE_PIECE  (4096)  // As the streaming thread reads.
+#define CHECK_REPEAT_NUM    (3)  // The fastest run is taken.
+namespace {
+struct Case {
+  int sample_rate;
+  int channel_num;
+  bool in_loop;
+  int start_frame;  // Of the source, as SeekStreaming.
+  bool is_adpcm;
+};
+const Case kCases[] = {
+  {44100, 2, false, 0},
+  {44100, 1, false, 0},
+  {44100, 2, true, 0},
+  {22050, 2, false, 0},
+  {48000, 1, false, 0},
+  {22050, 2, true, 0},
+  {44100, 2, false, 30000},
+  {44100, 2, true, 60000},
+  {44100, 1, true, 100000},  // After the loop end, so it wraps.
+  {44100, 2, false, 0, true},
+  {44100, 1, true, 0, true},
+  {22050, 2, false, 0, true},
+  {44100, 2, false, 30000, true},  // In the middle of a block.
+  {44100, 2, true, 100000, true},
+};
+  // The steps and the changes of the step index of IMA ADPCM.
+const int kAdpcmSteps[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+  45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209,
+  230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876,
+  963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+  3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493,
+  10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+  27086, 29794, 32767,
+};
+const int kAdpcmIndexChanges[16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8,
+};
+struct AdpcmState {
+  int predictor;
+  int index;
+};
+int DecodeNibble(int nibble, AdpcmState* state) {
+  const int step = kAdpcmSteps[state->index];
+  int diff = step >> 3;
+  if (nibble & 1) diff += step >> 2;
+  if (nibble & 2) diff += step >> 1;
+  if (nibble & 4) diff += step;
+  if (nibble & 8) diff = -diff;
+  state->predictor += diff;
+  if (state->predictor > 32767) state->predictor = 32767;
+  if (state->predictor < -32768) state->predictor = -32768;
+  state->index += kAdpcmIndexChanges[nibble];
+  if (state->index < 0) state->index = 0;
+  if (state->index > 88) state->index = 88;
+  return state->predictor;
+}
+  // The nibble nearest to the sample, and the state is the decoded one.
+int EncodeNibble(int sample, AdpcmState* state) {
+  int diff = sample - state->predictor;
+  int nibble = 0;
+  if (diff < 0) {
+    nibble = 8;
+    diff = -diff;
+  }
+  int step = kAdpcmSteps[state->index];
+  for (int bit = 4; bit > 0; bit >>= 1) {
+    if (diff >= step) {
+      nibble |= bit;
+      diff -= step;
+    }
+    step >>= 1;
+  }
+  DecodeNibble(nibble, state);
+  return nibble;
+}
+  // Blocks of the frames as encoders make them, the last one is cut after
+  // its frames. The samples are replaced with the decoded ones, which the
+  // stream must reproduce.
+std::vector<uint8_t> EncodeAdpcm(int channel_num,
+                                 std::vector<int16_t>* samples) {
+  const int frame_num = static_cast<int>(samples->size()) / channel_num;
+  const int block_frames = CHECK_ADPCM_FRAMES;
+  std::vector<uint8_t> data;
+  AdpcmState states[2] = {{0, 0}, {0, 0}};
+  // The step starts from the first change, so the decoded wave does not lag
+  // behind the sine, which the check would take for a gap.
+  for (int c = 0; (c < channel_num) && (frame_num > 1); ++c) {
+    const int change = abs((*samples)[channel_num + c] - (*samples)[c]);
+    while ((states[c].index < 88) && (kAdpcmSteps[states[c].index] < change)) {
+      ++states[c].index;
+    }
+  }
+  for (int head = 0; head < frame_num; head += block_frames) {
+    const int n = (frame_num - head < block_frames) ?
+      (frame_num - head) : block_frames;
+    for (int c = 0; c < channel_num; ++c) {
+      // The header is the first sample and the step index.
+      const int16_t first = (*samples)[head * channel_num + c];
+      states[c].predictor = first;
+      data.push_back(static_cast<uint8_t>(first));
+      data.push_back(static_cast<uint8_t>(first >> 8));
+      data.push_back(static_cast<uint8_t>(states[c].index));
+      data.push_back(0);
+    }
+    // Channels take turns every 4 bytes, 8 frames, low nibble first. The
+    // frames after the end repeat the last one.
+    for (int frame = 1; frame < n; frame += 8) {
+      for (int c = 0; c < channel_num; ++c) {
+        uint8_t bytes[4] = {0, 0, 0, 0};
+        for (int i = 0; i < 8; ++i) {
+          const int f = head + ((frame + i < n) ? (frame + i) : (n - 1));
+          int16_t& sample = (*samples)[f * channel_num + c];
+          AdpcmState state = states[c];
+          const int nibble = EncodeNibble(sample, &state);
+          bytes[i >> 1] |= static_cast<uint8_t>(nibble << ((i & 1) * 4));
+          if (frame + i < n) {
+            states[c] = state;
+            sample = static_cast<int16_t>(state.predictor);
+          }
+        }
+        data.insert(data.end(), bytes, bytes + 4);
+      }
+    }
+  }
+  return data;
+}
+
+  // 16 bit PCM, or IMA ADPCM with the fact chunk of the frames.
+std::vector<uint8_t> MakeWave(int sample_rate, int channel_num,
+                              bool is_adpcm, std::vector<int16_t>* samples) {
+  std::vector<uint8_t> data;
+  if (is_adpcm) {
+    data = EncodeAdpcm(channel_num, samples);
+  } else {
+    data.resize(samples->size() * 2);
+    memcpy(&data[0], &(*samples)[0], data.size());
+  }
+  std::vector<uint8_t> wave;
+  auto put = [&wave](uint32_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+      wave.push_back(static_cast<uint8_t>(v >> (i * 8)));
+    }
+  };
+  auto put_id = [&wave](const char* id) {
+    wave.insert(wave.end(), id, id + 4);
+  };
+  const int block_bytes = is_adpcm ?
+    CHECK_ADPCM_BYTES * channel_num : channel_num * 2;
+  const int block_frames = is_adpcm ? CHECK_ADPCM_FRAMES : 1;
+  put_id("RIFF");
+  put(0, 4);  // Set at the end.
+  put_id("WAVE");
+  put_id("fmt ");
+  put(is_adpcm ? 20 : 16, 4);
+  put(is_adpcm ? SYS_WAVE_FORMAT_IMA_ADPCM : SYS_WAVE_FORMAT_PCM, 2);
+  put(channel_num, 2);
+  put(sample_rate, 4);
+  put(static_cast<uint32_t>(static_cast<int64_t>(sample_rate) * block_bytes /
+                            block_frames), 4);
+  put(block_bytes, 2);
+  put(is_adpcm ? 4 : 16, 2);
+  if (is_adpcm) {
+    put(2, 2);  // cbSize
+    put(block_frames, 2);
+    put_id("fact");
+    put(4, 4);
+    put(static_cast<uint32_t>(samples->size() / channel_num), 4);
+  }
+  put_id("data");
+  put(static_cast<uint32_t>(data.size()), 4);
+  wave.insert(wave.end(), data.begin(), data.end());
+  const uint32_t riff_size = static_cast<uint32_t>(wave.size() - 8);
+  for (int i = 0; i < 4; ++i) {
+    wave[4 + i] = static_cast<uint8_t>(riff_size >> (i * 8));
+  }
+  return wave;
+}
+bool WriteWave(const char* file_name, const std::vector<uint8_t>& wave) {
+  FILE* file = fopen(file_name, "wb");
+  if (!file) return false;
+  fwrite(&wave[0], 1, wave.size(), file);
+  return fclose(file) == 0;
+}
+  // A ramp in the mixer rate, which comes out as it is, or a sine of whole
+  // cycles in the others, so the loop is smooth. The sine starts and ends at
+  // 0, so the silence before and after it is no step.
+int16_t GetSourceSample(const Case& c, int frame, int channel) {
+  if (c.sample_rate == SYS_MIXER_SAMPLE_RATE) {
+    const int v = (frame * 7 + channel * 5000) % 60000 - 30000;
+    return static_cast<int16_t>(v);
+  }
+  const double phase = 2.0 * 3.14159265358979 * 441.0 * frame / c.sample_rate;
+  return static_cast<int16_t>((channel ? -16384.0 : 16384.0) * sin(phase));
+}
+  // The frames of the stream are rendered block by block, as RenderSound
+  // does, and then the tail after the end.
+bool Render(const std::string& file_name, const Case& c, int frame_num,
+            sys::AudioSink* sink, int64_t* underrun_num) {
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  sys::StreamingScheduler scheduler;
+  std::shared_ptr<sys::StreamingData> streaming(new sys::StreamingData());
+  streaming->file_name.assign(file_name.begin(), file_name.end());
+  streaming->in_loop = c.in_loop;
+  streaming->start_frame = c.start_frame;
+  if (!sink->Open() || !mixer->AddStream(streaming->buffer)) return false;
+  scheduler.Add(streaming);
+  for (int i = 0; i < frame_num; i += SYS_MIXER_BLOCK_FRAMES) {
+    scheduler.Fill(SYS_MIXER_BLOCK_FRAMES);
+    if (!sys::RenderMixer(mixer.get(), sink, SYS_MIXER_BLOCK_FRAMES)) {
+      return false;
+    }
+  }
+  *underrun_num = streaming->buffer->underrun_num.load();
+  scheduler.Remove(streaming.get());
+  sink->Close();
+  return true;
+}
+  // The ramp, decoded for ADPCM, must match to the sample. A resampled
+  // sine must have no step much larger than its slope. The filter rings a
+  // little where the sine starts from silence, a lost frame doubles the step
+  // and a gap is more.
+int CheckSamples(const Case& c, const std::vector<int16_t>& out,
+                 const std::vector<int16_t>& source, int* played_frame_num) {
+  const int source_frame_num = static_cast<int>(source.size()) /
+    c.channel_num;
+  const int out_frame_num = static_cast<int>(out.size() / 2);
+  int played = out_frame_num;
+  while ((played > 0) && (out[played * 2 - 2] == 0) &&
+         (out[played * 2 - 1] == 0)) {
+    --played;
+  }
+  *played_frame_num = played;
+  int error_num = 0;
+  const double slope = 16384.0 * 2.0 * 3.14159265358979 * 441.0 /
+    SYS_MIXER_SAMPLE_RATE;
+  for (int i = 0; i < played; ++i) {
+    for (int ch = 0; ch < 2; ++ch) {
+      const int v = out[i * 2 + ch];
+      if (c.sample_rate == SYS_MIXER_SAMPLE_RATE) {
+        const int source_channel = (c.channel_num == 2) ? ch : 0;
+        const int frame = (c.start_frame + i) % source_frame_num;
+        const int e = source[frame * c.channel_num + source_channel];
+        if (abs(v - e) > 1) ++error_num;
+      } else if (i > 0) {
+        if (abs(v - out[(i - 1) * 2 + ch]) > slope * 1.25) ++error_num;
+      }
+    }
+  }
+  return error_num;
+}
+bool Check(const Case& c) {
+  const int source_frame_num = c.sample_rate * CHECK_WAVE_SECONDS;
+  std::vector<int16_t> source(source_frame_num * c.channel_num);
+  for (int i = 0; i < source_frame_num; ++i) {
+    for (int ch = 0; ch < c.channel_num; ++ch) {
+      source[i * c.channel_num + ch] = GetSourceSample(c, i, ch);
+    }
+  }
+  // The source becomes the decoded samples of ADPCM.
+  const std::vector<uint8_t> wave = MakeWave(c.sample_rate, c.channel_num,
+                                             c.is_adpcm, &source);
+  const std::string file_name = "build/stream_check_source.wav";
+  if (!WriteWave(file_name.c_str(), wave)) {
+    fprintf(stderr, "%s not written\n", file_name.c_str());
+    return false;
+  }
+  const int mixer_frame_num = static_cast<int>(
+      static_cast<int64_t>(source_frame_num) * SYS_MIXER_SAMPLE_RATE /
+      c.sample_rate);
+  const int block_num = (c.in_loop ?
+    mixer_frame_num * 3 : mixer_frame_num + CHECK_TAIL_FRAMES) /
+    SYS_MIXER_BLOCK_FRAMES;
+  const int frame_num = block_num * SYS_MIXER_BLOCK_FRAMES;
+  // The same frames are rendered to memory and to a wave file.
+  sys::MemorySink memory_sink;
+  sys::WavFileSink wav_sink(L"build/stream_check_out.wav");
+  int64_t underrun_num = 0;
+  int64_t wav_underrun_num = 0;
+  if (!Render(file_name, c, frame_num, &memory_sink, &underrun_num) ||
+      !Render(file_name, c, frame_num, &wav_sink, &wav_underrun_num)) {
+    fprintf(stderr, "not rendered\n");
+    return false;
+  }
+  const std::vector<int16_t>& out = memory_sink.GetSamples();
+  sys::WaveFile wav_file;
+  sys::WaveDecoder decoder;
+  const void* wav_samples = nullptr;
+  if (!wav_file.Open(std::wstring(L"build/stream_check_out.wav")) ||
+      !decoder.Reset(wav_file.GetView()) ||
+      (decoder.Read(frame_num, &wav_samples) != frame_num) ||
+      (static_cast<int>(out.size()) != frame_num * 2) ||
+      (memcmp(wav_samples, &out[0], out.size() * 2) != 0)) {
+    fprintf(stderr, "the wave file differs from the memory\n");
+    return false;
+  }
+  int played_frame_num = 0;
+  const int error_num =
+    CheckSamples(c, out, source, &played_frame_num);
+  // The resampler delays the end by a part of its taps.
+  const int expected_frame_num = c.in_loop ?
+    frame_num : mixer_frame_num - c.start_frame;
+  const bool is_passed = (error_num == 0) && (underrun_num == 0) &&
+    (abs(played_frame_num - expected_frame_num) <= 32);
+  printf("%6d Hz %d ch %-5s %-5s from %6d %8d frames %8d played %4d errors"
+         " %s\n",
+         c.sample_rate, c.channel_num, c.in_loop ? "loop" : "once",
+         c.is_adpcm ? "ADPCM" : "PCM", c.start_frame, frame_num,
+         played_frame_num, error_num, is_passed ? "ok" : "NG");
+  return is_passed;
+}
+  // Nanoseconds to decode a second of stereo ADPCM in pieces, as the
+  // streaming thread does, the fastest of the runs.
+int64_t MeasureDecode() {
+  const Case c = {SYS_MIXER_SAMPLE_RATE, 2, false, 0, true};
+  const int frame_num = c.sample_rate * CHECK_COST_SECONDS;
+  std::vector<int16_t> source(frame_num * c.channel_num);
+  for (int i = 0; i < frame_num; ++i) {
+    for (int ch = 0; ch < c.channel_num; ++ch) {
+      source[i * c.channel_num + ch] = GetSourceSample(c, i, ch);
+    }
+  }
+  const std::vector<uint8_t> wave = MakeWave(c.sample_rate, c.channel_num,
+                                             true, &source);
+  sys::WaveFile file;
+  if (!file.Open(&wave[0], wave.size())) return -1;
+  int64_t best_ns = INT64_MAX;
+  for (int i = 0; i < CHECK_REPEAT_NUM; ++i) {
+    sys::WaveDecoder decoder;
+    if (!decoder.Reset(file.GetView())) return -1;
+    const int64_t start_ns = sys::GetClockNanoSecond();
+    int read_num = 0;
+    const void* samples = nullptr;
+    int n = 0;
+    while ((n = decoder.Read(CHECK_DECODE_PIECE, &samples)) > 0) {
+      // The last frame of each piece is checked, so nothing is skipped.
+      const int16_t* p = static_cast<const int16_t*>(samples);
+      const int last = (read_num + n - 1) * c.channel_num;
+      if (p[(n - 1) * c.channel_num] != source[last]) return -1;
+      read_num += n;
+    }
+    const int64_t ns = sys::GetClockNanoSecond() - start_ns;
+    if (read_num != frame_num) return -1;
+    if (ns < best_ns) best_ns = ns;
+  }
+  return best_ns / CHECK_COST_SECONDS;
+}
+}  // namespace
+int main() {
+  bool is_passed = true;
+  for (const Case& c : kCases) {
+    if (!Check(c)) is_passed = false;
+  }
+  const int64_t ns = MeasureDecode();
+  if (ns <= 0) {
+    fprintf(stderr, "ADPCM not decoded\n");
+    return 1;
+  }
+  // The decoding of a stream is a part of a core, the rest is mixing.
+  printf("IMA ADPCM stereo decode %.1f us a second, %.0f streams a core\n",
+         ns / 1e3, 1e9 / ns);
+  return is_passed ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+﻿// @file voice_check.cc
+// @brief Voices checked to be selected by limits, and the cost of the pool.
+// @author Mamoru Kaminaga
+// @date 2026-10-19 17:34:52
+// Copyright 2026 Mamoru Kaminaga
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+#include "../clock_internal.h"
+#include "../mixer_internal.h"
+#define CHECK_UNIT          (256)  // The level of a voice in the output.
+#define CHECK_QUIET_GAIN    (0.0001f)  // Under the audible gain.
+#define CHECK_VIRTUAL_NUM   (10)  // Blocks a voice is virtual.
+#define CHECK_RAMP_FRAMES   (1000)  // A loop not of whole blocks.
+#define BENCH_BLOCK_NUM     (1000)  // Mixed in a run.
+#define BENCH_REPEAT_NUM    (3)  // The fastest run is taken.
+namespace {
+int error_num = 0;
+void Expect(bool condition, const char* name) {
+  if (condition) return;
+  fprintf(stderr, "failed: %s\n", name);
+  ++error_num;
+}
+std::shared_ptr<const sys::SampleBuffer> MakeSamples(
+    const std::vector<int16_t>& samples, bool in_loop) {
+  std::shared_ptr<sys::SampleBuffer> buffer(new sys::SampleBuffer());
+  buffer->format = SYS_SAMPLEFORMAT_INT16;
+  buffer->channel_num = 1;
+  buffer->frame_num = static_cast<int>(samples.size());
+  buffer->loop_end = in_loop ? buffer->frame_num : 0;
+  buffer->int16_samples = samples;
+  return buffer;
+}
+  // A constant level of a second, which is CHECK_UNIT << bit after the gain.
+std::shared_ptr<const sys::SampleBuffer> MakeLevel(int bit, float gain) {
+  const int16_t level = static_cast<int16_t>(lroundf((CHECK_UNIT << bit) /
+                                                     gain));
+  return MakeSamples(std::vector<int16_t>(SYS_MIXER_SAMPLE_RATE, level),
+                     true);
+}
+int Play(sys::Mixer* mixer, const std::shared_ptr<const sys::SampleBuffer>& s,
+         float gain, int priority, int category) {
+  sys::VoiceDesc desc;
+  desc.gain = gain;
+  desc.priority = priority;
+  desc.category = category;
+  return mixer->Play(s, 0, desc);
+}
+  // Blocks are mixed, and the bits of the voices heard at the last frame.
+int MixBits(sys::Mixer* mixer, int block_num) {
+  int16_t out[SYS_MIXER_BLOCK_FRAMES * SYS_MIXER_CHANNEL_NUM];
+  for (int i = 0; i < block_num; ++i) mixer->Mix(SYS_MIXER_BLOCK_FRAMES, out);
+  const int v = out[(SYS_MIXER_BLOCK_FRAMES - 1) * SYS_MIXER_CHANNEL_NUM];
+  return (v + CHECK_UNIT / 2) / CHECK_UNIT;
+}
+  // 4 voices of a category of 2, of the gains 1, 1/4, 1/2 and 1/8.
+int CheckCategory(SYS_VOICESTEAL steal, int priority_bit) {
+  static const float kGains[] = {1.0f, 0.25f, 0.5f, 0.125f};
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  sys::VoiceCategoryDesc category;
+  category.voice_limit = 2;
+  category.steal = steal;
+  mixer->SetCategory(1, category);
+  for (int i = 0; i < 4; ++i) {
+    Play(mixer.get(), MakeLevel(i, kGains[i]), kGains[i],
+         (i == priority_bit) ? 1 : 0, 1);
+  }
+  return MixBits(mixer.get(), 2);
+}
+void CheckSelection() {
+  // The loudest, or the newest, are kept. A priority is kept first.
+  const int quietest = CheckCategory(SYS_VOICESTEAL_QUIETEST, -1);
+  const int oldest = CheckCategory(SYS_VOICESTEAL_OLDEST, -1);
+  const int priority = CheckCategory(SYS_VOICESTEAL_QUIETEST, 3);
+  printf("category of 2: quietest 0x%x, oldest 0x%x, priority 0x%x\n",
+         quietest, oldest, priority);
+  Expect(quietest == 0x5, "the quietest dropped");
+  Expect(oldest == 0xc, "the oldest dropped");
+  Expect(priority == 0x9, "a priority kept in the category");
+  // A quiet voice of a priority is mixed over the limit of all voices.
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  const std::shared_ptr<const sys::SampleBuffer> silence =
+    MakeSamples(std::vector<int16_t>(SYS_MIXER_SAMPLE_RATE, 0), true);
+  for (int i = 0; i < SYS_MIXER_REAL_VOICE_NUM; ++i) {
+    Play(mixer.get(), silence, 1.0f, 0, 0);
+  }
+  Play(mixer.get(), MakeLevel(0, 0.01f), 0.01f, 1, 0);
+  const int bits = MixBits(mixer.get(), 2);
+  const sys::MixerStats stats = mixer->GetStats();
+  printf("%d voices and a quiet priority: 0x%x, %d mixed, %d virtual\n",
+         SYS_MIXER_REAL_VOICE_NUM, bits, stats.active_num,
+         stats.virtual_num);
+  Expect((bits == 1) && (stats.active_num == SYS_MIXER_REAL_VOICE_NUM) &&
+         (stats.virtual_num == 1), "a priority over the limit");
+}
+  // A voice made virtual for some blocks is heard again where a voice always
+  // mixed is, after the block it is faded in. A voice ends while virtual.
+void CheckVirtual() {
+  std::vector<int16_t> ramp(CHECK_RAMP_FRAMES);
+  for (int i = 0; i < CHECK_RAMP_FRAMES; ++i) {
+    ramp[i] = static_cast<int16_t>((i * 37 % 2000 - 1000) * 8);
+  }
+  const std::shared_ptr<const sys::SampleBuffer> samples =
+    MakeSamples(ramp, true);
+  std::unique_ptr<sys::Mixer> heard(new sys::Mixer());
+  std::unique_ptr<sys::Mixer> virtualized(new sys::Mixer());
+  Play(heard.get(), samples, 1.0f, 0, 0);
+  const int id = Play(virtualized.get(), samples, 1.0f, 0, 0);
+  const int block_num = CHECK_VIRTUAL_NUM + 8;
+  int16_t out[SYS_MIXER_BLOCK_FRAMES * SYS_MIXER_CHANNEL_NUM];
+  int16_t expected[SYS_MIXER_BLOCK_FRAMES * SYS_MIXER_CHANNEL_NUM];
+  int virtual_num = 0;
+  int diff_num = 0;
+  for (int i = 0; i < block_num; ++i) {
+    if (i == 2) virtualized->SetGain(id, CHECK_QUIET_GAIN);
+    if (i == 2 + CHECK_VIRTUAL_NUM) virtualized->SetGain(id, 1.0f);
+    heard->Mix(SYS_MIXER_BLOCK_FRAMES, expected);
+    virtualized->Mix(SYS_MIXER_BLOCK_FRAMES, out);
+    if (i == 2 + CHECK_VIRTUAL_NUM - 1) {
+      virtual_num = virtualized->GetStats().virtual_num;
+    }
+    // The block after the promotion is faded in.
+    if (i > 2 + CHECK_VIRTUAL_NUM) {
+      diff_num += (memcmp(out, expected, sizeof(out)) != 0) ? 1 : 0;
+    }
+  }
+  printf("virtual for %d blocks: %d virtual, %d blocks differ after it\n",
+         CHECK_VIRTUAL_NUM, virtual_num, diff_num);
+  Expect(virtual_num == 1, "a quiet voice virtual");
+  Expect(diff_num == 0, "a promoted voice where it would have been");
+  // A voice of 4 blocks ends while it is virtual.
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  const int end_id = Play(
+      mixer.get(), MakeSamples(std::vector<int16_t>(
+          SYS_MIXER_BLOCK_FRAMES * 4, 1000), false), CHECK_QUIET_GAIN, 0, 0);
+  MixBits(mixer.get(), 2);
+  Expect(mixer->IsPlaying(end_id) && (mixer->GetStats().virtual_num == 1),
+         "a virtual voice playing");
+  MixBits(mixer.get(), 3);
+  Expect(!mixer->IsPlaying(end_id) && (mixer->GetStats().virtual_num == 0),
+         "a virtual voice ended");
+}
+  // A full pool steals a voice of the same priority, not of a higher one.
+void CheckPool() {
+  std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+  const std::shared_ptr<const sys::SampleBuffer> silence =
+    MakeSamples(std::vector<int16_t>(SYS_MIXER_SAMPLE_RATE, 0), true);
+  for (int i = 0; i < SYS_MIXER_VOICE_NUM; ++i) {
+    Expect(Play(mixer.get(), silence, 1.0f, 1, 0) != SYS_MIXER_INVALID_VOICE,
+           "the pool filled");
+  }
+  const bool is_rejected =
+    Play(mixer.get(), silence, 1.0f, 0, 0) == SYS_MIXER_INVALID_VOICE;
+  const bool is_stolen =
+    Play(mixer.get(), silence, 1.0f, 1, 0) != SYS_MIXER_INVALID_VOICE;
+  const sys::MixerStats stats = mixer->GetStats();
+  printf("a full pool of %d: lower priority %s, same priority %s\n",
+         SYS_MIXER_VOICE_NUM, is_rejected ? "rejected" : "played",
+         is_stolen ? "stolen" : "rejected");
+  Expect(is_rejected && is_stolen && (stats.stolen_num == 1),
+         "a full pool stolen by priority");
+}
+  // Microseconds a block of looping voices of varied gains, the fastest of
+  // the runs. Only the real voices are mixed.
+double Measure(int voice_num) {
+  std::vector<int16_t> sine(SYS_MIXER_SAMPLE_RATE);
+  for (int i = 0; i < SYS_MIXER_SAMPLE_RATE; ++i) {
+    sine[i] = static_cast<int16_t>(16384.0f * sinf(i * 0.0627f));
+  }
+  const std::shared_ptr<const sys::SampleBuffer> samples =
+    MakeSamples(sine, true);
+  int64_t best_ns = INT64_MAX;
+  for (int i = 0; i < BENCH_REPEAT_NUM; ++i) {
+    std::unique_ptr<sys::Mixer> mixer(new sys::Mixer());
+    for (int j = 0; j < voice_num; ++j) {
+      Play(mixer.get(), samples, 0.5f / (1 + j % 97), j % 3, j % 4);
+    }
+    int16_t out[SYS_MIXER_BLOCK_FRAMES * SYS_MIXER_CHANNEL_NUM];
+    const int64_t start_ns = sys::GetClockNanoSecond();
+    for (int j = 0; j < BENCH_BLOCK_NUM; ++j) {
+      mixer->Mix(SYS_MIXER_BLOCK_FRAMES, out);
+    }
+    const int64_t ns = sys::GetClockNanoSecond() - start_ns;
+    const sys::MixerStats stats = mixer->GetStats();
+    Expect((stats.active_num <= SYS_MIXER_REAL_VOICE_NUM) &&
+           (stats.active_num + stats.virtual_num == voice_num),
+           "the real voices mixed");
+    if (ns < best_ns) best_ns = ns;
+  }
+  return best_ns / 1e3 / BENCH_BLOCK_NUM;
+}
+}  // namespace
+int main() {
+  CheckSelection();
+  CheckVirtual();
+  CheckPool();
+  printf("voices  us per block\n");
+  for (int voice_num : {SYS_MIXER_REAL_VOICE_NUM, SYS_MIXER_VOICE_NUM}) {
+    printf("%6d %13.1f\n", voice_num, Measure(voice_num));
+  }
+  return (error_num == 0) ? 0 : 1;
+}
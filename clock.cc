@@ -0,0 +1,108 @@
+﻿  // @file clock
+  // @brief Definitions of clock related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 13:05:52
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include "./clock_internal.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || \
+    defined(__x86_64__)
+#include <emmintrin.h>
+#define SYS_CLOCK_USE_PAUSE
+#endif
+namespace sys {
+  //
+  // These are internal structures related to clock
+  //
+FramePacer::FramePacer() : numerator_(60), denominator_(1),
+    spin_ns_(SYS_FRAME_SPIN_NS), base_ns_(0), frame_(0), last_deadline_(0) { }
+void FramePacer::SetRate(int numerator, int denominator) {
+  assert(numerator > 0);
+  assert(denominator > 0);
+  numerator_ = numerator;
+  denominator_ = denominator;
+  // Deadlines continue from the last one with the new period.
+  base_ns_ = last_deadline_;
+  frame_ = 0;
+}
+void FramePacer::SetSpinNanoSecond(int64_t spin_ns) {
+  spin_ns_ = (spin_ns > 0) ? spin_ns : 0;
+}
+void FramePacer::Reset(int64_t now_ns) {
+  base_ns_ = now_ns;
+  frame_ = 0;
+  last_deadline_ = now_ns;
+}
+int64_t FramePacer::Wait() {
+  const int64_t deadline = GetDeadline(frame_ + 1);
+  int64_t now = GetClockNanoSecond();
+  if (now - deadline >= GetPeriodNanoSecond()) {
+    // More than a frame late, the lost frames are not rushed.
+    Reset(now);
+    return now;
+  }
+  ++frame_;
+  while (deadline - now > spin_ns_) {
+    SleepNanoSecond(deadline - now - spin_ns_);
+    now = GetClockNanoSecond();
+  }
+  while (now < deadline) {
+    RelaxCPU();
+    now = GetClockNanoSecond();
+  }
+  last_deadline_ = deadline;
+  return now;
+}
+int64_t FramePacer::GetPeriodNanoSecond() const {
+  return SYS_NS_PER_SECOND * denominator_ / numerator_;
+}
+int64_t FramePacer::GetDeadline(int64_t frame) const {
+  // Computed from the base each time, so the fraction of the period is not
+  // lost, e.g., 16666666.67 ns for 60 fps.
+  return base_ns_ + frame * denominator_ * SYS_NS_PER_SECOND / numerator_;
+}
+
+  //
+  // These are internal functions related to clock
+  //
+int64_t GetClockNanoSecond() {
+#ifdef _WIN32
+  static LARGE_INTEGER frequency = {0};
+  if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  // Divided in two steps to avoid the overflow of the multiplication.
+  const int64_t f = frequency.QuadPart;
+  const int64_t c = counter.QuadPart;
+  return (c / f) * SYS_NS_PER_SECOND + (c % f) * SYS_NS_PER_SECOND / f;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * SYS_NS_PER_SECOND + ts.tv_nsec;
+#endif
+}
+void SleepNanoSecond(int64_t ns) {
+  if (ns <= 0) return;
+#ifdef _WIN32
+  // The granularity is the timer period, see timeBeginPeriod.
+  Sleep(static_cast<DWORD>(ns / SYS_NS_PER_MILLISECOND));
+#else
+  struct timespec ts;
+  ts.tv_sec = static_cast<time_t>(ns / SYS_NS_PER_SECOND);
+  ts.tv_nsec = static_cast<long>(ns % SYS_NS_PER_SECOND);  // NOLINT
+  nanosleep(&ts, nullptr);
+#endif
+}
+void RelaxCPU() {
+#if defined(SYS_CLOCK_USE_PAUSE)
+  _mm_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");  // NOLINT
+#endif
+}
+}  // namespace sys
@@ -0,0 +1,53 @@
+﻿  // @file clock_internal.h
+  // @brief Declaration of clock related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 13:05:52
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef CLOCK_INTERNAL_H_
+#define CLOCK_INTERNAL_H_
+#include <stdint.h>
+  //
+  // These are internal macros related to clock
+  //
+#define SYS_NS_PER_SECOND       (1000000000LL)
+#define SYS_NS_PER_MILLISECOND  (1000000LL)
+#define SYS_FRAME_SPIN_NS       (2000000LL)  // Spin for the last 2 ms.
+
+  //
+  // These are internal enumerations and constants related to clock
+  //
+
+namespace sys {
+  //
+  // These are internal structures related to clock
+  //
+  // Frames are paced to absolute deadlines, base + n * period, so errors of
+  // each wait are not accumulated. The pacer sleeps until the spin margin is
+  // left, then spins until the deadline.
+class FramePacer {
+ public:
+  FramePacer();
+  void SetRate(int numerator, int denominator);
+  void SetSpinNanoSecond(int64_t spin_ns);
+  void Reset(int64_t now_ns);
+  int64_t Wait();
+  int64_t GetPeriodNanoSecond() const;
+  int64_t GetLastDeadline() const { return last_deadline_; }
+ private:
+  int64_t GetDeadline(int64_t frame) const;
+  int numerator_;  // Frames per denominator seconds.
+  int denominator_;
+  int64_t spin_ns_;
+  int64_t base_ns_;
+  int64_t frame_;
+  int64_t last_deadline_;
+};
+
+  //
+  // These are internal functions related to clock
+  //
+int64_t GetClockNanoSecond();  // Monotonic.
+void SleepNanoSecond(int64_t ns);  // Coarse, it may return early.
+void RelaxCPU();  // A hint in spin loops.
+}  // namespace sys
+#endif  // CLOCK_INTERNAL_H_
@@ -10,7 +10,6 @@
   //
   // These are internal macros related to sound
   //
-#define SYS_ID_SERVER_EXCEEDS_LIMIT (-2)
 
   //
   // These are internal enumerations and constants related to sound
@@ -20,16 +19,6 @@ namespace sys {
   //
   // These are internal structures related to sound
   //
-class IdServer {
- public:
-  IdServer();
-  ~IdServer();
-  int CreateId();
-  int ReleaseId(int id);
- private:
-  struct Impl;
-  std::unique_ptr<Impl> impl_;
-};
 
   //
   // These are internal functions related to sound
@@ -0,0 +1,295 @@
+﻿  // @file effect
+  // @brief Definitions of effect related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 23:12:40
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include "./clock_internal.h"
+#include "./effect_internal.h"
+#ifdef SYS_EFFECT_USE_SSE2
+#include <emmintrin.h>
+#endif
+namespace sys {
+  //
+  // These are private functions related to effect
+  //
+namespace {
+const float kPi = 3.14159265358979f;
+inline float Clamp(float value, float low, float high) {
+  return (value < low) ? low : ((value > high) ? high : value);
+}
+void SetRamp(EffectState* state, float gain_l, float gain_r, int frame_num) {
+  assert(state);
+  state->targets[0] = gain_l;
+  state->targets[1] = gain_r;
+  if (frame_num <= 0) {
+    state->gains[0] = gain_l;
+    state->gains[1] = gain_r;
+    state->steps[0] = 0.0f;
+    state->steps[1] = 0.0f;
+    state->ramp_frames = 0;
+    return;
+  }
+  state->steps[0] = (gain_l - state->gains[0]) / frame_num;
+  state->steps[1] = (gain_r - state->gains[1]) / frame_num;
+  state->ramp_frames = frame_num;
+}
+  // Coefficients of the audio EQ cookbook by R. Bristow-Johnson.
+void SetFilter(EffectState* state) {
+  assert(state);
+  const float w0 = 2.0f * kPi * state->desc.frequency / SYS_EFFECT_SAMPLE_RATE;
+  const float cos_w0 = cosf(w0);
+  const float alpha = sinf(w0) / (2.0f * state->desc.q);
+  float b0 = 0.0f;
+  float b1 = 0.0f;
+  float b2 = 0.0f;
+  switch (state->desc.type) {
+    case SYS_EFFECTTYPE_LOWPASS:
+      b0 = (1.0f - cos_w0) * 0.5f;
+      b1 = 1.0f - cos_w0;
+      b2 = b0;
+      break;
+    case SYS_EFFECTTYPE_HIGHPASS:
+      b0 = (1.0f + cos_w0) * 0.5f;
+      b1 = -(1.0f + cos_w0);
+      b2 = b0;
+      break;
+    default:
+      b0 = alpha;
+      b2 = -alpha;
+      break;
+  }
+  const float a0 = 1.0f + alpha;
+  state->b0 = b0 / a0;
+  state->b1 = b1 / a0;
+  state->b2 = b2 / a0;
+  state->a1 = -2.0f * cos_w0 / a0;
+  state->a2 = (1.0f - alpha) / a0;
+}
+  // Interleaved stereo is multiplied by the gains.
+void ScaleStereo(float* samples, int frame_num, float gain_l, float gain_r) {
+  assert(samples || (frame_num == 0));
+  int i = 0;
+#ifdef SYS_EFFECT_USE_SSE2
+  const __m128 gain = _mm_setr_ps(gain_l, gain_r, gain_l, gain_r);
+  for (; i + 4 <= frame_num; i += 4) {
+    float* s = samples + i * 2;
+    _mm_storeu_ps(s, _mm_mul_ps(_mm_loadu_ps(s), gain));
+    _mm_storeu_ps(s + 4, _mm_mul_ps(_mm_loadu_ps(s + 4), gain));
+  }
+#endif
+  for (; i < frame_num; ++i) {
+    samples[i * 2] *= gain_l;
+    samples[i * 2 + 1] *= gain_r;
+  }
+}
+}  // namespace
+
+  //
+  // These are internal structures related to effect
+  //
+EffectCost::EffectCost() : block_num(0), process_ns(0) { }
+EffectState::EffectState() : desc(), gains(), targets(), steps(),
+    ramp_frames(0), b0(0.0f), b1(0.0f), b2(0.0f), a1(0.0f), a2(0.0f), z1(),
+    z2(), delay_frames(0) { }
+EffectChain::EffectChain(int delay_frame_num) : states_(), effect_num_(0),
+    delay_line_(static_cast<size_t>(delay_frame_num) * 2),
+    delay_position_(0) { }
+void EffectChain::Clear() {
+  if (effect_num_ == 0) return;
+  for (auto& state : states_) state = EffectState();
+  effect_num_ = 0;
+}
+bool EffectChain::Set(int index, const EffectDesc& desc) {
+  if ((index < 0) || (index >= SYS_EFFECT_CHAIN_NUM)) return false;
+  if (!IsValidEffect(desc, index, GetDelayIndex(), !delay_line_.empty())) {
+    return false;
+  }
+  EffectState& state = states_[index];
+  const bool is_new = (state.desc.type != desc.type);
+  if (state.desc.type != SYS_EFFECTTYPE_NONE) --effect_num_;
+  if (desc.type != SYS_EFFECTTYPE_NONE) ++effect_num_;
+  if (is_new) state = EffectState();
+  state.desc = desc;
+  switch (desc.type) {
+    case SYS_EFFECTTYPE_GAIN: {
+      // A new gain is ramped from the level without it.
+      if (is_new) SetRamp(&state, 1.0f, 1.0f, 0);
+      const float gain = (desc.gain > 0.0f) ? desc.gain : 0.0f;
+      const float ramp_ms = (desc.ramp_ms > 0.0f) ? desc.ramp_ms : 0.0f;
+      SetRamp(&state, gain, gain,
+              static_cast<int>(ramp_ms * SYS_EFFECT_SAMPLE_RATE / 1000.0f));
+      break;
+    }
+    case SYS_EFFECTTYPE_PAN: {
+      const float angle = (Clamp(desc.pan, -1.0f, 1.0f) + 1.0f) * kPi * 0.25f;
+      SetRamp(&state, cosf(angle), sinf(angle),
+              is_new ? 0 : SYS_EFFECT_PAN_RAMP_FRAMES);
+      break;
+    }
+    case SYS_EFFECTTYPE_LOWPASS:
+    case SYS_EFFECTTYPE_HIGHPASS:
+    case SYS_EFFECTTYPE_BANDPASS:
+      state.desc.frequency = Clamp(desc.frequency, 10.0f,
+                                   SYS_EFFECT_SAMPLE_RATE * 0.45f);
+      state.desc.q = Clamp(desc.q, 0.1f, 20.0f);
+      SetFilter(&state);
+      break;
+    case SYS_EFFECTTYPE_DELAY: {
+      const int capacity = static_cast<int>(delay_line_.size() / 2);
+      const int delay_frames = static_cast<int>(
+          desc.delay_ms * SYS_EFFECT_SAMPLE_RATE / 1000.0f);
+      state.delay_frames = (delay_frames < 1) ? 1 :
+        ((delay_frames > capacity) ? capacity : delay_frames);
+      state.desc.feedback = Clamp(desc.feedback, 0.0f, 0.95f);
+      state.desc.wet = Clamp(desc.wet, 0.0f, 1.0f);
+      if (is_new) {
+        memset(delay_line_.data(), 0, sizeof(float) * delay_line_.size());
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  return true;
+}
+int EffectChain::GetDelayIndex() const {
+  for (int i = 0; i < SYS_EFFECT_CHAIN_NUM; ++i) {
+    if (states_[i].desc.type == SYS_EFFECTTYPE_DELAY) return i;
+  }
+  return -1;
+}
+void EffectChain::Process(float* samples, int frame_num, EffectCost* costs) {
+  assert(samples || (frame_num == 0));
+  for (auto& state : states_) {
+    const SYS_EFFECTTYPE type = state.desc.type;
+    if (type == SYS_EFFECTTYPE_NONE) continue;
+    const int64_t start_ns = GetClockNanoSecond();
+    switch (type) {
+      case SYS_EFFECTTYPE_GAIN:
+      case SYS_EFFECTTYPE_PAN:
+        ProcessGain(&state, samples, frame_num);
+        break;
+      case SYS_EFFECTTYPE_DELAY:
+        ProcessDelay(&state, samples, frame_num);
+        break;
+      default:
+        ProcessFilter(&state, samples, frame_num);
+        break;
+    }
+    if (costs) {
+      costs[type].block_num.fetch_add(1);
+      costs[type].process_ns.fetch_add(GetClockNanoSecond() - start_ns);
+    }
+  }
+}
+void EffectChain::ProcessGain(EffectState* state, float* samples,
+                              int frame_num) {
+  assert(state);
+  int i = 0;
+  for (; (i < frame_num) && (state->ramp_frames > 0); ++i) {
+    state->gains[0] += state->steps[0];
+    state->gains[1] += state->steps[1];
+    if (--state->ramp_frames == 0) {
+      state->gains[0] = state->targets[0];
+      state->gains[1] = state->targets[1];
+    }
+    samples[i * 2] *= state->gains[0];
+    samples[i * 2 + 1] *= state->gains[1];
+  }
+  if ((state->gains[0] == 1.0f) && (state->gains[1] == 1.0f)) return;
+  ScaleStereo(samples + i * 2, frame_num - i, state->gains[0],
+              state->gains[1]);
+}
+  // Transposed direct form II. Left and right are filtered together in the
+  // lower lanes.
+void EffectChain::ProcessFilter(EffectState* state, float* samples,
+                                int frame_num) {
+  assert(state);
+#ifdef SYS_EFFECT_USE_SSE2
+  const __m128 b0 = _mm_set1_ps(state->b0);
+  const __m128 b1 = _mm_set1_ps(state->b1);
+  const __m128 b2 = _mm_set1_ps(state->b2);
+  const __m128 a1 = _mm_set1_ps(state->a1);
+  const __m128 a2 = _mm_set1_ps(state->a2);
+  __m128 z1 = _mm_setr_ps(state->z1[0], state->z1[1], 0.0f, 0.0f);
+  __m128 z2 = _mm_setr_ps(state->z2[0], state->z2[1], 0.0f, 0.0f);
+  for (int i = 0; i < frame_num; ++i) {
+    __m64* s = reinterpret_cast<__m64*>(samples + i * 2);
+    const __m128 x = _mm_loadl_pi(_mm_setzero_ps(), s);
+    const __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+    z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+    z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+    _mm_storel_pi(s, y);
+  }
+  _mm_storel_pi(reinterpret_cast<__m64*>(state->z1), z1);
+  _mm_storel_pi(reinterpret_cast<__m64*>(state->z2), z2);
+#else
+  for (int i = 0; i < frame_num; ++i) {
+    for (int c = 0; c < 2; ++c) {
+      const float x = samples[i * 2 + c];
+      const float y = state->b0 * x + state->z1[c];
+      state->z1[c] = state->b1 * x - state->a1 * y + state->z2[c];
+      state->z2[c] = state->b2 * x - state->a2 * y;
+      samples[i * 2 + c] = y;
+    }
+  }
+#endif
+}
+  // Frames are processed in runs where neither position wraps, and a run is
+  // not longer than the delay, so a run never reads what it writes.
+void EffectChain::ProcessDelay(EffectState* state, float* samples,
+                               int frame_num) {
+  assert(state);
+  assert(!delay_line_.empty());
+  const int capacity = static_cast<int>(delay_line_.size() / 2);
+  const float feedback = state->desc.feedback;
+  const float wet = state->desc.wet;
+  int done = 0;
+  while (done < frame_num) {
+    int read = delay_position_ - state->delay_frames;
+    if (read < 0) read += capacity;
+    int n = frame_num - done;
+    if (n > capacity - delay_position_) n = capacity - delay_position_;
+    if (n > capacity - read) n = capacity - read;
+    if (n > state->delay_frames) n = state->delay_frames;
+    float* s = samples + done * 2;
+    float* w = &delay_line_[static_cast<size_t>(delay_position_) * 2];
+    const float* r = &delay_line_[static_cast<size_t>(read) * 2];
+    const int sample_num = n * 2;
+    int i = 0;
+#ifdef SYS_EFFECT_USE_SSE2
+    const __m128 feedback4 = _mm_set1_ps(feedback);
+    const __m128 wet4 = _mm_set1_ps(wet);
+    for (; i + 4 <= sample_num; i += 4) {
+      const __m128 x = _mm_loadu_ps(s + i);
+      const __m128 delayed = _mm_loadu_ps(r + i);
+      _mm_storeu_ps(w + i, _mm_add_ps(x, _mm_mul_ps(feedback4, delayed)));
+      _mm_storeu_ps(s + i, _mm_add_ps(x, _mm_mul_ps(wet4, delayed)));
+    }
+#endif
+    for (; i < sample_num; ++i) {
+      const float delayed = r[i];
+      w[i] = s[i] + feedback * delayed;
+      s[i] += wet * delayed;
+    }
+    done += n;
+    delay_position_ += n;
+    if (delay_position_ >= capacity) delay_position_ = 0;
+  }
+}
+
+  //
+  // These are internal functions related to effect
+  //
+bool IsValidEffect(const EffectDesc& desc, int index, int delay_index,
+                   bool has_delay_line) {
+  if ((desc.type < SYS_EFFECTTYPE_NONE) || (desc.type >= SYS_EFFECTTYPE_NUM)) {
+    return false;
+  }
+  if (desc.type != SYS_EFFECTTYPE_DELAY) return true;
+  return has_delay_line && ((delay_index < 0) || (delay_index == index));
+}
+}  // namespace sys
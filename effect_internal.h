@@ -0,0 +1,89 @@
+﻿  // @file effect_internal.h
+  // @brief Declaration of effect related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 23:12:40
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef EFFECT_INTERNAL_H_
+#define EFFECT_INTERNAL_H_
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "./mixer.h"
+  //
+  // These are internal macros related to effect
+  //
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define SYS_EFFECT_USE_SSE2
+#endif
+#define SYS_EFFECT_SAMPLE_RATE    (44100)  // Of the mixer.
+#define SYS_EFFECT_DELAY_FRAMES   (44100)  // The longest delay, 1 s.
+#define SYS_EFFECT_PAN_RAMP_FRAMES  (256)  // A pan is moved in 5.8 ms.
+
+  //
+  // These are internal enumerations and constants related to effect
+  //
+
+namespace sys {
+  //
+  // These are internal structures related to effect
+  //
+  // The CPU cost of an effect type, added by the mixing thread.
+struct EffectCost {
+  std::atomic<int64_t> block_num;
+  std::atomic<int64_t> process_ns;
+  EffectCost();
+};
+  // An effect of a chain. The state is kept while the parameters change, so
+  // a filter or a gain is moved without a click.
+struct EffectState {
+  EffectDesc desc;
+  float gains[2];  // GAIN and PAN, the current gains of left and right.
+  float targets[2];
+  float steps[2];  // The change of a frame while ramped.
+  int ramp_frames;  // Left to the targets.
+  float b0;  // Filters, normalized by a0.
+  float b1;
+  float b2;
+  float a1;
+  float a2;
+  float z1[2];
+  float z2[2];
+  int delay_frames;
+  EffectState();
+};
+  // Effects of a voice, a bus or the master are processed in order on stereo
+  // float blocks of the mixer. Only a chain made with a delay line has a
+  // delay, so voices and buses do not hold one, and a chain has one delay
+  // since it has one line.
+  // Set and Process are called by the mixing thread and never allocate
+  // memory.
+class EffectChain {
+ public:
+  explicit EffectChain(int delay_frame_num);
+  void Clear();
+  bool Set(int index, const EffectDesc& desc);
+  bool IsEmpty() const { return effect_num_ == 0; }
+  int GetDelayIndex() const;  // -1 for none.
+  void Process(float* samples, int frame_num, EffectCost* costs);
+ private:
+  void ProcessGain(EffectState* state, float* samples, int frame_num);
+  void ProcessFilter(EffectState* state, float* samples, int frame_num);
+  void ProcessDelay(EffectState* state, float* samples, int frame_num);
+  EffectState states_[SYS_EFFECT_CHAIN_NUM];
+  int effect_num_;  // Not NONE.
+  std::vector<float> delay_line_;  // Interleaved stereo.
+  int delay_position_;  // The next frame written.
+};
+
+  //
+  // These are internal functions related to effect
+  //
+  // False for an unknown type, or a delay without a delay line. A delay is
+  // false too if the chain has one at another index than index, delay_index
+  // or -1 for none. Other parameters out of range are clamped when they are
+  // set.
+bool IsValidEffect(const EffectDesc& desc, int index, int delay_index,
+                   bool has_delay_line);
+}  // namespace sys
+#endif  // EFFECT_INTERNAL_H_
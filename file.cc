@@ -0,0 +1,135 @@
+﻿  // @file file
+  // @brief Definitions of file related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-18 10:12:05
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include <stdlib.h>
+#include <wchar.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "./file_internal.h"
+namespace sys {
+  //
+  // These are private functions related to file
+  //
+namespace {
+#ifndef _WIN32
+bool ToMultiByte(const wchar_t* wide, std::string* narrow) {
+  narrow->assign(wcslen(wide) * MB_CUR_MAX + 1, '\0');
+  const size_t size = wcstombs(&(*narrow)[0], wide, narrow->size());
+  if (size == static_cast<size_t>(-1)) return false;
+  narrow->resize(size);
+  return true;
+}
+#endif
+}  // namespace
+
+  //
+  // These are internal structures related to file
+  //
+#ifdef _WIN32
+FileMapping::FileMapping() : file_(INVALID_HANDLE_VALUE), mapping_(nullptr),
+    data_(nullptr), size_(0) { }
+#else
+FileMapping::FileMapping() : file_(-1), data_(nullptr), size_(0) { }
+#endif
+FileMapping::~FileMapping() {
+  Close();
+}
+#ifdef _WIN32
+bool FileMapping::Open(const std::wstring& file_name) {
+  assert(!data_);
+  file_ = CreateFileW(
+      file_name.c_str(),
+      GENERIC_READ,
+      FILE_SHARE_READ,
+      nullptr,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL,
+      nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) return false;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size) || (size.QuadPart <= 0)) {
+    Close();
+    return false;
+  }
+  mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping_) {
+    Close();
+    return false;
+  }
+  data_ = static_cast<const uint8_t*>(
+      MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (!data_) {
+    Close();
+    return false;
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+void FileMapping::Close() {
+  if (data_) UnmapViewOfFile(data_);
+  if (mapping_) CloseHandle(mapping_);
+  if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+  file_ = INVALID_HANDLE_VALUE;
+  mapping_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+}
+#else
+bool FileMapping::Open(const std::wstring& file_name) {
+  assert(!data_);
+  std::string narrow_name;
+  if (!ToMultiByte(file_name.c_str(), &narrow_name)) return false;
+  file_ = open(narrow_name.c_str(), O_RDONLY);
+  if (file_ < 0) return false;
+  struct stat status;
+  if ((fstat(file_, &status) != 0) || (status.st_size <= 0)) {
+    Close();
+    return false;
+  }
+  void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ,
+                    MAP_PRIVATE, file_, 0);
+  if (data == MAP_FAILED) {
+    Close();
+    return false;
+  }
+  data_ = static_cast<const uint8_t*>(data);
+  size_ = static_cast<size_t>(status.st_size);
+  return true;
+}
+void FileMapping::Close() {
+  if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+  if (file_ >= 0) close(file_);
+  file_ = -1;
+  data_ = nullptr;
+  size_ = 0;
+}
+#endif
+
+  //
+  // These are internal functions related to file
+  //
+FILE* OpenFile(const std::wstring& file_name, const wchar_t* mode) {
+  FILE* file = nullptr;
+#ifdef _WIN32
+  if (_wfopen_s(&file, file_name.c_str(), mode) != 0) return nullptr;
+#else
+  std::string narrow_name;
+  std::string narrow_mode;
+  if (!ToMultiByte(file_name.c_str(), &narrow_name) ||
+      !ToMultiByte(mode, &narrow_mode)) {
+    return nullptr;
+  }
+  file = fopen(narrow_name.c_str(), narrow_mode.c_str());
+#endif
+  return file;
+}
+}  // namespace sys
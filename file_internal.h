@@ -0,0 +1,54 @@
+﻿  // @file file_internal.h
+  // @brief Declaration of file related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-18 10:12:05
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef FILE_INTERNAL_H_
+#define FILE_INTERNAL_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+  //
+  // These are internal macros related to file
+  //
+
+  //
+  // These are internal enumerations and constants related to file
+  //
+
+namespace sys {
+  //
+  // These are internal structures related to file
+  //
+  // A file is mapped read only, and pages are read when they are touched
+  // first. The data is valid until the file is closed. Windows maps it with
+  // a file mapping object, and the others with mmap.
+class FileMapping {
+ public:
+  FileMapping();
+  ~FileMapping();
+  bool Open(const std::wstring& file_name);
+  void Close();
+  const uint8_t* GetData() const { return data_; }
+  size_t GetSize() const { return size_; }
+ private:
+  FileMapping(const FileMapping&);
+  FileMapping& operator=(const FileMapping&);
+#ifdef _WIN32
+  void* file_;  // HANDLE, windows.h is left to the definitions.
+  void* mapping_;
+#else
+  int file_;
+#endif
+  const uint8_t* data_;
+  size_t size_;
+};
+
+  //
+  // These are internal functions related to file
+  //
+  // The name is converted to the multibyte of the locale out of Windows.
+FILE* OpenFile(const std::wstring& file_name, const wchar_t* mode);
+}  // namespace sys
+#endif  // FILE_INTERNAL_H_
@@ -8,7 +8,11 @@
 #include <vector>
 #include "./graphic.h"
 #include "./graphic_internal.h"
+#include "./load.h"
+#include "./load_internal.h"
 #include "./system_internal.h"
+  // The image decoder of the software backend.
+#pragma comment(lib, "windowscodecs.lib")
 namespace sys {
   //
   // These are public structures related to graphic
@@ -18,6 +22,8 @@ ImageDesc::ImageDesc() : texture_id(0), x(0), y(0), w(0), h(0), s(1.0),
     image_mode(SYS_IMAGEMODE_DEFAULT) { }
 FontDesc::FontDesc() : resource_desc(), s(1.0),
     image_mode(SYS_IMAGEMODE_DEFAULT) { }
+DrawStats::DrawStats() : quad_num(0), draw_num(0), flush_num(0),
+    vertex_num(0), max_flush_vertex_num(0) { }
 
   //
   // These are internal structures related to graphic
@@ -28,7 +34,9 @@ GraphicData::GraphicData() : device(nullptr), device_context(nullptr),
     dxgi_swap_chain(nullptr), back_buffer(nullptr),
     render_target_view(nullptr), input_layout(nullptr), vs_cbuffer(nullptr),
     ps_cbuffer(nullptr), blend_state(nullptr), sampler_state(nullptr),
-    vertex_shader1(nullptr), pixel_shader1(nullptr), resolution(640, 480),
+    vertex_shader1(nullptr), pixel_shader1(nullptr), batch_buffer(nullptr),
+    d3d_batch_backend(), raster_batch_backend(), sprite_batch(),
+    backend(SYS_GRAPHICBACKEND_DIRECT3D), resolution(640, 480),
     on_fullscreen_start(false), on_power_save(false) {
   // The font table is initialized.
   const wchar_t font_array[SYS_FONT_COLUMN_NUM * SYS_FONT_ROW_NUM] =
@@ -36,40 +44,122 @@ GraphicData::GraphicData() : device(nullptr), device_context(nullptr),
   for (int i = 0; i < SYS_FONT_COLUMN_NUM * SYS_FONT_ROW_NUM; ++i) {
     font_map[font_array[i]] = i;
   }
-  // The resource buffers are initialized.
-  texture_buffer.resize(1024);
-  image_buffer.resize(1024);
-  font_buffer.resize(4);
 }
 
   //
   // These are public structures related to graphic
   //
 TextureData::TextureData() : w(0), h(0), blend_factor(),
-    shader_resource_view() { }
+    shader_resource_view(), raster_texture(), load_state(SYS_LOADSTATE_NONE),
+    load_request(nullptr) { }
 void TextureData::Release() {
   SYS_SAFE_RELEASE(shader_resource_view[0]);
+  raster_texture.Release();
+  if (load_request != nullptr) load_request->Cancel();
+  load_request = nullptr;
+  load_state = SYS_LOADSTATE_NONE;
 }
 bool TextureData::IsNull() {
-  return (shader_resource_view[0] == nullptr);
+  return ((shader_resource_view[0] == nullptr) && raster_texture.IsNull());
 }
-ImageData::ImageData() : w(0), h(0), texture_id(0), buffer(nullptr) { }
+ImageData::ImageData() : w(0), h(0), texture_id(0), vertices(),
+    in_use(false) { }
 void ImageData::Release() {
-  SYS_SAFE_RELEASE(buffer);
+  in_use = false;
 }
 bool ImageData::IsNull() {
-  return (buffer == nullptr);
+  return !in_use;
 }
-FontData::FontData() : font_texture(), font_image() { }
+FontData::FontData() : font_texture(), font_image(),
+    load_state(SYS_LOADSTATE_NONE), load_request(nullptr) { }
 void FontData::Release() {
   for (int i = 0; i < SYS_FONT_COLUMN_NUM * SYS_FONT_ROW_NUM; ++i) {
     font_image[i].Release();
   }
   font_texture.Release();
+  if (load_request != nullptr) load_request->Cancel();
+  load_request = nullptr;
+  load_state = SYS_LOADSTATE_NONE;
 }
 bool FontData::IsNull() {
   return font_texture.IsNull();
 }
+D3DBatchBackend::D3DBatchBackend() : bound_texture_(nullptr),
+    bound_alpha_(-1.0f) { }
+bool D3DBatchBackend::Upload(const VertexInputData* vertices,
+                             int vertex_num) {
+  assert(vertices);
+  // The whole stream is overwritten, the last one is discarded.
+  D3D11_MAPPED_SUBRESOURCE mapped;
+  if (FAILED(
+        graphic_data.device_context->Map(
+          graphic_data.batch_buffer,
+          0,
+          D3D11_MAP_WRITE_DISCARD,
+          0,
+          &mapped))) {
+    return false;
+  }
+  memcpy(mapped.pData, vertices, sizeof(VertexInputData) * vertex_num);
+  graphic_data.device_context->Unmap(graphic_data.batch_buffer, 0);
+  return true;
+}
+bool D3DBatchBackend::Draw(const BatchKey& key, int first_vertex,
+                           int vertex_num) {
+  // Graphic pipeline is over written only when the key changes.
+  if (key.texture != bound_texture_) {
+    const TextureData* texture = static_cast<const TextureData*>(key.texture);
+    graphic_data.device_context->PSSetShaderResources(
+        0,
+        1,
+        texture->shader_resource_view);
+    graphic_data.device_context->OMSetBlendState(
+        graphic_data.blend_state,
+        texture->blend_factor,
+        0xffffffff);
+    bound_texture_ = key.texture;
+  }
+  if (key.alpha != bound_alpha_) {
+    // Pixel shader constant buffer overwritten
+    PSConstBufferData ps_buffer;
+    ps_buffer.src.x = ps_buffer.src.y = ps_buffer.src.z = 0.0;
+    ps_buffer.src.w = key.alpha;
+    graphic_data.device_context->UpdateSubresource(
+        graphic_data.ps_cbuffer,
+        0,
+        nullptr,
+        &ps_buffer,
+        0,
+        0);
+    bound_alpha_ = key.alpha;
+  }
+  graphic_data.device_context->Draw(vertex_num, first_vertex);
+  return true;
+}
+void D3DBatchBackend::Reset() {
+  bound_texture_ = nullptr;
+  bound_alpha_ = -1.0f;
+}
+
+  //
+  // These are private structures related to graphic
+  //
+struct WICObjects {  // Released when the image is decoded.
+  IWICImagingFactory* factory;
+  IWICStream* stream;
+  IWICBitmapDecoder* decoder;
+  IWICBitmapFrameDecode* frame;
+  IWICFormatConverter* converter;
+  WICObjects() : factory(nullptr), stream(nullptr), decoder(nullptr),
+      frame(nullptr), converter(nullptr) { }
+  ~WICObjects() {
+    SYS_SAFE_RELEASE(converter);
+    SYS_SAFE_RELEASE(frame);
+    SYS_SAFE_RELEASE(decoder);
+    SYS_SAFE_RELEASE(stream);
+    SYS_SAFE_RELEASE(factory);
+  }
+};
 
   //
   // These are private functions related to common
@@ -257,6 +347,25 @@ bool CreateSamplerState() {
   }
   return true;
 }
+bool CreateBatchBuffer() {
+  D3D11_BUFFER_DESC desc;
+  desc.ByteWidth = sizeof(VertexInputData) * SYS_BATCH_VERTEX_NUM;
+  desc.Usage = D3D11_USAGE_DYNAMIC;
+  desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+  desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+  desc.MiscFlags = 0;
+  desc.StructureByteStride = sizeof(VertexInputData);
+  if (FAILED(
+        graphic_data.device->CreateBuffer(
+          &desc,
+          nullptr,
+          &graphic_data.batch_buffer))) {
+    return false;
+  }
+  graphic_data.d3d_batch_backend.Reset();
+  graphic_data.sprite_batch.SetBackend(&graphic_data.d3d_batch_backend);
+  return true;
+}
 bool CreateVertexInputLayout(const BYTE** asmptr, size_t asm_size) {
   D3D11_INPUT_ELEMENT_DESC desc[2];  // Description of VertexInputData
   desc[0].SemanticName = "POSITION";
@@ -312,9 +421,35 @@ bool CreatePixelShader(const BYTE** asmptr, size_t asm_size,
 }
 bool CreateGraphicPipeline() {
   graphic_data.device_context->IASetPrimitiveTopology(
-      D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+      D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
   graphic_data.device_context->IASetInputLayout(
       graphic_data.input_layout);
+  // The batch vertices are in screen space, the world matrix is identity.
+  UINT strids = sizeof(VertexInputData);
+  UINT offsets = 0;
+  graphic_data.device_context->IASetVertexBuffers(
+      0,
+      1,
+      &graphic_data.batch_buffer,
+      &strids,
+      &offsets);
+  VSConstBufferData vs_buffer;
+  vs_buffer.world_matrix = XMMatrixIdentity();
+  graphic_data.device_context->UpdateSubresource(
+      graphic_data.vs_cbuffer,
+      0,
+      nullptr,
+      &vs_buffer,
+      0,
+      0);
+  graphic_data.device_context->VSSetConstantBuffers(
+      0,
+      1,
+      &graphic_data.vs_cbuffer);
+  graphic_data.device_context->PSSetConstantBuffers(
+      0,
+      1,
+      &graphic_data.ps_cbuffer);
   graphic_data.device_context->VSSetShader(
       graphic_data.vertex_shader1,
       nullptr,
@@ -435,7 +570,19 @@ bool CheckDisplayModeChange() {
   }
   return true;
 }
+bool InitSoftwareGraphic() {
+  if (!graphic_data.raster_batch_backend.Resize(
+        graphic_data.resolution.x,
+        graphic_data.resolution.y)) {
+    return false;
+  }
+  graphic_data.sprite_batch.SetBackend(&graphic_data.raster_batch_backend);
+  return true;
+}
 bool InitGraphic() {
+  if (graphic_data.backend == SYS_GRAPHICBACKEND_SOFTWARE) {
+    return InitSoftwareGraphic();
+  }
   // Graphic pipeline
   if (!CreateD3DDevice()) return false;
   if (!CreateDXGIDevice()) return false;
@@ -448,6 +595,7 @@ bool InitGraphic() {
   if (!CreatePSConstBuffer()) return false;
   if (!CreateBlendState()) return false;
   if (!CreateSamplerState()) return false;
+  if (!CreateBatchBuffer()) return false;
   // Shaders
   if (!CreateVertexInputLayout(
         (const BYTE**) g_vshader1,
@@ -474,6 +622,12 @@ bool InitGraphic() {
   return true;
 }
 void FinalizeGraphic() {
+  // Resources left by the client are released.
+  for (TextureData& texture : graphic_data.texture_buffer) texture.Release();
+  for (FontData& font : graphic_data.font_buffer) font.Release();
+  graphic_data.texture_buffer.Clear();
+  graphic_data.image_buffer.Clear();
+  graphic_data.font_buffer.Clear();
   if (graphic_data.dxgi_swap_chain != nullptr) {
     graphic_data.dxgi_swap_chain->SetFullscreenState(false, nullptr);
   }
@@ -482,6 +636,9 @@ void FinalizeGraphic() {
   //
   SYS_SAFE_RELEASE(graphic_data.input_layout);
   //
+  graphic_data.sprite_batch.SetBackend(nullptr);
+  graphic_data.raster_batch_backend.Release();
+  SYS_SAFE_RELEASE(graphic_data.batch_buffer);
   SYS_SAFE_RELEASE(graphic_data.sampler_state);
   SYS_SAFE_RELEASE(graphic_data.blend_state);
   SYS_SAFE_RELEASE(graphic_data.ps_cbuffer);
@@ -495,7 +652,24 @@ void FinalizeGraphic() {
   SYS_SAFE_RELEASE(graphic_data.dxgi_device);
   SYS_SAFE_RELEASE(graphic_data.device);
 }
+bool FlushGraphic() {
+  return graphic_data.sprite_batch.Flush();
+}
+bool FlushBatchedTextures() {
+  // Batch keys point to stored textures, so queued quads are drawn before
+  // they are moved, and the bound texture is forgotten.
+  const bool result = FlushGraphic();
+  graphic_data.d3d_batch_backend.Reset();
+  return result;
+}
 bool PresentGraphic() {
+  const int64_t draw_ns = GetClockNanoSecond();
+  if (!FlushGraphic()) return false;
+  graphic_data.sprite_batch.EndFrame();
+  const int64_t present_ns = GetClockNanoSecond();
+  system_data.frame_profiler.AddPhase(
+      SYS_FRAMEPHASE_DRAW,
+      present_ns - draw_ns);
   HRESULT result = S_OK;
   if (!graphic_data.on_power_save) {
     result = graphic_data.dxgi_swap_chain->Present(1, 0);  // Vsync
@@ -516,23 +690,184 @@ bool PresentGraphic() {
     default:
       break;
   }
+  system_data.frame_profiler.AddPhase(
+      SYS_FRAMEPHASE_PRESENT,
+      GetClockNanoSecond() - present_ns);
   return true;
 }
 bool UpdateGraphic() {
+  if (graphic_data.backend == SYS_GRAPHICBACKEND_SOFTWARE) {
+    // The frame buffer is completed, it is not presented to the window.
+    const int64_t draw_ns = GetClockNanoSecond();
+    if (!FlushGraphic()) return false;
+    graphic_data.sprite_batch.EndFrame();
+    system_data.frame_profiler.AddPhase(
+        SYS_FRAMEPHASE_DRAW,
+        GetClockNanoSecond() - draw_ns);
+    return true;
+  }
   if (!CheckGraphicDeviceError()) return false;
   if (!CheckDisplayModeChange()) return false;
   if (!PresentGraphic()) return false;
   return true;
 }
+bool DecodeImage(const ResourceDesc& resource_desc, int* w, int* h,
+                 std::vector<uint32_t>* pixels) {
+  assert(w);
+  assert(h);
+  assert(pixels);
+  WICObjects wic;
+  if (FAILED(
+        CoCreateInstance(
+          CLSID_WICImagingFactory,
+          nullptr,
+          CLSCTX_INPROC_SERVER,
+          IID_PPV_ARGS(&wic.factory)))) {
+    return false;
+  }
+  if (resource_desc.use_mem) {
+    // From memory
+    if (FAILED(wic.factory->CreateStream(&wic.stream))) return false;
+    if (FAILED(
+          wic.stream->InitializeFromMemory(
+            resource_desc.mem_ptr,
+            static_cast<DWORD>(resource_desc.mem_size)))) {
+      return false;
+    }
+    if (FAILED(
+          wic.factory->CreateDecoderFromStream(
+            wic.stream,
+            nullptr,
+            WICDecodeMetadataCacheOnDemand,
+            &wic.decoder))) {
+      return false;
+    }
+  } else {
+    // From file
+    if (FAILED(
+          wic.factory->CreateDecoderFromFilename(
+            resource_desc.file_name.c_str(),
+            nullptr,
+            GENERIC_READ,
+            WICDecodeMetadataCacheOnDemand,
+            &wic.decoder))) {
+      return false;
+    }
+  }
+  if (FAILED(wic.decoder->GetFrame(0, &wic.frame))) return false;
+  if (FAILED(wic.factory->CreateFormatConverter(&wic.converter))) {
+    return false;
+  }
+  if (FAILED(
+        wic.converter->Initialize(
+          wic.frame,
+          GUID_WICPixelFormat32bppBGRA,
+          WICBitmapDitherTypeNone,
+          nullptr,
+          0.0,
+          WICBitmapPaletteTypeCustom))) {
+    return false;
+  }
+  UINT image_w = 0;
+  UINT image_h = 0;
+  if (FAILED(wic.converter->GetSize(&image_w, &image_h))) return false;
+  if ((image_w == 0) || (image_h == 0)) return false;
+  pixels->resize(static_cast<size_t>(image_w) * image_h);
+  if (FAILED(
+        wic.converter->CopyPixels(
+          nullptr,
+          image_w * 4,
+          image_w * image_h * 4,
+          reinterpret_cast<BYTE*>(&(*pixels)[0])))) {
+    return false;
+  }
+  *w = static_cast<int>(image_w);
+  *h = static_cast<int>(image_h);
+  return true;
+}
+bool CreateTextureDataFromPixels(int w, int h, std::vector<uint32_t>* pixels,
+                                 TextureData* texture) {
+  assert(pixels);
+  assert(texture);
+  assert(pixels->size() == static_cast<size_t>(w) * h);
+  if (graphic_data.backend == SYS_GRAPHICBACKEND_SOFTWARE) {
+    // BGRA to RGBA, the memory order of the frame buffer.
+    for (size_t i = 0; i < pixels->size(); ++i) {
+      const uint32_t c = (*pixels)[i];
+      (*pixels)[i] =
+        (c & 0xff00ff00) | ((c >> 16) & 0xff) | ((c & 0xff) << 16);
+    }
+    texture->raster_texture.w = w;
+    texture->raster_texture.h = h;
+    texture->raster_texture.pixels.swap(*pixels);
+  } else {
+    D3D11_TEXTURE2D_DESC texture_desc;
+    memset(&texture_desc, 0, sizeof(texture_desc));
+    texture_desc.Width = w;
+    texture_desc.Height = h;
+    texture_desc.MipLevels = 1;
+    texture_desc.ArraySize = 1;
+    texture_desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+    texture_desc.SampleDesc.Count = 1;
+    texture_desc.Usage = D3D11_USAGE_IMMUTABLE;
+    texture_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    D3D11_SUBRESOURCE_DATA subresource_data;
+    memset(&subresource_data, 0, sizeof(subresource_data));
+    subresource_data.pSysMem = &(*pixels)[0];
+    subresource_data.SysMemPitch = w * 4;
+    ID3D11Texture2D* texture2d = nullptr;
+    if (FAILED(
+          graphic_data.device->CreateTexture2D(
+            &texture_desc,
+            &subresource_data,
+            &texture2d))) {
+      return false;
+    }
+    const HRESULT result = graphic_data.device->CreateShaderResourceView(
+        texture2d,
+        nullptr,
+        texture->shader_resource_view);
+    SYS_SAFE_RELEASE(texture2d);
+    if (FAILED(result)) return false;
+  }
+  texture->w = w;
+  texture->h = h;
+  texture->blend_factor[0] = 1.0f;
+  texture->blend_factor[1] = 1.0f;
+  texture->blend_factor[2] = 1.0f;
+  texture->blend_factor[3] = 1.0f;
+  return true;
+}
+bool CreateRasterTextureData(const TextureDesc& desc, TextureData* texture) {
+  assert(texture);
+  int w = 0;
+  int h = 0;
+  std::vector<uint32_t> pixels;
+  if (!DecodeImage(desc.resource_desc, &w, &h, &pixels)) return false;
+  return CreateTextureDataFromPixels(w, h, &pixels, texture);
+}
 bool CreateTextureData(const TextureDesc& desc, TextureData* texture) {
   assert(texture);
+  if (graphic_data.backend == SYS_GRAPHICBACKEND_SOFTWARE) {
+    return CreateRasterTextureData(desc, texture);
+  }
   const ResourceDesc resource_desc = desc.resource_desc;
   D3DX11_IMAGE_INFO image_info;
   D3DX11_IMAGE_LOAD_INFO load_info;
+  // Texture properties acquired.
   if (resource_desc.use_mem) {
-    return false;  // TODO(Mamoru): Implement memory source one.
+    // From memory
+    if (FAILED(
+          D3DX11GetImageInfoFromMemory(
+            resource_desc.mem_ptr,
+            resource_desc.mem_size,
+            nullptr,
+            &image_info,
+            nullptr))) {
+      return false;
+    }
   } else {
-    // Texture properties acquired.
+    // From file
     if (FAILED(
           D3DX11GetImageInfoFromFile(
             resource_desc.file_name.c_str(),
@@ -541,27 +876,42 @@ bool CreateTextureData(const TextureDesc& desc, TextureData* texture) {
             nullptr))) {
       return false;
     }
-    texture->w = image_info.Width;
-    texture->h = image_info.Height;
-    texture->blend_factor[0] = 1.0f;
-    texture->blend_factor[1] = 1.0f;
-    texture->blend_factor[2] = 1.0f;
-    texture->blend_factor[3] = 1.0f;
-    // Load resource
-    load_info.Width = texture->w;
-    load_info.Height = texture->h;
-    load_info.Depth = 0;
-    load_info.FirstMipLevel = 0;
-    load_info.MipLevels = D3DX11_DEFAULT,
-    load_info.Usage = D3D11_USAGE_IMMUTABLE;
-    load_info.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-    load_info.CpuAccessFlags = 0;
-    load_info.MiscFlags = 0;
-    load_info.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-    load_info.Filter = D3DX11_FILTER_NONE;
-    load_info.MipFilter = D3DX11_FILTER_NONE;
-    load_info.pSrcInfo = nullptr;
-    // ShaderResourceView is created.
+  }
+  texture->w = image_info.Width;
+  texture->h = image_info.Height;
+  texture->blend_factor[0] = 1.0f;
+  texture->blend_factor[1] = 1.0f;
+  texture->blend_factor[2] = 1.0f;
+  texture->blend_factor[3] = 1.0f;
+  // Load resource
+  load_info.Width = texture->w;
+  load_info.Height = texture->h;
+  load_info.Depth = 0;
+  load_info.FirstMipLevel = 0;
+  load_info.MipLevels = D3DX11_DEFAULT,
+  load_info.Usage = D3D11_USAGE_IMMUTABLE;
+  load_info.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+  load_info.CpuAccessFlags = 0;
+  load_info.MiscFlags = 0;
+  load_info.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+  load_info.Filter = D3DX11_FILTER_NONE;
+  load_info.MipFilter = D3DX11_FILTER_NONE;
+  load_info.pSrcInfo = nullptr;
+  // ShaderResourceView is created.
+  if (resource_desc.use_mem) {
+    // From memory, e.g., a pack entry, decoded without a copy.
+    if (FAILED(D3DX11CreateShaderResourceViewFromMemory(
+            graphic_data.device,
+            resource_desc.mem_ptr,
+            resource_desc.mem_size,
+            &load_info,
+            nullptr,
+            texture->shader_resource_view,
+            nullptr))) {
+      return false;
+    }
+  } else {
+    // From file
     if (FAILED(D3DX11CreateShaderResourceViewFromFile(
             graphic_data.device,
             resource_desc.file_name.c_str(),
@@ -598,104 +948,16 @@ bool CreateImageData(const ImageDesc& desc, TextureData* texture,
   if (h == 0) h = texture->h;  // Full texture height is used.
   image->w = static_cast<int>(w * desc.s);
   image->h = static_cast<int>(h * desc.s);
-  // Image polygon rectangle size in window set.
-  float e_x = static_cast<float>(1.0f / graphic_data.resolution.x * 2.0f);
-  float e_y = static_cast<float>(1.0f / graphic_data.resolution.y * 2.0f);
-  float a_x = 0.0f;
-  float a_y = 0.0f;
-  float b_x = static_cast<float>(desc.s * w * e_x);
-  float b_y = -static_cast<float>(desc.s * h * e_y);
-  float position[SYS_VERTEX_INPUT_NUM][3] = {
-    { a_x, a_y, 0.5f },
-    { b_x, a_y, 0.5f },
-    { a_x, b_y, 0.5f },
-    { b_x, b_y, 0.5f },
-  };
   // Coordinates from pixel to U-V.
-  e_x = static_cast<float>(1.0f / texture->w);
-  e_y = static_cast<float>(1.0f / texture->h);
-  a_x = static_cast<float>(desc.x * e_x);
-  a_y = static_cast<float>(desc.y * e_y);
-  b_x = static_cast<float>(a_x + w * e_x);
-  b_y = static_cast<float>(a_y + h * e_y);
-  float def_coord[SYS_VERTEX_INPUT_NUM][2] = {
-    { a_x, a_y },
-    { b_x, a_y },
-    { a_x, b_y },
-    { b_x, b_y },
-  };
-  // Coordinates are texture polygon.
-  float coord[SYS_VERTEX_INPUT_NUM][2] = {0};
-  switch (desc.image_mode) {
-    case SYS_IMAGEMODE_DEFAULT:
-      coord[0][0] = def_coord[0][0]; coord[0][1] = def_coord[0][1];
-      coord[1][0] = def_coord[1][0]; coord[1][1] = def_coord[1][1];
-      coord[2][0] = def_coord[2][0]; coord[2][1] = def_coord[2][1];
-      coord[3][0] = def_coord[3][0]; coord[3][1] = def_coord[3][1];
-      break;
-    case SYS_IMAGEMODE_HINVERT:
-      coord[0][0] = def_coord[1][0]; coord[0][1] = def_coord[1][1];
-      coord[1][0] = def_coord[0][0]; coord[1][1] = def_coord[0][1];
-      coord[2][0] = def_coord[3][0]; coord[2][1] = def_coord[3][1];
-      coord[3][0] = def_coord[2][0]; coord[3][1] = def_coord[2][1];
-      break;
-    case SYS_IMAGEMODE_VINVERT:
-      coord[0][0] = def_coord[2][0]; coord[0][1] = def_coord[2][1];
-      coord[1][0] = def_coord[3][0]; coord[1][1] = def_coord[3][1];
-      coord[2][0] = def_coord[0][0]; coord[2][1] = def_coord[0][1];
-      coord[3][0] = def_coord[1][0]; coord[3][1] = def_coord[1][1];
-      break;
-    case SYS_IMAGEMODE_ROT90:
-      coord[0][0] = def_coord[2][0]; coord[0][1] = def_coord[2][1];
-      coord[1][0] = def_coord[0][0]; coord[1][1] = def_coord[0][1];
-      coord[2][0] = def_coord[3][0]; coord[2][1] = def_coord[3][1];
-      coord[3][0] = def_coord[1][0]; coord[3][1] = def_coord[1][1];
-      break;
-    case SYS_IMAGEMODE_ROT180:
-      coord[0][0] = def_coord[3][0]; coord[0][1] = def_coord[3][1];
-      coord[1][0] = def_coord[2][0]; coord[1][1] = def_coord[2][1];
-      coord[2][0] = def_coord[1][0]; coord[2][1] = def_coord[1][1];
-      coord[3][0] = def_coord[0][0]; coord[3][1] = def_coord[0][1];
-      break;
-    case SYS_IMAGEMODE_ROT270:
-      coord[0][0] = def_coord[1][0]; coord[0][1] = def_coord[1][1];
-      coord[1][0] = def_coord[3][0]; coord[1][1] = def_coord[3][1];
-      coord[2][0] = def_coord[0][0]; coord[2][1] = def_coord[0][1];
-      coord[3][0] = def_coord[2][0]; coord[3][1] = def_coord[2][1];
-      break;
-    default:
-      break;
-  }
-  // Relations set.
-  VertexInputData vertices_data[SYS_VERTEX_INPUT_NUM];
-  for (int i = 0; i < SYS_VERTEX_INPUT_NUM; ++i) {
-    // SV_POSITION
-    vertices_data[i].position[0] = position[i][0];
-    vertices_data[i].position[1] = position[i][1];
-    vertices_data[i].position[2] = position[i][2];
-    // TEXCOORD0
-    vertices_data[i].texcoord[0] = coord[i][0];
-    vertices_data[i].texcoord[1] = coord[i][1];
-  }
-  // Vertex buffer is created.
-  D3D11_BUFFER_DESC buf_desc;
-  buf_desc.ByteWidth = sizeof(VertexInputData) * SYS_VERTEX_INPUT_NUM;
-  buf_desc.Usage = D3D11_USAGE_DEFAULT;
-  buf_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-  buf_desc.CPUAccessFlags = 0;
-  buf_desc.MiscFlags = 0;
-  buf_desc.StructureByteStride = sizeof(VertexInputData);
-  D3D11_SUBRESOURCE_DATA data;
-  data.pSysMem = vertices_data;
-  data.SysMemPitch = 0;
-  data.SysMemSlicePitch = 0;
-  if (FAILED(
-        graphic_data.device->CreateBuffer(
-          &buf_desc,
-          &data,
-          &image->buffer))) {
-    return false;
-  }
+  const float e_x = static_cast<float>(1.0f / texture->w);
+  const float e_y = static_cast<float>(1.0f / texture->h);
+  const float a_x = static_cast<float>(desc.x * e_x);
+  const float a_y = static_cast<float>(desc.y * e_y);
+  SetImageQuad(desc.image_mode, desc.s * w, desc.s * h,
+               graphic_data.resolution.x, graphic_data.resolution.y, a_x, a_y,
+               static_cast<float>(a_x + w * e_x),
+               static_cast<float>(a_y + h * e_y), image->vertices);
+  image->in_use = true;
   return true;
 }
 bool ReleaseImageData(ImageData* image) {
@@ -715,67 +977,24 @@ bool DrawImageData(TextureData* texture, ImageData* image,
   assert(image);
   assert(texture);
   if (graphic_data.on_power_save) return false;  // Power save state.
-  // Graphic pipeline is over written
-  UINT strids = sizeof(VertexInputData);
-  UINT offsets = 0;
-  graphic_data.device_context->IASetVertexBuffers(
-      0,
-      1,
-      &image->buffer,
-      &strids,
-      &offsets);
-  graphic_data.device_context->PSSetShaderResources(
-      0,
-      1,
-      texture->shader_resource_view);
-  graphic_data.device_context->OMSetBlendState(
-      graphic_data.blend_state,
-      texture->blend_factor,
-      0xffffffff);
-  // Vertex shader constant buffer overwritten
-  XMMATRIX world_matrix = XMMatrixIdentity();
+  // The quad is queued, it is drawn when the batch is flushed.
   float display_x =
       static_cast<float>(position.x / graphic_data.resolution.x * 2.0f - 1.0f);
   float display_y =
       static_cast<float>(-position.y / graphic_data.resolution.y * 2.0f + 1.0f);
-  XMMATRIX matrix = XMMatrixTranslation(display_x, display_y, 0.5f);
-  VSConstBufferData vs_buffer;
-  vs_buffer.world_matrix =
-    XMMatrixTranspose(XMMatrixMultiply(world_matrix, matrix));
-  graphic_data.device_context->UpdateSubresource(
-      graphic_data.vs_cbuffer,
-      0,
-      nullptr,
-      &vs_buffer,
-      0,
-      0);
-  graphic_data.device_context->VSSetConstantBuffers(
-      0,
-      1,
-      &graphic_data.vs_cbuffer);
-  // Pixel shader constant buffer overwritten
-  PSConstBufferData ps_buffer;
-  ps_buffer.src.x = ps_buffer.src.y = ps_buffer.src.z = 0.0;
-  ps_buffer.src.w = static_cast<float>(alpha / 255.0);
-  graphic_data.device_context->UpdateSubresource(
-      graphic_data.ps_cbuffer,
-      0,
-      nullptr,
-      &ps_buffer,
-      0,
-      0);
-  graphic_data.device_context->PSSetConstantBuffers(
-      0,
-      1,
-      &graphic_data.ps_cbuffer);
-  graphic_data.device_context->Draw(SYS_VERTEX_INPUT_NUM, 0);
-  return true;
+  // The software backend reads its own copy of the texture.
+  const void* batch_texture = texture;
+  if (graphic_data.backend == SYS_GRAPHICBACKEND_SOFTWARE) {
+    batch_texture = &texture->raster_texture;
+  }
+  return graphic_data.sprite_batch.AddQuad(
+      BatchKey(batch_texture, static_cast<float>(alpha / 255.0)),
+      image->vertices,
+      display_x,
+      display_y);
 }
-bool CreateFontData(const FontDesc& desc, FontData* font) {
+bool CreateFontImageData(const FontDesc& desc, FontData* font) {
   assert(font);
-  TextureDesc texture_desc;
-  texture_desc.resource_desc = desc.resource_desc;
-  if (!CreateTextureData(texture_desc, &font->font_texture)) return false;
   // Image created for font.
   int w = font->font_texture.w / SYS_FONT_COLUMN_NUM;
   int h = font->font_texture.h / SYS_FONT_ROW_NUM;
@@ -798,6 +1017,13 @@ bool CreateFontData(const FontDesc& desc, FontData* font) {
   }
   return true;
 }
+bool CreateFontData(const FontDesc& desc, FontData* font) {
+  assert(font);
+  TextureDesc texture_desc;
+  texture_desc.resource_desc = desc.resource_desc;
+  if (!CreateTextureData(texture_desc, &font->font_texture)) return false;
+  return CreateFontImageData(desc, font);
+}
 bool ReleaseFontData(FontData* font) {
   assert(font);
   font->Release();
@@ -879,6 +1105,70 @@ bool DrawTextData(FontData* font, const Vector2d& position,
   return true;
 }
 
+  //
+  // These are private structures related to graphic
+  //
+class ImageLoadRequest : public LoadRequest {  // Decoded on a worker.
+ public:
+  explicit ImageLoadRequest(const ResourceDesc& resource_desc) :
+      resource_desc_(resource_desc), w_(0), h_(0), pixels_() { }
+  bool Decode() {
+    // COM is initialized on each worker thread.
+    const HRESULT result = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    const bool decoded = DecodeImage(resource_desc_, &w_, &h_, &pixels_);
+    if (SUCCEEDED(result)) CoUninitialize();
+    return decoded;
+  }
+ protected:
+  ResourceDesc resource_desc_;
+  int w_;
+  int h_;
+  std::vector<uint32_t> pixels_;  // BGRA.
+};
+class TextureLoadRequest : public ImageLoadRequest {
+ public:
+  explicit TextureLoadRequest(const TextureDesc& desc) :
+      ImageLoadRequest(desc.resource_desc) { }
+  bool Finish() {
+    TextureData* texture = graphic_data.texture_buffer.Get(id);
+    if (texture == nullptr) return false;
+    texture->load_request = nullptr;
+    if (!CreateTextureDataFromPixels(w_, h_, &pixels_, texture)) return false;
+    texture->load_state = SYS_LOADSTATE_DONE;
+    return true;
+  }
+  void Fail() {
+    TextureData* texture = graphic_data.texture_buffer.Get(id);
+    if (texture == nullptr) return;
+    texture->Release();
+    texture->load_state = SYS_LOADSTATE_FAILED;
+  }
+};
+class FontLoadRequest : public ImageLoadRequest {
+ public:
+  explicit FontLoadRequest(const FontDesc& desc) :
+      ImageLoadRequest(desc.resource_desc), desc_(desc) { }
+  bool Finish() {
+    FontData* font = graphic_data.font_buffer.Get(id);
+    if (font == nullptr) return false;
+    font->load_request = nullptr;
+    if (!CreateTextureDataFromPixels(w_, h_, &pixels_, &font->font_texture)) {
+      return false;
+    }
+    if (!CreateFontImageData(desc_, font)) return false;
+    font->load_state = SYS_LOADSTATE_DONE;
+    return true;
+  }
+  void Fail() {
+    FontData* font = graphic_data.font_buffer.Get(id);
+    if (font == nullptr) return;
+    font->Release();
+    font->load_state = SYS_LOADSTATE_FAILED;
+  }
+ private:
+  FontDesc desc_;
+};
+
   //
   // These are public functions related to graphic
   //
@@ -889,8 +1179,39 @@ void SetResolution(int x, int y) {
 void StartWithFullscreen(bool fullscreen) {
   graphic_data.on_fullscreen_start = fullscreen;
 }
+void SetGraphicBackend(SYS_GRAPHICBACKEND backend) {
+  graphic_data.backend = backend;
+}
+bool GetFrameBuffer(const uint8_t** pixels, int* w, int* h) {
+  assert(pixels);
+  assert(w);
+  assert(h);
+  if (graphic_data.backend != SYS_GRAPHICBACKEND_SOFTWARE) return false;
+  *pixels = graphic_data.raster_batch_backend.pixels();
+  *w = graphic_data.raster_batch_backend.width();
+  *h = graphic_data.raster_batch_backend.height();
+  return (*pixels != nullptr);
+}
+bool GetDrawStats(DrawStats* stats) {
+  assert(stats);
+  const BatchStats& batch_stats =
+    graphic_data.sprite_batch.GetLastFrameStats();
+  stats->quad_num = batch_stats.quad_num;
+  stats->draw_num = batch_stats.draw_num;
+  stats->flush_num = batch_stats.flush_num;
+  stats->vertex_num = batch_stats.vertex_num;
+  stats->max_flush_vertex_num = batch_stats.max_flush_vertex_num;
+  return true;
+}
 bool FillScreen(const Color4b& color) {
   if (graphic_data.on_power_save) return true;
+  // Queued quads are drawn before the target is cleared.
+  if (!FlushGraphic()) return false;
+  if (graphic_data.backend == SYS_GRAPHICBACKEND_SOFTWARE) {
+    graphic_data.raster_batch_backend.Clear(color.x, color.y, color.z,
+                                            color.w);
+    return true;
+  }
   float f4[4] = {
     static_cast<float>(color.x / 255.0f),
     static_cast<float>(color.y / 255.0f),
@@ -903,174 +1224,212 @@ bool FillScreen(const Color4b& color) {
   return true;
 }
 bool CreateTexture(const TextureDesc& desc, int* texture_id) {
-  // 1. The id allocation is checked.
-  int id = *texture_id = graphic_data.texture_id_server.CreateId();
-  if (id == SYS_ID_SERVER_EXCEEDS_LIMIT) {
-    ErrorDialogBox(SYS_ERROR_TEXTURE_ID_EXCEEDS_LIMIT, id);
+  // 1. The id allocation is checked, stored textures may be moved.
+  if (graphic_data.texture_buffer.IsFull()) FlushBatchedTextures();
+  TextureData* texture = nullptr;
+  const int id = *texture_id = graphic_data.texture_buffer.Create(&texture);
+  if (id == SYS_SLOT_INVALID_ID) {
+    ErrorDialogBox(SYS_ERROR_TEXTURE_ID_EXCEEDS_LIMIT);
     return false;
   }
-  // 2. The buffer size is checked.
-  if (id >= static_cast<int>(graphic_data.texture_buffer.size())) {
-    sys::ErrorDialogBox(
-        SYS_ERROR_TOO_MANY_TEXTURE_ID,
-        graphic_data.texture_buffer.size());
+  // 2. The texture is created, the id is released if it fails.
+  if (!CreateTextureData(desc, texture)) {
+    texture->Release();
+    graphic_data.texture_buffer.Release(id);
+    return false;
   }
-  return CreateTextureData(desc, &graphic_data.texture_buffer[id]);
+  return true;
 }
-bool ReleaseTexture(int texture_id) {
-  // 1. The buffer size is checked.
-  if (texture_id >= static_cast<int>(graphic_data.texture_buffer.size())) {
-    ErrorDialogBox(SYS_ERROR_INVALID_TEXTURE_ID, texture_id);
+bool CreateTextureAsync(const TextureDesc& desc, int* texture_id,
+                        LoadCallback callback, void* data) {
+  // 1. The id allocation is checked, stored textures may be moved.
+  if (graphic_data.texture_buffer.IsFull()) FlushBatchedTextures();
+  TextureData* texture = nullptr;
+  const int id = *texture_id = graphic_data.texture_buffer.Create(&texture);
+  if (id == SYS_SLOT_INVALID_ID) {
+    ErrorDialogBox(SYS_ERROR_TEXTURE_ID_EXCEEDS_LIMIT);
     return false;
   }
-  // 2. Null check.
-  if (graphic_data.texture_buffer[texture_id].IsNull()) {
-    ErrorDialogBox(SYS_ERROR_NULL_TEXTURE_ID, texture_id);
+  // The texture is created in UpdateSystem after the image is decoded.
+  TextureLoadRequest* request = new TextureLoadRequest(desc);
+  request->id = id;
+  request->callback = callback;
+  request->callback_data = data;
+  texture->load_state = SYS_LOADSTATE_LOADING;
+  texture->load_request = request;
+  return load_data.load_queue.Submit(request);
+}
+bool CreateTextureAsync(const TextureDesc& desc, int* texture_id) {
+  return CreateTextureAsync(desc, texture_id, nullptr, nullptr);
+}
+SYS_LOADSTATE GetTextureLoadState(int texture_id) {
+  const TextureData* texture = graphic_data.texture_buffer.Get(texture_id);
+  if (texture == nullptr) return SYS_LOADSTATE_NONE;
+  if (texture->load_state != SYS_LOADSTATE_NONE) return texture->load_state;
+  return SYS_LOADSTATE_DONE;  // Created synchronously.
+}
+bool ReleaseTexture(int texture_id) {
+  // 1. The id is checked, the one in loading or failed is released too.
+  TextureData* texture = graphic_data.texture_buffer.Get(texture_id);
+  if (texture == nullptr) {
+    ErrorDialogBox(SYS_ERROR_INVALID_TEXTURE_ID, texture_id);
     return false;
   }
-  graphic_data.texture_id_server.ReleaseId(texture_id);
-  return ReleaseTextureData(&graphic_data.texture_buffer[texture_id]);
+  // Queued quads may refer to the texture, and stored textures are moved.
+  FlushBatchedTextures();
+  ReleaseTextureData(texture);
+  graphic_data.texture_buffer.Release(texture_id);
+  return true;
 }
 bool GetTextureSize(int texture_id, Vector2d* size) {
-  // 1. The buffer size is checked.
-  if (texture_id >= static_cast<int>(graphic_data.texture_buffer.size())) {
+  // 1. The id is checked.
+  TextureData* texture = graphic_data.texture_buffer.Get(texture_id);
+  if (texture == nullptr) {
     ErrorDialogBox(SYS_ERROR_INVALID_TEXTURE_ID, texture_id);
     return false;
   }
   // 2. Null check.
-  if (graphic_data.texture_buffer[texture_id].IsNull()) {
+  if (texture->IsNull()) {
     ErrorDialogBox(SYS_ERROR_NULL_TEXTURE_ID, texture_id);
     return false;
   }
-  return GetTextureSize(&graphic_data.texture_buffer[texture_id], size);
+  return GetTextureSize(texture, size);
 }
 bool CreateImage(const ImageDesc& desc, int* image_id) {
-  // 1. The id allocation is checked.
-  int id = *image_id = graphic_data.image_id_server.CreateId();
-  if (id == SYS_ID_SERVER_EXCEEDS_LIMIT) {
-    ErrorDialogBox(SYS_ERROR_IMAGE_ID_EXCEEDS_LIMIT, id);
+  // 1. Null check for texture id.
+  TextureData* texture = graphic_data.texture_buffer.Get(desc.texture_id);
+  if ((texture == nullptr) || texture->IsNull()) {
+    ErrorDialogBox(SYS_ERROR_NULL_TEXTURE_ID, desc.texture_id);
     return false;
   }
-  // 2. The buffer size is checked.
-  if (id >= static_cast<int>(graphic_data.image_buffer.size())) {
-    sys::ErrorDialogBox(
-        SYS_ERROR_TOO_MANY_IMAGE_ID,
-        graphic_data.image_buffer.size());
-  }
-  // 3. Null check for texture id.
-  if (graphic_data.texture_buffer[desc.texture_id].IsNull()) {
-    ErrorDialogBox(SYS_ERROR_NULL_TEXTURE_ID, desc.texture_id);
+  // 2. The id allocation is checked.
+  ImageData* image = nullptr;
+  const int id = *image_id = graphic_data.image_buffer.Create(&image);
+  if (id == SYS_SLOT_INVALID_ID) {
+    ErrorDialogBox(SYS_ERROR_IMAGE_ID_EXCEEDS_LIMIT);
     return false;
   }
-  return CreateImageData(desc, &graphic_data.texture_buffer[desc.texture_id],
-                         &graphic_data.image_buffer[id]);
+  return CreateImageData(desc, texture, image);
 }
 bool ReleaseImage(int image_id) {
-  // 1. The buffer size is checked.
-  if (image_id >= static_cast<int>(graphic_data.image_buffer.size())) {
+  // 1. The id is checked.
+  ImageData* image = graphic_data.image_buffer.Get(image_id);
+  if (image == nullptr) {
     ErrorDialogBox(SYS_ERROR_INVALID_IMAGE_ID, image_id);
     return false;
   }
-  // 2. Null check.
-  if (graphic_data.image_buffer[image_id].IsNull()) {
-    ErrorDialogBox(SYS_ERROR_NULL_IMAGE_ID, image_id);
-    return false;
-  }
-  graphic_data.image_id_server.ReleaseId(image_id);
-  return ReleaseImageData(&graphic_data.image_buffer[image_id]);
+  ReleaseImageData(image);
+  graphic_data.image_buffer.Release(image_id);
+  return true;
 }
 bool GetImageSize(int image_id, Vector2d* size) {
-  // 1. The buffer size is checked.
-  if (image_id >= static_cast<int>(graphic_data.image_buffer.size())) {
+  // 1. The id is checked.
+  ImageData* image = graphic_data.image_buffer.Get(image_id);
+  if (image == nullptr) {
     ErrorDialogBox(SYS_ERROR_INVALID_IMAGE_ID, image_id);
     return false;
   }
-  // 2. Null check.
-  if (graphic_data.image_buffer[image_id].IsNull()) {
-    ErrorDialogBox(SYS_ERROR_NULL_IMAGE_ID, image_id);
-    return false;
-  }
-  return GetImageSize(&graphic_data.image_buffer[image_id], size);
+  return GetImageSize(image, size);
 }
 bool DrawImage(int image_id, const Vector2d& position, int alpha) {
-  // 1. The buffer size is checked.
-  if (image_id >= static_cast<int>(graphic_data.image_buffer.size())) {
+  // 1. The id is checked.
+  ImageData* image = graphic_data.image_buffer.Get(image_id);
+  if (image == nullptr) {
     ErrorDialogBox(SYS_ERROR_INVALID_IMAGE_ID, image_id);
     return false;
   }
-  // 2. Null check.
-  if (graphic_data.image_buffer[image_id].IsNull()) {
-    ErrorDialogBox(SYS_ERROR_NULL_IMAGE_ID, image_id);
-    return false;
-  }
-  // 3. Null check for texture.
-  const int texture_id = graphic_data.image_buffer[image_id].texture_id;
-  TextureData* texture = &graphic_data.texture_buffer[texture_id];
-  if (texture->IsNull()) {
-    ErrorDialogBox(SYS_ERROR_NULL_TEXTURE_ID, texture_id);
+  // 2. Null check for texture, it may be released before the image.
+  TextureData* texture = graphic_data.texture_buffer.Get(image->texture_id);
+  if ((texture == nullptr) || texture->IsNull()) {
+    ErrorDialogBox(SYS_ERROR_NULL_TEXTURE_ID, image->texture_id);
     return false;
   }
-  return DrawImageData(texture, &graphic_data.image_buffer[image_id], position,
-                       alpha);
+  return DrawImageData(texture, image, position, alpha);
 }
 bool DrawImage(int image_id, const Vector2d& position) {
   return  DrawImage(image_id, position, 255);
 }
 bool CreateFont(const FontDesc& desc, int* font_id) {
-  // 1. The id allocation is checked.
-  int id = *font_id = graphic_data.font_id_server.CreateId();
-  if (id == SYS_ID_SERVER_EXCEEDS_LIMIT) {
-    ErrorDialogBox(SYS_ERROR_FONT_ID_EXCEEDS_LIMIT, id);
+  // 1. The id allocation is checked, stored fonts may be moved.
+  if (graphic_data.font_buffer.IsFull()) FlushBatchedTextures();
+  FontData* font = nullptr;
+  const int id = *font_id = graphic_data.font_buffer.Create(&font);
+  if (id == SYS_SLOT_INVALID_ID) {
+    ErrorDialogBox(SYS_ERROR_FONT_ID_EXCEEDS_LIMIT);
     return false;
   }
-  // 2. The buffer size is checked.
-  if (id >= static_cast<int>(graphic_data.font_buffer.size())) {
-    sys::ErrorDialogBox(
-        SYS_ERROR_TOO_MANY_FONT_ID,
-        graphic_data.font_buffer.size());
+  // 2. The font is created, the id is released if it fails.
+  if (!CreateFontData(desc, font)) {
+    font->Release();
+    graphic_data.font_buffer.Release(id);
+    return false;
   }
-  // 3. Duplicate check.
-  if (!graphic_data.font_buffer[id].IsNull()) {
-    ErrorDialogBox(SYS_ERROR_DUPLICATE_FONT_ID, id);
+  return true;
+}
+bool CreateFontAsync(const FontDesc& desc, int* font_id,
+                     LoadCallback callback, void* data) {
+  // 1. The id allocation is checked, stored fonts may be moved.
+  if (graphic_data.font_buffer.IsFull()) FlushBatchedTextures();
+  FontData* font = nullptr;
+  const int id = *font_id = graphic_data.font_buffer.Create(&font);
+  if (id == SYS_SLOT_INVALID_ID) {
+    ErrorDialogBox(SYS_ERROR_FONT_ID_EXCEEDS_LIMIT);
     return false;
   }
-  return CreateFontData(desc, &graphic_data.font_buffer[id]);
+  // The font is created in UpdateSystem after the image is decoded.
+  FontLoadRequest* request = new FontLoadRequest(desc);
+  request->id = id;
+  request->callback = callback;
+  request->callback_data = data;
+  font->load_state = SYS_LOADSTATE_LOADING;
+  font->load_request = request;
+  return load_data.load_queue.Submit(request);
+}
+bool CreateFontAsync(const FontDesc& desc, int* font_id) {
+  return CreateFontAsync(desc, font_id, nullptr, nullptr);
+}
+SYS_LOADSTATE GetFontLoadState(int font_id) {
+  const FontData* font = graphic_data.font_buffer.Get(font_id);
+  if (font == nullptr) return SYS_LOADSTATE_NONE;
+  if (font->load_state != SYS_LOADSTATE_NONE) return font->load_state;
+  return SYS_LOADSTATE_DONE;  // Created synchronously.
 }
 bool ReleaseFont(int font_id) {
-  // 1. The buffer size is checked.
-  if (font_id >= static_cast<int>(graphic_data.font_buffer.size())) {
+  // 1. The id is checked, the one in loading or failed is released too.
+  FontData* font = graphic_data.font_buffer.Get(font_id);
+  if (font == nullptr) {
     ErrorDialogBox(SYS_ERROR_INVALID_FONT_ID, font_id);
     return false;
   }
-  // 2. Null check.
-  if (graphic_data.font_buffer[font_id].IsNull()) {
-    ErrorDialogBox(SYS_ERROR_NULL_FONT_ID, font_id);
-    return false;
-  }
-  graphic_data.font_id_server.ReleaseId(font_id);
-  return ReleaseFontData(&graphic_data.font_buffer[font_id]);
+  // Queued quads may refer to the texture, and stored fonts are moved.
+  FlushBatchedTextures();
+  ReleaseFontData(font);
+  graphic_data.font_buffer.Release(font_id);
+  return true;
 }
 bool GetFontSize(int font_id, Vector2d* size) {
-  // 1. The buffer size is checked.
-  if (font_id >= static_cast<int>(graphic_data.font_buffer.size())) {
+  // 1. The id is checked.
+  FontData* font = graphic_data.font_buffer.Get(font_id);
+  if (font == nullptr) {
     ErrorDialogBox(SYS_ERROR_INVALID_FONT_ID, font_id);
     return false;
   }
   // 2. Null check.
-  if (graphic_data.font_buffer[font_id].IsNull()) {
+  if (font->IsNull()) {
     ErrorDialogBox(SYS_ERROR_NULL_FONT_ID, font_id);
     return false;
   }
-  return GetFontSize(&graphic_data.font_buffer[font_id], size);
+  return GetFontSize(font, size);
 }
 bool GetTextSize(int font_id, Vector2d* size, const wchar_t* format, ...) {
-  // 1. The buffer size is checked.
-  if (font_id >= static_cast<int>(graphic_data.font_buffer.size())) {
+  // 1. The id is checked.
+  FontData* font = graphic_data.font_buffer.Get(font_id);
+  if (font == nullptr) {
     ErrorDialogBox(SYS_ERROR_INVALID_FONT_ID, font_id);
     return false;
   }
   // 2. Null check.
-  if (graphic_data.font_buffer[font_id].IsNull()) {
+  if (font->IsNull()) {
     ErrorDialogBox(SYS_ERROR_NULL_FONT_ID, font_id);
     return false;
   }
@@ -1078,17 +1437,18 @@ bool GetTextSize(int font_id, Vector2d* size, const wchar_t* format, ...) {
   va_list args;
   va_start(args, format);
   vswprintf_s(buffer, 256, format, args);
-  return GetTextSize(&graphic_data.font_buffer[font_id], size, buffer);
+  return GetTextSize(font, size, buffer);
 }
 bool DrawText(int font_id, const Vector2d& position, int alpha,
               SYS_FONTMODE font_mode, const wchar_t* format, ...) {
-  // 1. The buffer size is checked.
-  if (font_id >= static_cast<int>(graphic_data.font_buffer.size())) {
+  // 1. The id is checked.
+  FontData* font = graphic_data.font_buffer.Get(font_id);
+  if (font == nullptr) {
     ErrorDialogBox(SYS_ERROR_INVALID_FONT_ID, font_id);
     return false;
   }
   // 2. Null check.
-  if (graphic_data.font_buffer[font_id].IsNull()) {
+  if (font->IsNull()) {
     ErrorDialogBox(SYS_ERROR_NULL_FONT_ID, font_id);
     return false;
   }
@@ -1096,8 +1456,7 @@ bool DrawText(int font_id, const Vector2d& position, int alpha,
   va_list args;
   va_start(args, format);
   vswprintf_s(buffer, 256, format, args);
-  return DrawTextData(&graphic_data.font_buffer[font_id], position, alpha,
-                      font_mode, buffer);
+  return DrawTextData(font, position, alpha, font_mode, buffer);
 }
 bool DrawText(int font_id, const Vector2d& position, SYS_FONTMODE font_mode,
               const wchar_t* format, ...) {
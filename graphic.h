@@ -6,12 +6,15 @@
 #ifndef GRAPHIC_H_
 #define GRAPHIC_H_
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <wchar.h>
 #include <windows.h>
 #include <Vecmath.h>
 #include <string>
+#include "./batch.h"
 #include "./common.h"
+#include "./load.h"
   //
   // These are public macros related to graphic
   //
@@ -35,13 +38,9 @@
   //
   // These are public enumerations and constants related to graphic
   //
-enum SYS_IMAGEMODE {
-  SYS_IMAGEMODE_DEFAULT,
-  SYS_IMAGEMODE_HINVERT,
-  SYS_IMAGEMODE_VINVERT,
-  SYS_IMAGEMODE_ROT90,
-  SYS_IMAGEMODE_ROT180,
-  SYS_IMAGEMODE_ROT270,
+enum SYS_GRAPHICBACKEND {
+  SYS_GRAPHICBACKEND_DIRECT3D,
+  SYS_GRAPHICBACKEND_SOFTWARE,  // Rendered to a frame buffer in memory.
 };
 enum SYS_FONTMODE {
   SYS_FONTMODE_TOP_LEFT,
@@ -79,14 +78,30 @@ struct FontDesc {
   SYS_IMAGEMODE image_mode;
   FontDesc();
 };
+struct DrawStats {  // Counted in the last frame.
+  int quad_num;
+  int draw_num;
+  int flush_num;
+  int vertex_num;
+  int max_flush_vertex_num;
+  DrawStats();
+};
 
   //
   // These are public functions related to graphic
   //
 void SetResolution(int x, int y);
 void StartWithFullscreen(bool fullscreen);
+void SetGraphicBackend(SYS_GRAPHICBACKEND backend);
+bool GetFrameBuffer(const uint8_t** pixels, int* w, int* h);
+bool GetDrawStats(DrawStats* stats);
 bool FillScreen(const Color4b& color);
 bool CreateTexture(const TextureDesc& desc, int* texture_id);
+bool CreateTextureAsync(const TextureDesc& desc, int* texture_id,
+                        LoadCallback callback, void* data);
+bool CreateTextureAsync(const TextureDesc& desc,
+                        int* texture_id);  // Overloaded.
+SYS_LOADSTATE GetTextureLoadState(int texture_id);
 bool ReleaseTexture(int texture_id);
 bool GetTextureSize(int texture_id, Vector2d* size);
 bool CreateImage(const ImageDesc& desc, int* image_id);
@@ -95,6 +110,10 @@ bool GetImageSize(int image_id, Vector2d* size);
 bool DrawImage(int image_id, const Vector2d& position, int alpha);
 bool DrawImage(int image_id, const Vector2d& position);  // Overloaded.
 bool CreateFont(const FontDesc& desc, int* font_id);
+bool CreateFontAsync(const FontDesc& desc, int* font_id,
+                     LoadCallback callback, void* data);
+bool CreateFontAsync(const FontDesc& desc, int* font_id);  // Overloaded.
+SYS_LOADSTATE GetFontLoadState(int font_id);
 bool ReleaseFont(int font_id);
 bool GetFontSize(int font_id, Vector2d* size);
 bool GetTextSize(int font_id, Vector2d* size, const wchar_t* format, ...);
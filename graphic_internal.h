@@ -8,11 +8,17 @@
 #include <xnamath.h>
 #include <d3d11.h>
 #include <d3dx11.h>
+#include <wincodec.h>
 #include <unordered_map>
 #include <vector>
+#include "./batch_internal.h"
 #include "./common.h"
 #include "./common_internal.h"
 #include "./graphic.h"
+#include "./load.h"
+#include "./load_internal.h"
+#include "./raster_internal.h"
+#include "./slot_map_internal.h"
 #include "shader/pshader1.h"  // Precompiler pixel shader
 #include "shader/vshader1.h"  // Precompiler vertex shader
   //
@@ -21,7 +27,6 @@
 #define SYS_REFRESH_RATE_NUMERATOR    (60)  // Fixed.
 #define SYS_REFRESH_RATE_DENOMINATOR  (1)  // Fixed.
 #define SYS_MAXIMUM_FRAME_LATENCY     (1)  // 1 or 2 or 3
-#define SYS_VERTEX_INPUT_NUM          (4)  // Fixed.
 #define SYS_FONT_COLUMN_NUM           (16)  // Fixed.
 #define SYS_FONT_ROW_NUM              (4)  // Fixed.
 #define SYS_TEXT_BUF_SIZE             (128)
@@ -40,15 +45,14 @@ struct VSConstBufferData {  // Vertex shader
 struct PSConstBufferData {  // Pixel shader
   XMFLOAT4 src;
 };
-struct VertexInputData {
-  float position[3];  // SV_POSITION
-  float texcoord[2];  // TEXCOORD0
-};
 struct TextureData {
   int w;
   int h;
   float blend_factor[4];
   ID3D11ShaderResourceView* shader_resource_view[1];
+  RasterTexture raster_texture;  // Software backend.
+  SYS_LOADSTATE load_state;
+  LoadRequest* load_request;  // Canceled when released.
   TextureData();
   void Release();
   bool IsNull();
@@ -57,7 +61,8 @@ struct ImageData {
   int w;
   int h;
   int texture_id;
-  ID3D11Buffer* buffer;
+  VertexInputData vertices[SYS_VERTEX_INPUT_NUM];  // Origin at top left.
+  bool in_use;
   ImageData();
   void Release();
   bool IsNull();
@@ -65,10 +70,22 @@ struct ImageData {
 struct FontData {
   TextureData font_texture;
   ImageData font_image[SYS_FONT_COLUMN_NUM * SYS_FONT_ROW_NUM];
+  SYS_LOADSTATE load_state;
+  LoadRequest* load_request;  // Canceled when released.
   FontData();
   void Release();
   bool IsNull();
 };
+class D3DBatchBackend : public BatchBackend {
+ public:
+  D3DBatchBackend();
+  bool Upload(const VertexInputData* vertices, int vertex_num);
+  bool Draw(const BatchKey& key, int first_vertex, int vertex_num);
+  void Reset();
+ private:
+  const void* bound_texture_;
+  float bound_alpha_;
+};
 struct GraphicData {
   ID3D11Device* device;
   ID3D11DeviceContext* device_context;
@@ -85,13 +102,15 @@ struct GraphicData {
   ID3D11SamplerState* sampler_state;
   ID3D11VertexShader* vertex_shader1;
   ID3D11PixelShader* pixel_shader1;
+  ID3D11Buffer* batch_buffer;
+  D3DBatchBackend d3d_batch_backend;
+  RasterBatchBackend raster_batch_backend;
+  SpriteBatch sprite_batch;
+  SYS_GRAPHICBACKEND backend;
   //
-  IdServer image_id_server;
-  IdServer texture_id_server;
-  IdServer font_id_server;
-  std::vector<TextureData> texture_buffer;
-  std::vector<ImageData> image_buffer;
-  std::vector<FontData> font_buffer;
+  SlotMap<TextureData> texture_buffer;
+  SlotMap<ImageData> image_buffer;
+  SlotMap<FontData> font_buffer;
   Vector2<int> resolution;
   bool on_fullscreen_start;
   bool on_power_save;
@@ -106,5 +125,6 @@ extern GraphicData graphic_data;
 bool InitGraphic();
 bool UpdateGraphic();
 void FinalizeGraphic();
+bool FlushGraphic();
 }  // namespace sys
 #endif  // GRAPHIC_INTERNAL_H_
@@ -0,0 +1,304 @@
+﻿  // @file job
+  // @brief Definitions of job related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 15:02:44
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include "./clock_internal.h"
+#include "./job.h"
+#include "./job_internal.h"
+namespace sys {
+  //
+  // These are private functions related to job
+  //
+namespace {
+thread_local int worker_index = -1;  // -1 for threads that are not workers.
+thread_local const JobSystem* worker_owner = nullptr;
+}  // namespace
+
+  //
+  // These are internal structures related to job
+  //
+JobData job_data;
+JobData::JobData() : job_system(), worker_num(SYS_JOB_WORKER_AUTO) { }
+JobDeque::JobDeque() : top_(0), bottom_(0) { }
+bool JobDeque::Push(const Job& job) {
+  const int64_t b = bottom_.load(std::memory_order_relaxed);
+  const int64_t t = top_.load(std::memory_order_acquire);
+  if (b - t >= SYS_JOB_DEQUE_SIZE) return false;  // Full.
+  jobs_[b & (SYS_JOB_DEQUE_SIZE - 1)] = job;
+  std::atomic_thread_fence(std::memory_order_release);
+  bottom_.store(b + 1, std::memory_order_relaxed);
+  return true;
+}
+bool JobDeque::Pop(Job* job) {
+  assert(job);
+  const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+  bottom_.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = top_.load(std::memory_order_relaxed);
+  if (t > b) {
+    // Empty.
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return false;
+  }
+  *job = jobs_[b & (SYS_JOB_DEQUE_SIZE - 1)];
+  if (t < b) return true;
+  // The last job, it may be stolen at the same time.
+  const bool result = top_.compare_exchange_strong(
+      t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+  bottom_.store(b + 1, std::memory_order_relaxed);
+  return result;
+}
+bool JobDeque::Steal(Job* job) {
+  assert(job);
+  int64_t t = top_.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  const int64_t b = bottom_.load(std::memory_order_acquire);
+  if (t >= b) return false;
+  *job = jobs_[t & (SYS_JOB_DEQUE_SIZE - 1)];
+  return top_.compare_exchange_strong(
+      t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+JobSystem::JobSystem() : worker_num_(0), deques_(), threads_(),
+    shared_mutex_(), shared_jobs_(), queued_num_(0), sleeping_num_(0),
+    quit_(false), sleep_mutex_(), sleep_cv_() { }
+JobSystem::~JobSystem() {
+  Stop();
+}
+bool JobSystem::Start(int worker_num) {
+  assert(worker_num_ == 0);
+  if (worker_num <= 0) {
+    worker_num = static_cast<int>(std::thread::hardware_concurrency());
+    if (worker_num <= 0) worker_num = 1;
+  }
+  worker_num_ = worker_num;
+  deques_.reset(new JobDeque[worker_num]);
+  quit_.store(false);
+  // The calling thread is the worker 0.
+  worker_index = 0;
+  worker_owner = this;
+  for (int i = 1; i < worker_num; ++i) {
+    threads_.push_back(std::thread(&JobSystem::WorkerProc, this, i));
+  }
+  return true;
+}
+void JobSystem::Stop() {
+  if (worker_num_ == 0) return;
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    quit_.store(true);
+  }
+  sleep_cv_.notify_all();
+  for (auto& thread : threads_) thread.join();
+  threads_.clear();
+  // The jobs left are run here, so no counter waits forever.
+  Job job;
+  while (FindJob(0, &job)) Execute(job);
+  if (worker_owner == this) {
+    worker_index = -1;
+    worker_owner = nullptr;
+  }
+  deques_.reset();
+  worker_num_ = 0;
+}
+bool JobSystem::Run(const JobDesc* jobs, int num, JobCounter* counter) {
+  assert(jobs);
+  assert(num >= 0);
+  if (worker_num_ == 0) return false;
+  if (counter) counter->value_.fetch_add(num);
+  for (int i = 0; i < num; ++i) {
+    assert(jobs[i].function);
+    Job job = {jobs[i].function, jobs[i].data, counter};
+    Push(job);
+  }
+  return true;
+}
+bool JobSystem::RunAfter(JobCounter* dependency, const JobDesc* jobs, int num,
+                         JobCounter* counter) {
+  assert(dependency);
+  assert(jobs);
+  assert(num >= 0);
+  if (worker_num_ == 0) return false;
+  // The counter is increased now, so waiting for it waits for the pending
+  // jobs too.
+  if (counter) counter->value_.fetch_add(num);
+  {
+    std::lock_guard<std::mutex> lock(dependency->pending_mutex_);
+    if (dependency->value_.load() != 0) {
+      JobCounter::PendingJobs pending;
+      pending.jobs.assign(jobs, jobs + num);
+      pending.counter = counter;
+      dependency->pending_.push_back(pending);
+      return true;
+    }
+  }
+  for (int i = 0; i < num; ++i) {
+    assert(jobs[i].function);
+    Job job = {jobs[i].function, jobs[i].data, counter};
+    Push(job);
+  }
+  return true;
+}
+void JobSystem::Wait(JobCounter* counter) {
+  assert(counter);
+  const int worker = GetWorkerIndex();
+  int spin = 0;
+  while (counter->value_.load() != 0) {
+    // Other jobs are run while waiting, so the waiting thread helps.
+    Job job;
+    if (FindJob(worker, &job)) {
+      Execute(job);
+      spin = 0;
+    } else if (++spin < SYS_JOB_SPIN_NUM) {
+      RelaxCPU();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+bool JobSystem::RunOne() {
+  Job job;
+  if (!FindJob(GetWorkerIndex(), &job)) return false;
+  Execute(job);
+  return true;
+}
+void JobSystem::Push(const Job& job) {
+  const int worker = GetWorkerIndex();
+  if (worker >= 0) {
+    if (!deques_[worker].Push(job)) {
+      // The deque is full, the job is run now.
+      Execute(job);
+      return;
+    }
+  } else {
+    std::lock_guard<std::mutex> lock(shared_mutex_);
+    shared_jobs_.push_back(job);
+  }
+  queued_num_.fetch_add(1);
+  if (sleeping_num_.load() > 0) {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    sleep_cv_.notify_one();
+  }
+}
+bool JobSystem::FindJob(int worker, Job* job) {
+  assert(job);
+  if (queued_num_.load() <= 0) return false;
+  if ((worker >= 0) && deques_[worker].Pop(job)) {
+    queued_num_.fetch_sub(1);
+    return true;
+  }
+  {
+    std::lock_guard<std::mutex> lock(shared_mutex_);
+    if (!shared_jobs_.empty()) {
+      *job = shared_jobs_.front();
+      shared_jobs_.pop_front();
+      queued_num_.fetch_sub(1);
+      return true;
+    }
+  }
+  // Other workers are visited from the next one.
+  const int start = (worker >= 0) ? worker : 0;
+  for (int i = 1; i <= worker_num_; ++i) {
+    const int victim = (start + i) % worker_num_;
+    if (victim == worker) continue;
+    if (deques_[victim].Steal(job)) {
+      queued_num_.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+void JobSystem::Execute(const Job& job) {
+  job.function(job.data);
+  if (job.counter) Finish(job.counter);
+}
+void JobSystem::Finish(JobCounter* counter) {
+  assert(counter);
+  if (counter->value_.fetch_sub(1) != 1) return;
+  // The counter reached zero, the jobs waiting for it are run.
+  std::vector<JobCounter::PendingJobs> pending;
+  {
+    std::lock_guard<std::mutex> lock(counter->pending_mutex_);
+    pending.swap(counter->pending_);
+  }
+  for (auto& p : pending) {
+    for (auto& desc : p.jobs) {
+      Job job = {desc.function, desc.data, p.counter};
+      Push(job);
+    }
+  }
+}
+void JobSystem::WorkerProc(int worker) {
+  worker_index = worker;
+  worker_owner = this;
+  int spin = 0;
+  while (!quit_.load()) {
+    Job job;
+    if (FindJob(worker, &job)) {
+      Execute(job);
+      spin = 0;
+      continue;
+    }
+    if (++spin < SYS_JOB_SPIN_NUM) {
+      RelaxCPU();
+      continue;
+    }
+    // No job for a while, the worker sleeps until a job is pushed.
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleeping_num_.fetch_add(1);
+    sleep_cv_.wait(lock, [this] {
+      return quit_.load() || (queued_num_.load() > 0);
+    });
+    sleeping_num_.fetch_sub(1);
+    spin = 0;
+  }
+}
+int JobSystem::GetWorkerIndex() const {
+  return (worker_owner == this) ? worker_index : -1;
+}
+
+  //
+  // These are public structures related to job
+  //
+JobDesc::JobDesc() : function(nullptr), data(nullptr) { }
+JobDesc::JobDesc(JobFunction function, void* data) : function(function),
+    data(data) { }
+JobCounter::JobCounter() : value_(0), pending_mutex_(), pending_() { }
+int JobCounter::GetValue() const {
+  return value_.load();
+}
+bool JobCounter::IsDone() const {
+  return value_.load() == 0;
+}
+
+  //
+  // These are internal functions related to job
+  //
+bool InitJob() {
+  return job_data.job_system.Start(job_data.worker_num);
+}
+void FinalizeJob() {
+  job_data.job_system.Stop();
+}
+
+  //
+  // These are public functions related to job
+  //
+void SetJobWorkerNum(int worker_num) {
+  job_data.worker_num = worker_num;
+}
+int GetJobWorkerNum() {
+  return job_data.job_system.GetWorkerNum();
+}
+bool RunJobs(const JobDesc* jobs, int num, JobCounter* counter) {
+  return job_data.job_system.Run(jobs, num, counter);
+}
+bool RunJobsAfter(JobCounter* dependency, const JobDesc* jobs, int num,
+                  JobCounter* counter) {
+  return job_data.job_system.RunAfter(dependency, jobs, num, counter);
+}
+void WaitJobs(JobCounter* counter) {
+  job_data.job_system.Wait(counter);
+}
+}  // namespace sys
@@ -0,0 +1,62 @@
+﻿  // @file job
+  // @brief Declaration of job related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 15:02:44
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef JOB_H_
+#define JOB_H_
+#include <atomic>
+#include <mutex>
+#include <vector>
+  //
+  // These are public macros related to job
+  //
+#define SYS_JOB_WORKER_AUTO  (-1)  // One worker for each core.
+
+  //
+  // These are public enumerations and constants related to job
+  //
+
+namespace sys {
+  //
+  // These are public structures related to job
+  //
+typedef void (*JobFunction)(void* data);
+struct JobDesc {
+  JobFunction function;
+  void* data;
+  JobDesc();
+  JobDesc(JobFunction function, void* data);
+};
+  // A counter is increased by the number of jobs run with it, and it is
+  // decreased when each of them finishes. Jobs can be run after a counter
+  // reaches zero.
+class JobCounter {
+ public:
+  JobCounter();
+  int GetValue() const;
+  bool IsDone() const;
+ private:
+  friend class JobSystem;
+  struct PendingJobs {
+    std::vector<JobDesc> jobs;
+    JobCounter* counter;
+  };
+  JobCounter(const JobCounter&);
+  JobCounter& operator=(const JobCounter&);
+  std::atomic<int> value_;
+  std::mutex pending_mutex_;
+  std::vector<PendingJobs> pending_;  // Run when the value reaches zero.
+};
+
+  //
+  // These are public functions related to job
+  //
+void SetJobWorkerNum(int worker_num);  // Before InitSystem.
+int GetJobWorkerNum();
+bool RunJobs(const JobDesc* jobs, int num, JobCounter* counter);
+bool RunJobsAfter(JobCounter* dependency, const JobDesc* jobs, int num,
+                  JobCounter* counter);
+void WaitJobs(JobCounter* counter);
+}  // namespace sys
+#endif  // JOB_H_
@@ -0,0 +1,97 @@
+﻿  // @file job_internal.h
+  // @brief Declaration of job related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 15:02:44
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef JOB_INTERNAL_H_
+#define JOB_INTERNAL_H_
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "./job.h"
+  //
+  // These are internal macros related to job
+  //
+#define SYS_JOB_DEQUE_SIZE   (4096)  // Power of 2.
+#define SYS_JOB_SPIN_NUM     (1024)  // Tries before a worker sleeps.
+
+  //
+  // These are internal enumerations and constants related to job
+  //
+
+namespace sys {
+  //
+  // These are internal structures related to job
+  //
+struct Job {
+  JobFunction function;
+  void* data;
+  JobCounter* counter;  // Decreased when the job finishes.
+};
+  // Chase-Lev deque of a fixed size. The owner pushes and pops at the
+  // bottom, and other workers steal from the top.
+class JobDeque {
+ public:
+  JobDeque();
+  bool Push(const Job& job);  // Owner only.
+  bool Pop(Job* job);  // Owner only.
+  bool Steal(Job* job);
+ private:
+  std::atomic<int64_t> top_;
+  std::atomic<int64_t> bottom_;
+  Job jobs_[SYS_JOB_DEQUE_SIZE];
+};
+  // Thread 0 is the thread that starts the system, it runs jobs only when
+  // it waits or calls RunOne. Other threads run jobs until the system stops.
+  // Threads that are not workers push jobs to a shared queue.
+class JobSystem {
+ public:
+  JobSystem();
+  ~JobSystem();
+  bool Start(int worker_num);
+  void Stop();
+  int GetWorkerNum() const { return worker_num_; }
+  bool Run(const JobDesc* jobs, int num, JobCounter* counter);
+  bool RunAfter(JobCounter* dependency, const JobDesc* jobs, int num,
+                JobCounter* counter);
+  void Wait(JobCounter* counter);
+  bool RunOne();  // A job queued is run, false if there is none.
+ private:
+  JobSystem(const JobSystem&);
+  JobSystem& operator=(const JobSystem&);
+  void Push(const Job& job);
+  bool FindJob(int worker, Job* job);
+  void Execute(const Job& job);
+  void Finish(JobCounter* counter);
+  void WorkerProc(int worker);
+  int GetWorkerIndex() const;
+  int worker_num_;
+  std::unique_ptr<JobDeque[]> deques_;
+  std::vector<std::thread> threads_;
+  std::mutex shared_mutex_;
+  std::deque<Job> shared_jobs_;
+  std::atomic<int> queued_num_;
+  std::atomic<int> sleeping_num_;
+  std::atomic<bool> quit_;
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+};
+struct JobData {
+  JobSystem job_system;
+  int worker_num;
+  JobData();
+};
+extern JobData job_data;
+
+  //
+  // These are internal functions related to job
+  //
+bool InitJob();
+void FinalizeJob();
+}  // namespace sys
+#endif  // JOB_INTERNAL_H_
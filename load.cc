@@ -0,0 +1,173 @@
+﻿  // @file load
+  // @brief Definitions of load related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 16:10:28
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include "./clock_internal.h"
+#include "./load.h"
+#include "./load_internal.h"
+namespace sys {
+  //
+  // These are public structures related to load
+  //
+LoadStats::LoadStats() : loading_num(0), done_num(0), failed_num(0),
+    decode_ns(0), finish_ns(0) { }
+
+  //
+  // These are internal structures related to load
+  //
+LoadData load_data;
+LoadData::LoadData() : load_queue() { }
+LoadRequest::LoadRequest() : id(0), callback(nullptr),
+    callback_data(nullptr), decode_result_(false), canceled_(false) { }
+LoadRequest::~LoadRequest() { }
+LoadQueue::LoadQueue() : job_system_(nullptr), decode_counter_(),
+    decoded_mutex_(), decoded_(), budget_ns_(SYS_LOAD_BUDGET_NS),
+    loading_num_(0), done_num_(0), failed_num_(0), decode_ns_(0),
+    finish_ns_(0) { }
+LoadQueue::~LoadQueue() {
+  Clear();
+}
+void LoadQueue::SetJobSystem(JobSystem* job_system) {
+  job_system_ = job_system;
+}
+void LoadQueue::SetBudgetNanoSecond(int64_t budget_ns) {
+  budget_ns_ = (budget_ns > 0) ? budget_ns : 0;
+}
+bool LoadQueue::Submit(LoadRequest* request) {
+  assert(request);
+  ++loading_num_;
+  JobDesc job(DecodeProc, request);
+  if ((job_system_ == nullptr) ||
+      !job_system_->Run(&job, 1, &decode_counter_)) {
+    // No worker, it is decoded now and finished in the next update.
+    Decode(request);
+  }
+  return true;
+}
+void LoadQueue::Update() {
+  // The main thread is the worker 0, and it runs jobs only when it waits.
+  // Without other workers, a request is decoded here, so loading always
+  // progresses.
+  if ((job_system_ != nullptr) && (job_system_->GetWorkerNum() == 1)) {
+    DecodeNext();
+  }
+  // At least one request is finished.
+  const int64_t start_ns = GetClockNanoSecond();
+  while (FinishNext()) {
+    if (GetClockNanoSecond() - start_ns >= budget_ns_) break;
+  }
+}
+void LoadQueue::Wait() {
+  while (loading_num_ > 0) {
+    if (job_system_ != nullptr) job_system_->Wait(&decode_counter_);
+    while (FinishNext()) { }
+  }
+}
+void LoadQueue::Clear() {
+  if (job_system_ != nullptr) job_system_->Wait(&decode_counter_);
+  std::lock_guard<std::mutex> lock(decoded_mutex_);
+  for (auto request : decoded_) {
+    // The resource is left failed, the callback is not called.
+    if (!request->canceled_) request->Fail();
+    delete request;
+  }
+  decoded_.clear();
+  loading_num_ = 0;
+}
+LoadStats LoadQueue::GetStats() const {
+  LoadStats stats;
+  stats.loading_num = loading_num_;
+  stats.done_num = done_num_;
+  stats.failed_num = failed_num_;
+  stats.decode_ns = decode_ns_.load();
+  stats.finish_ns = finish_ns_;
+  return stats;
+}
+void LoadQueue::DecodeProc(void* data) {
+  assert(data);
+  LoadRequest* request = static_cast<LoadRequest*>(data);
+  load_data.load_queue.Decode(request);
+}
+void LoadQueue::Decode(LoadRequest* request) {
+  assert(request);
+  const int64_t start_ns = GetClockNanoSecond();
+  request->decode_result_ = request->Decode();
+  decode_ns_.fetch_add(GetClockNanoSecond() - start_ns);
+  std::lock_guard<std::mutex> lock(decoded_mutex_);
+  decoded_.push_back(request);
+}
+void LoadQueue::Finish(LoadRequest* request) {
+  assert(request);
+  if (!request->canceled_) {
+    const int64_t start_ns = GetClockNanoSecond();
+    const bool result = request->decode_result_ && request->Finish();
+    if (result) {
+      ++done_num_;
+    } else {
+      request->Fail();
+      ++failed_num_;
+    }
+    finish_ns_ += GetClockNanoSecond() - start_ns;
+    if (request->callback) {
+      request->callback(request->id, result, request->callback_data);
+    }
+  }
+  delete request;
+  --loading_num_;
+}
+bool LoadQueue::FinishNext() {
+  LoadRequest* request = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(decoded_mutex_);
+    if (decoded_.empty()) return false;
+    request = decoded_.front();
+    decoded_.pop_front();
+  }
+  Finish(request);
+  return true;
+}
+bool LoadQueue::DecodeNext() {
+  // Other jobs found before a decode job are run too.
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(decoded_mutex_);
+      if (!decoded_.empty()) return true;
+    }
+    if (decode_counter_.IsDone() || !job_system_->RunOne()) return false;
+  }
+}
+
+  //
+  // These are internal functions related to load
+  //
+bool InitLoad() {
+  load_data.load_queue.SetJobSystem(&job_data.job_system);
+  return true;
+}
+void FinalizeLoad() {
+  load_data.load_queue.Clear();
+  load_data.load_queue.SetJobSystem(nullptr);
+}
+bool UpdateLoad() {
+  load_data.load_queue.Update();
+  return true;
+}
+
+  //
+  // These are public functions related to load
+  //
+void SetLoadBudget(int64_t ns) {
+  load_data.load_queue.SetBudgetNanoSecond(ns);
+}
+bool WaitLoad() {
+  load_data.load_queue.Wait();
+  return true;
+}
+bool GetLoadStats(LoadStats* stats) {
+  assert(stats);
+  *stats = load_data.load_queue.GetStats();
+  return true;
+}
+}  // namespace sys
@@ -0,0 +1,45 @@
+﻿  // @file load
+  // @brief Declaration of load related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 16:10:28
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef LOAD_H_
+#define LOAD_H_
+#include <stdint.h>
+  //
+  // These are public macros related to load
+  //
+
+  //
+  // These are public enumerations and constants related to load
+  //
+enum SYS_LOADSTATE {
+  SYS_LOADSTATE_NONE,  // Not created, or created synchronously.
+  SYS_LOADSTATE_LOADING,
+  SYS_LOADSTATE_DONE,
+  SYS_LOADSTATE_FAILED,  // The id is kept until it is released.
+};
+
+namespace sys {
+  //
+  // These are public structures related to load
+  //
+  // Called in UpdateSystem or WaitLoad when the resource is ready or failed.
+typedef void (*LoadCallback)(int id, bool result, void* data);
+struct LoadStats {
+  int loading_num;
+  int done_num;
+  int failed_num;
+  int64_t decode_ns;  // Sum of the time on the workers.
+  int64_t finish_ns;  // Sum of the time on the main thread.
+  LoadStats();
+};
+
+  //
+  // These are public functions related to load
+  //
+void SetLoadBudget(int64_t ns);
+bool WaitLoad();
+bool GetLoadStats(LoadStats* stats);
+}  // namespace sys
+#endif  // LOAD_H_
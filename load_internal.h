@@ -0,0 +1,92 @@
+﻿  // @file load_internal.h
+  // @brief Declaration of load related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 16:10:28
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef LOAD_INTERNAL_H_
+#define LOAD_INTERNAL_H_
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include "./job.h"
+#include "./job_internal.h"
+#include "./load.h"
+  //
+  // These are internal macros related to load
+  //
+#define SYS_LOAD_BUDGET_NS  (2000000)  // Finish time in each frame.
+
+  //
+  // These are internal enumerations and constants related to load
+  //
+
+namespace sys {
+  //
+  // These are internal structures related to load
+  //
+  // Decode runs on a worker and reads files, Finish runs on the main thread
+  // and creates the device objects. Fail is called instead of Finish when
+  // either of them fails. Neither is called when the request is canceled.
+class LoadRequest {
+ public:
+  LoadRequest();
+  virtual ~LoadRequest();
+  virtual bool Decode() = 0;
+  virtual bool Finish() = 0;
+  virtual void Fail() { }
+  void Cancel() { canceled_ = true; }
+  int id;
+  LoadCallback callback;
+  void* callback_data;
+ private:
+  friend class LoadQueue;
+  LoadRequest(const LoadRequest&);
+  LoadRequest& operator=(const LoadRequest&);
+  bool decode_result_;
+  bool canceled_;  // Main thread only.
+};
+class LoadQueue {
+ public:
+  LoadQueue();
+  ~LoadQueue();
+  void SetJobSystem(JobSystem* job_system);
+  void SetBudgetNanoSecond(int64_t budget_ns);
+  bool Submit(LoadRequest* request);  // Owned by the queue.
+  void Update();
+  void Wait();
+  void Clear();  // Requests fail without the callbacks.
+  LoadStats GetStats() const;
+ private:
+  LoadQueue(const LoadQueue&);
+  LoadQueue& operator=(const LoadQueue&);
+  static void DecodeProc(void* data);
+  void Decode(LoadRequest* request);
+  void Finish(LoadRequest* request);
+  bool FinishNext();
+  bool DecodeNext();  // On this thread, false if nothing is decoded.
+  JobSystem* job_system_;
+  JobCounter decode_counter_;
+  std::mutex decoded_mutex_;
+  std::deque<LoadRequest*> decoded_;
+  int64_t budget_ns_;
+  int loading_num_;
+  int done_num_;
+  int failed_num_;
+  std::atomic<int64_t> decode_ns_;
+  int64_t finish_ns_;
+};
+struct LoadData {
+  LoadQueue load_queue;
+  LoadData();
+};
+extern LoadData load_data;
+
+  //
+  // These are internal functions related to load
+  //
+bool InitLoad();
+void FinalizeLoad();
+bool UpdateLoad();
+}  // namespace sys
+#endif  // LOAD_INTERNAL_H_
@@ -0,0 +1,1409 @@
+﻿  // @file mixer
+  // @brief Definitions of mixer related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 20:14:51
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <algorithm>
+#include "./clock_internal.h"
+#include "./file_internal.h"
+#include "./mixer_internal.h"
+#ifdef SYS_MIXER_USE_SSE2
+#include <emmintrin.h>
+#endif
+static_assert(SYS_MIXER_RETIRED_NUM >= SYS_MIXER_COMMAND_NUM +
+              SYS_MIXER_VOICE_NUM + SYS_MIXER_STREAM_NUM,
+              "Every voice and stream must fit in the retired ring.");
+namespace sys {
+  //
+  // These are private functions related to mixer
+  //
+namespace {
+const float kInt16Scale = 1.0f / 32768.0f;
+const int kVoiceIndexBits = 10;
+const uint32_t kVoiceGenerationMask = 0x1fffff;  // The id stays positive.
+void WriteUint32(uint8_t* p, uint32_t v) {
+  p[0] = static_cast<uint8_t>(v);
+  p[1] = static_cast<uint8_t>(v >> 8);
+  p[2] = static_cast<uint8_t>(v >> 16);
+  p[3] = static_cast<uint8_t>(v >> 24);
+}
+void WriteUint16(uint8_t* p, uint16_t v) {
+  p[0] = static_cast<uint8_t>(v);
+  p[1] = static_cast<uint8_t>(v >> 8);
+}
+inline float GetPcmSample(const PcmFormat& format, const uint8_t* p) {
+  if (format.is_float) {
+    float v = 0.0f;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+  if (format.bits == 8) return (p[0] - 128) * (1.0f / 128.0f);
+  if (format.bits == 24) {
+    // The sign is extended by the arithmetic shift.
+    const int32_t v = static_cast<int32_t>(
+        (p[0] << 8) | (p[1] << 16) | (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+    return v * (1.0f / 8388608.0f);
+  }
+  if (format.bits == 32) {
+    int32_t v = 0;
+    memcpy(&v, p, sizeof(v));
+    return v * (1.0f / 2147483648.0f);
+  }
+  int16_t v = 0;
+  memcpy(&v, p, sizeof(v));
+  return v * kInt16Scale;
+}
+  // Channels are mixed by the gains, left and right of each channel.
+void ReadPcmFrames(const PcmFormat& format, const float* gains,
+                   const void* data, int frame_num, int out_channel_num,
+                   float* dst) {
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  const int sample_bytes = format.bits / 8;
+  const int channel_num = format.channel_num;
+  for (int i = 0; i < frame_num; ++i) {
+    if (channel_num == out_channel_num) {
+      for (int c = 0; c < channel_num; ++c) {
+        dst[c] = GetPcmSample(format, src + c * sample_bytes);
+      }
+    } else {
+      float l = 0.0f;
+      float r = 0.0f;
+      for (int c = 0; c < channel_num; ++c) {
+        const float v = GetPcmSample(format, src + c * sample_bytes);
+        l += v * gains[c * 2];
+        r += v * gains[c * 2 + 1];
+      }
+      dst[0] = l;
+      dst[1] = r;
+    }
+    src += sample_bytes * channel_num;
+    dst += out_channel_num;
+  }
+}
+  // Frames from start to end of the source are resampled, and frame_num
+  // frames are added to dst at most. A loop from loop_start to the source
+  // end is circular, the frames before the loop start are the ones before
+  // the end, and the frames after an end are the ones from the loop start.
+  // Without a loop, loop_start is -1 and the frames around are silent.
+bool ResampleFrames(const std::vector<float>& src, int channel_num,
+                    int source_rate, int start, int end, int loop_start,
+                    int frame_num, SYS_RESAMPLEQUALITY quality,
+                    std::vector<float>* dst) {
+  assert(dst);
+  Resampler resampler;
+  if (!resampler.Reset(source_rate, SYS_MIXER_SAMPLE_RATE, channel_num,
+                       quality)) {
+    return false;
+  }
+  const int source_frame_num = static_cast<int>(src.size()) / channel_num;
+  const int loop_frame_num = source_frame_num - loop_start;
+  std::vector<float> edge(SYS_RESAMPLE_TAP_MAX * channel_num);
+  if ((loop_start >= 0) && (start == loop_start)) {
+    for (int i = 0; i < SYS_RESAMPLE_TAP_MAX; ++i) {
+      const int frame = source_frame_num - 1 -
+        (SYS_RESAMPLE_TAP_MAX - 1 - i) % loop_frame_num;
+      memcpy(&edge[i * channel_num], &src[frame * channel_num],
+             sizeof(float) * channel_num);
+    }
+    resampler.Prime(&edge[0], SYS_RESAMPLE_TAP_MAX);
+  }
+  std::vector<float> out;
+  std::vector<float> tail;
+  resampler.Process(&src[start * channel_num], end - start, &out);
+  if (loop_start >= 0) {
+    for (int i = 0; i < SYS_RESAMPLE_TAP_MAX; ++i) {
+      const int frame = loop_start + i % loop_frame_num;
+      memcpy(&edge[i * channel_num], &src[frame * channel_num],
+             sizeof(float) * channel_num);
+    }
+    resampler.Process(&edge[0], SYS_RESAMPLE_TAP_MAX, &tail);
+  } else {
+    resampler.Flush(&tail);
+  }
+  out.insert(out.end(), tail.begin(), tail.end());
+  const size_t sample_num = static_cast<size_t>(frame_num) * channel_num;
+  dst->insert(dst->end(), out.begin(),
+              out.begin() + ((out.size() < sample_num) ?
+                             out.size() : sample_num));
+  return true;
+}
+  // Interleaved stereo is multiplied by a line from the first gain to the
+  // last one.
+void ApplyRamp(float* samples, int frame_num, float first, float last) {
+  assert(samples);
+  assert(frame_num > 0);
+  const float step = (last - first) / frame_num;
+  float gain = first;
+  for (int i = 0; i < frame_num; ++i) {
+    gain += step;
+    samples[i * SYS_MIXER_CHANNEL_NUM] *= gain;
+    samples[i * SYS_MIXER_CHANNEL_NUM + 1] *= gain;
+  }
+}
+  // The envelope moves 1 - 1 / e of the way in the time, 0 for no time.
+float GetFollowerCoefficient(float ms) {
+  if (ms <= 0.0f) return 0.0f;
+  return expf(-1000.0f / (ms * SYS_MIXER_SAMPLE_RATE));
+}
+}  // namespace
+
+  //
+  // These are internal structures related to mixer
+  //
+PcmFormat::PcmFormat() : sample_rate(0), channel_num(0), bits(0),
+    is_float(false), channel_mask(0) { }
+SampleBuffer::SampleBuffer() : format(SYS_SAMPLEFORMAT_INT16),
+    channel_num(0), frame_num(0), loop_start(0), loop_end(0), int16_samples(),
+    float_samples() { }
+Voice::Voice() : samples(), position(0), gain(1.0f), pan(0.0f),
+    voice_id(SYS_MIXER_INVALID_VOICE), start_frame(0), priority(0),
+    category(0), bus(SYS_BUS_MASTER), audible_gain(1.0f), play_order(0),
+    is_real(false), is_selected(false), effects(0) { }
+VoiceSlot::VoiceSlot() : owner_id(-1), priority(0), gain(1.0f),
+    generation(0), play_order(0), in_use(false) { }
+StreamBuffer::StreamBuffer(int frame_num) : gain(1.0f),
+    bus(SYS_BUS_MASTER), ready(false),
+    paused(false), end(false), played_frames(0), underrun_num(0),
+    underrun_frames(0), min_fill_frames(frame_num), decoded_pieces(0),
+    decode_ns(0), max_decode_ns(0),
+    ring_(frame_num * SYS_MIXER_CHANNEL_NUM) { }
+int StreamBuffer::GetCapacityFrames() const {
+  return ring_.GetCapacity() / SYS_MIXER_CHANNEL_NUM;
+}
+int StreamBuffer::GetReadableFrames() const {
+  return ring_.GetReadable() / SYS_MIXER_CHANNEL_NUM;
+}
+int StreamBuffer::GetWritableFrames() const {
+  return ring_.GetWritable() / SYS_MIXER_CHANNEL_NUM;
+}
+int StreamBuffer::Write(const float* samples, int frame_num) {
+  return ring_.Write(samples, frame_num * SYS_MIXER_CHANNEL_NUM) /
+    SYS_MIXER_CHANNEL_NUM;
+}
+int StreamBuffer::Read(float* samples, int frame_num) {
+  return ring_.Read(samples, frame_num * SYS_MIXER_CHANNEL_NUM) /
+    SYS_MIXER_CHANNEL_NUM;
+}
+StreamConverter::StreamConverter() : format_(), gains_(),
+    use_resampler_(false), resampler_(), stereo_() { }
+bool StreamConverter::Reset(const PcmFormat& format,
+                            SYS_RESAMPLEQUALITY quality) {
+  if (format.sample_rate <= 0) return false;
+  if (!(format.is_float ? (format.bits == 32) :
+        ((format.bits == 8) || (format.bits == 16) || (format.bits == 24) ||
+         (format.bits == 32)))) {
+    return false;
+  }
+  if (!GetChannelGains(format.channel_num, format.channel_mask, gains_)) {
+    return false;
+  }
+  format_ = format;
+  use_resampler_ = (format.sample_rate != SYS_MIXER_SAMPLE_RATE);
+  if (use_resampler_ &&
+      !resampler_.Reset(format.sample_rate, SYS_MIXER_SAMPLE_RATE,
+                        SYS_MIXER_CHANNEL_NUM, quality)) {
+    return false;
+  }
+  return true;
+}
+int StreamConverter::GetSourceFrames(int frame_num) const {
+  return use_resampler_ ? resampler_.GetSourceFrames(frame_num) : frame_num;
+}
+int StreamConverter::Convert(const void* data, int source_frame_num,
+                             std::vector<float>* out) {
+  assert(data || (source_frame_num == 0));
+  assert(out);
+  out->clear();
+  if (source_frame_num <= 0) return 0;
+  std::vector<float>* stereo = use_resampler_ ? &stereo_ : out;
+  stereo->resize(static_cast<size_t>(source_frame_num) *
+                 SYS_MIXER_CHANNEL_NUM);
+  ReadPcmFrames(format_, gains_, data, source_frame_num,
+                SYS_MIXER_CHANNEL_NUM, stereo->data());
+  if (!use_resampler_) return source_frame_num;
+  return resampler_.Process(stereo_.data(), source_frame_num, out);
+}
+int StreamConverter::Flush(std::vector<float>* out) {
+  assert(out);
+  out->clear();
+  return use_resampler_ ? resampler_.Flush(out) : 0;
+}
+MixerCommand::MixerCommand() : type(SYS_MIXERCOMMAND_NONE),
+    voice_id(SYS_MIXER_INVALID_VOICE), gain(1.0f), pan(0.0f), samples(),
+    stream(), removed_stream(nullptr), effect_index(0), effect_num(0),
+    effects(), start_frame(0), priority(0), category(0), category_desc(),
+    bus(SYS_BUS_MASTER), bus_desc() { }
+MixerRetired::MixerRetired() : voice_id(SYS_MIXER_INVALID_VOICE), samples(),
+    stream() { }
+MixerBus::MixerBus() : desc(), effects(0), gain(1.0f), target_gain(1.0f),
+    gain_step(0.0f), ramp_frames(0),
+    attack(GetFollowerCoefficient(desc.attack_ms)),
+    release(GetFollowerCoefficient(desc.release_ms)), envelope(0.0f),
+    duck_gain(1.0f), is_used(false) { }
+BusCost::BusCost() : block_num(0), process_ns(0), peak(0.0f),
+    duck_gain(1.0f) { }
+MixerStats::MixerStats() : playing_num(0), active_num(0), virtual_num(0),
+    played_num(0),
+    stolen_num(0),
+    mixed_frames(0), late_num(0), late_frames(0), last_mix_ns(0),
+    max_mix_ns(0) { }
+Mixer::Mixer() : voice_slots_(), added_streams_(), removed_streams_(),
+    play_order_(0),
+    played_num_(0), stolen_num_(0), mix_histogram_(), bus_descs_(),
+    master_delay_index_(-1),
+    commands_(SYS_MIXER_COMMAND_NUM), retired_(SYS_MIXER_RETIRED_NUM),
+    mix_times_(SYS_MIXER_TIME_NUM), active_num_(0), virtual_num_(0),
+    mixed_frames_(0),
+    late_num_(0), late_frames_(0), clock_offset_ns_(SYS_MIXER_INVALID_CLOCK),
+    last_mix_ns_(0), max_mix_ns_(0), effect_costs_(), bus_costs_(),
+    voices_(), streams_(), stream_num_(0),
+    block_frame_(0), voice_order_(0), categories_(),
+    audible_gain_(SYS_MIXER_AUDIBLE_GAIN), selected_(), buses_(),
+    master_effects_(SYS_EFFECT_DELAY_FRAMES), bus_blocks_(), stream_block_(),
+    voice_block_() { }
+int Mixer::Play(const std::shared_ptr<const SampleBuffer>& samples,
+                int owner_id, const VoiceDesc& desc) {
+  assert(samples);
+  assert(desc.effects || (desc.effect_num == 0));
+  if (samples->frame_num <= 0) return SYS_MIXER_INVALID_VOICE;
+  if ((desc.effect_num < 0) || (desc.effect_num > SYS_EFFECT_CHAIN_NUM)) {
+    return SYS_MIXER_INVALID_VOICE;
+  }
+  for (int i = 0; i < desc.effect_num; ++i) {
+    if (!IsValidEffect(desc.effects[i], i, -1, false)) {
+      return SYS_MIXER_INVALID_VOICE;
+    }
+  }
+  if ((desc.category < 0) || (desc.category >= SYS_VOICE_CATEGORY_NUM) ||
+      (desc.bus < 0) || (desc.bus >= SYS_MIXER_BUS_NUM)) {
+    return SYS_MIXER_INVALID_VOICE;
+  }
+  Collect();
+  // A free voice, or the lowest priority, quietest and oldest one.
+  int index = -1;
+  for (int i = 0; (i < SYS_MIXER_VOICE_NUM) && (index < 0); ++i) {
+    if (!voice_slots_[i].in_use) index = i;
+  }
+  const bool is_stolen = (index < 0);
+  if (is_stolen) {
+    index = 0;
+    for (int i = 1; i < SYS_MIXER_VOICE_NUM; ++i) {
+      const VoiceSlot& slot = voice_slots_[i];
+      const VoiceSlot& stolen = voice_slots_[index];
+      if (slot.priority != stolen.priority) {
+        if (slot.priority < stolen.priority) index = i;
+      } else if ((slot.gain < stolen.gain) ||
+                 ((slot.gain == stolen.gain) &&
+                  (slot.play_order < stolen.play_order))) {
+        index = i;
+      }
+    }
+    // Voices of higher priorities are not stolen.
+    if (voice_slots_[index].priority > desc.priority) {
+      return SYS_MIXER_INVALID_VOICE;
+    }
+  }
+  VoiceSlot& slot = voice_slots_[index];
+  const uint32_t generation = (slot.generation + 1) & kVoiceGenerationMask;
+  MixerCommand command;
+  command.type = SYS_MIXERCOMMAND_PLAY;
+  command.voice_id = static_cast<int>((generation << kVoiceIndexBits) | index);
+  command.gain = desc.gain;
+  command.pan = (desc.pan < -1.0f) ? -1.0f :
+    ((desc.pan > 1.0f) ? 1.0f : desc.pan);
+  command.samples = samples;
+  command.effect_num = desc.effect_num;
+  for (int i = 0; i < desc.effect_num; ++i) {
+    command.effects[i] = desc.effects[i];
+  }
+  command.start_frame = (desc.start_frame > 0) ? desc.start_frame : 0;
+  command.priority = desc.priority;
+  command.category = desc.category;
+  command.bus = desc.bus;
+  if (!Send(command)) return SYS_MIXER_INVALID_VOICE;
+  slot.owner_id = owner_id;
+  slot.priority = desc.priority;
+  slot.gain = desc.gain;
+  slot.generation = generation;
+  slot.play_order = ++play_order_;
+  slot.in_use = true;
+  ++played_num_;
+  if (is_stolen) ++stolen_num_;
+  return command.voice_id;
+}
+bool Mixer::Stop(int voice_id) {
+  Collect();
+  VoiceSlot* slot = GetVoiceSlot(voice_id);
+  if (slot == nullptr) return false;
+  MixerCommand command;
+  command.type = SYS_MIXERCOMMAND_STOP;
+  command.voice_id = voice_id;
+  if (!Send(command)) return false;
+  slot->in_use = false;
+  slot->owner_id = -1;
+  return true;
+}
+void Mixer::StopOwner(int owner_id) {
+  Collect();
+  for (int i = 0; i < SYS_MIXER_VOICE_NUM; ++i) {
+    const VoiceSlot& slot = voice_slots_[i];
+    if (!slot.in_use || (slot.owner_id != owner_id)) continue;
+    Stop(static_cast<int>((slot.generation << kVoiceIndexBits) | i));
+  }
+}
+void Mixer::StopAll() {
+  Collect();
+  for (int i = 0; i < SYS_MIXER_VOICE_NUM; ++i) {
+    const VoiceSlot& slot = voice_slots_[i];
+    if (!slot.in_use) continue;
+    Stop(static_cast<int>((slot.generation << kVoiceIndexBits) | i));
+  }
+}
+bool Mixer::SetGain(int voice_id, float gain) {
+  Collect();
+  VoiceSlot* slot = GetVoiceSlot(voice_id);
+  if (slot == nullptr) return false;
+  MixerCommand command;
+  command.type = SYS_MIXERCOMMAND_SET_GAIN;
+  command.voice_id = voice_id;
+  command.gain = gain;
+  if (!Send(command)) return false;
+  slot->gain = gain;
+  return true;
+}
+bool Mixer::IsPlaying(int voice_id) {
+  Collect();
+  return GetVoiceSlot(voice_id) != nullptr;
+}
+bool Mixer::SetEffect(int voice_id, int index, const EffectDesc& desc) {
+  Collect();
+  if (GetVoiceSlot(voice_id) == nullptr) return false;
+  if ((index < 0) || (index >= SYS_EFFECT_CHAIN_NUM)) return false;
+  if (!IsValidEffect(desc, index, -1, false)) return false;
+  MixerCommand command;
+  command.type = SYS_MIXERCOMMAND_SET_EFFECT;
+  command.voice_id = voice_id;
+  command.effect_index = index;
+  command.effects[0] = desc;
+  return Send(command);
+}
+bool Mixer::SetMasterEffect(int index, const EffectDesc& desc) {
+  if ((index < 0) || (index >= SYS_EFFECT_CHAIN_NUM)) return false;
+  // The chain is checked as it will be when the command is executed.
+  if (!IsValidEffect(desc, index, master_delay_index_, true)) return false;
+  MixerCommand command;
+  command.type = SYS_MIXERCOMMAND_SET_MASTER_EFFECT;
+  command.effect_index = index;
+  command.effects[0] = desc;
+  if (!Send(command)) return false;
+  if (desc.type == SYS_EFFECTTYPE_DELAY) {
+    master_delay_index_ = index;
+  } else if (master_delay_index_ == index) {
+    master_delay_index_ = -1;
+  }
+  return true;
+}
+bool Mixer::SetCategory(int category, const VoiceCategoryDesc& desc) {
+  if ((category < 0) || (category >= SYS_VOICE_CATEGORY_NUM)) return false;
+  if ((desc.voice_limit < 0) ||
+      ((desc.steal != SYS_VOICESTEAL_QUIETEST) &&
+       (desc.steal != SYS_VOICESTEAL_OLDEST))) {
+    return false;
+  }
+  Collect();
+  MixerCommand command;
+  command.type = SYS_MIXERCOMMAND_SET_CATEGORY;
+  command.category = category;
+  command.category_desc = desc;
+  return Send(command);
+}
+bool Mixer::SetAudibleGain(float gain) {
+  if (!(gain >= 0.0f)) return false;
+  Collect();
+  MixerCommand command;
+  command.type = SYS_MIXERCOMMAND_SET_AUDIBLE_GAIN;
+  command.gain = gain;
+  return Send(command);
+}
+bool Mixer::SetBus(int bus, const BusDesc& desc) {
+  if ((bus < 0) || (bus >= SYS_MIXER_BUS_NUM)) return false;
+  // Buses are processed from the last one, so the graph has no loop.
+  if ((bus != SYS_BUS_MASTER) &&
+      ((desc.parent < SYS_BUS_MASTER) || (desc.parent >= bus))) {
+    return false;
+  }
+  if ((desc.sidechain != -1) &&
+      ((desc.sidechain <= bus) || (desc.sidechain >= SYS_MIXER_BUS_NUM))) {
+    return false;
+  }
+  if (!(desc.gain >= 0.0f) || !(desc.ramp_ms >= 0.0f) ||
+      !(desc.duck_threshold > 0.0f) || !(desc.duck_gain >= 0.0f) ||
+      !(desc.duck_gain <= 1.0f) || !(desc.attack_ms >= 0.0f) ||
+      !(desc.release_ms >= 0.0f)) {
+    return false;
+  }
+  Collect();
+  MixerCommand command;
+  command.type = SYS_MIXERCOMMAND_SET_BUS;
+  command.bus = bus;
+  command.bus_desc = desc;
+  if (!Send(command)) return false;
+  bus_descs_[bus] = desc;
+  return true;
+}
+bool Mixer::SetBusEffect(int bus, int index, const EffectDesc& desc) {
+  // The master has its own chain with a delay line.
+  if ((bus <= SYS_BUS_MASTER) || (bus >= SYS_MIXER_BUS_NUM)) return false;
+  if ((index < 0) || (index >= SYS_EFFECT_CHAIN_NUM)) return false;
+  if (!IsValidEffect(desc, index, -1, false)) return false;
+  MixerCommand command;
+  command.type = SYS_MIXERCOMMAND_SET_BUS_EFFECT;
+  command.bus = bus;
+  command.effect_index = index;
+  command.effects[0] = desc;
+  return Send(command);
+}
+bool Mixer::GetBus(int bus, BusDesc* desc) const {
+  assert(desc);
+  if ((bus < 0) || (bus >= SYS_MIXER_BUS_NUM)) return false;
+  *desc = bus_descs_[bus];
+  return true;
+}
+bool Mixer::AddStream(const std::shared_ptr<StreamBuffer>& stream) {
+  assert(stream);
+  Collect();
+  if (added_streams_.size() + removed_streams_.size() >=
+      SYS_MIXER_STREAM_NUM) {
+    return false;
+  }
+  MixerCommand command;
+  command.type = SYS_MIXERCOMMAND_ADD_STREAM;
+  command.stream = stream;
+  if (!Send(command)) return false;
+  added_streams_.push_back(stream);
+  return true;
+}
+  // The stream is held by the mixer until it is removed, so it is sent in
+  // the next call if the queue is full now.
+void Mixer::RemoveStream(const StreamBuffer* stream) {
+  for (size_t i = 0; i < added_streams_.size(); ++i) {
+    if (added_streams_[i].get() != stream) continue;
+    removed_streams_.push_back(added_streams_[i]);
+    added_streams_[i] = added_streams_.back();
+    added_streams_.pop_back();
+    break;
+  }
+  Collect();
+}
+MixerStats Mixer::GetStats() {
+  Collect();
+  MixerStats stats;
+  for (auto& slot : voice_slots_) {
+    if (slot.in_use) ++stats.playing_num;
+  }
+  stats.active_num = active_num_.load();
+  stats.virtual_num = virtual_num_.load();
+  stats.played_num = played_num_;
+  stats.stolen_num = stolen_num_;
+  stats.mixed_frames = mixed_frames_.load();
+  stats.late_num = late_num_.load();
+  stats.late_frames = late_frames_.load();
+  stats.last_mix_ns = last_mix_ns_.load();
+  stats.max_mix_ns = max_mix_ns_.load();
+  return stats;
+}
+EffectStats Mixer::GetEffectStats(SYS_EFFECTTYPE type) const {
+  assert((type >= SYS_EFFECTTYPE_NONE) && (type < SYS_EFFECTTYPE_NUM));
+  EffectStats stats;
+  stats.block_num = effect_costs_[type].block_num.load();
+  stats.process_ns = effect_costs_[type].process_ns.load();
+  return stats;
+}
+BusStats Mixer::GetBusStats(int bus) const {
+  assert((bus >= 0) && (bus < SYS_MIXER_BUS_NUM));
+  BusStats stats;
+  stats.block_num = bus_costs_[bus].block_num.load();
+  stats.process_ns = bus_costs_[bus].process_ns.load();
+  stats.peak = bus_costs_[bus].peak.load();
+  stats.duck_gain = bus_costs_[bus].duck_gain.load();
+  return stats;
+}
+const LogHistogram& Mixer::GetMixHistogram() {
+  Collect();
+  return mix_histogram_;
+}
+void Mixer::ResetTimeStats() {
+  Collect();
+  mix_histogram_.Reset();
+  max_mix_ns_.store(0);
+}
+int64_t Mixer::GetFrame() const {
+  return mixed_frames_.load();
+}
+int64_t Mixer::GetClockOffset() const {
+  return clock_offset_ns_.load();
+}
+void Mixer::Mix(int frame_num, int16_t* out) {
+  assert(out);
+  const int64_t start_ns = GetClockNanoSecond();
+  // Calls are late by the sleep of the mixing thread, never early, so the
+  // offset follows an earlier call at once and a later one by a part.
+  const int64_t offset_ns = start_ns - FramesToNanoSecond(block_frame_);
+  const int64_t last_offset_ns = clock_offset_ns_.load();
+  if ((last_offset_ns == SYS_MIXER_INVALID_CLOCK) ||
+      (offset_ns < last_offset_ns)) {
+    clock_offset_ns_.store(offset_ns);
+  } else {
+    clock_offset_ns_.store(last_offset_ns + (offset_ns - last_offset_ns) /
+                           SYS_MIXER_CLOCK_WEIGHT);
+  }
+#ifdef SYS_MIXER_USE_SSE2
+  // Denormals are flushed to zero, so decaying filters and echoes are not
+  // slowed down.
+  const unsigned int csr = _mm_getcsr();
+  _mm_setcsr(csr | 0x8040);
+#endif
+  // Each command sends back one thing at most.
+  MixerCommand command;
+  while ((retired_.GetWritable() > 0) && (commands_.Read(&command, 1) == 1)) {
+    Execute(&command);
+  }
+  const int64_t mixed_frame_num = frame_num;
+  while (frame_num > 0) {
+    const int n = (frame_num < SYS_MIXER_BLOCK_FRAMES) ?
+      frame_num : SYS_MIXER_BLOCK_FRAMES;
+    MixBlock(n);
+    block_frame_ += n;
+    ConvertToInt16(bus_blocks_[SYS_BUS_MASTER], n * SYS_MIXER_CHANNEL_NUM,
+                   out);
+    out += n * SYS_MIXER_CHANNEL_NUM;
+    frame_num -= n;
+  }
+#ifdef SYS_MIXER_USE_SSE2
+  _mm_setcsr(csr);
+#endif
+  mixed_frames_.fetch_add(mixed_frame_num);
+  const int64_t mix_ns = GetClockNanoSecond() - start_ns;
+  last_mix_ns_.store(mix_ns);
+  if (mix_ns > max_mix_ns_.load()) max_mix_ns_.store(mix_ns);
+  // The time is lost if the client is late.
+  mix_times_.Write(&mix_ns, 1);
+}
+bool Mixer::Send(const MixerCommand& command) {
+  return commands_.Write(&command, 1) == 1;
+}
+  // The ended voices are freed, and the buffers the mixing thread has done
+  // with are released here. The times of Mix are put into the histogram.
+void Mixer::Collect() {
+  while (!removed_streams_.empty()) {
+    MixerCommand command;
+    command.type = SYS_MIXERCOMMAND_REMOVE_STREAM;
+    command.removed_stream = removed_streams_.back().get();
+    if (!Send(command)) break;
+    removed_streams_.pop_back();
+  }
+  int64_t mix_ns[64];
+  int num = 0;
+  while ((num = mix_times_.Read(mix_ns, 64)) > 0) {
+    for (int i = 0; i < num; ++i) mix_histogram_.Add(mix_ns[i]);
+  }
+  MixerRetired retired;
+  while (retired_.Read(&retired, 1) == 1) {
+    VoiceSlot* slot = GetVoiceSlot(retired.voice_id);
+    if (slot != nullptr) {
+      slot->in_use = false;
+      slot->owner_id = -1;
+    }
+    retired.samples.reset();
+    retired.stream.reset();
+  }
+}
+VoiceSlot* Mixer::GetVoiceSlot(int voice_id) {
+  if (voice_id < 0) return nullptr;
+  const int index = voice_id & ((1 << kVoiceIndexBits) - 1);
+  const uint32_t generation = static_cast<uint32_t>(voice_id) >>
+    kVoiceIndexBits;
+  if (index >= SYS_MIXER_VOICE_NUM) return nullptr;
+  VoiceSlot& slot = voice_slots_[index];
+  if (!slot.in_use || (slot.generation != generation)) return nullptr;
+  return &slot;
+}
+  // The buffers are moved, so nothing is freed on the mixing thread.
+void Mixer::Execute(MixerCommand* command) {
+  assert(command);
+  switch (command->type) {
+    case SYS_MIXERCOMMAND_PLAY: {
+      Voice& voice = voices_[command->voice_id &
+                             ((1 << kVoiceIndexBits) - 1)];
+      // The voice stolen is sent back first. Mix runs a command only with
+      // room for it, so the play is not dropped.
+      if (voice.samples && !Retire(&voice)) break;
+      voice.samples = std::move(command->samples);
+      voice.position = 0;
+      voice.gain = command->gain;
+      voice.pan = command->pan;
+      voice.voice_id = command->voice_id;
+      voice.start_frame = command->start_frame;
+      voice.priority = command->priority;
+      voice.category = command->category;
+      voice.bus = command->bus;
+      voice.play_order = ++voice_order_;
+      voice.is_real = false;
+      voice.is_selected = false;
+      voice.effects.Clear();
+      for (int i = 0; i < command->effect_num; ++i) {
+        voice.effects.Set(i, command->effects[i]);
+      }
+      break;
+    }
+    case SYS_MIXERCOMMAND_STOP: {
+      Voice* voice = GetVoice(command->voice_id);
+      if (voice != nullptr) Retire(voice);
+      break;
+    }
+    case SYS_MIXERCOMMAND_SET_GAIN: {
+      Voice* voice = GetVoice(command->voice_id);
+      if (voice != nullptr) voice->gain = command->gain;
+      break;
+    }
+    case SYS_MIXERCOMMAND_SET_EFFECT: {
+      Voice* voice = GetVoice(command->voice_id);
+      if (voice != nullptr) {
+        voice->effects.Set(command->effect_index, command->effects[0]);
+      }
+      break;
+    }
+    case SYS_MIXERCOMMAND_SET_MASTER_EFFECT:
+      master_effects_.Set(command->effect_index, command->effects[0]);
+      break;
+    case SYS_MIXERCOMMAND_SET_CATEGORY:
+      categories_[command->category] = command->category_desc;
+      break;
+    case SYS_MIXERCOMMAND_SET_AUDIBLE_GAIN:
+      audible_gain_ = command->gain;
+      break;
+    case SYS_MIXERCOMMAND_SET_BUS: {
+      MixerBus& bus = buses_[command->bus];
+      bus.desc = command->bus_desc;
+      bus.target_gain = bus.desc.is_muted ? 0.0f : bus.desc.gain;
+      bus.ramp_frames = static_cast<int>(
+          bus.desc.ramp_ms * SYS_MIXER_SAMPLE_RATE / 1000.0f);
+      if (bus.ramp_frames < SYS_MIXER_BUS_RAMP_FRAMES) {
+        bus.ramp_frames = SYS_MIXER_BUS_RAMP_FRAMES;
+      }
+      bus.gain_step = (bus.target_gain - bus.gain) / bus.ramp_frames;
+      bus.attack = GetFollowerCoefficient(bus.desc.attack_ms);
+      bus.release = GetFollowerCoefficient(bus.desc.release_ms);
+      break;
+    }
+    case SYS_MIXERCOMMAND_SET_BUS_EFFECT:
+      buses_[command->bus].effects.Set(command->effect_index,
+                                       command->effects[0]);
+      break;
+    case SYS_MIXERCOMMAND_ADD_STREAM:
+      assert(stream_num_ < SYS_MIXER_STREAM_NUM);
+      streams_[stream_num_++] = std::move(command->stream);
+      break;
+    case SYS_MIXERCOMMAND_REMOVE_STREAM:
+      for (int i = 0; i < stream_num_; ++i) {
+        if (streams_[i].get() != command->removed_stream) continue;
+        MixerRetired retired;
+        retired.stream = std::move(streams_[i]);
+        if (retired_.Push(&retired, 1) == 0) {
+          // Not freed here, it is mixed until it can be sent back.
+          streams_[i] = std::move(retired.stream);
+          break;
+        }
+        --stream_num_;
+        if (i != stream_num_) streams_[i] = std::move(streams_[stream_num_]);
+        break;
+      }
+      break;
+    default:
+      break;
+  }
+}
+Voice* Mixer::GetVoice(int voice_id) {
+  if (voice_id < 0) return nullptr;
+  Voice& voice = voices_[voice_id & ((1 << kVoiceIndexBits) - 1)];
+  if (!voice.samples || (voice.voice_id != voice_id)) return nullptr;
+  return &voice;
+}
+  // The samples are sent back to the client thread with the voice id. The
+  // voice is kept if the ring is full, so no buffer is freed here.
+bool Mixer::Retire(Voice* voice) {
+  assert(voice);
+  MixerRetired retired;
+  retired.voice_id = voice->voice_id;
+  retired.samples = std::move(voice->samples);
+  if (retired_.Push(&retired, 1) == 0) {
+    voice->samples = std::move(retired.samples);
+    return false;
+  }
+  voice->voice_id = SYS_MIXER_INVALID_VOICE;
+  return true;
+}
+  // Audible voices are selected, and the voices over the limit of the
+  // category and the total are dropped. Nothing is sorted while all voices
+  // are under the limits.
+void Mixer::SelectVoices(int frame_num) {
+  // The gains of the buses to the master, a parent is before the children.
+  float bus_gains[SYS_MIXER_BUS_NUM];
+  for (int i = 0; i < SYS_MIXER_BUS_NUM; ++i) {
+    const MixerBus& bus = buses_[i];
+    bus_gains[i] = ((bus.gain > bus.target_gain) ? bus.gain :
+                    bus.target_gain) * bus.duck_gain;
+    if (i != SYS_BUS_MASTER) bus_gains[i] *= bus_gains[bus.desc.parent];
+  }
+  int num = 0;
+  int category_nums[SYS_VOICE_CATEGORY_NUM] = {0};
+  bool is_over = false;
+  for (int i = 0; i < SYS_MIXER_VOICE_NUM; ++i) {
+    Voice& voice = voices_[i];
+    voice.is_selected = false;
+    if (!voice.samples) continue;
+    if ((voice.start_frame > 0) &&
+        (voice.start_frame - block_frame_ >= frame_num)) {
+      continue;
+    }
+    voice.audible_gain = voice.gain * bus_gains[voice.bus];
+    if (voice.audible_gain < audible_gain_) continue;
+    selected_[num++] = i;
+    if (++category_nums[voice.category] >
+        categories_[voice.category].voice_limit) {
+      is_over = true;
+    }
+  }
+  if (is_over) {
+    // In the order of the category, and the policy of it in a category.
+    std::sort(selected_, selected_ + num, [this](int a, int b) {
+      const Voice& voice_a = voices_[a];
+      const Voice& voice_b = voices_[b];
+      if (voice_a.category != voice_b.category) {
+        return voice_a.category < voice_b.category;
+      }
+      if (voice_a.priority != voice_b.priority) {
+        return voice_a.priority > voice_b.priority;
+      }
+      if ((categories_[voice_a.category].steal == SYS_VOICESTEAL_QUIETEST) &&
+          (voice_a.audible_gain != voice_b.audible_gain)) {
+        return voice_a.audible_gain > voice_b.audible_gain;
+      }
+      return voice_a.play_order > voice_b.play_order;
+    });
+    int kept_num = 0;
+    int category = -1;
+    int category_num = 0;
+    for (int i = 0; i < num; ++i) {
+      const Voice& voice = voices_[selected_[i]];
+      if (voice.category != category) {
+        category = voice.category;
+        category_num = 0;
+      }
+      if (category_num++ < categories_[category].voice_limit) {
+        selected_[kept_num++] = selected_[i];
+      }
+    }
+    num = kept_num;
+  }
+  if (num > SYS_MIXER_REAL_VOICE_NUM) {
+    std::nth_element(selected_, selected_ + SYS_MIXER_REAL_VOICE_NUM,
+                     selected_ + num, [this](int a, int b) {
+      const Voice& voice_a = voices_[a];
+      const Voice& voice_b = voices_[b];
+      if (voice_a.priority != voice_b.priority) {
+        return voice_a.priority > voice_b.priority;
+      }
+      if (voice_a.audible_gain != voice_b.audible_gain) {
+        return voice_a.audible_gain > voice_b.audible_gain;
+      }
+      return voice_a.play_order > voice_b.play_order;
+    });
+    num = SYS_MIXER_REAL_VOICE_NUM;
+  }
+  for (int i = 0; i < num; ++i) voices_[selected_[i]].is_selected = true;
+}
+  // A virtual voice goes on as if it were mixed.
+void Mixer::AdvanceVoice(Voice* voice, int frame_num) {
+  assert(voice);
+  const SampleBuffer& samples = *voice->samples;
+  const bool in_loop = samples.loop_end > samples.loop_start;
+  const int end = in_loop ? samples.loop_end : samples.frame_num;
+  const int position = voice->position + frame_num;
+  if (position < end) {
+    voice->position = position;
+  } else if (in_loop) {
+    voice->position = samples.loop_start + (position - samples.loop_start) %
+      (samples.loop_end - samples.loop_start);
+  } else {
+    voice->position = end;
+    // The voice ends in the next block if the client is late.
+    Retire(voice);
+  }
+}
+void Mixer::MixBlock(int frame_num) {
+  for (auto& bus : buses_) bus.is_used = false;
+  GetBusBlock(SYS_BUS_MASTER, frame_num);
+  SelectVoices(frame_num);
+  int active_num = 0;
+  int virtual_num = 0;
+  for (auto& voice : voices_) {
+    if (!voice.samples) continue;
+    // A waiting voice starts at its frame, or at once if it is late.
+    int mixed = 0;
+    if (voice.start_frame > 0) {
+      const int64_t wait = voice.start_frame - block_frame_;
+      if (wait >= frame_num) continue;
+      if (wait >= 0) {
+        mixed = static_cast<int>(wait);
+      } else {
+        late_num_.fetch_add(1);
+        late_frames_.fetch_add(-wait);
+      }
+      voice.start_frame = 0;
+    }
+    if (!voice.is_selected && !voice.is_real) {
+      AdvanceVoice(&voice, frame_num - mixed);
+      ++virtual_num;
+      continue;
+    }
+    ++active_num;
+    // A voice moved in or out in the middle is faded, so it doesn't click.
+    const bool is_faded_in = !voice.is_real && (voice.position > 0);
+    const bool is_faded_out = !voice.is_selected;
+    voice.is_real = voice.is_selected;
+    const SampleBuffer& samples = *voice.samples;
+    // Pan lowers the other side only, the center is the full gain.
+    const float gain_l = voice.gain * ((voice.pan > 0.0f) ? 1.0f - voice.pan :
+                                       1.0f);
+    const float gain_r = voice.gain * ((voice.pan < 0.0f) ? 1.0f + voice.pan :
+                                       1.0f);
+    const bool in_loop = samples.loop_end > samples.loop_start;
+    const int end = in_loop ? samples.loop_end : samples.frame_num;
+    const bool has_effects = !voice.effects.IsEmpty();
+    const bool use_voice_block = has_effects || is_faded_in || is_faded_out;
+    float* voice_block = use_voice_block ? voice_block_ :
+      GetBusBlock(voice.bus, frame_num);
+    if (use_voice_block) {
+      memset(voice_block_, 0,
+             sizeof(float) * frame_num * SYS_MIXER_CHANNEL_NUM);
+    }
+    while (mixed < frame_num) {
+      const int left = end - voice.position;
+      const int n = (frame_num - mixed < left) ? frame_num - mixed : left;
+      const size_t offset = static_cast<size_t>(voice.position) *
+        samples.channel_num;
+      float* dst = voice_block + mixed * SYS_MIXER_CHANNEL_NUM;
+      if (samples.format == SYS_SAMPLEFORMAT_INT16) {
+        const int16_t* src = &samples.int16_samples[offset];
+        if (samples.channel_num == 1) {
+          MixMonoInt16(src, n, gain_l, gain_r, dst);
+        } else {
+          MixStereoInt16(src, n, gain_l, gain_r, dst);
+        }
+      } else {
+        const float* src = &samples.float_samples[offset];
+        if (samples.channel_num == 1) {
+          MixMonoFloat(src, n, gain_l, gain_r, dst);
+        } else {
+          MixStereoFloat(src, n, gain_l, gain_r, dst);
+        }
+      }
+      voice.position += n;
+      mixed += n;
+      if (voice.position < end) continue;
+      if (in_loop) {
+        voice.position = samples.loop_start;
+        continue;
+      }
+      // The voice ends in the next block if the client is late.
+      Retire(&voice);
+      break;
+    }
+    if (has_effects) {
+      voice.effects.Process(voice_block_, frame_num, effect_costs_);
+    }
+    if (is_faded_in) ApplyRamp(voice_block_, frame_num, 0.0f, 1.0f);
+    if (is_faded_out) ApplyRamp(voice_block_, frame_num, 1.0f, 0.0f);
+    if (use_voice_block) {
+      MixStereoFloat(voice_block_, frame_num, 1.0f, 1.0f,
+                     GetBusBlock(voice.bus, frame_num));
+    }
+  }
+  active_num_.store(active_num);
+  virtual_num_.store(virtual_num);
+  for (int i = 0; i < stream_num_; ++i) MixStream(streams_[i].get(), frame_num);
+  // Buses nothing is mixed to are skipped, unless the gain or the envelope
+  // is moving.
+  for (int i = SYS_MIXER_BUS_NUM - 1; i > SYS_BUS_MASTER; --i) {
+    const MixerBus& bus = buses_[i];
+    if (bus.is_used || (bus.ramp_frames > 0) || (bus.desc.sidechain >= 0) ||
+        (bus.envelope > 0.0f)) {
+      ProcessBus(i, frame_num);
+    }
+  }
+  ProcessBus(SYS_BUS_MASTER, frame_num);
+  master_effects_.Process(bus_blocks_[SYS_BUS_MASTER], frame_num,
+                          effect_costs_);
+}
+void Mixer::MixStream(StreamBuffer* stream, int frame_num) {
+  if (!stream->ready.load() || stream->paused.load()) return;
+  const int n = stream->Read(stream_block_, frame_num);
+  MixStereoFloat(stream_block_, n, stream->gain, stream->gain,
+                 GetBusBlock(stream->bus, frame_num));
+  stream->played_frames.fetch_add(n);
+  if ((n < frame_num) && !stream->end.load()) {
+    // The reading thread is late, the rest of the block is silent.
+    stream->underrun_num.fetch_add(1);
+    stream->underrun_frames.fetch_add(frame_num - n);
+  }
+  const int fill = stream->GetReadableFrames();
+  if (!stream->end.load() && (fill < stream->min_fill_frames.load())) {
+    stream->min_fill_frames.store(fill);
+  }
+}
+float* Mixer::GetBusBlock(int bus, int frame_num) {
+  MixerBus& mixer_bus = buses_[bus];
+  if (!mixer_bus.is_used) {
+    memset(bus_blocks_[bus], 0,
+           sizeof(float) * frame_num * SYS_MIXER_CHANNEL_NUM);
+    mixer_bus.is_used = true;
+  }
+  return bus_blocks_[bus];
+}
+  // The block is multiplied by the gain and the gain by ducking, and mixed
+  // to the parent. The envelope follows the sidechain after the gain of it,
+  // or silence if it has none, so the gain comes back when it is removed.
+void Mixer::ProcessBus(int index, int frame_num) {
+  const int64_t start_ns = GetClockNanoSecond();
+  MixerBus& bus = buses_[index];
+  if ((bus.ramp_frames == 0) && (bus.gain == 0.0f) &&
+      (index != SYS_BUS_MASTER)) {
+    bus.is_used = false;  // Muted, so it is silent to the sidechains too.
+  }
+  float* samples = bus.is_used ? bus_blocks_[index] : nullptr;
+  if ((samples != nullptr) && !bus.effects.IsEmpty()) {
+    bus.effects.Process(samples, frame_num, effect_costs_);
+  }
+  const int sidechain = bus.desc.sidechain;
+  const float* key = ((sidechain >= 0) && buses_[sidechain].is_used) ?
+    bus_blocks_[sidechain] : nullptr;
+  const float threshold = bus.desc.duck_threshold;
+  float duck_gain = bus.duck_gain;
+  float peak = 0.0f;
+  for (int i = 0; i < frame_num; ++i) {
+    if (bus.ramp_frames > 0) {
+      bus.gain += bus.gain_step;
+      if (--bus.ramp_frames == 0) bus.gain = bus.target_gain;
+    }
+    if (bus.envelope > 0.0f || key != nullptr) {
+      float level = 0.0f;
+      if (key != nullptr) {
+        const float l = fabsf(key[i * SYS_MIXER_CHANNEL_NUM]);
+        const float r = fabsf(key[i * SYS_MIXER_CHANNEL_NUM + 1]);
+        level = (l > r) ? l : r;
+      }
+      const float coefficient = (level > bus.envelope) ? bus.attack :
+        bus.release;
+      bus.envelope = level + coefficient * (bus.envelope - level);
+      if (bus.envelope > threshold) {
+        duck_gain = threshold / bus.envelope;
+        if (duck_gain < bus.desc.duck_gain) duck_gain = bus.desc.duck_gain;
+      } else {
+        duck_gain = 1.0f;
+        if (sidechain < 0) bus.envelope = 0.0f;
+      }
+    }
+    if (samples == nullptr) continue;
+    const float gain = bus.gain * duck_gain;
+    float* frame = samples + i * SYS_MIXER_CHANNEL_NUM;
+    frame[0] *= gain;
+    frame[1] *= gain;
+    const float l = fabsf(frame[0]);
+    const float r = fabsf(frame[1]);
+    if (l > peak) peak = l;
+    if (r > peak) peak = r;
+  }
+  bus.duck_gain = duck_gain;
+  if ((samples != nullptr) && (index != SYS_BUS_MASTER)) {
+    MixStereoFloat(samples, frame_num, 1.0f, 1.0f,
+                   GetBusBlock(bus.desc.parent, frame_num));
+  }
+  BusCost& cost = bus_costs_[index];
+  cost.block_num.fetch_add(1);
+  cost.process_ns.fetch_add(GetClockNanoSecond() - start_ns);
+  cost.peak.store(peak);
+  cost.duck_gain.store(duck_gain);
+}
+bool NullSink::Write(const int16_t* samples, int frame_num) {
+  assert(samples);
+  written_frames_ += frame_num;
+  return true;
+}
+bool MemorySink::Write(const int16_t* samples, int frame_num) {
+  assert(samples);
+  samples_.insert(samples_.end(), samples,
+                  samples + frame_num * SYS_MIXER_CHANNEL_NUM);
+  return true;
+}
+WavFileSink::WavFileSink(const wchar_t* file_name) : file_name_(file_name),
+    file_(nullptr), data_bytes_(0) { }
+WavFileSink::~WavFileSink() {
+  Close();
+}
+bool WavFileSink::Open() {
+  assert(!file_);
+  file_ = OpenFile(file_name_, L"wb");
+  if (!file_) return false;
+  data_bytes_ = 0;
+  // The header is written again with the sizes when the file is closed.
+  uint8_t header[44] = {0};
+  if (fwrite(header, sizeof(header), 1, file_) != 1) {
+    Close();
+    return false;
+  }
+  return true;
+}
+void WavFileSink::Close() {
+  if (!file_) return;
+  const int block_align = SYS_MIXER_CHANNEL_NUM * sizeof(int16_t);
+  uint8_t header[44] = {0};
+  memcpy(header, "RIFF", 4);
+  WriteUint32(header + 4, static_cast<uint32_t>(36 + data_bytes_));
+  memcpy(header + 8, "WAVEfmt ", 8);
+  WriteUint32(header + 16, 16);
+  WriteUint16(header + 20, 1);  // PCM
+  WriteUint16(header + 22, SYS_MIXER_CHANNEL_NUM);
+  WriteUint32(header + 24, SYS_MIXER_SAMPLE_RATE);
+  WriteUint32(header + 28, SYS_MIXER_SAMPLE_RATE * block_align);
+  WriteUint16(header + 32, block_align);
+  WriteUint16(header + 34, 16);
+  memcpy(header + 36, "data", 4);
+  WriteUint32(header + 40, static_cast<uint32_t>(data_bytes_));
+  fseek(file_, 0, SEEK_SET);
+  fwrite(header, sizeof(header), 1, file_);
+  fclose(file_);
+  file_ = nullptr;
+}
+bool WavFileSink::Write(const int16_t* samples, int frame_num) {
+  assert(samples);
+  if (!file_) return false;
+  const size_t sample_num = static_cast<size_t>(frame_num) *
+    SYS_MIXER_CHANNEL_NUM;
+  if (fwrite(samples, sizeof(int16_t), sample_num, file_) != sample_num) {
+    return false;
+  }
+  data_bytes_ += sample_num * sizeof(int16_t);
+  return true;
+}
+MixerThread::MixerThread() : mixer_(nullptr), sink_(nullptr), thread_(),
+    quit_(false) { }
+MixerThread::~MixerThread() {
+  Stop();
+}
+bool MixerThread::Start(Mixer* mixer, AudioSink* sink) {
+  assert(mixer);
+  assert(sink);
+  assert(!thread_.joinable());
+  mixer_ = mixer;
+  sink_ = sink;
+  quit_.store(false);
+  thread_ = std::thread(&MixerThread::MixProc, this);
+  return true;
+}
+void MixerThread::Stop() {
+  if (!thread_.joinable()) return;
+  quit_.store(true);
+  thread_.join();
+}
+void MixerThread::MixProc() {
+  const int64_t block_ns = SYS_NS_PER_SECOND * SYS_MIXER_BLOCK_FRAMES /
+    SYS_MIXER_SAMPLE_RATE;
+  std::vector<int16_t> samples(SYS_MIXER_BLOCK_FRAMES * SYS_MIXER_CHANNEL_NUM);
+  while (!quit_.load()) {
+    if (sink_->GetWritableFrames() >= SYS_MIXER_BLOCK_FRAMES) {
+      mixer_->Mix(SYS_MIXER_BLOCK_FRAMES, &samples[0]);
+      sink_->Write(&samples[0], SYS_MIXER_BLOCK_FRAMES);
+      continue;
+    }
+    // The sink takes a block in every block time.
+    SleepNanoSecond(block_ns / 2);
+  }
+}
+
+  //
+  // These are internal functions related to mixer
+  //
+void MixMonoInt16(const int16_t* src, int frame_num, float gain_l,
+                  float gain_r, float* dst) {
+  assert(src || (frame_num == 0));
+  assert(dst);
+  gain_l *= kInt16Scale;
+  gain_r *= kInt16Scale;
+  int i = 0;
+#ifdef SYS_MIXER_USE_SSE2
+  const __m128 gain = _mm_setr_ps(gain_l, gain_r, gain_l, gain_r);
+  for (; i + 4 <= frame_num; i += 4) {
+    const __m128i s = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(
+        src + i));
+    const __m128 v = _mm_cvtepi32_ps(
+        _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+    float* d = dst + i * 2;
+    _mm_storeu_ps(d, _mm_add_ps(_mm_loadu_ps(d),
+                                _mm_mul_ps(_mm_unpacklo_ps(v, v), gain)));
+    _mm_storeu_ps(d + 4, _mm_add_ps(_mm_loadu_ps(d + 4),
+                                    _mm_mul_ps(_mm_unpackhi_ps(v, v), gain)));
+  }
+#endif
+  for (; i < frame_num; ++i) {
+    const float v = src[i];
+    dst[i * 2] += v * gain_l;
+    dst[i * 2 + 1] += v * gain_r;
+  }
+}
+void MixStereoInt16(const int16_t* src, int frame_num, float gain_l,
+                    float gain_r, float* dst) {
+  assert(src || (frame_num == 0));
+  assert(dst);
+  gain_l *= kInt16Scale;
+  gain_r *= kInt16Scale;
+  int i = 0;
+#ifdef SYS_MIXER_USE_SSE2
+  const __m128 gain = _mm_setr_ps(gain_l, gain_r, gain_l, gain_r);
+  for (; i + 4 <= frame_num; i += 4) {
+    const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+        src + i * 2));
+    const __m128 lo = _mm_cvtepi32_ps(
+        _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+    const __m128 hi = _mm_cvtepi32_ps(
+        _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+    float* d = dst + i * 2;
+    _mm_storeu_ps(d, _mm_add_ps(_mm_loadu_ps(d), _mm_mul_ps(lo, gain)));
+    _mm_storeu_ps(d + 4, _mm_add_ps(_mm_loadu_ps(d + 4),
+                                    _mm_mul_ps(hi, gain)));
+  }
+#endif
+  for (; i < frame_num; ++i) {
+    dst[i * 2] += src[i * 2] * gain_l;
+    dst[i * 2 + 1] += src[i * 2 + 1] * gain_r;
+  }
+}
+void MixMonoFloat(const float* src, int frame_num, float gain_l,
+                  float gain_r, float* dst) {
+  assert(src || (frame_num == 0));
+  assert(dst);
+  int i = 0;
+#ifdef SYS_MIXER_USE_SSE2
+  const __m128 gain = _mm_setr_ps(gain_l, gain_r, gain_l, gain_r);
+  for (; i + 4 <= frame_num; i += 4) {
+    const __m128 v = _mm_loadu_ps(src + i);
+    float* d = dst + i * 2;
+    _mm_storeu_ps(d, _mm_add_ps(_mm_loadu_ps(d),
+                                _mm_mul_ps(_mm_unpacklo_ps(v, v), gain)));
+    _mm_storeu_ps(d + 4, _mm_add_ps(_mm_loadu_ps(d + 4),
+                                    _mm_mul_ps(_mm_unpackhi_ps(v, v), gain)));
+  }
+#endif
+  for (; i < frame_num; ++i) {
+    dst[i * 2] += src[i] * gain_l;
+    dst[i * 2 + 1] += src[i] * gain_r;
+  }
+}
+void MixStereoFloat(const float* src, int frame_num, float gain_l,
+                    float gain_r, float* dst) {
+  assert(src || (frame_num == 0));
+  assert(dst);
+  int i = 0;
+#ifdef SYS_MIXER_USE_SSE2
+  const __m128 gain = _mm_setr_ps(gain_l, gain_r, gain_l, gain_r);
+  for (; i + 4 <= frame_num; i += 4) {
+    const float* s = src + i * 2;
+    float* d = dst + i * 2;
+    _mm_storeu_ps(d, _mm_add_ps(_mm_loadu_ps(d),
+                                _mm_mul_ps(_mm_loadu_ps(s), gain)));
+    _mm_storeu_ps(d + 4, _mm_add_ps(_mm_loadu_ps(d + 4),
+                                    _mm_mul_ps(_mm_loadu_ps(s + 4), gain)));
+  }
+#endif
+  for (; i < frame_num; ++i) {
+    dst[i * 2] += src[i * 2] * gain_l;
+    dst[i * 2 + 1] += src[i * 2 + 1] * gain_r;
+  }
+}
+void ConvertToInt16(const float* src, int sample_num, int16_t* dst) {
+  assert(src || (sample_num == 0));
+  assert(dst || (sample_num == 0));
+  int i = 0;
+#ifdef SYS_MIXER_USE_SSE2
+  // Clamped before the conversion, which overflows to the negative limit.
+  const __m128 scale = _mm_set1_ps(32768.0f);
+  const __m128 low = _mm_set1_ps(-32768.0f);
+  const __m128 high = _mm_set1_ps(32767.0f);
+  for (; i + 8 <= sample_num; i += 8) {
+    const __m128 a = _mm_min_ps(_mm_max_ps(
+        _mm_mul_ps(_mm_loadu_ps(src + i), scale), low), high);
+    const __m128 b = _mm_min_ps(_mm_max_ps(
+        _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), low), high);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+  }
+#endif
+  for (; i < sample_num; ++i) {
+    float v = src[i] * 32768.0f;
+    v = (v < -32768.0f) ? -32768.0f : ((v > 32767.0f) ? 32767.0f : v);
+    dst[i] = static_cast<int16_t>(v + ((v >= 0.0f) ? 0.5f : -0.5f));
+  }
+}
+bool ConvertPcm(const PcmFormat& format, const void* data, size_t size,
+                int loop_start, SYS_RESAMPLEQUALITY quality,
+                SampleBuffer* samples) {
+  assert(data || (size == 0));
+  assert(samples);
+  float gains[SYS_RESAMPLE_CHANNEL_MAX * 2];
+  if (!GetChannelGains(format.channel_num, format.channel_mask, gains)) {
+    return false;
+  }
+  if (format.sample_rate <= 0) return false;
+  const size_t frame_bytes = (format.bits / 8) * format.channel_num;
+  if (frame_bytes == 0) return false;
+  const size_t frame_num = size / frame_bytes;
+  if ((frame_num == 0) || (frame_num > 0x7fffffff)) return false;
+  const size_t sample_num = frame_num * format.channel_num;
+  // Mono stays mono to be panned.
+  const int channel_num = (format.channel_num == 1) ? 1 : 2;
+  samples->channel_num = channel_num;
+  samples->int16_samples.clear();
+  samples->float_samples.clear();
+  if (loop_start >= static_cast<int>(frame_num)) loop_start = 0;
+  samples->loop_start = (loop_start >= 0) ? loop_start : 0;
+  samples->loop_end = (loop_start >= 0) ? static_cast<int>(frame_num) : 0;
+  if ((format.sample_rate == SYS_MIXER_SAMPLE_RATE) &&
+      (format.channel_num <= 2)) {
+    if (!format.is_float && (format.bits == 8)) {
+      // Unsigned 8 bit.
+      const uint8_t* src = static_cast<const uint8_t*>(data);
+      samples->format = SYS_SAMPLEFORMAT_INT16;
+      samples->int16_samples.resize(sample_num);
+      for (size_t i = 0; i < sample_num; ++i) {
+        samples->int16_samples[i] = static_cast<int16_t>((src[i] - 128) << 8);
+      }
+    } else if (!format.is_float && (format.bits == 16)) {
+      samples->format = SYS_SAMPLEFORMAT_INT16;
+      samples->int16_samples.resize(sample_num);
+      memcpy(&samples->int16_samples[0], data, sample_num * sizeof(int16_t));
+    } else if (!format.is_float &&
+               ((format.bits == 24) || (format.bits == 32))) {
+      // Float keeps the precision.
+      samples->format = SYS_SAMPLEFORMAT_FLOAT;
+      samples->float_samples.resize(sample_num);
+      ReadPcmFrames(format, gains, data, static_cast<int>(frame_num),
+                    channel_num, &samples->float_samples[0]);
+    } else if (format.is_float && (format.bits == 32)) {
+      samples->format = SYS_SAMPLEFORMAT_FLOAT;
+      samples->float_samples.resize(sample_num);
+      memcpy(&samples->float_samples[0], data, sample_num * sizeof(float));
+    } else {
+      return false;
+    }
+    samples->frame_num = static_cast<int>(frame_num);
+    return true;
+  }
+  if (!(format.is_float ? (format.bits == 32) :
+        ((format.bits == 8) || (format.bits == 16) || (format.bits == 24) ||
+         (format.bits == 32)))) {
+    return false;
+  }
+  // The wave is converted at once, and the length is cut to the source
+  // length. The frames held by the filter are flushed, or a loop is
+  // converted apart from the frames before it, with the frames around it
+  // taken circularly, so the end joins the start without a click. The loop
+  // start is moved to the nearest frame in the mixer rate.
+  std::vector<float> dst(frame_num * channel_num);
+  ReadPcmFrames(format, gains, data, static_cast<int>(frame_num), channel_num,
+                &dst[0]);
+  const int64_t rate = format.sample_rate;
+  if (rate != SYS_MIXER_SAMPLE_RATE) {
+    std::vector<float> resampled;
+    const int source_frame_num = static_cast<int>(frame_num);
+    if (loop_start < 0) {
+      const int64_t dst_frame_num = (static_cast<int64_t>(frame_num) *
+        SYS_MIXER_SAMPLE_RATE + rate - 1) / rate;
+      if ((dst_frame_num == 0) || (dst_frame_num > 0x7fffffff)) return false;
+      if (!ResampleFrames(dst, channel_num, format.sample_rate, 0,
+                          source_frame_num, -1,
+                          static_cast<int>(dst_frame_num), quality,
+                          &resampled)) {
+        return false;
+      }
+    } else {
+      const int64_t dst_start = (static_cast<int64_t>(loop_start) *
+        SYS_MIXER_SAMPLE_RATE + rate / 2) / rate;
+      int64_t dst_end = (static_cast<int64_t>(frame_num) *
+        SYS_MIXER_SAMPLE_RATE + rate / 2) / rate;
+      if (dst_end <= dst_start) dst_end = dst_start + 1;
+      if (dst_end > 0x7fffffff) return false;
+      if (((loop_start > 0) &&
+           !ResampleFrames(dst, channel_num, format.sample_rate, 0,
+                           loop_start, loop_start,
+                           static_cast<int>(dst_start), quality,
+                           &resampled)) ||
+          !ResampleFrames(dst, channel_num, format.sample_rate, loop_start,
+                          source_frame_num, loop_start,
+                          static_cast<int>(dst_end - dst_start), quality,
+                          &resampled)) {
+        return false;
+      }
+      samples->loop_start = static_cast<int>(dst_start);
+    }
+    dst.swap(resampled);
+  }
+  samples->frame_num = static_cast<int>(dst.size() / channel_num);
+  if (loop_start >= 0) samples->loop_end = samples->frame_num;
+  if (format.is_float || (format.bits > 16)) {
+    samples->format = SYS_SAMPLEFORMAT_FLOAT;
+    samples->float_samples.swap(dst);
+  } else {
+    // 8 and 16 bit waves stay small.
+    samples->format = SYS_SAMPLEFORMAT_INT16;
+    samples->int16_samples.resize(dst.size());
+    ConvertToInt16(&dst[0], static_cast<int>(dst.size()),
+                   &samples->int16_samples[0]);
+  }
+  return samples->frame_num > 0;
+}
+int64_t GetSampleBytes(const SampleBuffer& samples) {
+  return static_cast<int64_t>(
+      sizeof(samples) + samples.int16_samples.capacity() * sizeof(int16_t) +
+      samples.float_samples.capacity() * sizeof(float));
+}
+int64_t FramesToNanoSecond(int64_t frame_num) {
+  // Seconds and the rest are multiplied apart, so days do not overflow.
+  const int64_t rest = frame_num % SYS_MIXER_SAMPLE_RATE;
+  return frame_num / SYS_MIXER_SAMPLE_RATE * SYS_NS_PER_SECOND +
+    (rest * SYS_NS_PER_SECOND + SYS_MIXER_SAMPLE_RATE - 1) /
+    SYS_MIXER_SAMPLE_RATE;
+}
+int64_t NanoSecondToFrames(int64_t ns) {
+  const int64_t rest = ns % SYS_NS_PER_SECOND;
+  return ns / SYS_NS_PER_SECOND * SYS_MIXER_SAMPLE_RATE +
+    rest * SYS_MIXER_SAMPLE_RATE / SYS_NS_PER_SECOND;
+}
+bool RenderMixer(Mixer* mixer, AudioSink* sink, int frame_num) {
+  assert(mixer);
+  assert(sink);
+  int16_t samples[SYS_MIXER_BLOCK_FRAMES * SYS_MIXER_CHANNEL_NUM];
+  while (frame_num > 0) {
+    const int n = (frame_num < SYS_MIXER_BLOCK_FRAMES) ?
+      frame_num : SYS_MIXER_BLOCK_FRAMES;
+    mixer->Mix(n, samples);
+    if (!sink->Write(samples, n)) return false;
+    frame_num -= n;
+  }
+  return true;
+}
+}  // namespace sys
@@ -0,0 +1,146 @@
+﻿  // @file mixer
+  // @brief Declaration of mixer related structures.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-18 10:12:05
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef MIXER_H_
+#define MIXER_H_
+#include <stdint.h>
+  //
+  // These are public macros related to mixer
+  //
+#define SYS_EFFECT_CHAIN_NUM              (4)  // Of a voice or the master.
+#define SYS_VOICE_NUM                     (512)  // Playing at once.
+#define SYS_VOICE_REAL_NUM                (64)  // Mixed, the others virtual.
+#define SYS_VOICE_CATEGORY_NUM            (8)
+#define SYS_BUS_NUM                       (16)  // With the user buses.
+
+  //
+  // These are public enumerations and constants related to mixer
+  //
+enum SYS_RESAMPLEQUALITY {
+  SYS_RESAMPLEQUALITY_LOW = 0,  // 8 taps.
+  SYS_RESAMPLEQUALITY_MEDIUM = 1,  // 16 taps.
+  SYS_RESAMPLEQUALITY_HIGH = 2,  // 32 taps.
+};
+enum SYS_EFFECTTYPE {
+  SYS_EFFECTTYPE_NONE = 0,
+  SYS_EFFECTTYPE_GAIN = 1,  // Ramped to the gain.
+  SYS_EFFECTTYPE_PAN = 2,  // Constant power, the center is -3 dB.
+  SYS_EFFECTTYPE_LOWPASS = 3,  // Biquad, 12 dB per octave.
+  SYS_EFFECTTYPE_HIGHPASS = 4,
+  SYS_EFFECTTYPE_BANDPASS = 5,  // The peak is 0 dB.
+  SYS_EFFECTTYPE_DELAY = 6,  // Echoes fed back, one of the master.
+  SYS_EFFECTTYPE_NUM = 7,
+};
+enum SYS_BUS {
+  SYS_BUS_MASTER = 0,
+  SYS_BUS_MUSIC = 1,
+  SYS_BUS_SFX = 2,
+  SYS_BUS_VOICE = 3,
+  SYS_BUS_USER = 4,  // The first user bus, up to SYS_BUS_NUM - 1.
+};
+enum SYS_VOICESTEAL {
+  SYS_VOICESTEAL_QUIETEST = 0,  // Then the oldest.
+  SYS_VOICESTEAL_OLDEST = 1,
+};
+
+namespace sys {
+  //
+  // These are public structures related to mixer
+  //
+  // Parameters of an effect, each type uses some of them.
+struct EffectDesc {
+  SYS_EFFECTTYPE type;
+  float gain;  // GAIN.
+  float ramp_ms;  // GAIN, the time to reach the gain.
+  float pan;  // PAN, -1 is left, 0 is center and 1 is right.
+  float frequency;  // Filters, the cutoff or the center in Hz.
+  float q;  // Filters, 0.707 is flat.
+  float delay_ms;  // DELAY, up to 1000.
+  float feedback;  // DELAY, the level of an echo to the next, below 1.
+  float wet;  // DELAY, the level of the echoes.
+  EffectDesc() :
+    type(SYS_EFFECTTYPE_NONE),
+    gain(1.0f),
+    ramp_ms(0.0f),
+    pan(0.0f),
+    frequency(1000.0f),
+    q(0.707f),
+    delay_ms(250.0f),
+    feedback(0.3f),
+    wet(0.5f) { }
+};
+  // The CPU cost of an effect type in the mixing thread.
+struct EffectStats {
+  int64_t block_num;  // Blocks processed, of 256 frames at most.
+  int64_t process_ns;
+  EffectStats() :
+    block_num(0),
+    process_ns(0) { }
+};
+struct VoiceDesc {
+  float gain;  // 1 is the level of the wave.
+  float pan;  // -1 is left, 0 is center and 1 is right.
+  const EffectDesc* effects;  // Applied in order, up to 4.
+  int effect_num;
+  int64_t start_frame;  // On the sound clock, 0 to start now.
+  int priority;  // A higher one is mixed and kept first.
+  int category;  // 0 to SYS_VOICE_CATEGORY_NUM - 1.
+  int bus;  // Mixed to it.
+  VoiceDesc() :
+    gain(1.0f),
+    pan(0.0f),
+    effects(nullptr),
+    effect_num(0),
+    start_frame(0),
+    priority(0),
+    category(0),
+    bus(SYS_BUS_SFX) { }
+};
+  // Voices of a category over the limit are virtual, the ones the policy
+  // steals first.
+struct VoiceCategoryDesc {
+  int voice_limit;  // Mixed at once.
+  SYS_VOICESTEAL steal;
+  VoiceCategoryDesc() :
+    voice_limit(SYS_VOICE_REAL_NUM),
+    steal(SYS_VOICESTEAL_QUIETEST) { }
+};
+  // A bus is mixed to the parent, which is a bus of a lower index. The
+  // sidechain is a bus of a higher index, and the bus is lowered by the
+  // level of it over the threshold, down to duck_gain.
+struct BusDesc {
+  int parent;  // Not used by the master.
+  float gain;
+  float ramp_ms;  // The time to reach the gain.
+  bool is_muted;
+  int sidechain;  // -1 for none.
+  float duck_threshold;
+  float duck_gain;
+  float attack_ms;  // Of the envelope of the sidechain.
+  float release_ms;
+  BusDesc() :
+    parent(SYS_BUS_MASTER),
+    gain(1.0f),
+    ramp_ms(0.0f),
+    is_muted(false),
+    sidechain(-1),
+    duck_threshold(0.05f),
+    duck_gain(0.25f),
+    attack_ms(10.0f),
+    release_ms(300.0f) { }
+};
+struct BusStats {
+  int64_t block_num;  // Processed.
+  int64_t process_ns;
+  float peak;  // Of the last block, after the gain.
+  float duck_gain;  // At the end of the last block.
+  BusStats() :
+    block_num(0),
+    process_ns(0),
+    peak(0.0f),
+    duck_gain(1.0f) { }
+};
+}  // namespace sys
+#endif  // MIXER_H_
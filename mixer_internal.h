@@ -0,0 +1,425 @@
+﻿  // @file mixer_internal.h
+  // @brief Declaration of mixer related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 20:14:51
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef MIXER_INTERNAL_H_
+#define MIXER_INTERNAL_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "./effect_internal.h"
+#include "./profile_internal.h"
+#include "./resample_internal.h"
+#include "./ring_internal.h"
+  //
+  // These are internal macros related to mixer
+  //
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define SYS_MIXER_USE_SSE2
+#endif
+#define SYS_MIXER_SAMPLE_RATE     (44100)
+#define SYS_MIXER_CHANNEL_NUM     (2)  // Output is interleaved stereo.
+#define SYS_MIXER_VOICE_NUM       (512)  // Mixed or virtual.
+#define SYS_MIXER_REAL_VOICE_NUM  (64)  // Mixed in a block.
+#define SYS_MIXER_AUDIBLE_GAIN    (0.001f)  // -60 dB.
+#define SYS_MIXER_BUS_NUM         (16)
+#define SYS_MIXER_BUS_RAMP_FRAMES (256)  // A gain is moved in it at least.
+#define SYS_MIXER_BLOCK_FRAMES    (256)  // Frames mixed at once, 5.8 ms.
+#define SYS_MIXER_INVALID_VOICE   (-1)
+#define SYS_MIXER_STREAM_NUM      (256)
+#define SYS_MIXER_COMMAND_NUM     (1024)  // Sent and not mixed yet.
+#define SYS_MIXER_RETIRED_NUM     (2048)  // Sent back and not collected.
+#define SYS_MIXER_TIME_NUM        (1024)  // Mix times not collected, 5.9 s.
+#define SYS_MIXER_CLOCK_WEIGHT    (64)  // The clock follows 1/64 of a delay.
+#define SYS_MIXER_INVALID_CLOCK   (INT64_MIN)  // Before the first Mix.
+#define SYS_STREAM_RING_FRAMES    (32768)  // Read ahead of the mixer, 0.74 s.
+
+  //
+  // These are internal enumerations and constants related to mixer
+  //
+enum SYS_SAMPLEFORMAT {
+  SYS_SAMPLEFORMAT_INT16,
+  SYS_SAMPLEFORMAT_FLOAT,  // In [-1, 1].
+};
+enum SYS_MIXERCOMMAND {
+  SYS_MIXERCOMMAND_NONE,
+  SYS_MIXERCOMMAND_PLAY,
+  SYS_MIXERCOMMAND_STOP,
+  SYS_MIXERCOMMAND_SET_GAIN,
+  SYS_MIXERCOMMAND_ADD_STREAM,
+  SYS_MIXERCOMMAND_REMOVE_STREAM,
+  SYS_MIXERCOMMAND_SET_EFFECT,
+  SYS_MIXERCOMMAND_SET_MASTER_EFFECT,
+  SYS_MIXERCOMMAND_SET_CATEGORY,
+  SYS_MIXERCOMMAND_SET_AUDIBLE_GAIN,
+  SYS_MIXERCOMMAND_SET_BUS,
+  SYS_MIXERCOMMAND_SET_BUS_EFFECT,
+};
+
+namespace sys {
+  //
+  // These are internal structures related to mixer
+  //
+struct PcmFormat {
+  int sample_rate;
+  int channel_num;
+  int bits;  // Bits of a sample.
+  bool is_float;
+  uint32_t channel_mask;  // Speakers of the channels, 0 for the default.
+  PcmFormat();
+};
+  // Samples of a wave in the mixer rate, mono or interleaved stereo. Voices
+  // share it, so a wave can be released while it is played. Voices of a
+  // looped one go back to the loop start at the end until they are stopped.
+struct SampleBuffer {
+  SYS_SAMPLEFORMAT format;
+  int channel_num;
+  int frame_num;
+  int loop_start;
+  int loop_end;  // The frame after the loop, 0 for no loop.
+  std::vector<int16_t> int16_samples;
+  std::vector<float> float_samples;
+  SampleBuffer();
+};
+  // A voice in the mixing thread. A virtual one is not mixed, but the
+  // position goes on.
+struct Voice {
+  std::shared_ptr<const SampleBuffer> samples;
+  int position;  // The next frame.
+  float gain;
+  float pan;  // -1 is left, 1 is right.
+  int voice_id;
+  int64_t start_frame;  // Waits for the frame if positive, 0 once started.
+  int priority;
+  int category;
+  int bus;
+  float audible_gain;  // With the gains of the buses.
+  uint64_t play_order;
+  bool is_real;  // Mixed in the last block.
+  bool is_selected;  // To be mixed in this block.
+  EffectChain effects;  // Last, the fields above are read for all voices.
+  Voice();
+};
+  // A voice as the client thread sees it. It is ended when the mixing thread
+  // sends it back.
+struct VoiceSlot {
+  int owner_id;  // Voices of an owner are stopped together.
+  int priority;
+  float gain;
+  uint32_t generation;
+  uint64_t play_order;  // The oldest one is stolen first.
+  bool in_use;
+  VoiceSlot();
+};
+  // Frames of a stream are written by the reading thread and read by the
+  // mixing thread, float interleaved stereo in the mixer rate. Underruns are
+  // counted after the reading thread has filled the ring first.
+class StreamBuffer {
+ public:
+  explicit StreamBuffer(int frame_num);
+  int GetCapacityFrames() const;
+  int GetReadableFrames() const;
+  int GetWritableFrames() const;
+  int Write(const float* samples, int frame_num);  // The reading thread.
+  int Read(float* samples, int frame_num);  // The mixing thread.
+  float gain;
+  int bus;
+  std::atomic<bool> ready;  // Filled first.
+  std::atomic<bool> paused;
+  std::atomic<bool> end;  // No more frames are written.
+  std::atomic<int64_t> played_frames;
+  std::atomic<int64_t> underrun_num;
+  std::atomic<int64_t> underrun_frames;
+  std::atomic<int> min_fill_frames;
+  std::atomic<int64_t> decoded_pieces;  // Read by the reading thread.
+  std::atomic<int64_t> decode_ns;
+  std::atomic<int64_t> max_decode_ns;
+ private:
+  SpscRing<float> ring_;
+};
+  // PCM of any rate and channels is converted to float stereo in the mixer
+  // rate, piece by piece. The resampler keeps the frames between pieces, so
+  // pieces are joined without a gap.
+class StreamConverter {
+ public:
+  StreamConverter();
+  bool Reset(const PcmFormat& format, SYS_RESAMPLEQUALITY quality);
+  int GetSourceFrames(int frame_num) const;  // Source frames for frame_num.
+  int Convert(const void* data, int source_frame_num, std::vector<float>* out);
+  int Flush(std::vector<float>* out);  // At the end.
+ private:
+  PcmFormat format_;
+  float gains_[SYS_RESAMPLE_CHANNEL_MAX * 2];
+  bool use_resampler_;
+  Resampler resampler_;
+  std::vector<float> stereo_;
+};
+  // Sent from the client thread to the mixing thread.
+struct MixerCommand {
+  SYS_MIXERCOMMAND type;
+  int voice_id;
+  float gain;
+  float pan;
+  std::shared_ptr<const SampleBuffer> samples;
+  std::shared_ptr<StreamBuffer> stream;  // To add.
+  const StreamBuffer* removed_stream;
+  int effect_index;  // SET_EFFECT, SET_MASTER_EFFECT and SET_BUS_EFFECT.
+  int effect_num;  // PLAY.
+  EffectDesc effects[SYS_EFFECT_CHAIN_NUM];
+  int64_t start_frame;  // PLAY.
+  int priority;  // PLAY.
+  int category;  // PLAY and SET_CATEGORY.
+  VoiceCategoryDesc category_desc;  // SET_CATEGORY.
+  int bus;  // PLAY, SET_BUS and SET_BUS_EFFECT.
+  BusDesc bus_desc;  // SET_BUS.
+  MixerCommand();
+};
+  // Sent back from the mixing thread. The voice has ended, and the client
+  // thread releases the buffers.
+struct MixerRetired {
+  int voice_id;  // -1 for none.
+  std::shared_ptr<const SampleBuffer> samples;
+  std::shared_ptr<StreamBuffer> stream;
+  MixerRetired();
+};
+  // A bus in the mixing thread. Voices, streams and the child buses are
+  // mixed to the block of the bus, which is mixed to the parent with the
+  // gain. The envelope follows the level of the sidechain bus, and the gain
+  // is lowered by the level over the threshold. The effects are applied
+  // before the gain, without a delay line as for voices.
+struct MixerBus {
+  BusDesc desc;
+  EffectChain effects;
+  float gain;  // Ramped to the target.
+  float target_gain;
+  float gain_step;
+  int ramp_frames;  // Left.
+  float attack;  // Of the envelope follower.
+  float release;
+  float envelope;
+  float duck_gain;  // At the end of the last block.
+  bool is_used;  // Something is mixed to the block.
+  MixerBus();
+};
+  // The cost of a bus and the levels at the end of the last block.
+struct BusCost {
+  std::atomic<int64_t> block_num;
+  std::atomic<int64_t> process_ns;
+  std::atomic<float> peak;
+  std::atomic<float> duck_gain;
+  BusCost();
+};
+struct MixerStats {
+  int playing_num;
+  int active_num;  // Voices mixed in the last block.
+  int virtual_num;  // Voices not mixed in the last block.
+  int64_t played_num;
+  int64_t stolen_num;  // Voices stopped to play new ones.
+  int64_t mixed_frames;
+  int64_t late_num;  // Voices started after the start frame.
+  int64_t late_frames;  // Sum of the frames they were late.
+  int64_t last_mix_ns;  // Of the last call of Mix.
+  int64_t max_mix_ns;
+  MixerStats();
+};
+  // A fixed pool of voices is mixed into float blocks, which are converted to
+  // 16 bit samples. When all voices are used, one of the lowest priority is
+  // stolen, the quietest and the oldest first. Up to SYS_MIXER_REAL_VOICE_NUM
+  // voices are mixed in a block, the others are virtual. Quiet voices and
+  // voices over the limit of the category are virtual first. A voice moved
+  // in or out in the middle is faded in the block, so the cost of a block is
+  // bounded by twice the limit. Voices and streams are mixed to buses, and
+  // the buses are processed from the last one, so the children and the
+  // sidechain of a bus are done before it.
+  // One client thread sends commands through a wait-free queue, and the
+  // mixing thread sends back what it has done with and the time of each
+  // call, so the mixing thread never locks, allocates or frees memory. A
+  // voice with effects is mixed to its own block first, and the master
+  // effects are applied last. A voice may wait for a frame of the mixer
+  // clock, the frames mixed since the start, and it starts at the frame
+  // inside the block. The clock offset is the clock of the frame 0 as Mix
+  // has seen it, smoothed over the calls.
+class Mixer {
+ public:
+  Mixer();
+  // These are called by the client thread.
+  int Play(const std::shared_ptr<const SampleBuffer>& samples, int owner_id,
+           const VoiceDesc& desc);
+  bool Stop(int voice_id);
+  void StopOwner(int owner_id);
+  void StopAll();
+  bool SetGain(int voice_id, float gain);
+  bool IsPlaying(int voice_id);
+  bool SetEffect(int voice_id, int index, const EffectDesc& desc);
+  bool SetMasterEffect(int index, const EffectDesc& desc);
+  bool SetCategory(int category, const VoiceCategoryDesc& desc);
+  bool SetAudibleGain(float gain);
+  bool SetBus(int bus, const BusDesc& desc);
+  bool SetBusEffect(int bus, int index, const EffectDesc& desc);
+  bool GetBus(int bus, BusDesc* desc) const;
+  bool AddStream(const std::shared_ptr<StreamBuffer>& stream);
+  void RemoveStream(const StreamBuffer* stream);
+  MixerStats GetStats();
+  EffectStats GetEffectStats(SYS_EFFECTTYPE type) const;
+  BusStats GetBusStats(int bus) const;
+  const LogHistogram& GetMixHistogram();  // Times of the calls of Mix.
+  void ResetTimeStats();
+  void Collect();  // Called by the other functions too.
+  int64_t GetFrame() const;  // The next frame mixed.
+  int64_t GetClockOffset() const;
+  // This is called by the mixing thread.
+  void Mix(int frame_num, int16_t* out);  // Interleaved stereo.
+ private:
+  Mixer(const Mixer&);
+  Mixer& operator=(const Mixer&);
+  bool Send(const MixerCommand& command);
+  VoiceSlot* GetVoiceSlot(int voice_id);
+  void Execute(MixerCommand* command);
+  Voice* GetVoice(int voice_id);
+  bool Retire(Voice* voice);  // False if the voice is kept.
+  void SelectVoices(int frame_num);
+  void AdvanceVoice(Voice* voice, int frame_num);
+  void MixBlock(int frame_num);
+  void MixStream(StreamBuffer* stream, int frame_num);
+  float* GetBusBlock(int bus, int frame_num);  // Cleared when first used.
+  void ProcessBus(int bus, int frame_num);
+  // The client thread.
+  VoiceSlot voice_slots_[SYS_MIXER_VOICE_NUM];
+  std::vector<std::shared_ptr<StreamBuffer>> added_streams_;
+  std::vector<std::shared_ptr<StreamBuffer>> removed_streams_;  // Not sent.
+  uint64_t play_order_;
+  int64_t played_num_;
+  int64_t stolen_num_;
+  LogHistogram mix_histogram_;
+  BusDesc bus_descs_[SYS_MIXER_BUS_NUM];
+  int master_delay_index_;  // Of the master effects sent, -1 for none.
+  // Both threads.
+  SpscRing<MixerCommand> commands_;
+  SpscRing<MixerRetired> retired_;
+  SpscRing<int64_t> mix_times_;
+  std::atomic<int> active_num_;
+  std::atomic<int> virtual_num_;
+  std::atomic<int64_t> mixed_frames_;
+  std::atomic<int64_t> late_num_;
+  std::atomic<int64_t> late_frames_;
+  std::atomic<int64_t> clock_offset_ns_;
+  std::atomic<int64_t> last_mix_ns_;
+  std::atomic<int64_t> max_mix_ns_;
+  EffectCost effect_costs_[SYS_EFFECTTYPE_NUM];
+  BusCost bus_costs_[SYS_MIXER_BUS_NUM];
+  // The mixing thread.
+  Voice voices_[SYS_MIXER_VOICE_NUM];
+  std::shared_ptr<StreamBuffer> streams_[SYS_MIXER_STREAM_NUM];
+  int stream_num_;
+  int64_t block_frame_;  // The first frame of the block mixed.
+  uint64_t voice_order_;
+  VoiceCategoryDesc categories_[SYS_VOICE_CATEGORY_NUM];
+  float audible_gain_;
+  int selected_[SYS_MIXER_VOICE_NUM];  // Voices in the order to be mixed.
+  MixerBus buses_[SYS_MIXER_BUS_NUM];
+  EffectChain master_effects_;
+  float bus_blocks_[SYS_MIXER_BUS_NUM][SYS_MIXER_BLOCK_FRAMES *
+                                       SYS_MIXER_CHANNEL_NUM];
+  float stream_block_[SYS_MIXER_BLOCK_FRAMES * SYS_MIXER_CHANNEL_NUM];
+  float voice_block_[SYS_MIXER_BLOCK_FRAMES * SYS_MIXER_CHANNEL_NUM];
+};
+  // The mixed samples are written to a sink, 16 bit interleaved stereo in
+  // the mixer rate.
+class AudioSink {
+ public:
+  virtual ~AudioSink() { }
+  virtual bool Open() = 0;
+  virtual void Close() = 0;
+  virtual int GetWritableFrames() = 0;
+  virtual bool Write(const int16_t* samples, int frame_num) = 0;
+  // Written and not heard when a block is mixed.
+  virtual int GetLatencyFrames() { return 0; }
+};
+  // Samples are thrown away, so the mixing speed is measured.
+class NullSink : public AudioSink {
+ public:
+  NullSink() : written_frames_(0) { }
+  bool Open() { return true; }
+  void Close() { }
+  int GetWritableFrames() { return SYS_MIXER_BLOCK_FRAMES; }
+  bool Write(const int16_t* samples, int frame_num);
+  int64_t GetWrittenFrames() const { return written_frames_; }
+ private:
+  int64_t written_frames_;
+};
+  // Samples are kept in memory.
+class MemorySink : public AudioSink {
+ public:
+  MemorySink() : samples_() { }
+  bool Open() { samples_.clear(); return true; }
+  void Close() { }
+  int GetWritableFrames() { return SYS_MIXER_BLOCK_FRAMES; }
+  bool Write(const int16_t* samples, int frame_num);
+  const std::vector<int16_t>& GetSamples() const { return samples_; }
+ private:
+  std::vector<int16_t> samples_;
+};
+  // Samples are written to a wave file, the sizes are set when it is closed.
+class WavFileSink : public AudioSink {
+ public:
+  explicit WavFileSink(const wchar_t* file_name);
+  ~WavFileSink();
+  bool Open();
+  void Close();
+  int GetWritableFrames() { return SYS_MIXER_BLOCK_FRAMES; }
+  bool Write(const int16_t* samples, int frame_num);
+ private:
+  std::wstring file_name_;
+  FILE* file_;
+  int64_t data_bytes_;
+};
+  // The mixer is rendered to the sink whenever it takes a block.
+class MixerThread {
+ public:
+  MixerThread();
+  ~MixerThread();
+  bool Start(Mixer* mixer, AudioSink* sink);
+  void Stop();
+ private:
+  void MixProc();
+  Mixer* mixer_;
+  AudioSink* sink_;
+  std::thread thread_;
+  std::atomic<bool> quit_;
+};
+
+  //
+  // These are internal functions related to mixer
+  //
+  // Kernels add src multiplied by the gains to dst, interleaved stereo.
+void MixMonoInt16(const int16_t* src, int frame_num, float gain_l,
+                  float gain_r, float* dst);
+void MixStereoInt16(const int16_t* src, int frame_num, float gain_l,
+                    float gain_r, float* dst);
+void MixMonoFloat(const float* src, int frame_num, float gain_l,
+                  float gain_r, float* dst);
+void MixStereoFloat(const float* src, int frame_num, float gain_l,
+                    float gain_r, float* dst);
+void ConvertToInt16(const float* src, int sample_num, int16_t* dst);
+  // 8 and 16 bit PCM are converted to 16 bit, 24 and 32 bit PCM to float,
+  // 32 bit float is kept. Other rates are converted to the mixer rate, and
+  // more than 2 channels are mixed down to stereo. The data is looped from
+  // loop_start to the end, or not looped if it is -1.
+bool ConvertPcm(const PcmFormat& format, const void* data, size_t size,
+                int loop_start, SYS_RESAMPLEQUALITY quality,
+                SampleBuffer* samples);
+int64_t GetSampleBytes(const SampleBuffer& samples);  // Resident in memory.
+  // Frames of the mixer rate. Nanoseconds are rounded up, so a frame comes
+  // back as the same frame.
+int64_t FramesToNanoSecond(int64_t frame_num);
+int64_t NanoSecondToFrames(int64_t ns);
+bool RenderMixer(Mixer* mixer, AudioSink* sink, int frame_num);
+}  // namespace sys
+#endif  // MIXER_INTERNAL_H_
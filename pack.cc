@@ -0,0 +1,328 @@
+﻿  // @file pack
+  // @brief Definitions of pack related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 19:20:05
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include <stdio.h>
+#include "./common.h"
+#include "./pack.h"
+#include "./pack_internal.h"
+namespace sys {
+  //
+  // These are private functions related to pack
+  //
+namespace {
+uint64_t Align(uint64_t offset, uint64_t alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+bool WritePadding(FILE* file, uint64_t* offset, uint64_t alignment) {
+  static const uint8_t zero[SYS_PACK_ALIGNMENT] = {0};
+  const uint64_t size = Align(*offset, alignment) - *offset;
+  if (fwrite(zero, 1, static_cast<size_t>(size), file) != size) return false;
+  *offset += size;
+  return true;
+}
+bool GetFileSize(const wchar_t* file_name, uint64_t* size) {
+  WIN32_FILE_ATTRIBUTE_DATA attribute;
+  if (!GetFileAttributesExW(file_name, GetFileExInfoStandard, &attribute)) {
+    return false;
+  }
+  *size = (static_cast<uint64_t>(attribute.nFileSizeHigh) << 32) |
+    attribute.nFileSizeLow;
+  return true;
+}
+bool CopyFileData(const wchar_t* file_name, uint64_t size, FILE* out) {
+  FILE* in = nullptr;
+  if (_wfopen_s(&in, file_name, L"rb") != 0) return false;
+  std::vector<uint8_t> buffer(64 * 1024);
+  while (size > 0) {
+    const size_t n = static_cast<size_t>(
+        (size < buffer.size()) ? size : buffer.size());
+    if ((fread(&buffer[0], 1, n, in) != n) ||
+        (fwrite(&buffer[0], 1, n, out) != n)) {
+      fclose(in);
+      return false;
+    }
+    size -= n;
+  }
+  fclose(in);
+  return true;
+}
+}  // namespace
+
+  //
+  // These are internal structures related to pack
+  //
+PackData pack_data;
+PackData::PackData() : packs() { }
+PackFile::PackFile() : file_(INVALID_HANDLE_VALUE), mapping_(nullptr),
+    view_(nullptr), size_(0), header_(nullptr), entries_(nullptr),
+    buckets_(nullptr), names_(nullptr) { }
+PackFile::~PackFile() {
+  Close();
+}
+bool PackFile::Open(const wchar_t* pack_name) {
+  assert(pack_name);
+  assert(!view_);
+  file_ = CreateFileW(
+      pack_name,
+      GENERIC_READ,
+      FILE_SHARE_READ,
+      nullptr,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL,
+      nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) return false;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size) || (size.QuadPart <= 0)) {
+    Close();
+    return false;
+  }
+  size_ = static_cast<uint64_t>(size.QuadPart);
+  // Pages are read when they are touched first.
+  mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping_) {
+    Close();
+    return false;
+  }
+  view_ = static_cast<const uint8_t*>(
+      MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (!view_) {
+    Close();
+    return false;
+  }
+  header_ = reinterpret_cast<const PackHeader*>(view_);
+  if (!Validate()) {
+    Close();
+    return false;
+  }
+  entries_ = reinterpret_cast<const PackEntry*>(view_ + header_->entry_offset);
+  buckets_ = reinterpret_cast<const uint32_t*>(view_ + header_->bucket_offset);
+  names_ = reinterpret_cast<const uint16_t*>(view_ + header_->name_offset);
+  return true;
+}
+void PackFile::Close() {
+  if (view_) UnmapViewOfFile(view_);
+  if (mapping_) CloseHandle(mapping_);
+  if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+  file_ = INVALID_HANDLE_VALUE;
+  mapping_ = nullptr;
+  view_ = nullptr;
+  size_ = 0;
+  header_ = nullptr;
+  entries_ = nullptr;
+  buckets_ = nullptr;
+  names_ = nullptr;
+}
+const PackEntry* PackFile::Find(const std::wstring& name,
+                                uint64_t hash) const {
+  if (!view_) return nullptr;
+  // Validate made sure of an empty bucket, and a probe visits a bucket once
+  // at most anyway.
+  const uint32_t bucket_num = header_->bucket_num;
+  const uint32_t mask = bucket_num - 1;
+  uint32_t i = static_cast<uint32_t>(hash) & mask;
+  for (uint32_t n = 0; n < bucket_num; ++n, i = (i + 1) & mask) {
+    const uint32_t bucket = buckets_[i];
+    if (bucket == 0) return nullptr;
+    const PackEntry& entry = entries_[bucket - 1];
+    if ((entry.hash != hash) || (entry.name_length != name.size())) continue;
+    const uint16_t* entry_name = names_ + entry.name_offset;
+    bool same = true;
+    for (size_t j = 0; (j < name.size()) && same; ++j) {
+      same = (entry_name[j] == static_cast<uint16_t>(name[j]));
+    }
+    if (same) return &entry;
+  }
+  return nullptr;
+}
+const uint8_t* PackFile::GetData(const PackEntry& entry) const {
+  assert(view_);
+  return view_ + entry.offset;
+}
+bool PackFile::Validate() const {
+  // Offsets are checked without overflow.
+  auto in_file = [this](uint64_t offset, uint64_t size) {
+    return (offset <= size_) && (size <= size_ - offset);
+  };
+  if (size_ < sizeof(PackHeader)) return false;
+  const PackHeader& header = *header_;
+  if ((header.magic != SYS_PACK_MAGIC) ||
+      (header.version != SYS_PACK_VERSION) ||
+      (header.file_size != size_)) {
+    return false;
+  }
+  if ((header.bucket_num == 0) ||
+      ((header.bucket_num & (header.bucket_num - 1)) != 0) ||
+      (header.bucket_num <= header.entry_num)) {
+    return false;
+  }
+  if (((header.entry_offset % sizeof(uint64_t)) != 0) ||
+      ((header.bucket_offset % sizeof(uint32_t)) != 0) ||
+      ((header.name_offset % sizeof(uint16_t)) != 0)) {
+    return false;
+  }
+  if (!in_file(header.entry_offset,
+               static_cast<uint64_t>(header.entry_num) * sizeof(PackEntry)) ||
+      !in_file(header.bucket_offset,
+               static_cast<uint64_t>(header.bucket_num) * sizeof(uint32_t)) ||
+      !in_file(header.name_offset, 0)) {
+    return false;
+  }
+  const PackEntry* entries =
+    reinterpret_cast<const PackEntry*>(view_ + header.entry_offset);
+  const uint64_t name_num = (size_ - header.name_offset) / sizeof(uint16_t);
+  for (uint32_t i = 0; i < header.entry_num; ++i) {
+    const PackEntry& entry = entries[i];
+    if (!in_file(entry.offset, entry.size)) return false;
+    if ((entry.name_offset > name_num) ||
+        (entry.name_length > name_num - entry.name_offset)) {
+      return false;
+    }
+  }
+  const uint32_t* buckets =
+    reinterpret_cast<const uint32_t*>(view_ + header.bucket_offset);
+  bool has_empty = false;
+  for (uint32_t i = 0; i < header.bucket_num; ++i) {
+    if (buckets[i] > header.entry_num) return false;
+    if (buckets[i] == 0) has_empty = true;
+  }
+  return has_empty;
+}
+
+  //
+  // These are public structures related to pack
+  //
+
+  //
+  // These are internal functions related to pack
+  //
+std::wstring NormalizePackName(const wchar_t* name) {
+  assert(name);
+  std::wstring normalized(name);
+  for (auto& c : normalized) {
+    if (c == L'\\') {
+      c = L'/';
+    } else if ((c >= L'A') && (c <= L'Z')) {
+      c = c - L'A' + L'a';
+    }
+  }
+  return normalized;
+}
+uint64_t HashPackName(const std::wstring& name) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (auto c : name) {
+    hash ^= static_cast<uint16_t>(c);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+void FinalizePack() {
+  pack_data.packs.clear();
+}
+
+  //
+  // These are public functions related to pack
+  //
+bool CreatePackFile(const wchar_t* pack_name, const wchar_t* const* file_names,
+                    int num) {
+  assert(pack_name);
+  assert(file_names || (num == 0));
+  assert(num >= 0);
+  // 1. Entries are made and put in the buckets.
+  std::vector<PackEntry> entries(num);
+  std::wstring names;
+  uint32_t bucket_num = 1;
+  while (bucket_num <= static_cast<uint32_t>(num) * 2) bucket_num *= 2;
+  std::vector<uint32_t> buckets(bucket_num, 0);
+  for (int i = 0; i < num; ++i) {
+    const std::wstring name = NormalizePackName(file_names[i]);
+    PackEntry& entry = entries[i];
+    entry.hash = HashPackName(name);
+    entry.name_offset = static_cast<uint32_t>(names.size());
+    entry.name_length = static_cast<uint32_t>(name.size());
+    if (!GetFileSize(file_names[i], &entry.size)) {
+      ErrorDialogBox(SYS_ERROR_FILE_NOT_READ, file_names[i]);
+      return false;
+    }
+    names += name;
+    uint32_t j = static_cast<uint32_t>(entry.hash) & (bucket_num - 1);
+    for (; buckets[j] != 0; j = (j + 1) & (bucket_num - 1)) {
+      const PackEntry& other = entries[buckets[j] - 1];
+      if ((other.hash == entry.hash) &&
+          (names.compare(other.name_offset, other.name_length, name) == 0)) {
+        ErrorDialogBox(SYS_ERROR_DUPLICATE_PACK_ENTRY, file_names[i]);
+        return false;
+      }
+    }
+    buckets[j] = i + 1;
+  }
+  // 2. The layout is decided, the data are aligned.
+  PackHeader header;
+  header.magic = SYS_PACK_MAGIC;
+  header.version = SYS_PACK_VERSION;
+  header.entry_num = static_cast<uint32_t>(num);
+  header.bucket_num = bucket_num;
+  header.entry_offset = sizeof(PackHeader);
+  header.bucket_offset = header.entry_offset + sizeof(PackEntry) * num;
+  header.name_offset = header.bucket_offset + sizeof(uint32_t) * bucket_num;
+  uint64_t offset = header.name_offset + sizeof(uint16_t) * names.size();
+  for (auto& entry : entries) {
+    entry.offset = Align(offset, SYS_PACK_ALIGNMENT);
+    offset = entry.offset + entry.size;
+  }
+  header.file_size = offset;
+  // 3. The file is written.
+  FILE* file = nullptr;
+  if (_wfopen_s(&file, pack_name, L"wb") != 0) {
+    ErrorDialogBox(SYS_ERROR_PACK_NOT_OPENED, pack_name);
+    return false;
+  }
+  std::vector<uint16_t> name_chars(names.begin(), names.end());
+  bool result =
+    (fwrite(&header, sizeof(header), 1, file) == 1) &&
+    (entries.empty() ||
+     (fwrite(&entries[0], sizeof(PackEntry), num, file) == entries.size())) &&
+    (fwrite(&buckets[0], sizeof(uint32_t), bucket_num, file) == bucket_num) &&
+    (name_chars.empty() ||
+     (fwrite(&name_chars[0], sizeof(uint16_t), name_chars.size(), file) ==
+      name_chars.size()));
+  offset = header.name_offset + sizeof(uint16_t) * names.size();
+  for (int i = 0; (i < num) && result; ++i) {
+    result = WritePadding(file, &offset, SYS_PACK_ALIGNMENT) &&
+      CopyFileData(file_names[i], entries[i].size, file);
+    if (!result) ErrorDialogBox(SYS_ERROR_FILE_NOT_READ, file_names[i]);
+    offset += entries[i].size;
+  }
+  fclose(file);
+  return result;
+}
+bool OpenPack(const wchar_t* pack_name) {
+  assert(pack_name);
+  std::unique_ptr<PackFile> pack(new PackFile());
+  if (!pack->Open(pack_name)) {
+    ErrorDialogBox(SYS_ERROR_PACK_NOT_OPENED, pack_name);
+    return false;
+  }
+  pack_data.packs.push_back(std::move(pack));
+  return true;
+}
+bool GetPackResource(const wchar_t* name, ResourceDesc* resource_desc) {
+  assert(name);
+  assert(resource_desc);
+  const std::wstring normalized = NormalizePackName(name);
+  const uint64_t hash = HashPackName(normalized);
+  for (auto& pack : pack_data.packs) {
+    const PackEntry* entry = pack->Find(normalized, hash);
+    if (!entry) continue;
+    resource_desc->file_name = name;
+    resource_desc->mem_ptr = const_cast<uint8_t*>(pack->GetData(*entry));
+    resource_desc->mem_size = static_cast<size_t>(entry->size);
+    resource_desc->use_mem = true;
+    return true;
+  }
+  ErrorDialogBox(SYS_ERROR_PACK_ENTRY_NOT_FOUND, name);
+  return false;
+}
+}  // namespace sys
@@ -0,0 +1,38 @@
+﻿  // @file pack
+  // @brief Declaration of pack related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 19:20:05
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef PACK_H_
+#define PACK_H_
+#include <wchar.h>
+#include "./common.h"
+  //
+  // These are public macros related to pack
+  //
+#define SYS_ERROR_PACK_NOT_OPENED         L"Error! Pack not opened:%s"
+#define SYS_ERROR_PACK_ENTRY_NOT_FOUND    L"Error! Pack entry not found:%s"
+#define SYS_ERROR_DUPLICATE_PACK_ENTRY    L"Error! Duplicate pack entry:%s"
+#define SYS_ERROR_FILE_NOT_READ           L"Error! File not read:%s"
+
+  //
+  // These are public enumerations and constants related to pack
+  //
+
+namespace sys {
+  //
+  // These are public structures related to pack
+  //
+
+  //
+  // These are public functions related to pack
+  //
+  // Files are stored by their names, where back slashes are slashes and A-Z
+  // are a-z, so either can be used in GetPackResource.
+bool CreatePackFile(const wchar_t* pack_name, const wchar_t* const* file_names,
+                    int num);
+bool OpenPack(const wchar_t* pack_name);  // Mapped until FinalizeSystem.
+  // The resource points to the mapped file, it must not be written.
+bool GetPackResource(const wchar_t* name, ResourceDesc* resource_desc);
+}  // namespace sys
+#endif  // PACK_H_
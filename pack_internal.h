@@ -0,0 +1,86 @@
+﻿  // @file pack_internal.h
+  // @brief Declaration of pack related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 19:20:05
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef PACK_INTERNAL_H_
+#define PACK_INTERNAL_H_
+#include <stdint.h>
+#include <windows.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "./pack.h"
+  //
+  // These are internal macros related to pack
+  //
+#define SYS_PACK_MAGIC      (0x4b415053)  // "SPAK"
+#define SYS_PACK_VERSION    (1)
+#define SYS_PACK_ALIGNMENT  (64)  // Data of each entry, a cache line.
+
+  //
+  // These are internal enumerations and constants related to pack
+  //
+
+namespace sys {
+  //
+  // These are internal structures related to pack
+  //
+  // A pack is the header, the entries, the buckets, the names and the data.
+  // Offsets are from the head of the file, and names are UTF-16 without the
+  // terminator. Buckets are an open addressing table of entry index + 1, 0
+  // for an empty bucket, and the bucket of a name is its hash modulo the
+  // bucket number, a power of 2.
+struct PackHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entry_num;
+  uint32_t bucket_num;
+  uint64_t entry_offset;
+  uint64_t bucket_offset;
+  uint64_t name_offset;
+  uint64_t file_size;
+};
+struct PackEntry {
+  uint64_t hash;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t name_offset;  // From the names, in characters.
+  uint32_t name_length;
+};
+  // The file is mapped read only, the entries point to the view.
+class PackFile {
+ public:
+  PackFile();
+  ~PackFile();
+  bool Open(const wchar_t* pack_name);
+  void Close();
+  const PackEntry* Find(const std::wstring& name, uint64_t hash) const;
+  const uint8_t* GetData(const PackEntry& entry) const;
+ private:
+  PackFile(const PackFile&);
+  PackFile& operator=(const PackFile&);
+  bool Validate() const;
+  HANDLE file_;
+  HANDLE mapping_;
+  const uint8_t* view_;
+  uint64_t size_;
+  const PackHeader* header_;
+  const PackEntry* entries_;
+  const uint32_t* buckets_;
+  const uint16_t* names_;
+};
+struct PackData {
+  std::vector<std::unique_ptr<PackFile>> packs;  // Searched in this order.
+  PackData();
+};
+extern PackData pack_data;
+
+  //
+  // These are internal functions related to pack
+  //
+std::wstring NormalizePackName(const wchar_t* name);
+uint64_t HashPackName(const std::wstring& name);  // FNV-1a.
+void FinalizePack();
+}  // namespace sys
+#endif  // PACK_INTERNAL_H_
@@ -0,0 +1,136 @@
+﻿  // @file profile
+  // @brief Definitions of profile related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 14:21:37
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include <string.h>
+#include "./profile_internal.h"
+namespace sys {
+  //
+  // These are private functions related to profile
+  //
+namespace {
+int FloorLog2(uint64_t v) {
+  assert(v != 0);
+  int n = 0;
+  if (v >= (1ULL << 32)) { v >>= 32; n += 32; }
+  if (v >= (1ULL << 16)) { v >>= 16; n += 16; }
+  if (v >= (1ULL << 8)) { v >>= 8; n += 8; }
+  if (v >= (1ULL << 4)) { v >>= 4; n += 4; }
+  if (v >= (1ULL << 2)) { v >>= 2; n += 2; }
+  if (v >= (1ULL << 1)) { n += 1; }
+  return n;
+}
+}  // namespace
+
+  //
+  // These are internal structures related to profile
+  //
+LogHistogram::LogHistogram() {
+  Reset();
+}
+void LogHistogram::Reset() {
+  memset(buckets_, 0, sizeof(buckets_));
+  count_ = 0;
+  sum_ = 0;
+  max_ = 0;
+}
+void LogHistogram::Add(int64_t value) {
+  if (value < 0) value = 0;
+  ++buckets_[GetBucket(value)];
+  ++count_;
+  sum_ += value;
+  if (value > max_) max_ = value;
+}
+int64_t LogHistogram::GetPercentile(double percent) const {
+  if (count_ == 0) return 0;
+  int64_t rank = static_cast<int64_t>(percent / 100.0 * count_ + 0.5);
+  if (rank < 1) rank = 1;
+  if (rank > count_) rank = count_;
+  int64_t sum = 0;
+  for (int i = 0; i < SYS_HISTOGRAM_BUCKET_NUM; ++i) {
+    sum += buckets_[i];
+    if (sum >= rank) {
+      // The upper bound of the bucket, but never above the maximum.
+      const int64_t value = GetBucketUpperBound(i);
+      return (value < max_) ? value : max_;
+    }
+  }
+  return max_;
+}
+int64_t LogHistogram::GetMean() const {
+  if (count_ == 0) return 0;
+  return sum_ / count_;
+}
+int LogHistogram::GetBucket(int64_t value) {
+  if (value < SYS_HISTOGRAM_SUB_NUM) return static_cast<int>(value);
+  const int e = FloorLog2(static_cast<uint64_t>(value));
+  const int sub = static_cast<int>(
+      (value >> (e - SYS_HISTOGRAM_SUB_BITS)) & (SYS_HISTOGRAM_SUB_NUM - 1));
+  const int bucket =
+    (e - SYS_HISTOGRAM_SUB_BITS + 1) * SYS_HISTOGRAM_SUB_NUM + sub;
+  return (bucket < SYS_HISTOGRAM_BUCKET_NUM) ?
+    bucket : (SYS_HISTOGRAM_BUCKET_NUM - 1);
+}
+int64_t LogHistogram::GetBucketUpperBound(int bucket) {
+  if (bucket < SYS_HISTOGRAM_SUB_NUM) return bucket;
+  const int e = bucket / SYS_HISTOGRAM_SUB_NUM + SYS_HISTOGRAM_SUB_BITS - 1;
+  const int64_t sub = bucket % SYS_HISTOGRAM_SUB_NUM;
+  return ((SYS_HISTOGRAM_SUB_NUM + sub + 1) << (e - SYS_HISTOGRAM_SUB_BITS)) -
+    1;
+}
+FrameProfiler::FrameProfiler() {
+  Reset();
+}
+void FrameProfiler::Reset() {
+  memset(ring_, 0, sizeof(ring_));
+  memset(current_, 0, sizeof(current_));
+  for (int i = 0; i < SYS_PROFILE_PHASE_NUM; ++i) histograms_[i].Reset();
+  ring_head_ = 0;
+  ring_size_ = 0;
+  frame_start_ns_ = 0;
+  in_frame_ = false;
+}
+void FrameProfiler::StartFrame(int64_t now_ns) {
+  if (in_frame_) {
+    // The last frame is closed.
+    current_[0] = now_ns - frame_start_ns_;
+    for (int i = 0; i < SYS_PROFILE_PHASE_NUM; ++i) {
+      ring_[ring_head_][i] = current_[i];
+      histograms_[i].Add(current_[i]);
+    }
+    ring_head_ = (ring_head_ + 1) % SYS_PROFILE_FRAME_NUM;
+    if (ring_size_ < SYS_PROFILE_FRAME_NUM) ++ring_size_;
+  }
+  memset(current_, 0, sizeof(current_));
+  frame_start_ns_ = now_ns;
+  in_frame_ = true;
+}
+void FrameProfiler::AddPhase(int phase, int64_t ns) {
+  assert((phase > 0) && (phase < SYS_PROFILE_PHASE_NUM));
+  if (!in_frame_) return;
+  current_[phase] += ns;
+}
+const LogHistogram& FrameProfiler::GetHistogram(int phase) const {
+  assert((phase >= 0) && (phase < SYS_PROFILE_PHASE_NUM));
+  return histograms_[phase];
+}
+int FrameProfiler::GetHistory(int phase, int64_t* ns, int size) const {
+  assert((phase >= 0) && (phase < SYS_PROFILE_PHASE_NUM));
+  assert(ns);
+  // The latest frames are given, the oldest first.
+  const int num = (size < ring_size_) ? size : ring_size_;
+  int index = ring_head_ - num;
+  if (index < 0) index += SYS_PROFILE_FRAME_NUM;
+  for (int i = 0; i < num; ++i) {
+    ns[i] = ring_[index][phase];
+    index = (index + 1) % SYS_PROFILE_FRAME_NUM;
+  }
+  return num;
+}
+
+  //
+  // These are internal functions related to profile
+  //
+}  // namespace sys
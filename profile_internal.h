@@ -0,0 +1,70 @@
+﻿  // @file profile_internal.h
+  // @brief Declaration of profile related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 14:21:37
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef PROFILE_INTERNAL_H_
+#define PROFILE_INTERNAL_H_
+#include <stdint.h>
+  //
+  // These are internal macros related to profile
+  //
+#define SYS_PROFILE_PHASE_NUM       (6)  // Phase 0 is the whole frame.
+#define SYS_PROFILE_FRAME_NUM       (1024)  // Frames kept in the ring.
+#define SYS_HISTOGRAM_SUB_BITS      (4)  // 16 buckets in each octave.
+#define SYS_HISTOGRAM_SUB_NUM       (1 << SYS_HISTOGRAM_SUB_BITS)
+#define SYS_HISTOGRAM_BUCKET_NUM    (SYS_HISTOGRAM_SUB_NUM * 60)
+
+  //
+  // These are internal enumerations and constants related to profile
+  //
+
+namespace sys {
+  //
+  // These are internal structures related to profile
+  //
+  // Values below 16 have their own buckets, larger ones are put into 16
+  // linear buckets of their octave, so a bucket is within 6.25 % of values.
+class LogHistogram {
+ public:
+  LogHistogram();
+  void Reset();
+  void Add(int64_t value);
+  int64_t GetPercentile(double percent) const;
+  int64_t GetCount() const { return count_; }
+  int64_t GetMax() const { return max_; }
+  int64_t GetMean() const;
+  int64_t GetBucketCount(int bucket) const { return buckets_[bucket]; }
+  static int GetBucket(int64_t value);
+  static int64_t GetBucketUpperBound(int bucket);
+ private:
+  int64_t buckets_[SYS_HISTOGRAM_BUCKET_NUM];
+  int64_t count_;
+  int64_t sum_;
+  int64_t max_;
+};
+  // The time of each phase is recorded into a fixed ring of frames and into
+  // histograms. Nothing is allocated after the construction.
+class FrameProfiler {
+ public:
+  FrameProfiler();
+  void Reset();
+  void StartFrame(int64_t now_ns);
+  void AddPhase(int phase, int64_t ns);
+  const LogHistogram& GetHistogram(int phase) const;
+  int GetHistory(int phase, int64_t* ns, int size) const;
+ private:
+  int64_t ring_[SYS_PROFILE_FRAME_NUM][SYS_PROFILE_PHASE_NUM];
+  int64_t current_[SYS_PROFILE_PHASE_NUM];
+  LogHistogram histograms_[SYS_PROFILE_PHASE_NUM];
+  int ring_head_;  // The next slot to write.
+  int ring_size_;
+  int64_t frame_start_ns_;
+  bool in_frame_;
+};
+
+  //
+  // These are internal functions related to profile
+  //
+}  // namespace sys
+#endif  // PROFILE_INTERNAL_H_
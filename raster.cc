@@ -0,0 +1,219 @@
+﻿  // @file raster
+  // @brief Definitions of software raster related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 11:40:08
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "./batch_internal.h"
+#include "./raster_internal.h"
+#ifdef SYS_RASTER_USE_SSE2
+#include <emmintrin.h>
+#endif
+namespace sys {
+  //
+  // These are private functions related to raster
+  //
+namespace {
+  // x / 255 rounded, exact for x in [0, 65535].
+inline uint32_t Div255(uint32_t x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+inline uint32_t BlendPixel(uint32_t dst, uint32_t src, uint32_t alpha) {
+  const uint32_t sa = Div255((src >> 24) * alpha);
+  const uint32_t da = 255 - sa;
+  uint32_t out = sa << 24;
+  for (int shift = 0; shift < 24; shift += 8) {
+    const uint32_t s = (src >> shift) & 0xff;
+    const uint32_t d = (dst >> shift) & 0xff;
+    out |= Div255(s * sa + d * da) << shift;
+  }
+  return out;
+}
+inline int WrapTexel(int t, int size) {
+  if (static_cast<unsigned>(t) < static_cast<unsigned>(size)) return t;
+  t %= size;
+  return (t < 0) ? (t + size) : t;
+}
+inline int FixedFloor(int32_t v) {
+  // Arithmetic shift is avoided for negative values.
+  return (v >= 0) ? (v >> 16) : -((-v + 0xffff) >> 16);
+}
+#ifdef SYS_RASTER_USE_SSE2
+inline __m128i Div255Epu16(__m128i x) {
+  x = _mm_add_epi16(x, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+inline __m128i BlendPixel4(__m128i dst, __m128i src, __m128i alpha16) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i full = _mm_set1_epi16(255);
+  // Source alpha of 4 pixels, in 16 bit lanes 0 to 3.
+  __m128i sa = _mm_srli_epi32(src, 24);
+  sa = _mm_packs_epi32(sa, sa);
+  sa = Div255Epu16(_mm_mullo_epi16(sa, alpha16));
+  // Alpha is broadcast to the channels of each pixel.
+  const __m128i sa_pair = _mm_unpacklo_epi16(sa, sa);
+  const __m128i sa_lo = _mm_unpacklo_epi32(sa_pair, sa_pair);
+  const __m128i sa_hi = _mm_unpackhi_epi32(sa_pair, sa_pair);
+  __m128i lo = _mm_add_epi16(
+      _mm_mullo_epi16(_mm_unpacklo_epi8(src, zero), sa_lo),
+      _mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero),
+                      _mm_sub_epi16(full, sa_lo)));
+  __m128i hi = _mm_add_epi16(
+      _mm_mullo_epi16(_mm_unpackhi_epi8(src, zero), sa_hi),
+      _mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero),
+                      _mm_sub_epi16(full, sa_hi)));
+  const __m128i out = _mm_packus_epi16(Div255Epu16(lo), Div255Epu16(hi));
+  // The result alpha is the source alpha.
+  const __m128i sa32 = _mm_slli_epi32(_mm_unpacklo_epi16(sa, zero), 24);
+  return _mm_or_si128(_mm_and_si128(out, _mm_set1_epi32(0x00ffffff)), sa32);
+}
+#endif
+}  // namespace
+
+  //
+  // These are internal structures related to raster
+  //
+RasterTexture::RasterTexture() : w(0), h(0), pixels() { }
+void RasterTexture::Release() {
+  w = 0;
+  h = 0;
+  std::vector<uint32_t>().swap(pixels);
+}
+bool RasterTexture::IsNull() const {
+  return pixels.empty();
+}
+RasterBatchBackend::RasterBatchBackend() : w_(0), h_(0), pixels_(), row_(),
+    vertices_(nullptr), vertex_num_(0) { }
+bool RasterBatchBackend::Resize(int w, int h) {
+  if ((w <= 0) || (h <= 0)) return false;
+  w_ = w;
+  h_ = h;
+  pixels_.assign(static_cast<size_t>(w) * h, 0);
+  row_.resize(w);
+  return true;
+}
+void RasterBatchBackend::Release() {
+  w_ = 0;
+  h_ = 0;
+  std::vector<uint32_t>().swap(pixels_);
+  std::vector<uint32_t>().swap(row_);
+}
+void RasterBatchBackend::Clear(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+  const uint8_t rgba[4] = {r, g, b, a};
+  uint32_t color = 0;
+  memcpy(&color, rgba, sizeof(color));
+  std::fill(pixels_.begin(), pixels_.end(), color);
+}
+bool RasterBatchBackend::Upload(const VertexInputData* vertices,
+                                int vertex_num) {
+  assert(vertices);
+  // The stream is not copied, it lives until the flush ends.
+  vertices_ = vertices;
+  vertex_num_ = vertex_num;
+  return true;
+}
+bool RasterBatchBackend::Draw(const BatchKey& key, int first_vertex,
+                              int vertex_num) {
+  assert(vertices_);
+  if (first_vertex + vertex_num > vertex_num_) return false;
+  const RasterTexture* texture = static_cast<const RasterTexture*>(
+      key.texture);
+  if ((texture == nullptr) || texture->IsNull()) return false;
+  int alpha = static_cast<int>(key.alpha * 255.0f + 0.5f);
+  if (alpha <= 0) return true;  // Nothing is visible.
+  if (alpha > 255) alpha = 255;
+  for (int i = 0; i < vertex_num; i += SYS_BATCH_QUAD_VERTEX_NUM) {
+    if (!FillQuad(*texture, alpha, &vertices_[first_vertex + i])) {
+      return false;
+    }
+  }
+  return true;
+}
+const uint8_t* RasterBatchBackend::pixels() const {
+  if (pixels_.empty()) return nullptr;
+  return reinterpret_cast<const uint8_t*>(&pixels_[0]);
+}
+bool RasterBatchBackend::FillQuad(const RasterTexture& texture, int alpha,
+                                  const VertexInputData* quad) {
+  assert(quad);
+  // The list 0-1-2, 2-1-3 has the top left, the top right and the bottom
+  // left corners of the strip at 0, 1 and 2. Images are axis aligned, so
+  // the texture coordinates are affine over the screen.
+  const VertexInputData& v0 = quad[0];
+  const VertexInputData& v1 = quad[1];
+  const VertexInputData& v2 = quad[2];
+  const double x0 = (v0.position[0] + 1.0) * 0.5 * w_;
+  const double x1 = (v1.position[0] + 1.0) * 0.5 * w_;
+  const double y0 = (1.0 - v0.position[1]) * 0.5 * h_;
+  const double y2 = (1.0 - v2.position[1]) * 0.5 * h_;
+  const double ex = x1 - x0;
+  const double ey = y2 - y0;
+  if ((ex == 0.0) || (ey == 0.0)) return true;  // Degenerated.
+  // Texel derivatives on the screen.
+  const double du_dx = (v1.texcoord[0] - v0.texcoord[0]) / ex * texture.w;
+  const double dv_dx = (v1.texcoord[1] - v0.texcoord[1]) / ex * texture.h;
+  const double du_dy = (v2.texcoord[0] - v0.texcoord[0]) / ey * texture.w;
+  const double dv_dy = (v2.texcoord[1] - v0.texcoord[1]) / ey * texture.h;
+  // Pixel centers inside the rectangle are covered, top left rule.
+  int ix0 = static_cast<int>(ceil(((ex > 0) ? x0 : x1) - 0.5));
+  int ix1 = static_cast<int>(ceil(((ex > 0) ? x1 : x0) - 0.5));
+  int iy0 = static_cast<int>(ceil(((ey > 0) ? y0 : y2) - 0.5));
+  int iy1 = static_cast<int>(ceil(((ey > 0) ? y2 : y0) - 0.5));
+  if (ix0 < 0) ix0 = 0;
+  if (iy0 < 0) iy0 = 0;
+  if (ix1 > w_) ix1 = w_;
+  if (iy1 > h_) iy1 = h_;
+  const int n = ix1 - ix0;
+  if ((n <= 0) || (iy1 <= iy0)) return true;  // Out of the screen.
+  const int32_t step_u = static_cast<int32_t>(floor(du_dx * 65536.0 + 0.5));
+  const int32_t step_v = static_cast<int32_t>(floor(dv_dx * 65536.0 + 0.5));
+  const uint32_t* texels = &texture.pixels[0];
+  for (int iy = iy0; iy < iy1; ++iy) {
+    const double cx = ix0 + 0.5 - x0;
+    const double cy = iy + 0.5 - y0;
+    const double u = v0.texcoord[0] * texture.w + cx * du_dx + cy * du_dy;
+    const double v = v0.texcoord[1] * texture.h + cx * dv_dx + cy * dv_dy;
+    int32_t fu = static_cast<int32_t>(floor(u * 65536.0));
+    int32_t fv = static_cast<int32_t>(floor(v * 65536.0));
+    // Texels are fetched with point sampling and wrap addressing.
+    for (int i = 0; i < n; ++i) {
+      const int tx = WrapTexel(FixedFloor(fu), texture.w);
+      const int ty = WrapTexel(FixedFloor(fv), texture.h);
+      row_[i] = texels[ty * texture.w + tx];
+      fu += step_u;
+      fv += step_v;
+    }
+    BlendRasterSpan(&pixels_[static_cast<size_t>(iy) * w_ + ix0], &row_[0],
+                    n, alpha);
+  }
+  return true;
+}
+
+  //
+  // These are internal functions related to raster
+  //
+void BlendRasterSpan(uint32_t* dst, const uint32_t* src, int n, int alpha) {
+  assert(dst);
+  assert(src);
+  int i = 0;
+#ifdef SYS_RASTER_USE_SSE2
+  const __m128i alpha16 = _mm_set1_epi16(static_cast<int16_t>(alpha));
+  for (; i + 4 <= n; i += 4) {
+    const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+        src + i));
+    const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+        dst + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     BlendPixel4(d, s, alpha16));
+  }
+#endif
+  for (; i < n; ++i) {
+    dst[i] = BlendPixel(dst[i], src[i], alpha);
+  }
+}
+}  // namespace sys
@@ -0,0 +1,67 @@
+﻿  // @file raster_internal.h
+  // @brief Declaration of software raster related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 11:40:08
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef RASTER_INTERNAL_H_
+#define RASTER_INTERNAL_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "./batch_internal.h"
+  //
+  // These are internal macros related to raster
+  //
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define SYS_RASTER_USE_SSE2
+#endif
+
+  //
+  // These are internal enumerations and constants related to raster
+  //
+
+namespace sys {
+  //
+  // These are internal structures related to raster
+  //
+struct RasterTexture {
+  int w;
+  int h;
+  std::vector<uint32_t> pixels;  // RGBA8 in memory order, no padding.
+  RasterTexture();
+  void Release();
+  bool IsNull() const;
+};
+  // The vertices given by the sprite batch are filled into an RGBA8 frame
+  // buffer. The key texture of the batch must be a RasterTexture.
+class RasterBatchBackend : public BatchBackend {
+ public:
+  RasterBatchBackend();
+  bool Resize(int w, int h);
+  void Release();
+  void Clear(uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+  bool Upload(const VertexInputData* vertices, int vertex_num);
+  bool Draw(const BatchKey& key, int first_vertex, int vertex_num);
+  int width() const { return w_; }
+  int height() const { return h_; }
+  const uint8_t* pixels() const;
+ private:
+  bool FillQuad(const RasterTexture& texture, int alpha,
+                const VertexInputData* quad);
+  int w_;
+  int h_;
+  std::vector<uint32_t> pixels_;
+  std::vector<uint32_t> row_;  // Texels fetched for one span.
+  const VertexInputData* vertices_;  // Valid while the batch is flushed.
+  int vertex_num_;
+};
+
+  //
+  // These are internal functions related to raster
+  //
+  // src is blended over dst with its alpha multiplied by alpha [0, 255].
+  // The result alpha is the source alpha, as the graphic pipeline does.
+void BlendRasterSpan(uint32_t* dst, const uint32_t* src, int n, int alpha);
+}  // namespace sys
+#endif  // RASTER_INTERNAL_H_
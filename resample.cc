@@ -0,0 +1,291 @@
+﻿  // @file resample
+  // @brief Definitions of resample related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 22:31:09
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include "./resample_internal.h"
+#ifdef SYS_RESAMPLE_USE_SSE2
+#include <emmintrin.h>
+#endif
+namespace sys {
+  //
+  // These are private functions related to resample
+  //
+namespace {
+struct ResamplePreset {
+  int tap_num;  // A multiple of 4.
+  int phase_num;
+  double cutoff;  // Of the lower Nyquist frequency.
+  double beta;  // Of the Kaiser window.
+};
+const ResamplePreset kResamplePresets[] = {
+  {8, 64, 0.80, 5.0},  // SYS_RESAMPLEQUALITY_LOW
+  {16, 256, 0.88, 7.0},  // SYS_RESAMPLEQUALITY_MEDIUM
+  {32, 512, 0.94, 9.0},  // SYS_RESAMPLEQUALITY_HIGH
+};
+  // Gains to left and right of the speakers in the order of the mask bits.
+const float kSpeakerGains[18][2] = {
+  {1.0f, 0.0f},  // Front left
+  {0.0f, 1.0f},  // Front right
+  {0.707f, 0.707f},  // Front center
+  {0.0f, 0.0f},  // Low frequency
+  {0.707f, 0.0f},  // Back left
+  {0.0f, 0.707f},  // Back right
+  {0.924f, 0.383f},  // Front left of center
+  {0.383f, 0.924f},  // Front right of center
+  {0.5f, 0.5f},  // Back center
+  {0.707f, 0.0f},  // Side left
+  {0.0f, 0.707f},  // Side right
+  {0.5f, 0.5f},  // Top center
+  {0.707f, 0.0f},  // Top front left
+  {0.5f, 0.5f},  // Top front center
+  {0.0f, 0.707f},  // Top front right
+  {0.707f, 0.0f},  // Top back left
+  {0.5f, 0.5f},  // Top back center
+  {0.0f, 0.707f},  // Top back right
+};
+const uint32_t kDefaultChannelMasks[SYS_RESAMPLE_CHANNEL_MAX + 1] = {
+  0, 0x4, 0x3, 0x7, 0x33, 0x37, 0x3f, 0x13f, 0x63f,
+};
+double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 32; ++k) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12) break;
+  }
+  return sum;
+}
+int GetGcd(int a, int b) {
+  while (b != 0) {
+    const int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+inline void FilterMono(const float* src, const float* filter, int tap_num,
+                       float* dst) {
+#ifdef SYS_RESAMPLE_USE_SSE2
+  __m128 sum = _mm_setzero_ps();
+  for (int i = 0; i < tap_num; i += 4) {
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + i),
+                                     _mm_loadu_ps(filter + i)));
+  }
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  _mm_store_ss(dst, sum);
+#else
+  float sum = 0.0f;
+  for (int i = 0; i < tap_num; ++i) sum += src[i] * filter[i];
+  *dst = sum;
+#endif
+}
+  // The taps are repeated for left and right, so 2 frames are filtered at
+  // once.
+inline void FilterStereo(const float* src, const float* filter, int tap_num,
+                         float* dst) {
+#ifdef SYS_RESAMPLE_USE_SSE2
+  __m128 sum = _mm_setzero_ps();
+  for (int i = 0; i < tap_num * 2; i += 4) {
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + i),
+                                     _mm_loadu_ps(filter + i)));
+  }
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  _mm_storel_pi(reinterpret_cast<__m64*>(dst), sum);
+#else
+  float sum_l = 0.0f;
+  float sum_r = 0.0f;
+  for (int i = 0; i < tap_num * 2; i += 2) {
+    sum_l += src[i] * filter[i];
+    sum_r += src[i + 1] * filter[i + 1];
+  }
+  dst[0] = sum_l;
+  dst[1] = sum_r;
+#endif
+}
+}  // namespace
+
+  //
+  // These are internal structures related to resample
+  //
+Resampler::Resampler() : channel_num_(0), tap_num_(0), phase_num_(0),
+    source_rate_(0), target_rate_(0), step_(0), step_fraction_(0),
+    position_(0), position_fraction_(0), filter_(), buffer_() { }
+bool Resampler::Reset(int source_rate, int target_rate, int channel_num,
+                      SYS_RESAMPLEQUALITY quality) {
+  if ((source_rate <= 0) || (target_rate <= 0)) return false;
+  if ((channel_num != 1) && (channel_num != 2)) return false;
+  if ((quality < SYS_RESAMPLEQUALITY_LOW) ||
+      (quality > SYS_RESAMPLEQUALITY_HIGH)) {
+    return false;
+  }
+  const ResamplePreset& preset = kResamplePresets[quality];
+  // The rates are reduced, so the fraction stays small.
+  const int gcd = GetGcd(source_rate, target_rate);
+  channel_num_ = channel_num;
+  tap_num_ = preset.tap_num;
+  phase_num_ = preset.phase_num;
+  source_rate_ = source_rate / gcd;
+  target_rate_ = target_rate / gcd;
+  step_ = source_rate_ / target_rate_;
+  step_fraction_ = source_rate_ % target_rate_;
+  // The taps of a frame are tap_num / 2 - 1 frames before and tap_num / 2
+  // frames after it. The frames before the first one are silent.
+  position_ = tap_num_ / 2 - 1;
+  position_fraction_ = 0;
+  buffer_.assign(position_ * channel_num_, 0.0f);
+  // The cutoff is lowered when the rate is lowered, against aliasing.
+  const double ratio = (target_rate < source_rate) ?
+    static_cast<double>(target_rate) / source_rate : 1.0;
+  const double cutoff = preset.cutoff * ratio;
+  const double pi = 3.14159265358979323846;
+  const double half = tap_num_ / 2.0;
+  const double i0_beta = BesselI0(preset.beta);
+  // The phase after the last one is the next frame, for the positions
+  // rounded up to it. Its taps are in the same frames.
+  filter_.resize(static_cast<size_t>(phase_num_ + 1) * tap_num_ *
+                 channel_num_);
+  for (int phase = 0; phase <= phase_num_; ++phase) {
+    float* taps = &filter_[static_cast<size_t>(phase) * tap_num_ *
+                           channel_num_];
+    double sum = 0.0;
+    std::vector<double> values(tap_num_);
+    for (int k = 0; k < tap_num_; ++k) {
+      const double t = (k - half + 1.0) - static_cast<double>(phase) /
+        phase_num_;
+      const double x = pi * cutoff * t;
+      const double sinc = (fabs(x) < 1e-9) ? 1.0 : sin(x) / x;
+      const double w = t / half;
+      const double window = (fabs(w) < 1.0) ?
+        BesselI0(preset.beta * sqrt(1.0 - w * w)) / i0_beta : 0.0;
+      values[k] = sinc * window;
+      sum += values[k];
+    }
+    // Each phase passes the DC as it is.
+    for (int k = 0; k < tap_num_; ++k) {
+      for (int c = 0; c < channel_num_; ++c) {
+        taps[k * channel_num_ + c] = static_cast<float>(values[k] / sum);
+      }
+    }
+  }
+  return true;
+}
+int Resampler::GetSourceFrames(int frame_num) const {
+  if (frame_num <= 0) return 0;
+  // The frames given up to the frame n are less than
+  // n * target_rate / source_rate + 1.
+  const int buffered = static_cast<int>(buffer_.size()) / channel_num_ -
+    position_ - tap_num_ / 2;
+  const int64_t source_frame_num = static_cast<int64_t>(frame_num - 1) *
+    source_rate_ / target_rate_ - buffered;
+  if (source_frame_num <= 0) return 0;
+  return (source_frame_num < 0x7fffffff) ?
+    static_cast<int>(source_frame_num) : 0x7fffffff;
+}
+void Resampler::Prime(const float* src, int frame_num) {
+  assert(src || (frame_num == 0));
+  const int history = tap_num_ / 2 - 1;
+  assert((position_ == history) &&
+         (static_cast<int>(buffer_.size()) == history * channel_num_));
+  const int n = (frame_num < history) ? frame_num : history;
+  if (n <= 0) return;
+  memcpy(&buffer_[static_cast<size_t>(history - n) * channel_num_],
+         src + static_cast<size_t>(frame_num - n) * channel_num_,
+         sizeof(float) * n * channel_num_);
+}
+int Resampler::Process(const float* src, int frame_num,
+                       std::vector<float>* out) {
+  assert(src || (frame_num == 0));
+  assert(out);
+  out->clear();
+  if (frame_num > 0) {
+    buffer_.insert(buffer_.end(), src, src + frame_num * channel_num_);
+  }
+  return Filter(out);
+}
+int Resampler::Flush(std::vector<float>* out) {
+  assert(out);
+  out->clear();
+  buffer_.resize(buffer_.size() + tap_num_ / 2 * channel_num_, 0.0f);
+  return Filter(out);
+}
+int Resampler::Filter(std::vector<float>* out) {
+  const int buffer_frames = static_cast<int>(buffer_.size()) / channel_num_;
+  const int last = buffer_frames - tap_num_ / 2;  // Frames before it.
+  if (position_ < last) {
+    out->reserve(static_cast<size_t>(
+        (static_cast<int64_t>(last - position_) * target_rate_ /
+         source_rate_ + 1) * channel_num_));
+  }
+  float frame[2];
+  while (position_ < last) {
+    // The nearest phase, which halves the error of the time.
+    const int phase = static_cast<int>(
+        (static_cast<int64_t>(position_fraction_) * phase_num_ * 2 +
+         target_rate_) / (static_cast<int64_t>(target_rate_) * 2));
+    const float* taps = &filter_[static_cast<size_t>(phase) * tap_num_ *
+                                 channel_num_];
+    const float* head = &buffer_[static_cast<size_t>(
+        position_ - tap_num_ / 2 + 1) * channel_num_];
+    if (channel_num_ == 1) {
+      FilterMono(head, taps, tap_num_, frame);
+    } else {
+      FilterStereo(head, taps, tap_num_, frame);
+    }
+    out->insert(out->end(), frame, frame + channel_num_);
+    position_ += step_;
+    position_fraction_ += step_fraction_;
+    if (position_fraction_ >= target_rate_) {
+      position_fraction_ -= target_rate_;
+      ++position_;
+    }
+  }
+  // Frames no longer used by the taps are removed.
+  const int used = position_ - (tap_num_ / 2 - 1);
+  if (used > 0) {
+    const int removed = (used < buffer_frames) ? used : buffer_frames;
+    buffer_.erase(buffer_.begin(), buffer_.begin() + removed * channel_num_);
+    position_ -= removed;
+  }
+  return static_cast<int>(out->size()) / channel_num_;
+}
+
+  //
+  // These are internal functions related to resample
+  //
+bool GetChannelGains(int channel_num, uint32_t channel_mask, float* gains) {
+  assert(gains);
+  if ((channel_num <= 0) || (channel_num > SYS_RESAMPLE_CHANNEL_MAX)) {
+    return false;
+  }
+  if (channel_num == 1) {
+    gains[0] = 1.0f;
+    gains[1] = 1.0f;
+    return true;
+  }
+  if (channel_mask == 0) channel_mask = kDefaultChannelMasks[channel_num];
+  // Channels take the set bits of the mask in order, the rest are silent.
+  int speaker = 0;
+  float sum_l = 0.0f;
+  float sum_r = 0.0f;
+  for (int c = 0; c < channel_num; ++c) {
+    while ((speaker < 18) && !(channel_mask & (1u << speaker))) ++speaker;
+    gains[c * 2] = (speaker < 18) ? kSpeakerGains[speaker][0] : 0.0f;
+    gains[c * 2 + 1] = (speaker < 18) ? kSpeakerGains[speaker][1] : 0.0f;
+    sum_l += gains[c * 2];
+    sum_r += gains[c * 2 + 1];
+    ++speaker;
+  }
+  // The mix does not clip if all channels are full.
+  const float sum = (sum_l > sum_r) ? sum_l : sum_r;
+  if (sum > 1.0f) {
+    for (int i = 0; i < channel_num * 2; ++i) gains[i] /= sum;
+  }
+  return true;
+}
+}  // namespace sys
@@ -0,0 +1,68 @@
+﻿  // @file resample_internal.h
+  // @brief Declaration of resample related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 22:31:09
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef RESAMPLE_INTERNAL_H_
+#define RESAMPLE_INTERNAL_H_
+#include <stdint.h>
+#include <vector>
+#include "./mixer.h"
+  //
+  // These are internal macros related to resample
+  //
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define SYS_RESAMPLE_USE_SSE2
+#endif
+#define SYS_RESAMPLE_CHANNEL_MAX  (8)  // Up to 7.1.
+#define SYS_RESAMPLE_TAP_MAX      (32)  // Of the presets.
+
+  //
+  // These are internal enumerations and constants related to resample
+  //
+
+namespace sys {
+  //
+  // These are internal structures related to resample
+  //
+  // A windowed sinc is sampled in phases between two source frames, and an
+  // output frame is filtered by the phase nearest to it, rounded and not
+  // floored. The position is kept as a fraction of the rates, so it never
+  // drifts. Mono or interleaved stereo
+  // float, the filter holds the last frames until the next ones come.
+class Resampler {
+ public:
+  Resampler();
+  bool Reset(int source_rate, int target_rate, int channel_num,
+             SYS_RESAMPLEQUALITY quality);
+  int GetSourceFrames(int frame_num) const;  // Frames giving frame_num.
+  // The frames before the first one, in place of silence. Called after
+  // Reset, the last frames of them are taken.
+  void Prime(const float* src, int frame_num);
+  int Process(const float* src, int frame_num, std::vector<float>* out);
+  int Flush(std::vector<float>* out);  // The frames held are output.
+ private:
+  int Filter(std::vector<float>* out);
+  int channel_num_;
+  int tap_num_;
+  int phase_num_;
+  int source_rate_;
+  int target_rate_;
+  int step_;  // Source frames for an output frame, the integer part.
+  int step_fraction_;  // In 1 / target_rate_.
+  int position_;  // The source frame in buffer_.
+  int position_fraction_;
+  std::vector<float> filter_;  // Phases of taps, repeated for each channel.
+  std::vector<float> buffer_;
+};
+
+  //
+  // These are internal functions related to resample
+  //
+  // Gains of the source channels to left and right, interleaved. Mono goes
+  // to both. Others are mixed down by the speaker positions of the mask,
+  // or the default positions for the channel number if it is 0.
+bool GetChannelGains(int channel_num, uint32_t channel_mask, float* gains);
+}  // namespace sys
+#endif  // RESAMPLE_INTERNAL_H_
@@ -0,0 +1,89 @@
+﻿  // @file ring_internal.h
+  // @brief Declaration of ring buffer related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 21:02:37
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef RING_INTERNAL_H_
+#define RING_INTERNAL_H_
+#include <assert.h>
+#include <stdint.h>
+#include <atomic>
+#include <utility>
+#include <vector>
+  //
+  // These are internal macros related to ring buffer
+  //
+
+  //
+  // These are internal enumerations and constants related to ring buffer
+  //
+
+namespace sys {
+  //
+  // These are internal structures related to ring buffer
+  //
+  // One thread writes and another thread reads without a lock. The indices
+  // increase forever and are masked by the capacity, a power of 2.
+template <typename T>
+class SpscRing {
+ public:
+  explicit SpscRing(int capacity) : buffer_(capacity), mask_(capacity - 1),
+      head_(0), tail_(0) {
+    assert((capacity > 0) && ((capacity & (capacity - 1)) == 0));
+  }
+  int GetCapacity() const { return mask_ + 1; }
+  int GetReadable() const {
+    return static_cast<int>(tail_.load(std::memory_order_acquire) -
+                            head_.load(std::memory_order_acquire));
+  }
+  int GetWritable() const { return GetCapacity() - GetReadable(); }
+  // Writer only, the number written is returned.
+  int Write(const T* values, int num) {
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    const int writable = GetCapacity() - static_cast<int>(tail - head);
+    if (num > writable) num = writable;
+    for (int i = 0; i < num; ++i) buffer_[(tail + i) & mask_] = values[i];
+    tail_.store(tail + num, std::memory_order_release);
+    return num;
+  }
+  // Writer only, as Write but values are moved in, so the writer holds
+  // nothing of them after it.
+  int Push(T* values, int num) {
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    const int writable = GetCapacity() - static_cast<int>(tail - head);
+    if (num > writable) num = writable;
+    for (int i = 0; i < num; ++i) {
+      buffer_[(tail + i) & mask_] = std::move(values[i]);
+    }
+    tail_.store(tail + num, std::memory_order_release);
+    return num;
+  }
+  // Reader only, the number read is returned. Values are moved out, so the
+  // reader owns what they hold.
+  int Read(T* values, int num) {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    const uint64_t tail = tail_.load(std::memory_order_acquire);
+    const int readable = static_cast<int>(tail - head);
+    if (num > readable) num = readable;
+    for (int i = 0; i < num; ++i) {
+      values[i] = std::move(buffer_[(head + i) & mask_]);
+    }
+    head_.store(head + num, std::memory_order_release);
+    return num;
+  }
+ private:
+  SpscRing(const SpscRing&);
+  SpscRing& operator=(const SpscRing&);
+  std::vector<T> buffer_;
+  int mask_;
+  std::atomic<uint64_t> head_;  // The next one to read.
+  std::atomic<uint64_t> tail_;  // The next one to write.
+};
+
+  //
+  // These are internal functions related to ring buffer
+  //
+}  // namespace sys
+#endif  // RING_INTERNAL_H_
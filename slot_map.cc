@@ -0,0 +1,307 @@
+﻿  // @file slot_map
+  // @brief Definitions of slot map related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 17:03:12
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include <atomic>
+#include "./slot_map_internal.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#define SYS_BIT_NOT_FOUND         (-1)
+#define SYS_ID_SERVER_WORD_BITS   (6)  // 64 ids in each word.
+#define SYS_ID_SERVER_LEVEL_NUM   (5)  // 64^5 ids, within int.
+#define SYS_ID_SERVER_CAPACITY    (1LL << 30)
+#define SYS_ID_SERVER_BLOCK_BITS  (12)  // 4096 words allocated at once.
+namespace sys {
+  //
+  // These are private functions related to slot map
+  //
+namespace {
+  // The number of the trailing zero bits, v must not be 0.
+int CountTrailingZeros64(uint64_t v) {
+  assert(v != 0);
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+  unsigned long index = 0;  // NOLINT
+  _BitScanForward64(&index, v);
+  return static_cast<int>(index);
+#elif defined(_MSC_VER)
+  unsigned long index = 0;  // NOLINT
+  if (_BitScanForward(&index, static_cast<uint32_t>(v))) {
+    return static_cast<int>(index);
+  }
+  _BitScanForward(&index, static_cast<uint32_t>(v >> 32));
+  return static_cast<int>(index) + 32;
+#elif defined(__GNUC__)
+  return __builtin_ctzll(v);
+#else
+  // The lowest bit is isolated and looked up with a de Bruijn sequence.
+  static const int table[64] = {
+     0,  1,  2, 53,  3,  7, 54, 27,  4, 38, 41,  8, 34, 55, 48, 28,
+    62,  5, 39, 46, 44, 42, 22,  9, 24, 35, 59, 56, 49, 18, 29, 11,
+    63, 52,  6, 26, 37, 40, 33, 47, 61, 45, 43, 21, 23, 58, 17, 10,
+    51, 25, 36, 32, 60, 20, 57, 16, 50, 31, 19, 15, 30, 14, 13, 12,
+  };
+  return table[((v & (0 - v)) * 0x022fdd63cc95386dULL) >> 58];
+#endif
+}
+}  // namespace
+
+  //
+  // These are internal structures related to slot map
+  //
+  // Level 0 has a bit for each id, which is set when the id is used. A bit
+  // of level n is set when the word of level n - 1 under it is full, so the
+  // lowest free id is found by one word in each level. Words are allocated
+  // in blocks when they are used first.
+  //
+  // Any thread can use the server at the same time. An id is owned by the
+  // thread whose fetch_or sets its bit, so ids are never given twice. Upper
+  // bits are only hints: a bit set while a word is released is cleared again
+  // by the check after it, and a full word under a clear bit is skipped and
+  // fixed by the search.
+struct IdServer::Impl {
+  std::unique_ptr<std::atomic<std::atomic<uint64_t>*>[]>
+    blocks[SYS_ID_SERVER_LEVEL_NUM];
+  int block_bits[SYS_ID_SERVER_LEVEL_NUM];  // 2^n words in each block.
+  Impl() {
+    for (int i = 0; i < SYS_ID_SERVER_LEVEL_NUM; ++i) {
+      const int word_bits = SYS_ID_SERVER_WORD_BITS *
+        (SYS_ID_SERVER_LEVEL_NUM - 1 - i);
+      block_bits[i] = (word_bits < SYS_ID_SERVER_BLOCK_BITS) ?
+        word_bits : SYS_ID_SERVER_BLOCK_BITS;
+      const int64_t block_num = 1LL << (word_bits - block_bits[i]);
+      blocks[i].reset(new std::atomic<std::atomic<uint64_t>*>[block_num]);
+      for (int64_t j = 0; j < block_num; ++j) blocks[i][j].store(nullptr);
+    }
+  }
+  ~Impl() {
+    for (int i = 0; i < SYS_ID_SERVER_LEVEL_NUM; ++i) {
+      const int word_bits = SYS_ID_SERVER_WORD_BITS *
+        (SYS_ID_SERVER_LEVEL_NUM - 1 - i);
+      for (int64_t j = 0; j < (1LL << (word_bits - block_bits[i])); ++j) {
+        delete[] blocks[i][j].load();
+      }
+    }
+  }
+  // Null is returned for words not allocated when create is false, they are
+  // treated as 0.
+  std::atomic<uint64_t>* GetWord(int level, int64_t index, bool create) const {
+    std::atomic<std::atomic<uint64_t>*>& block =
+      blocks[level][index >> block_bits[level]];
+    std::atomic<uint64_t>* words = block.load(std::memory_order_acquire);
+    if (!words) {
+      if (!create) return nullptr;
+      const int64_t size = 1LL << block_bits[level];
+      std::atomic<uint64_t>* new_words = new std::atomic<uint64_t>[size];
+      for (int64_t i = 0; i < size; ++i) new_words[i].store(0);
+      // Another thread may allocate the same block, the first one is used.
+      if (block.compare_exchange_strong(words, new_words,
+                                        std::memory_order_acq_rel)) {
+        words = new_words;
+      } else {
+        delete[] new_words;
+      }
+    }
+    return &words[index & ((1LL << block_bits[level]) - 1)];
+  }
+  uint64_t LoadWord(int level, int64_t index) const {
+    const std::atomic<uint64_t>* word = GetWord(level, index, false);
+    return word ? word->load(std::memory_order_acquire) : 0;
+  }
+  bool IsUsed(int64_t id) const {
+    if ((id < 0) || (id >= SYS_ID_SERVER_CAPACITY)) return false;
+    return ((LoadWord(0, id >> 6) >> (id & 63)) & 1) != 0;
+  }
+  // The word was seen full, it is told to the upper levels.
+  void MarkFull(int level, int64_t index) {
+    for (int i = level; i < SYS_ID_SERVER_LEVEL_NUM - 1; ++i) {
+      const uint64_t bit = 1ULL << (index & 63);
+      const uint64_t old = GetWord(i + 1, index >> 6, true)->fetch_or(
+          bit, std::memory_order_acq_rel);
+      // An id released before the bit was set would be hidden by it.
+      if (LoadWord(i, index) != ~0ULL) {
+        MarkNotFull(i, index);
+        return;
+      }
+      if ((old | bit) != ~0ULL) return;
+      index >>= 6;
+    }
+  }
+  // The word has a free id now, the upper bits are cleared.
+  void MarkNotFull(int level, int64_t index) {
+    for (int i = level; i < SYS_ID_SERVER_LEVEL_NUM - 1; ++i) {
+      std::atomic<uint64_t>* word = GetWord(i + 1, index >> 6, false);
+      if (!word) return;
+      const uint64_t old = word->fetch_and(~(1ULL << (index & 63)),
+                                           std::memory_order_acq_rel);
+      if (old != ~0ULL) return;
+      index >>= 6;
+    }
+  }
+  // The lowest free id from pos is searched.
+  int64_t FindFreeId(int64_t pos) {
+    while (pos < SYS_ID_SERVER_CAPACITY) {
+      bool restart = false;
+      for (int i = 0; (i < SYS_ID_SERVER_LEVEL_NUM) && !restart; ++i) {
+        const int shift = SYS_ID_SERVER_WORD_BITS * i;
+        const int64_t index = pos >> (shift + SYS_ID_SERVER_WORD_BITS);
+        const int bit = static_cast<int>((pos >> shift) & 63);
+        const uint64_t free_bits = ~LoadWord(i, index) & (~0ULL << bit);
+        if (free_bits != 0) {
+          // The word under a clear bit has a free id, so it is descended.
+          int64_t id = (index << SYS_ID_SERVER_WORD_BITS) |
+            CountTrailingZeros64(free_bits);
+          for (int j = i - 1; j >= 0; --j) {
+            const uint64_t word = LoadWord(j, id);
+            if (word == ~0ULL) {
+              // Filled by another thread, the search goes on after it.
+              MarkFull(j, id);
+              pos = (id + 1) << (SYS_ID_SERVER_WORD_BITS * (j + 1));
+              restart = true;
+              break;
+            }
+            id = (id << SYS_ID_SERVER_WORD_BITS) | CountTrailingZeros64(~word);
+          }
+          if (!restart) return id;
+        } else {
+          // The next word of this level is searched by the upper level.
+          pos = (index + 1) << (shift + SYS_ID_SERVER_WORD_BITS);
+          if (pos >= SYS_ID_SERVER_CAPACITY) return SYS_BIT_NOT_FOUND;
+        }
+      }
+    }
+    return SYS_BIT_NOT_FOUND;
+  }
+  // The first used id in [first, last) is searched.
+  int64_t FindUsedId(int64_t first, int64_t last) const {
+    for (int64_t pos = first; pos < last; pos = ((pos >> 6) + 1) << 6) {
+      uint64_t used_bits = LoadWord(0, pos >> 6) & (~0ULL << (pos & 63));
+      if (used_bits != 0) {
+        const int64_t id = (pos & ~63LL) | CountTrailingZeros64(used_bits);
+        return (id < last) ? id : SYS_BIT_NOT_FOUND;
+      }
+    }
+    return SYS_BIT_NOT_FOUND;
+  }
+  // Bits of [first, last) are set. If one of them is used by another thread,
+  // the bits set are cleared again and the used id is returned.
+  int64_t BusyIds(int64_t first, int64_t last) {
+    for (int64_t pos = first; pos < last; pos = ((pos >> 6) + 1) << 6) {
+      const uint64_t mask = GetMask(pos, last);
+      std::atomic<uint64_t>* word = GetWord(0, pos >> 6, true);
+      uint64_t old = word->load(std::memory_order_relaxed);
+      do {
+        if ((old & mask) != 0) {
+          if (pos > first) FreeIds(first, pos);
+          return (pos & ~63LL) | CountTrailingZeros64(old & mask);
+        }
+      } while (!word->compare_exchange_weak(old, old | mask,
+                                            std::memory_order_acq_rel));
+      if ((old | mask) == ~0ULL) MarkFull(0, pos >> 6);
+    }
+    return SYS_BIT_NOT_FOUND;
+  }
+  // Bits of [first, last) are cleared, the upper bits are cleared too.
+  void FreeIds(int64_t first, int64_t last) {
+    for (int64_t pos = first; pos < last; pos = ((pos >> 6) + 1) << 6) {
+      std::atomic<uint64_t>* word = GetWord(0, pos >> 6, false);
+      if (!word) continue;
+      const uint64_t old = word->fetch_and(~GetMask(pos, last),
+                                           std::memory_order_acq_rel);
+      if (old == ~0ULL) MarkNotFull(0, pos >> 6);
+    }
+  }
+  // The bits from pos to the end of its word or last.
+  static uint64_t GetMask(int64_t pos, int64_t last) {
+    const int64_t end = (((pos >> 6) + 1) << 6 < last) ?
+      (((pos >> 6) + 1) << 6) : last;
+    const int n = static_cast<int>(end - pos);
+    return ((n == 64) ? ~0ULL : ((1ULL << n) - 1)) << (pos & 63);
+  }
+};
+IdServer::IdServer() : impl_(new Impl()) { }
+IdServer::~IdServer() = default;
+int IdServer::CreateId() {
+  int64_t pos = 0;
+  while (true) {
+    const int64_t id = impl_->FindFreeId(pos);
+    if (id == SYS_BIT_NOT_FOUND) return SYS_ID_SERVER_EXCEEDS_LIMIT;
+    const uint64_t bit = 1ULL << (id & 63);
+    std::atomic<uint64_t>* word = impl_->GetWord(0, id >> 6, true);
+    const uint64_t old = word->fetch_or(bit, std::memory_order_acq_rel);
+    if ((old & bit) != 0) {
+      pos = id;  // Taken by another thread.
+      continue;
+    }
+    if ((old | bit) == ~0ULL) impl_->MarkFull(0, id >> 6);
+    return static_cast<int>(id);
+  }
+}
+int IdServer::ReleaseId(int id) {
+  if ((id < 0) || (id >= SYS_ID_SERVER_CAPACITY)) return id;
+  impl_->FreeIds(id, static_cast<int64_t>(id) + 1);
+  return id;
+}
+int IdServer::CreateIds(int num) {
+  assert(num > 0);
+  // The lowest run of free ids is searched.
+  int64_t pos = 0;
+  while (true) {
+    const int64_t first = impl_->FindFreeId(pos);
+    if ((first == SYS_BIT_NOT_FOUND) ||
+        (first + num > SYS_ID_SERVER_CAPACITY)) {
+      return SYS_ID_SERVER_EXCEEDS_LIMIT;
+    }
+    int64_t used = impl_->FindUsedId(first, first + num);
+    if (used == SYS_BIT_NOT_FOUND) {
+      used = impl_->BusyIds(first, first + num);
+      if (used == SYS_BIT_NOT_FOUND) return static_cast<int>(first);
+    }
+    pos = used + 1;
+  }
+}
+void IdServer::ReleaseIds(int first, int num) {
+  assert(first >= 0);
+  assert(num > 0);
+  const int64_t last = static_cast<int64_t>(first) + num;
+  if (last > SYS_ID_SERVER_CAPACITY) return;
+  impl_->FreeIds(first, last);
+}
+bool IdServer::IsUsed(int id) const {
+  return impl_->IsUsed(id);
+}
+FreeSlotSet::FreeSlotSet() : slots_(), top_(0) {
+  for (int i = 0; i < SYS_SLOT_FREE_WORD_NUM; ++i) words_[i] = 0;
+}
+void FreeSlotSet::Add(uint32_t slot) {
+  assert(slot <= SYS_SLOT_INDEX_MASK);
+  const uint32_t index = slot >> 6;
+  if (index >= slots_.size()) slots_.resize(index + 1, 0);
+  slots_[index] |= 1ULL << (slot & 63);
+  words_[index >> 6] |= 1ULL << (index & 63);
+  top_ |= 1ULL << (index >> 6);
+}
+int FreeSlotSet::TakeLowest() {
+  if (top_ == 0) return -1;
+  const int word = CountTrailingZeros64(top_);
+  const int index = (word << 6) | CountTrailingZeros64(words_[word]);
+  const int bit = CountTrailingZeros64(slots_[index]);
+  // The bits above are cleared when the word under them becomes empty.
+  slots_[index] &= slots_[index] - 1;
+  if (slots_[index] == 0) {
+    words_[word] &= words_[word] - 1;
+    if (words_[word] == 0) top_ &= top_ - 1;
+  }
+  return (index << 6) | bit;
+}
+bool FreeSlotSet::Has(uint32_t slot) const {
+  const uint32_t index = slot >> 6;
+  return (index < slots_.size()) && (((slots_[index] >> (slot & 63)) & 1) != 0);
+}
+
+  //
+  // These are internal functions related to slot map
+  //
+}  // namespace sys
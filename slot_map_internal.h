@@ -0,0 +1,257 @@
+﻿  // @file slot_map_internal.h
+  // @brief Declaration of slot map related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 17:03:12
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef SLOT_MAP_INTERNAL_H_
+#define SLOT_MAP_INTERNAL_H_
+#include <assert.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+  //
+  // These are internal macros related to slot map
+  //
+#define SYS_SLOT_INDEX_BITS       (16)  // Up to 65536 entries.
+#define SYS_SLOT_INDEX_MASK       ((1 << SYS_SLOT_INDEX_BITS) - 1)
+#define SYS_SLOT_GENERATION_MASK  (0x7fff)  // 15 bits, the id stays positive.
+#define SYS_SLOT_PAGE_BITS        (10)  // Generations allocated at once.
+#define SYS_SLOT_FREE_WORD_NUM    (1 << (SYS_SLOT_INDEX_BITS - 12))
+#define SYS_SLOT_INVALID_ID       (-1)
+#define SYS_ID_SERVER_EXCEEDS_LIMIT (-2)
+
+  //
+  // These are internal enumerations and constants related to slot map
+  //
+
+namespace sys {
+  //
+  // These are internal structures related to slot map
+  //
+  // The lowest free id is given. Ids are not limited by a fixed table, up to
+  // 2^30 ids can be used. Threads can create and release ids at the same
+  // time without a lock.
+class IdServer {
+ public:
+  IdServer();
+  ~IdServer();
+  int CreateId();
+  int ReleaseId(int id);
+  int CreateIds(int num);  // The first one of num contiguous ids.
+  void ReleaseIds(int first, int num);
+  bool IsUsed(int id) const;
+ private:
+  IdServer(const IdServer&);
+  IdServer& operator=(const IdServer&);
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+  // The free slots of one owner thread, set and found without atomics. Level
+  // 0 has a bit for each free slot, and a bit of level n is set when the
+  // word of level n - 1 under it has one, so the lowest is found by one word
+  // in each level.
+class FreeSlotSet {
+ public:
+  FreeSlotSet();
+  void Add(uint32_t slot);
+  int TakeLowest();  // -1 if there is none.
+  bool Has(uint32_t slot) const;
+ private:
+  std::vector<uint64_t> slots_;  // Grown to the highest slot added.
+  uint64_t words_[SYS_SLOT_FREE_WORD_NUM];  // Level 1, a bit for 64 slots.
+  uint64_t top_;  // Level 2.
+};
+  // An id is the generation and the index of a slot, and a slot points to a
+  // value in the dense array. New slots are taken from an id server, so the
+  // lowest one is used first and the slots stay compact. A released id is
+  // detected by the generation, which is increased when the slot is
+  // released, so ids of slots never released are 0, 1, 2, ... A slot
+  // released 32768 times is retired instead of wrapping the generation, so
+  // an id is never given twice. 2^31 ids are given before all slots are
+  // retired. Values are moved when the array grows and when a value is
+  // released, so pointers to them are valid only until the next Create or
+  // Release.
+  //
+  // Any thread can reserve ids at the same time without a lock, e.g., a
+  // loader thread giving an id to a resource before it is made. The other
+  // functions are called by the thread owning the values, which inserts a
+  // value for a reserved id or releases it. A released slot stays used in
+  // the server and is kept by the owner, so Create reuses it without an
+  // atomic operation. Reserve does not see it and takes a new slot.
+template <typename T>
+class SlotMap {
+ public:
+  SlotMap() : values_(), value_slots_(), indices_(), slot_server_(),
+      free_slots_() {
+    for (int i = 0; i < kPageNum; ++i) pages_[i].store(nullptr);
+  }
+  ~SlotMap() {
+    for (int i = 0; i < kPageNum; ++i) delete[] pages_[i].load();
+  }
+  int Reserve() {
+    const int slot_id = slot_server_.CreateId();
+    if (slot_id < 0) return SYS_SLOT_INVALID_ID;
+    if (slot_id > SYS_SLOT_INDEX_MASK) {
+      // All slots are used or retired.
+      slot_server_.ReleaseId(slot_id);
+      return SYS_SLOT_INVALID_ID;
+    }
+    const uint32_t slot = static_cast<uint32_t>(slot_id);
+    // The generation was increased before the slot was released.
+    const uint32_t generation =
+      GetGeneration(slot)->load(std::memory_order_acquire);
+    return static_cast<int>((generation << SYS_SLOT_INDEX_BITS) | slot);
+  }
+  T* Insert(int id) {  // Null if the id is not reserved.
+    if (!IsReserved(id)) return nullptr;
+    return InsertSlot(id & SYS_SLOT_INDEX_MASK);
+  }
+  int Create(T** value) {
+    // A slot released by the owner is reused first, the server is not used.
+    const int free_slot = free_slots_.TakeLowest();
+    if (free_slot < 0) {
+      const int id = Reserve();
+      if (id == SYS_SLOT_INVALID_ID) return SYS_SLOT_INVALID_ID;
+      T* inserted = Insert(id);
+      if (value) *value = inserted;
+      return id;
+    }
+    const uint32_t slot = static_cast<uint32_t>(free_slot);
+    T* inserted = InsertSlot(slot);
+    if (value) *value = inserted;
+    return static_cast<int>(
+        (LoadGeneration(slot) << SYS_SLOT_INDEX_BITS) | slot);
+  }
+  bool Release(int id) {  // The id is inserted or reserved.
+    const bool is_valid = IsValid(id);
+    if (!is_valid && !IsReserved(id)) return false;
+    const uint32_t slot = id & SYS_SLOT_INDEX_MASK;
+    if (is_valid) {
+      // The last value is moved to the hole, so values stay dense.
+      const uint32_t index = indices_[slot];
+      const uint32_t last = static_cast<uint32_t>(values_.size() - 1);
+      if (index != last) {
+        values_[index] = std::move(values_[last]);
+        value_slots_[index] = value_slots_[last];
+        indices_[value_slots_[index]] = index;
+      }
+      values_.pop_back();
+      value_slots_.pop_back();
+      indices_[slot] = kNoValue;
+    }
+    std::atomic<uint32_t>* generation = GetGeneration(slot);
+    const uint32_t old = generation->load(std::memory_order_relaxed);
+    if (old == SYS_SLOT_GENERATION_MASK) {
+      // A retired slot is kept used in the server, and no id matches it.
+      generation->store(kRetired, std::memory_order_relaxed);
+      return true;
+    }
+    generation->store(old + 1, std::memory_order_release);
+    free_slots_.Add(slot);
+    return true;
+  }
+  bool IsValid(int id) const {  // Inserted.
+    if (id < 0) return false;
+    const uint32_t slot = id & SYS_SLOT_INDEX_MASK;
+    if (slot >= indices_.size()) return false;
+    const uint32_t index = indices_[slot];
+    if ((index >= values_.size()) || (value_slots_[index] != slot)) {
+      return false;
+    }
+    return LoadGeneration(slot) ==
+      (static_cast<uint32_t>(id) >> SYS_SLOT_INDEX_BITS);
+  }
+  T* Get(int id) {
+    if (!IsValid(id)) return nullptr;
+    return &values_[indices_[id & SYS_SLOT_INDEX_MASK]];
+  }
+  const T* Get(int id) const {
+    if (!IsValid(id)) return nullptr;
+    return &values_[indices_[id & SYS_SLOT_INDEX_MASK]];
+  }
+  // True when the next Create moves the values.
+  bool IsFull() const { return values_.size() == values_.capacity(); }
+  int size() const { return static_cast<int>(values_.size()); }
+  int GetId(int index) const {  // Of the value at the index of begin().
+    assert((index >= 0) && (index < size()));
+    const uint32_t slot = value_slots_[index];
+    return static_cast<int>(
+        (LoadGeneration(slot) << SYS_SLOT_INDEX_BITS) | slot);
+  }
+  T* begin() { return values_.data(); }
+  T* end() { return values_.data() + values_.size(); }
+  void Clear() {  // The values, ids only reserved are kept.
+    while (!values_.empty()) Release(GetId(size() - 1));
+  }
+ private:
+  static const uint32_t kNoValue = 0xffffffff;
+  static const uint32_t kRetired = SYS_SLOT_GENERATION_MASK + 1;
+  static const int kPageNum =
+    1 << (SYS_SLOT_INDEX_BITS - SYS_SLOT_PAGE_BITS);
+  static const int kPageSize = 1 << SYS_SLOT_PAGE_BITS;
+  SlotMap(const SlotMap&);
+  SlotMap& operator=(const SlotMap&);
+  // The page is allocated when it is used first.
+  std::atomic<uint32_t>* GetGeneration(uint32_t slot) {
+    std::atomic<std::atomic<uint32_t>*>& page =
+      pages_[slot >> SYS_SLOT_PAGE_BITS];
+    std::atomic<uint32_t>* generations =
+      page.load(std::memory_order_acquire);
+    if (!generations) {
+      std::atomic<uint32_t>* new_generations =
+        new std::atomic<uint32_t>[kPageSize];
+      for (int i = 0; i < kPageSize; ++i) new_generations[i].store(0);
+      // Another thread may allocate the same page, the first one is used.
+      if (page.compare_exchange_strong(generations, new_generations,
+                                       std::memory_order_acq_rel)) {
+        generations = new_generations;
+      } else {
+        delete[] new_generations;
+      }
+    }
+    return &generations[slot & (kPageSize - 1)];
+  }
+  uint32_t LoadGeneration(uint32_t slot) const {
+    const std::atomic<uint32_t>* generations =
+      pages_[slot >> SYS_SLOT_PAGE_BITS].load(std::memory_order_acquire);
+    if (!generations) return 0;
+    return generations[slot & (kPageSize - 1)].load(
+        std::memory_order_relaxed);
+  }
+  T* InsertSlot(uint32_t slot) {
+    if (slot >= indices_.size()) {
+      const uint32_t no_value = kNoValue;
+      indices_.resize(slot + 1, no_value);
+    }
+    indices_[slot] = static_cast<uint32_t>(values_.size());
+    values_.push_back(T());
+    value_slots_.push_back(slot);
+    return &values_.back();
+  }
+  bool IsReserved(int id) const {  // Not inserted yet.
+    if (id < 0) return false;
+    const uint32_t slot = id & SYS_SLOT_INDEX_MASK;
+    if ((slot < indices_.size()) && (indices_[slot] != kNoValue)) {
+      return false;
+    }
+    // A slot kept by the owner is used in the server, but it is free.
+    if (free_slots_.Has(slot)) return false;
+    return slot_server_.IsUsed(static_cast<int>(slot)) &&
+      (LoadGeneration(slot) ==
+       (static_cast<uint32_t>(id) >> SYS_SLOT_INDEX_BITS));
+  }
+  std::vector<T> values_;
+  std::vector<uint32_t> value_slots_;  // The slot of each value.
+  std::vector<uint32_t> indices_;  // The value of each slot, or kNoValue.
+  std::atomic<std::atomic<uint32_t>*> pages_[kPageNum];  // Generations.
+  IdServer slot_server_;
+  FreeSlotSet free_slots_;  // Released, and still used in the server.
+};
+
+  //
+  // These are internal functions related to slot map
+  //
+}  // namespace sys
+#endif  // SLOT_MAP_INTERNAL_H_
@@ -4,127 +4,181 @@
   // @date 2017-07-27 21:04:42
   // Copyright 2017 Mamoru Kaminaga
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include <memory>
+#include <string>
 #include <vector>
+#include "./load.h"
+#include "./load_internal.h"
+#include "./mixer_internal.h"
 #include "./sound.h"
 #include "./sound_internal.h"
 #include "./system_internal.h"
+#include "./wave_internal.h"
+static_assert(SYS_SOUND_FRAME_RATE == SYS_MIXER_SAMPLE_RATE,
+              "The sound clock must be the mixer rate.");
+static_assert((SYS_VOICE_NUM == SYS_MIXER_VOICE_NUM) &&
+              (SYS_VOICE_REAL_NUM == SYS_MIXER_REAL_VOICE_NUM),
+              "Voices must match the mixer.");
+static_assert(SYS_BUS_NUM == SYS_MIXER_BUS_NUM, "Buses must match the mixer.");
 namespace sys {
   //
   // These are internal structures related to sound
   //
 SoundData sound_data;
-SoundData::SoundData() : direct_sound8(nullptr), hmutex(nullptr),
-    wave_buffer(), streaming_data() { }
-
-  //
-  // These are public structures related to sound
-  //
-WaveData::WaveData() : buffer(nullptr) { }
-void WaveData::Release() {
-  SYS_SAFE_RELEASE(buffer);
-}
-bool WaveData::IsNull() {
-  return (buffer == nullptr);
-}
-StreamingData::StreamingData() : resource_desc(), hthread(nullptr),
-    wave_data(), stop_request(false), in_pause(false), in_use(false),
-    in_loop(false) {
-  // The buffer is initialized.
-  sound_data.wave_buffer.resize(1024);
-}
-void StreamingData::Reset() {
-  hthread = nullptr;
-  stop_request = false;
-  in_pause = false;
-  in_use = false;
-  in_loop = false;
-  wave_data.Release();
+SoundData::SoundData() : direct_sound8(nullptr),
+    wave_buffer(), sample_cache(), streaming_buffer(),
+    default_streaming_id(SYS_SLOT_INVALID_ID), streaming_scheduler(),
+    decode_histogram(), mixer(), sink(), memory_sink(nullptr), mixer_thread(),
+    resample_quality(SYS_RESAMPLEQUALITY_MEDIUM),
+    backend(SYS_SOUNDBACKEND_DIRECTSOUND), render_file_name() { }
+DecodedSamples::DecodedSamples() : samples(), source() { }
+SampleCache::SampleCache() : mutex_(), entries_(),
+    prune_num_(SYS_SOUND_CACHE_PRUNE_NUM), hit_num_(0), decoded_num_(0) { }
+std::shared_ptr<const SampleBuffer> SampleCache::Find(
+    const std::wstring& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto entry = entries_.find(key);
+  if (entry == entries_.end()) return nullptr;
+  std::shared_ptr<const SampleBuffer> samples = entry->second.samples.lock();
+  if (samples) ++hit_num_;
+  return samples;
 }
-
-  //
-  // These are private functions related to sound
-  //
-HMMIO GetFileHandle(const wchar_t* file_name) {
-  return mmioOpen((LPWSTR) file_name, nullptr, MMIO_READ);
-}
-HMMIO GetFileHandle(const HPSTR mem_ptr, int mem_size) {
-  MMIOINFO mmio_info;
-  memset(&mmio_info, 0, sizeof(mmio_info));
-  mmio_info.pchBuffer = mem_ptr;
-  mmio_info.fccIOProc = FOURCC_MEM;
-  mmio_info.cchBuffer = mem_size;
-  mmio_info.adwInfo[0] = 1024;
-  return mmioOpen(nullptr, &mmio_info, MMIO_READ);
-}
-bool DescendToRiffChunk(HMMIO hmmio, MMCKINFO* riff_chunk_out) {
-  if (!riff_chunk_out) return false;
-  memset(riff_chunk_out, 0, sizeof(MMCKINFO));
-  riff_chunk_out->fccType = mmioFOURCC('W', 'A', 'V', 'E');
-  if (mmioDescend(hmmio, riff_chunk_out, nullptr, MMIO_FINDRIFF) !=
-      MMSYSERR_NOERROR) {
-    return false;
+std::shared_ptr<const SampleBuffer> SampleCache::Find(
+    const std::wstring& key, const void* source, size_t size) {
+  assert(source || (size == 0));
+  std::shared_ptr<const SampleBuffer> samples;
+  std::shared_ptr<const std::vector<uint8_t>> added_source;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry = entries_.find(key);
+    if (entry == entries_.end()) return nullptr;
+    samples = entry->second.samples.lock();
+    added_source = entry->second.source.lock();
   }
-  return true;
+  // The samples hold the source, so it is compared out of the lock.
+  if (!samples || !added_source || (added_source->size() != size) ||
+      ((size > 0) && (memcmp(added_source->data(), source, size) != 0))) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++hit_num_;
+  return samples;
 }
-bool DescendToFormatChunk(HMMIO hmmio, const MMCKINFO& riff_chunk,
-                          MMCKINFO* format_chunk_out) {
-  memset(format_chunk_out, 0, sizeof(MMCKINFO));
-  format_chunk_out->ckid = mmioFOURCC('f', 'm', 't', ' ');
-  if (mmioDescend(hmmio, format_chunk_out, &riff_chunk, MMIO_FINDCHUNK) !=
-      MMSYSERR_NOERROR) {
-    return false;
+std::shared_ptr<const SampleBuffer> SampleCache::Add(
+    const std::wstring& key, const std::wstring& alias_key,
+    const std::shared_ptr<const SampleBuffer>& samples,
+    const std::shared_ptr<const std::vector<uint8_t>>& source) {
+  assert(samples);
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry& entry = entries_[key];
+  std::shared_ptr<const SampleBuffer> added = entry.samples.lock();
+  if (!added) {
+    added = samples;
+    entry.samples = samples;
+    entry.source = source;
+    ++decoded_num_;
+  } else if (added != samples) {
+    // Decoded by another worker at the same time, or collided.
+    const std::shared_ptr<const std::vector<uint8_t>> added_source =
+      entry.source.lock();
+    if (source && added_source && (*source == *added_source)) {
+      ++hit_num_;
+    } else {
+      added = samples;
+      ++decoded_num_;
+    }
   }
-  return true;
+  if (!alias_key.empty()) {
+    Entry& alias = entries_[alias_key];
+    alias.samples = added;
+    alias.source.reset();
+  }
+  if (entries_.size() >= prune_num_) Prune();
+  return added;
 }
-bool ReadWavFormatEx(HMMIO hmmio, const MMCKINFO& format_chunk,
-                     WAVEFORMATEX* wave_fmt_ex_out) {
-  memset(wave_fmt_ex_out, 0, sizeof(WAVEFORMATEX));
-  if (mmioRead(hmmio, (HPSTR) wave_fmt_ex_out, format_chunk.cksize) !=
-      static_cast<LONG>(format_chunk.cksize)) {
-    return false;
+void SampleCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  prune_num_ = SYS_SOUND_CACHE_PRUNE_NUM;
+  hit_num_ = 0;
+  decoded_num_ = 0;
+}
+WaveCacheStats SampleCache::GetStats() {
+  WaveCacheStats stats;
+  std::vector<std::shared_ptr<const SampleBuffer>> samples;
+  std::vector<std::shared_ptr<const std::vector<uint8_t>>> sources;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.hit_num = hit_num_;
+    stats.decoded_num = decoded_num_;
+    for (auto& entry : entries_) {
+      std::shared_ptr<const SampleBuffer> resident =
+        entry.second.samples.lock();
+      if (resident) samples.push_back(resident);
+      std::shared_ptr<const std::vector<uint8_t>> source =
+        entry.second.source.lock();
+      if (source) sources.push_back(source);
+    }
   }
-  return true;
+  // Samples added with two keys are counted once.
+  std::sort(samples.begin(), samples.end());
+  samples.erase(std::unique(samples.begin(), samples.end()), samples.end());
+  stats.sample_num = static_cast<int>(samples.size());
+  for (auto& resident : samples) {
+    stats.resident_bytes += GetSampleBytes(*resident);
+  }
+  std::sort(sources.begin(), sources.end());
+  sources.erase(std::unique(sources.begin(), sources.end()), sources.end());
+  for (auto& source : sources) {
+    stats.resident_bytes += static_cast<int64_t>(source->size());
+  }
+  return stats;
 }
-bool DescendToDataChunk(HMMIO hmmio, const MMCKINFO& riff_chunk,
-                        MMCKINFO* data_chunk_out) {
-  memset(data_chunk_out, 0, sizeof(MMCKINFO));
-  data_chunk_out->ckid = mmioFOURCC('d', 'a', 't', 'a');
-  if (mmioDescend(hmmio, data_chunk_out, &riff_chunk, MMIO_FINDCHUNK) !=
-      MMSYSERR_NOERROR) {
-    return false;
+  // Entries of the released samples are removed, and the size to prune at
+  // is doubled from the entries left, so the cost is spread.
+void SampleCache::Prune() {
+  for (auto entry = entries_.begin(); entry != entries_.end();) {
+    if (entry->second.samples.expired()) {
+      entry = entries_.erase(entry);
+    } else {
+      ++entry;
+    }
   }
-  return true;
+  prune_num_ = (entries_.size() * 2 > SYS_SOUND_CACHE_PRUNE_NUM) ?
+    entries_.size() * 2 : SYS_SOUND_CACHE_PRUNE_NUM;
 }
-bool CreateWaveDataBuffer(const char* wave_mem, int wave_data_size,
-                          WaveData* wave, WAVEFORMATEX* wave_fmt_ex) {
-  assert(wave);
-  //
+DirectSoundSink::DirectSoundSink() : buffer_(nullptr), write_frame_(0) { }
+bool DirectSoundSink::Open() {
+  WAVEFORMATEX wave_fmt_ex = {0};
+  wave_fmt_ex.wFormatTag = WAVE_FORMAT_PCM;
+  wave_fmt_ex.nChannels = SYS_MIXER_CHANNEL_NUM;
+  wave_fmt_ex.nSamplesPerSec = SYS_MIXER_SAMPLE_RATE;
+  wave_fmt_ex.wBitsPerSample = 16;
+  wave_fmt_ex.nBlockAlign = SYS_MIXER_CHANNEL_NUM * sizeof(int16_t);
+  wave_fmt_ex.nAvgBytesPerSec = SYS_MIXER_SAMPLE_RATE *
+    wave_fmt_ex.nBlockAlign;
   DSBUFFERDESC ds_buf_desc;
   memset(&ds_buf_desc, 0, sizeof(ds_buf_desc));
   ds_buf_desc.dwSize = sizeof(ds_buf_desc);
-  ds_buf_desc.dwFlags = DSBCAPS_GLOBALFOCUS;
-  ds_buf_desc.dwBufferBytes = wave_data_size;
-  ds_buf_desc.lpwfxFormat = static_cast<LPWAVEFORMATEX>(wave_fmt_ex);
+  ds_buf_desc.dwFlags = DSBCAPS_GLOBALFOCUS | DSBCAPS_GETCURRENTPOSITION2;
+  ds_buf_desc.dwBufferBytes = SYS_SOUND_RING_FRAMES * wave_fmt_ex.nBlockAlign;
+  ds_buf_desc.lpwfxFormat = &wave_fmt_ex;
   ds_buf_desc.guid3DAlgorithm = GUID_NULL;
-  IDirectSoundBuffer* temp_buffer;
   if (FAILED(
         sound_data.direct_sound8->CreateSoundBuffer(
           &ds_buf_desc,
-          &temp_buffer,
+          &buffer_,
           nullptr))) {
     return false;
   }
-  temp_buffer->QueryInterface(
-      IID_IDirectSoundBuffer8,
-      reinterpret_cast<void**>(&wave->buffer));
-  SYS_SAFE_RELEASE(temp_buffer);
-  //
-  if (wave->buffer == nullptr) return false;
+  // The buffer is silent until the mixer writes to it.
   LPVOID write_ptr = nullptr;
   DWORD length = 0;
-  if (FAILED(
-        wave->buffer->Lock(
+  if (SUCCEEDED(
+        buffer_->Lock(
           0,
           0,
           &write_ptr,
@@ -132,176 +186,325 @@ bool CreateWaveDataBuffer(const char* wave_mem, int wave_data_size,
           nullptr,
           nullptr,
           DSBLOCK_ENTIREBUFFER))) {
+    memset(write_ptr, 0, length);
+    buffer_->Unlock(write_ptr, length, nullptr, 0);
+  }
+  write_frame_ = 0;
+  return SUCCEEDED(buffer_->Play(0, 0, DSBPLAY_LOOPING));
+}
+void DirectSoundSink::Close() {
+  if (buffer_ != nullptr) buffer_->Stop();
+  SYS_SAFE_RELEASE(buffer_);
+}
+int DirectSoundSink::GetWritableFrames() {
+  if (buffer_ == nullptr) return 0;
+  DWORD play_cursor = 0;
+  DWORD write_cursor = 0;
+  if (FAILED(buffer_->GetCurrentPosition(&play_cursor, &write_cursor))) {
+    return 0;
+  }
+  const int frame_bytes = SYS_MIXER_CHANNEL_NUM * sizeof(int16_t);
+  const int play_frame = play_cursor / frame_bytes;
+  int queued = (write_frame_ - play_frame + SYS_SOUND_RING_FRAMES) %
+    SYS_SOUND_RING_FRAMES;
+  if (queued > SYS_SOUND_LATENCY_FRAMES * 2) {
+    // Underrun, the played frames are old.
+    write_frame_ = write_cursor / frame_bytes;
+    queued = (write_frame_ - play_frame + SYS_SOUND_RING_FRAMES) %
+      SYS_SOUND_RING_FRAMES;
+  }
+  return (queued < SYS_SOUND_LATENCY_FRAMES) ?
+    (SYS_SOUND_LATENCY_FRAMES - queued) : 0;
+}
+bool DirectSoundSink::Write(const int16_t* samples, int frame_num) {
+  assert(samples);
+  if (buffer_ == nullptr) return false;
+  const int frame_bytes = SYS_MIXER_CHANNEL_NUM * sizeof(int16_t);
+  LPVOID write_ptr[2] = {nullptr, nullptr};
+  DWORD length[2] = {0, 0};
+  if (FAILED(
+        buffer_->Lock(
+          write_frame_ * frame_bytes,
+          frame_num * frame_bytes,
+          &write_ptr[0],
+          &length[0],
+          &write_ptr[1],
+          &length[1],
+          0))) {
     return false;
   }
-  memcpy(write_ptr, wave_mem, length);
-  wave->buffer->Unlock(write_ptr, length, nullptr, 0);
+  // The ring is wrapped into two parts.
+  memcpy(write_ptr[0], samples, length[0]);
+  if (write_ptr[1] != nullptr) {
+    memcpy(write_ptr[1], reinterpret_cast<const uint8_t*>(samples) + length[0],
+           length[1]);
+  }
+  buffer_->Unlock(write_ptr[0], length[0], write_ptr[1], length[1]);
+  write_frame_ = (write_frame_ + frame_num) % SYS_SOUND_RING_FRAMES;
   return true;
 }
-bool CreateWaveData(const WaveDesc& desc, WaveData* wave) {
-  assert(wave);
-  const ResourceDesc resource_desc = desc.resource_desc;
-  HMMIO hmmio = nullptr;
+
+  //
+  // These are public structures related to sound
+  //
+WaveData::WaveData() : samples(), load_state(SYS_LOADSTATE_NONE),
+    load_request(nullptr) { }
+void WaveData::Release() {
+  samples.reset();
+  if (load_request != nullptr) load_request->Cancel();
+  load_request = nullptr;
+  load_state = SYS_LOADSTATE_NONE;
+}
+bool WaveData::IsNull() {
+  return (samples == nullptr);
+}
+
+  //
+  // These are private functions related to sound
+  //
+  // A wave in memory is used in place, and a file is mapped.
+bool OpenWaveFile(const ResourceDesc& resource_desc, WaveFile* file) {
   if (resource_desc.use_mem) {
-    // From memory
-    hmmio = GetFileHandle(
-        reinterpret_cast<const HPSTR>(resource_desc.mem_ptr),
-        resource_desc.mem_size);
-  } else {
-    // From file
-    hmmio = GetFileHandle(resource_desc.file_name.c_str());
+    return file->Open(resource_desc.mem_ptr, resource_desc.mem_size);
   }
-  if (hmmio == nullptr) return false;
-  MMCKINFO riff_chunk = {0};
-  if (!DescendToRiffChunk(hmmio, &riff_chunk)) {
-    mmioClose(hmmio, 0);
-    return false;
+  return file->Open(resource_desc.file_name);
+}
+  // FNV-1a on bytes. A hit is compared with the source, so the hash only
+  // has to spread the bits.
+uint64_t HashWaveData(const uint8_t* data, size_t size) {
+  assert(data || (size == 0));
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ULL;
   }
-  MMCKINFO format_chunk = {0};
-  if (!DescendToFormatChunk(hmmio, riff_chunk, &format_chunk)) {
-    mmioClose(hmmio, 0);
-    return false;
+  return hash;
+}
+  // A file is taken as the same while waves of it are resident. Waves in
+  // memory are keyed by the data only, since the memory may be reused.
+std::wstring GetResourceKey(const WaveDesc& desc,
+                            SYS_RESAMPLEQUALITY quality) {
+  if (desc.resource_desc.use_mem) return std::wstring();
+  std::wstring key = L"file:" + desc.resource_desc.file_name + L"|" +
+    std::to_wstring(quality);
+  if (desc.use_loop) {
+    key += L"|" + std::to_wstring(desc.loop_start) + L"-" +
+      std::to_wstring(desc.loop_end);
   }
-  WAVEFORMATEX wave_fmt_ex = {0};
-  if (!ReadWavFormatEx(hmmio, format_chunk, &wave_fmt_ex)) {
-    mmioClose(hmmio, 0);
-    return false;
+  return key;
+}
+std::wstring GetDataKey(const WaveView& view, bool use_loop, int loop_start,
+                        int loop_end, SYS_RESAMPLEQUALITY quality) {
+  const PcmFormat& format = view.format;
+  std::wstring key = L"data:" +
+    std::to_wstring(HashWaveData(view.data, view.size)) + L"|" +
+    std::to_wstring(view.size) + L"|" + std::to_wstring(view.codec) + L"|" +
+    std::to_wstring(format.sample_rate) + L"|" +
+    std::to_wstring(format.channel_num) + L"|" +
+    std::to_wstring(format.bits) + L"|" + std::to_wstring(format.is_float) +
+    L"|" + std::to_wstring(format.channel_mask) + L"|" +
+    std::to_wstring(view.block_bytes) + L"|" + std::to_wstring(quality);
+  if (use_loop) {
+    key += L"|" + std::to_wstring(loop_start) + L"-" +
+      std::to_wstring(loop_end);
   }
-  mmioAscend(hmmio, &format_chunk, 0);
-  MMCKINFO data_chunk = {0};
-  if (!DescendToDataChunk(hmmio, riff_chunk, &data_chunk)) {
-    mmioClose(hmmio, 0);
-    return false;
+  return key;
+}
+  // The wave is converted to the mixer format, so it is done on a worker
+  // when the wave is created asynchronously. Samples resident for the same
+  // file or the same data are shared instead.
+bool DecodeWaveData(const WaveDesc& desc, SYS_RESAMPLEQUALITY quality,
+                    std::shared_ptr<const SampleBuffer>* samples) {
+  assert(samples);
+  SampleCache& cache = sound_data.sample_cache;
+  // 1. The same file is not opened again.
+  const std::wstring resource_key = GetResourceKey(desc, quality);
+  if (!resource_key.empty()) {
+    *samples = cache.Find(resource_key);
+    if (*samples) return true;
   }
-  std::unique_ptr<char[]> wave_mem(new char[data_chunk.cksize]);
-  if (mmioRead(hmmio, (HPSTR) wave_mem.get(), data_chunk.cksize) !=
-      static_cast<LONG>(data_chunk.cksize)) {
-    mmioClose(hmmio, 0);
+  // PCM is converted from the mapped file directly.
+  WaveFile file;
+  WaveDecoder decoder;
+  if (!OpenWaveFile(desc.resource_desc, &file) ||
+      !decoder.Reset(file.GetView())) {
     return false;
   }
-  mmioClose(hmmio, 0);
-  // Sound buffer is set.
-  WaitForSingleObject(sound_data.hmutex, 0);
-  if (!CreateWaveDataBuffer(
-        wave_mem.get(),
-        data_chunk.cksize,
-        wave,
-        &wave_fmt_ex)) {
-    ReleaseMutex(sound_data.hmutex);
-    return false;
+  const WaveView& view = file.GetView();
+  int loop_start = 0;
+  int loop_end = view.frame_num;
+  if (desc.use_loop) {
+    // The frames after the loop are never played.
+    GetWaveLoop(view, desc.loop_start, desc.loop_end, &loop_start,
+                &loop_end);
   }
-  if (wave->IsNull()) {
-    ReleaseMutex(sound_data.hmutex);
+  // 2. The same data is not decoded again.
+  const std::wstring data_key = GetDataKey(view, desc.use_loop, loop_start,
+                                           loop_end, quality);
+  std::shared_ptr<const SampleBuffer> resident =
+    cache.Find(data_key, view.data, view.size);
+  if (resident) {
+    *samples = cache.Add(data_key, resource_key, resident, nullptr);
+    return true;
+  }
+  const void* pcm = nullptr;
+  const int frame_num = decoder.Read(loop_end, &pcm);
+  // The source is kept as long as the samples, to compare the next waves.
+  std::shared_ptr<DecodedSamples> decoded(new DecodedSamples());
+  if (!ConvertPcm(view.format, pcm,
+                  static_cast<size_t>(frame_num) * view.frame_bytes,
+                  desc.use_loop ? loop_start : -1, quality,
+                  &decoded->samples)) {
     return false;
   }
-  ReleaseMutex(sound_data.hmutex);
+  decoded->source.assign(view.data, view.data + view.size);
+  const std::shared_ptr<const SampleBuffer> converted(decoded,
+                                                      &decoded->samples);
+  const std::shared_ptr<const std::vector<uint8_t>> source(decoded,
+                                                           &decoded->source);
+  *samples = cache.Add(data_key, resource_key, converted, source);
   return true;
 }
-bool StopWaveData(WaveData* wave) {
+bool CreateWaveData(const WaveDesc& desc, WaveData* wave) {
   assert(wave);
-  WaitForSingleObject(sound_data.hmutex, 0);
-  if (wave->IsNull()) {
-    ReleaseMutex(sound_data.hmutex);
-    return false;
-  }
-  wave->buffer->Stop();
-  wave->buffer->SetCurrentPosition(0);
-  ReleaseMutex(sound_data.hmutex);
+  return DecodeWaveData(desc, sound_data.resample_quality, &wave->samples);
+}
+  // Voices are owned by the wave id, since samples may be shared.
+bool StopWaveData(int wave_id, WaveData* wave) {
+  assert(wave);
+  if (wave->IsNull()) return false;
+  sound_data.mixer.StopOwner(wave_id);
   return true;
 }
-bool ReleaseWaveData(WaveData* wave) {
+bool ReleaseWaveData(int wave_id, WaveData* wave) {
   assert(wave);
-  StopWaveData(wave);
-  WaitForSingleObject(sound_data.hmutex, 0);
-  if (wave->IsNull()) {
-    ReleaseMutex(sound_data.hmutex);
-    return false;
-  }
+  if (wave->IsNull()) return false;
+  StopWaveData(wave_id, wave);
   wave->Release();
-  ReleaseMutex(sound_data.hmutex);
   return true;
 }
-bool PlayWaveData(WaveData* wave) {
+int PlayWaveData(int wave_id, WaveData* wave, const VoiceDesc& desc) {
   assert(wave);
-  WaitForSingleObject(sound_data.hmutex, 0);
-  if (wave->IsNull()) {
-    ReleaseMutex(sound_data.hmutex);
-    return false;
-  }
-  wave->buffer->Play(0, 0, 0);
-  ReleaseMutex(sound_data.hmutex);
-  return true;
+  if (wave->IsNull()) return SYS_MIXER_INVALID_VOICE;
+  return sound_data.mixer.Play(wave->samples, wave_id, desc);
 }
-unsigned __stdcall StreamingProc(LPVOID lpargs) {
-  assert(lpargs);
-  ResourceDesc* resource_desc = static_cast<ResourceDesc*>(lpargs);
-  HMMIO hmmio = nullptr;
-  do {
-    if (resource_desc->use_mem) {
-      // Form memory
-      hmmio = GetFileHandle(
-          reinterpret_cast<const HPSTR>(resource_desc->mem_ptr),
-          resource_desc->mem_size);
-    } else {
-      // From file
-      hmmio = GetFileHandle(resource_desc->file_name.c_str());
-    }
-    if (hmmio == nullptr) return false;
-    MMCKINFO riff_chunk = {0};
-    if (!DescendToRiffChunk(hmmio, &riff_chunk)) {
-      mmioClose(hmmio, 0);
-      return S_OK;
-    }
-    MMCKINFO format_chunk = {0};
-    if (!DescendToFormatChunk(hmmio, riff_chunk, &format_chunk)) {
-      mmioClose(hmmio, 0);
-      return S_OK;
-    }
-    WAVEFORMATEX wave_fmt_ex = {0};
-    if (!ReadWavFormatEx(hmmio, format_chunk, &wave_fmt_ex)) {
-      mmioClose(hmmio, 0);
-      return S_OK;
-    }
-    mmioAscend(hmmio, &format_chunk, 0);
-    MMCKINFO data_chunk = {0};
-    if (!DescendToDataChunk(hmmio, riff_chunk, &data_chunk)) {
-      mmioClose(hmmio, 0);
-      return S_OK;
-    }
-    DWORD buf_status = 0;
-    std::unique_ptr<char[]> wave_mem(new char[SYS_STREAMING_READ_BYTES]);
-    int read_size = 0;
-    while (true) {
-      if (sound_data.streaming_data.stop_request) {
-        mmioClose(hmmio, 0);
-        return S_OK;  // Thread terminated.
-        break;
-      }
-      if (!sound_data.streaming_data.in_pause &&
-          !(buf_status & DSBSTATUS_PLAYING)) {
-        read_size = mmioRead(hmmio, (HPSTR) wave_mem.get(),
-                             SYS_STREAMING_READ_BYTES);
-        if (read_size == 0) {
-          break;
-        }
-        if (!CreateWaveDataBuffer(
-              wave_mem.get(),
-              read_size,
-              &sound_data.streaming_data.wave_data,
-              &wave_fmt_ex)) {
-          break;
-        }
-        PlayWaveData(&sound_data.streaming_data.wave_data);
-      }
-      sound_data.streaming_data.wave_data.buffer->GetStatus(&buf_status);
-      // This sleep is here to reduce the load of the CPU.
-      Sleep(1);
+void GetStreamingDataStats(const StreamingData& streaming,
+                           StreamingStats* stats) {
+  assert(stats);
+  const StreamBuffer& stream = *streaming.buffer;
+  stats->played_frames = stream.played_frames.load();
+  stats->underrun_num = stream.underrun_num.load();
+  stats->underrun_frames = stream.underrun_frames.load();
+  stats->fill_frames = stream.GetReadableFrames();
+  stats->min_fill_frames = stream.min_fill_frames.load();
+  stats->capacity_frames = stream.GetCapacityFrames();
+  stats->decoded_pieces = stream.decoded_pieces.load();
+  stats->decode_mean_ns = (stats->decoded_pieces > 0) ?
+    stream.decode_ns.load() / stats->decoded_pieces : 0;
+  stats->decode_max_ns = stream.max_decode_ns.load();
+}
+  // The times sent by the mixing and reading threads are put into the
+  // histograms, so the rings don't overflow between the queries.
+void CollectSoundTimes() {
+  sound_data.mixer.Collect();
+  int64_t decode_ns[64];
+  int num = 0;
+  while ((num = sound_data.streaming_scheduler.ReadDecodeTimes(decode_ns,
+                                                               64)) > 0) {
+    for (int i = 0; i < num; ++i) {
+      sound_data.decode_histogram.Add(decode_ns[i]);
     }
-    mmioClose(hmmio, 0);
-  } while (sound_data.streaming_data.in_loop);
-  return S_OK;  // Thread terminated.
+  }
+}
+void GetSoundTimeStats(const LogHistogram& histogram, SoundTimeStats* stats) {
+  assert(stats);
+  stats->count = histogram.GetCount();
+  stats->mean_ns = histogram.GetMean();
+  stats->p50_ns = histogram.GetPercentile(50.0);
+  stats->p95_ns = histogram.GetPercentile(95.0);
+  stats->p99_ns = histogram.GetPercentile(99.0);
+  stats->max_ns = histogram.GetMax();
+}
+void WriteSoundTimeStats(FILE* file, const char* name,
+                         const SoundTimeStats& stats) {
+  assert(file);
+  assert(name);
+  fprintf(file, "%s,%lld,%lld,%lld,%lld,%lld,%lld\n", name,
+          static_cast<long long>(stats.count),
+          static_cast<long long>(stats.mean_ns),
+          static_cast<long long>(stats.p50_ns),
+          static_cast<long long>(stats.p95_ns),
+          static_cast<long long>(stats.p99_ns),
+          static_cast<long long>(stats.max_ns));
+}
+  // The time the frame 0 is heard, of GetNanoSecond. The time of the
+  // offline backend is the frames rendered, and the mixer has no offset
+  // before the first block.
+int64_t GetSoundClockOrigin() {
+  if (sound_data.backend == SYS_SOUNDBACKEND_OFFLINE) return 0;
+  const int64_t offset_ns = sound_data.mixer.GetClockOffset();
+  if (offset_ns == SYS_MIXER_INVALID_CLOCK) {
+    return GetNanoSecond() - FramesToNanoSecond(sound_data.mixer.GetFrame());
+  }
+  const int latency_frames = sound_data.sink ?
+    sound_data.sink->GetLatencyFrames() : 0;
+  return offset_ns - system_data.start_ns +
+    FramesToNanoSecond(latency_frames);
+}
+  // The scheduler may read the stream once more, but the mixer doesn't.
+void StopStreamingData(StreamingData* streaming) {
+  assert(streaming);
+  streaming->stop_request.store(true);
+  sound_data.streaming_scheduler.Remove(streaming);
+  sound_data.mixer.RemoveStream(streaming->buffer.get());
 }
+
+  //
+  // These are private structures related to sound
+  //
+class WaveLoadRequest : public LoadRequest {  // Read on a worker.
+ public:
+  explicit WaveLoadRequest(const WaveDesc& desc) :
+      desc_(desc), resample_quality_(sound_data.resample_quality),
+      samples_() { }
+  bool Decode() {
+    return DecodeWaveData(desc_, resample_quality_, &samples_);
+  }
+  bool Finish() {
+    WaveData* wave = sound_data.wave_buffer.Get(id);
+    if (wave == nullptr) return false;
+    wave->load_request = nullptr;
+    wave->samples = samples_;
+    wave->load_state = SYS_LOADSTATE_DONE;
+    return true;
+  }
+  void Fail() {
+    WaveData* wave = sound_data.wave_buffer.Get(id);
+    if (wave == nullptr) return;
+    wave->Release();
+    wave->load_state = SYS_LOADSTATE_FAILED;
+  }
+ private:
+  WaveDesc desc_;
+  SYS_RESAMPLEQUALITY resample_quality_;
+  std::shared_ptr<const SampleBuffer> samples_;
+};
+
+  //
+  // These are internal functions related to sound
+  //
 bool InitSound() {
+  if (sound_data.backend == SYS_SOUNDBACKEND_OFFLINE) {
+    // No thread is started, RenderSound reads streams and mixes them.
+    if (sound_data.render_file_name.empty()) {
+      sound_data.memory_sink = new MemorySink();
+      sound_data.sink.reset(sound_data.memory_sink);
+    } else {
+      sound_data.sink.reset(
+          new WavFileSink(sound_data.render_file_name.c_str()));
+    }
+    return sound_data.sink->Open();
+  }
   if (FAILED(
         DirectSoundCreate8(
           nullptr,
@@ -316,17 +519,36 @@ bool InitSound() {
           DSSCL_PRIORITY))) {
     return false;
   }
-  sound_data.streaming_data.Reset();
-  sound_data.hmutex = CreateMutex(nullptr, TRUE, nullptr);
-  return true;
+  // Waves are mixed into one buffer on the mixing thread.
+  sound_data.sink.reset(new DirectSoundSink());
+  if (!sound_data.sink->Open()) return false;
+  // All streams are read on the scheduling thread.
+  if (!sound_data.streaming_scheduler.Start()) return false;
+  return sound_data.mixer_thread.Start(&sound_data.mixer,
+                                       sound_data.sink.get());
 }
 void FinalizeSound() {
-  StopStreaming();
-  CloseHandle(sound_data.hmutex);
+  // Streams left by the client are stopped.
+  for (auto& streaming : sound_data.streaming_buffer) {
+    StopStreamingData(streaming.get());
+  }
+  sound_data.streaming_buffer.Clear();
+  sound_data.default_streaming_id = SYS_SLOT_INVALID_ID;
+  sound_data.streaming_scheduler.Stop();
+  sound_data.mixer_thread.Stop();
+  if (sound_data.sink) sound_data.sink->Close();
+  sound_data.sink.reset();
+  sound_data.memory_sink = nullptr;
+  sound_data.mixer.StopAll();
+  // Waves left by the client are released.
+  for (WaveData& wave : sound_data.wave_buffer) wave.Release();
+  sound_data.wave_buffer.Clear();
+  sound_data.sample_cache.Clear();
   SYS_SAFE_RELEASE(sound_data.direct_sound8);
 }
 bool UpdateSound() {
-  return true;  // No Impl.
+  CollectSoundTimes();
+  return true;
 }
 
   //
@@ -334,113 +556,471 @@ bool UpdateSound() {
   //
 bool CreateWave(const WaveDesc& desc, int* wave_id) {
   // 1. The id allocation is checked.
-  int id = *wave_id = sound_data.wave_id_server.CreateId();
-  if (id == SYS_ID_SERVER_EXCEEDS_LIMIT) {
-    ErrorDialogBox(SYS_ERROR_IMAGE_ID_EXCEEDS_LIMIT, id);
+  WaveData* wave = nullptr;
+  const int id = *wave_id = sound_data.wave_buffer.Create(&wave);
+  if (id == SYS_SLOT_INVALID_ID) {
+    ErrorDialogBox(SYS_ERROR_WAVE_ID_EXCEEDS_LIMIT);
     return false;
   }
-  // 2. The buffer size is checked.
-  if (id >= static_cast<int>(sound_data.wave_buffer.size())) {
-    sys::ErrorDialogBox(
-        SYS_ERROR_TOO_MANY_WAVE_ID,
-        sound_data.wave_buffer.size());
+  // 2. The wave is created, the id is released if it fails.
+  if (!CreateWaveData(desc, wave)) {
+    wave->Release();
+    sound_data.wave_buffer.Release(id);
+    return false;
   }
-  CreateWaveData(desc, &sound_data.wave_buffer[id]);
   return true;
 }
+bool CreateWaveAsync(const WaveDesc& desc, int* wave_id,
+                     LoadCallback callback, void* data) {
+  // 1. The id allocation is checked.
+  WaveData* wave = nullptr;
+  const int id = *wave_id = sound_data.wave_buffer.Create(&wave);
+  if (id == SYS_SLOT_INVALID_ID) {
+    ErrorDialogBox(SYS_ERROR_WAVE_ID_EXCEEDS_LIMIT);
+    return false;
+  }
+  // The sound buffer is created in UpdateSystem after the file is read.
+  WaveLoadRequest* request = new WaveLoadRequest(desc);
+  request->id = id;
+  request->callback = callback;
+  request->callback_data = data;
+  wave->load_state = SYS_LOADSTATE_LOADING;
+  wave->load_request = request;
+  return load_data.load_queue.Submit(request);
+}
+bool CreateWaveAsync(const WaveDesc& desc, int* wave_id) {
+  return CreateWaveAsync(desc, wave_id, nullptr, nullptr);
+}
+SYS_LOADSTATE GetWaveLoadState(int wave_id) {
+  const WaveData* wave = sound_data.wave_buffer.Get(wave_id);
+  if (wave == nullptr) return SYS_LOADSTATE_NONE;
+  if (wave->load_state != SYS_LOADSTATE_NONE) return wave->load_state;
+  return SYS_LOADSTATE_DONE;  // Created synchronously.
+}
 bool StopWave(int wave_id) {
-  // 1. The buffer size is checked.
-  if (wave_id >= static_cast<int>(sound_data.wave_buffer.size())) {
+  // 1. The id is checked.
+  WaveData* wave = sound_data.wave_buffer.Get(wave_id);
+  if (wave == nullptr) {
     ErrorDialogBox(SYS_ERROR_INVALID_WAVE_ID, wave_id);
     return false;
   }
   // 2. Null check.
-  if (sound_data.wave_buffer[wave_id].IsNull()) {
+  if (wave->IsNull()) {
     ErrorDialogBox(SYS_ERROR_NULL_WAVE_ID, wave_id);
     return false;
   }
-  return StopWaveData(&sound_data.wave_buffer[wave_id]);
+  return StopWaveData(wave_id, wave);
 }
 bool ReleaseWave(int wave_id) {
-  // 1. The buffer size is checked.
-  if (wave_id >= static_cast<int>(sound_data.wave_buffer.size())) {
+  // 1. The id is checked, the one in loading or failed is released too.
+  WaveData* wave = sound_data.wave_buffer.Get(wave_id);
+  if (wave == nullptr) {
     ErrorDialogBox(SYS_ERROR_INVALID_WAVE_ID, wave_id);
     return false;
   }
-  // 2. Null check.
-  if (sound_data.wave_buffer[wave_id].IsNull()) {
+  if (!wave->IsNull()) ReleaseWaveData(wave_id, wave);
+  wave->Release();
+  sound_data.wave_buffer.Release(wave_id);
+  return true;
+}
+bool GetWaveStats(int wave_id, WaveStats* stats) {
+  assert(stats);
+  // 1. The id is checked.
+  const WaveData* wave = sound_data.wave_buffer.Get(wave_id);
+  if (wave == nullptr) {
+    ErrorDialogBox(SYS_ERROR_INVALID_WAVE_ID, wave_id);
+    return false;
+  }
+  // 2. Null check, a wave in loading has no samples yet.
+  if (wave->samples == nullptr) {
     ErrorDialogBox(SYS_ERROR_NULL_WAVE_ID, wave_id);
     return false;
   }
-  sound_data.wave_id_server.ReleaseId(wave_id);
-  return ReleaseWaveData(&sound_data.wave_buffer[wave_id]);
+  stats->resident_bytes = GetSampleBytes(*wave->samples);
+  stats->share_num = static_cast<int>(wave->samples.use_count());
+  return true;
+}
+bool GetWaveCacheStats(WaveCacheStats* stats) {
+  assert(stats);
+  *stats = sound_data.sample_cache.GetStats();
+  return true;
 }
 bool PlayWave(int wave_id) {
-  // 1. The buffer size is checked.
-  if (wave_id >= static_cast<int>(sound_data.wave_buffer.size())) {
+  int voice_id = SYS_MIXER_INVALID_VOICE;
+  return PlayWave(wave_id, VoiceDesc(), &voice_id);
+}
+bool PlayWave(int wave_id, const VoiceDesc& desc, int* voice_id) {
+  assert(voice_id);
+  *voice_id = SYS_MIXER_INVALID_VOICE;
+  // 1. The id is checked.
+  WaveData* wave = sound_data.wave_buffer.Get(wave_id);
+  if (wave == nullptr) {
     ErrorDialogBox(SYS_ERROR_INVALID_WAVE_ID, wave_id);
     return false;
   }
   // 2. Null check.
-  if (sound_data.wave_buffer[wave_id].IsNull()) {
+  if (wave->IsNull()) {
     ErrorDialogBox(SYS_ERROR_NULL_WAVE_ID, wave_id);
     return false;
   }
-  return PlayWaveData(&sound_data.wave_buffer[wave_id]);
+  // 3. A new voice is started, the wave may be played over itself.
+  *voice_id = PlayWaveData(wave_id, wave, desc);
+  return *voice_id != SYS_MIXER_INVALID_VOICE;
+}
+  // Voices end by themselves, so ended ones are not errors.
+bool StopVoice(int voice_id) {
+  return sound_data.mixer.Stop(voice_id);
+}
+bool SetVoiceGain(int voice_id, float gain) {
+  return sound_data.mixer.SetGain(voice_id, gain);
+}
+bool IsVoicePlaying(int voice_id) {
+  return sound_data.mixer.IsPlaying(voice_id);
+}
+bool SetVoiceCategory(int category, const VoiceCategoryDesc& desc) {
+  return sound_data.mixer.SetCategory(category, desc);
+}
+bool SetVoiceAudibleGain(float gain) {
+  return sound_data.mixer.SetAudibleGain(gain);
+}
+bool SetVoiceEffect(int voice_id, int index, const EffectDesc& desc) {
+  return sound_data.mixer.SetEffect(voice_id, index, desc);
+}
+bool SetMasterEffect(int index, const EffectDesc& desc) {
+  return sound_data.mixer.SetMasterEffect(index, desc);
+}
+int64_t GetSoundFrame() {
+  return sound_data.mixer.GetFrame();
+}
+int64_t GetSoundFrameAt(int64_t ns) {
+  return NanoSecondToFrames(ns - GetSoundClockOrigin());
+}
+int64_t GetSoundNanoSecond(int64_t frame) {
+  return GetSoundClockOrigin() + FramesToNanoSecond(frame);
+}
+bool GetEffectStats(SYS_EFFECTTYPE type, EffectStats* stats) {
+  assert(stats);
+  if ((type < SYS_EFFECTTYPE_NONE) || (type >= SYS_EFFECTTYPE_NUM)) {
+    return false;
+  }
+  *stats = sound_data.mixer.GetEffectStats(type);
+  return true;
+}
+bool SetBus(int bus, const BusDesc& desc) {
+  return sound_data.mixer.SetBus(bus, desc);
+}
+bool SetBusGain(int bus, float gain, float ramp_ms) {
+  BusDesc desc;
+  if (!sound_data.mixer.GetBus(bus, &desc)) return false;
+  desc.gain = gain;
+  desc.ramp_ms = ramp_ms;
+  return sound_data.mixer.SetBus(bus, desc);
+}
+bool SetBusMute(int bus, bool is_muted) {
+  BusDesc desc;
+  if (!sound_data.mixer.GetBus(bus, &desc)) return false;
+  desc.is_muted = is_muted;
+  return sound_data.mixer.SetBus(bus, desc);
+}
+bool SetBusEffect(int bus, int index, const EffectDesc& desc) {
+  return sound_data.mixer.SetBusEffect(bus, index, desc);
+}
+bool GetBusStats(int bus, BusStats* stats) {
+  assert(stats);
+  if ((bus < 0) || (bus >= SYS_BUS_NUM)) return false;
+  *stats = sound_data.mixer.GetBusStats(bus);
+  return true;
 }
 bool PlayStreaming(const StreamingDesc& desc) {
-  if (sound_data.streaming_data.in_use) return false;
-  sound_data.streaming_data.Reset();
-  //
-  sound_data.streaming_data.resource_desc = desc.resource_desc;
-  sound_data.streaming_data.in_loop = desc.use_loop;
-  unsigned thread_id = 0;
-  sound_data.streaming_data.hthread =
-    (HANDLE) _beginthreadex(
-      nullptr,
-      0,
-      StreamingProc,
-      &(sound_data.streaming_data.resource_desc),
-      0,
-      &thread_id);  // NOLINT
-  if (sound_data.streaming_data.hthread == nullptr) return false;
-  sound_data.streaming_data.in_use = true;
+  if (sound_data.streaming_buffer.IsValid(sound_data.default_streaming_id)) {
+    return false;
+  }
+  return PlayStreaming(desc, &sound_data.default_streaming_id);
+}
+bool PlayStreaming(const StreamingDesc& desc, int* streaming_id) {
+  assert(streaming_id);
+  // 1. The bus and the id allocation are checked.
+  if ((desc.bus < 0) || (desc.bus >= SYS_BUS_NUM)) {
+    ErrorDialogBox(SYS_ERROR_INVALID_BUS, desc.bus);
+    *streaming_id = SYS_SLOT_INVALID_ID;
+    return false;
+  }
+  std::shared_ptr<StreamingData>* streaming = nullptr;
+  const int id = *streaming_id =
+    sound_data.streaming_buffer.Create(&streaming);
+  if (id == SYS_SLOT_INVALID_ID) {
+    ErrorDialogBox(SYS_ERROR_STREAMING_ID_EXCEEDS_LIMIT);
+    return false;
+  }
+  // 2. The file is opened on the scheduling thread, and the mixer waits
+  // until the ring is filled.
+  streaming->reset(new StreamingData());
+  if (desc.resource_desc.use_mem) {
+    (*streaming)->mem = desc.resource_desc.mem_ptr;
+    (*streaming)->mem_size = desc.resource_desc.mem_size;
+  } else {
+    (*streaming)->file_name = desc.resource_desc.file_name;
+  }
+  (*streaming)->in_loop = desc.use_loop;
+  (*streaming)->loop_start = desc.loop_start;
+  (*streaming)->loop_end = desc.loop_end;
+  (*streaming)->resample_quality = sound_data.resample_quality;
+  (*streaming)->buffer->bus = desc.bus;
+  if (!sound_data.mixer.AddStream((*streaming)->buffer)) {
+    ErrorDialogBox(SYS_ERROR_TOO_MANY_STREAMING, SYS_MIXER_STREAM_NUM);
+    sound_data.streaming_buffer.Release(id);
+    *streaming_id = SYS_SLOT_INVALID_ID;
+    return false;
+  }
+  sound_data.streaming_scheduler.Add(*streaming);
   return true;
 }
 bool PauseStreaming() {
-  if (!sound_data.streaming_data.in_use) return false;
-  WaitForSingleObject(sound_data.hmutex, 0);
-  if (sound_data.streaming_data.wave_data.IsNull()) {
-    ReleaseMutex(sound_data.hmutex);
+  if (!sound_data.streaming_buffer.IsValid(sound_data.default_streaming_id)) {
     return false;
   }
-  StopWaveData(&sound_data.streaming_data.wave_data);
-  sound_data.streaming_data.in_pause = true;
-  ReleaseMutex(sound_data.hmutex);
+  return PauseStreaming(sound_data.default_streaming_id);
+}
+bool PauseStreaming(int streaming_id) {
+  // 1. The id is checked.
+  std::shared_ptr<StreamingData>* streaming =
+    sound_data.streaming_buffer.Get(streaming_id);
+  if (streaming == nullptr) {
+    ErrorDialogBox(SYS_ERROR_INVALID_STREAMING_ID, streaming_id);
+    return false;
+  }
+  (*streaming)->buffer->paused.store(true);
   return true;
 }
 bool ContinueStreaming() {
-  if (!sound_data.streaming_data.in_use) return false;
-  WaitForSingleObject(sound_data.hmutex, 0);
-  if (sound_data.streaming_data.wave_data.IsNull()) {
-    ReleaseMutex(sound_data.hmutex);
+  if (!sound_data.streaming_buffer.IsValid(sound_data.default_streaming_id)) {
+    return false;
+  }
+  return ContinueStreaming(sound_data.default_streaming_id);
+}
+bool ContinueStreaming(int streaming_id) {
+  // 1. The id is checked.
+  std::shared_ptr<StreamingData>* streaming =
+    sound_data.streaming_buffer.Get(streaming_id);
+  if (streaming == nullptr) {
+    ErrorDialogBox(SYS_ERROR_INVALID_STREAMING_ID, streaming_id);
+    return false;
+  }
+  (*streaming)->buffer->paused.store(false);
+  return true;
+}
+bool SeekStreaming(int frame) {
+  if (!sound_data.streaming_buffer.IsValid(sound_data.default_streaming_id)) {
     return false;
   }
-  PlayWaveData(&sound_data.streaming_data.wave_data);
-  sound_data.streaming_data.in_pause = false;
-  ReleaseMutex(sound_data.hmutex);
+  return SeekStreaming(sound_data.default_streaming_id, frame);
+}
+bool SeekStreaming(int streaming_id, int frame) {
+  // 1. The id and the frame are checked.
+  std::shared_ptr<StreamingData>* streaming =
+    sound_data.streaming_buffer.Get(streaming_id);
+  if (streaming == nullptr) {
+    ErrorDialogBox(SYS_ERROR_INVALID_STREAMING_ID, streaming_id);
+    return false;
+  }
+  if (frame < 0) return false;
+  // 2. The stream is replaced by one read from the frame, with a new ring
+  // and converter, so nothing read ahead or held by the resampler is
+  // played. The mixer switches them between blocks, and the id is kept.
+  const std::shared_ptr<StreamingData> old_streaming = *streaming;
+  StopStreamingData(old_streaming.get());
+  streaming->reset(new StreamingData());
+  (*streaming)->file_name = old_streaming->file_name;
+  (*streaming)->mem = old_streaming->mem;
+  (*streaming)->mem_size = old_streaming->mem_size;
+  (*streaming)->in_loop = old_streaming->in_loop;
+  (*streaming)->loop_start = old_streaming->loop_start;
+  (*streaming)->loop_end = old_streaming->loop_end;
+  (*streaming)->start_frame = frame;
+  (*streaming)->resample_quality = old_streaming->resample_quality;
+  (*streaming)->buffer->gain = old_streaming->buffer->gain;
+  (*streaming)->buffer->bus = old_streaming->buffer->bus;
+  (*streaming)->buffer->paused.store(old_streaming->buffer->paused.load());
+  if (!sound_data.mixer.AddStream((*streaming)->buffer)) {
+    ErrorDialogBox(SYS_ERROR_TOO_MANY_STREAMING, SYS_MIXER_STREAM_NUM);
+    sound_data.streaming_buffer.Release(streaming_id);
+    if (streaming_id == sound_data.default_streaming_id) {
+      sound_data.default_streaming_id = SYS_SLOT_INVALID_ID;
+    }
+    return false;
+  }
+  sound_data.streaming_scheduler.Add(*streaming);
   return true;
 }
 bool StopStreaming() {
-  if (!sound_data.streaming_data.in_use) return false;
-  WaitForSingleObject(sound_data.hmutex, 0);
-  sound_data.streaming_data.stop_request = true;
-  ReleaseMutex(sound_data.hmutex);
-  //
-  WaitForSingleObject(sound_data.streaming_data.hthread, INFINITE);
-  CloseHandle(sound_data.streaming_data.hthread);
-  ReleaseWaveData(&sound_data.streaming_data.wave_data);
-  sound_data.streaming_data.Reset();
+  if (!sound_data.streaming_buffer.IsValid(sound_data.default_streaming_id)) {
+    return false;
+  }
+  const bool result = StopStreaming(sound_data.default_streaming_id);
+  sound_data.default_streaming_id = SYS_SLOT_INVALID_ID;
+  return result;
+}
+bool StopStreaming(int streaming_id) {
+  // 1. The id is checked.
+  std::shared_ptr<StreamingData>* streaming =
+    sound_data.streaming_buffer.Get(streaming_id);
+  if (streaming == nullptr) {
+    ErrorDialogBox(SYS_ERROR_INVALID_STREAMING_ID, streaming_id);
+    return false;
+  }
+  // 2. The id is released after the mixer leaves the stream.
+  StopStreamingData(streaming->get());
+  sound_data.streaming_buffer.Release(streaming_id);
+  return true;
+}
+bool GetStreamingStats(StreamingStats* stats) {
+  assert(stats);
+  if (!sound_data.streaming_buffer.IsValid(sound_data.default_streaming_id)) {
+    return false;
+  }
+  return GetStreamingStats(sound_data.default_streaming_id, stats);
+}
+bool GetStreamingStats(int streaming_id, StreamingStats* stats) {
+  assert(stats);
+  // 1. The id is checked.
+  const std::shared_ptr<StreamingData>* streaming =
+    sound_data.streaming_buffer.Get(streaming_id);
+  if (streaming == nullptr) {
+    ErrorDialogBox(SYS_ERROR_INVALID_STREAMING_ID, streaming_id);
+    return false;
+  }
+  GetStreamingDataStats(**streaming, stats);
+  return true;
+}
+bool GetSoundStats(SoundStats* stats) {
+  assert(stats);
+  CollectSoundTimes();
+  const MixerStats mixer_stats = sound_data.mixer.GetStats();
+  stats->voice_num = mixer_stats.playing_num;
+  stats->active_voice_num = mixer_stats.active_num;
+  stats->virtual_voice_num = mixer_stats.virtual_num;
+  stats->streaming_num = sound_data.streaming_buffer.size();
+  stats->stolen_num = mixer_stats.stolen_num;
+  stats->underrun_num = 0;
+  for (auto& streaming : sound_data.streaming_buffer) {
+    stats->underrun_num += streaming->buffer->underrun_num.load();
+  }
+  stats->mixed_frames = mixer_stats.mixed_frames;
+  stats->late_num = mixer_stats.late_num;
+  stats->late_frames = mixer_stats.late_frames;
+  GetSoundTimeStats(sound_data.mixer.GetMixHistogram(), &stats->mix_time);
+  GetSoundTimeStats(sound_data.decode_histogram, &stats->decode_time);
+  return true;
+}
+void ResetSoundStats() {
+  CollectSoundTimes();
+  sound_data.mixer.ResetTimeStats();
+  sound_data.decode_histogram.Reset();
+}
+  // Lines of comma separated values, a header line before each kind.
+bool DumpSoundStats(const wchar_t* file_name) {
+  assert(file_name);
+  SoundStats stats;
+  GetSoundStats(&stats);
+  FILE* file = nullptr;
+  if ((_wfopen_s(&file, file_name, L"w") != 0) || (file == nullptr)) {
+    return false;
+  }
+  fprintf(file, "voice_num,active_voice_num,virtual_voice_num,"
+          "streaming_num,stolen_num,underrun_num,mixed_frames,late_num,"
+          "late_frames\n");
+  fprintf(file, "%d,%d,%d,%d,%lld,%lld,%lld,%lld,%lld\n", stats.voice_num,
+          stats.active_voice_num, stats.virtual_voice_num,
+          stats.streaming_num,
+          static_cast<long long>(stats.stolen_num),
+          static_cast<long long>(stats.underrun_num),
+          static_cast<long long>(stats.mixed_frames),
+          static_cast<long long>(stats.late_num),
+          static_cast<long long>(stats.late_frames));
+  fprintf(file, "time,count,mean_ns,p50_ns,p95_ns,p99_ns,max_ns\n");
+  WriteSoundTimeStats(file, "mix", stats.mix_time);
+  WriteSoundTimeStats(file, "decode", stats.decode_time);
+  // The histogram of the mix times, buckets without a count are skipped.
+  fprintf(file, "mix_upper_ns,count\n");
+  const LogHistogram& histogram = sound_data.mixer.GetMixHistogram();
+  for (int i = 0; i < SYS_HISTOGRAM_BUCKET_NUM; ++i) {
+    const int64_t count = histogram.GetBucketCount(i);
+    if (count == 0) continue;
+    fprintf(file, "%lld,%lld\n",
+            static_cast<long long>(LogHistogram::GetBucketUpperBound(i)),
+            static_cast<long long>(count));
+  }
+  fprintf(file, "streaming_id,played_frames,underrun_num,underrun_frames,"
+          "fill_frames,min_fill_frames,capacity_frames,decoded_pieces,"
+          "decode_mean_ns,decode_max_ns\n");
+  for (int i = 0; i < sound_data.streaming_buffer.size(); ++i) {
+    StreamingStats streaming_stats;
+    GetStreamingDataStats(*sound_data.streaming_buffer.begin()[i],
+                          &streaming_stats);
+    fprintf(file, "%d,%lld,%lld,%lld,%d,%d,%d,%lld,%lld,%lld\n",
+            sound_data.streaming_buffer.GetId(i),
+            static_cast<long long>(streaming_stats.played_frames),
+            static_cast<long long>(streaming_stats.underrun_num),
+            static_cast<long long>(streaming_stats.underrun_frames),
+            streaming_stats.fill_frames, streaming_stats.min_fill_frames,
+            streaming_stats.capacity_frames,
+            static_cast<long long>(streaming_stats.decoded_pieces),
+            static_cast<long long>(streaming_stats.decode_mean_ns),
+            static_cast<long long>(streaming_stats.decode_max_ns));
+  }
+  fprintf(file, "effect,block_num,process_ns\n");
+  for (int type = SYS_EFFECTTYPE_GAIN; type < SYS_EFFECTTYPE_NUM; ++type) {
+    const EffectStats effect_stats = sound_data.mixer.GetEffectStats(
+        static_cast<SYS_EFFECTTYPE>(type));
+    fprintf(file, "%d,%lld,%lld\n", type,
+            static_cast<long long>(effect_stats.block_num),
+            static_cast<long long>(effect_stats.process_ns));
+  }
+  fprintf(file, "bus,block_num,process_ns,peak,duck_gain\n");
+  for (int bus = SYS_BUS_MASTER; bus < SYS_BUS_NUM; ++bus) {
+    const BusStats bus_stats = sound_data.mixer.GetBusStats(bus);
+    fprintf(file, "%d,%lld,%lld,%f,%f\n", bus,
+            static_cast<long long>(bus_stats.block_num),
+            static_cast<long long>(bus_stats.process_ns), bus_stats.peak,
+            bus_stats.duck_gain);
+  }
+  const bool result = (ferror(file) == 0);
+  fclose(file);
+  return result;
+}
+void SetResampleQuality(SYS_RESAMPLEQUALITY quality) {
+  sound_data.resample_quality = quality;
+}
+void SetSoundBackend(SYS_SOUNDBACKEND backend) {
+  sound_data.backend = backend;
+}
+void SetSoundRenderFile(const wchar_t* file_name) {
+  sound_data.render_file_name = (file_name != nullptr) ? file_name : L"";
+}
+  // The time of the offline backend is the frames rendered, so the result is
+  // the same whatever the speed is.
+bool RenderSound(int frame_num) {
+  if (sound_data.backend != SYS_SOUNDBACKEND_OFFLINE) return false;
+  if (!sound_data.sink) return false;
+  while (frame_num > 0) {
+    const int n = (frame_num < SYS_MIXER_BLOCK_FRAMES) ?
+      frame_num : SYS_MIXER_BLOCK_FRAMES;
+    sound_data.streaming_scheduler.Fill(n);
+    if (!RenderMixer(&sound_data.mixer, sound_data.sink.get(), n)) {
+      return false;
+    }
+    CollectSoundTimes();
+    frame_num -= n;
+  }
+  return true;
+}
+bool GetRenderedSound(const int16_t** samples, int* frame_num) {
+  assert(samples);
+  assert(frame_num);
+  if (sound_data.memory_sink == nullptr) return false;
+  const std::vector<int16_t>& rendered = sound_data.memory_sink->GetSamples();
+  *samples = rendered.empty() ? nullptr : &rendered[0];
+  *frame_num = static_cast<int>(rendered.size() / SYS_MIXER_CHANNEL_NUM);
   return true;
 }
 }  // namespace sys
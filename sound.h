@@ -11,6 +11,8 @@
 #include <windows.h>
 #include <string>
 #include "./common.h"
+#include "./load.h"
+#include "./mixer.h"
   //
   // These are public macros related to sound
   //
@@ -19,37 +21,196 @@
 #define SYS_ERROR_NULL_WAVE_ID            L"Error! Null wave id:%d"
 #define SYS_ERROR_INVALID_WAVE_ID         L"Error! Invalid wave id:%d"
 #define SYS_ERROR_TOO_MANY_WAVE_ID        L"Error! Too many waves, max:%d"
+#define SYS_ERROR_STREAMING_ID_EXCEEDS_LIMIT \
+  L"Error! Streaming id exceeds limit"
+#define SYS_ERROR_INVALID_STREAMING_ID    L"Error! Invalid streaming id:%d"
+#define SYS_ERROR_TOO_MANY_STREAMING      L"Error! Too many streams, max:%d"
+#define SYS_ERROR_INVALID_BUS             L"Error! Invalid bus:%d"
+#define SYS_SOUND_FRAME_RATE              (44100)  // Of the sound clock.
 
   //
   // These are public enumerations and constants related to sound
   //
+enum SYS_SOUNDBACKEND {
+  SYS_SOUNDBACKEND_DIRECTSOUND,
+  SYS_SOUNDBACKEND_OFFLINE,  // Rendered by RenderSound to memory or a file.
+};
 
 namespace sys {
   //
   // These are public structures related to sound
   //
+  // Loop points are frames of the wave, and the end is the frame after the
+  // loop. If loop_end is 0, the loop of the smpl chunk or the whole wave is
+  // used.
 struct WaveDesc {
   ResourceDesc resource_desc;
-  WaveDesc() : resource_desc() { }
+  bool use_loop;  // Voices are played until they are stopped.
+  int loop_start;
+  int loop_end;
+  WaveDesc() :
+    resource_desc(),
+    use_loop(false),
+    loop_start(0),
+    loop_end(0) { }
+};
+  // Waves of the same file or the same data share the samples.
+struct WaveStats {
+  int64_t resident_bytes;  // Of the samples, once for the waves sharing.
+  int share_num;  // Waves and voices sharing the samples.
+  WaveStats() :
+    resident_bytes(0),
+    share_num(0) { }
+};
+struct WaveCacheStats {
+  int sample_num;  // Samples resident.
+  int64_t resident_bytes;  // With the data kept to compare.
+  int64_t hit_num;  // Waves created from the samples resident.
+  int64_t decoded_num;  // Waves decoded from the files.
+  WaveCacheStats() :
+    sample_num(0),
+    resident_bytes(0),
+    hit_num(0),
+    decoded_num(0) { }
 };
 struct StreamingDesc {
   ResourceDesc resource_desc;
   bool use_loop;
+  int loop_start;
+  int loop_end;
+  int bus;  // Mixed to it.
   StreamingDesc() :
     resource_desc(),
-    use_loop(false) { }
+    use_loop(false),
+    loop_start(0),
+    loop_end(0),
+    bus(SYS_BUS_MUSIC) { }
+};
+struct StreamingStats {
+  int64_t played_frames;  // In 44100 Hz.
+  int64_t underrun_num;  // Blocks the reading thread was late for.
+  int64_t underrun_frames;  // Silent frames by underruns.
+  int fill_frames;  // Frames read ahead of the mixer.
+  int min_fill_frames;
+  int capacity_frames;
+  int64_t decoded_pieces;  // Read by the reading thread, of 4096 frames.
+  int64_t decode_mean_ns;
+  int64_t decode_max_ns;
+  StreamingStats() :
+    played_frames(0),
+    underrun_num(0),
+    underrun_frames(0),
+    fill_frames(0),
+    min_fill_frames(0),
+    capacity_frames(0),
+    decoded_pieces(0),
+    decode_mean_ns(0),
+    decode_max_ns(0) { }
+};
+struct SoundTimeStats {
+  int64_t count;
+  int64_t mean_ns;
+  int64_t p50_ns;
+  int64_t p95_ns;
+  int64_t p99_ns;
+  int64_t max_ns;
+  SoundTimeStats() :
+    count(0),
+    mean_ns(0),
+    p50_ns(0),
+    p95_ns(0),
+    p99_ns(0),
+    max_ns(0) { }
+};
+struct SoundStats {
+  int voice_num;  // Playing.
+  int active_voice_num;  // Mixed in the last block.
+  int virtual_voice_num;  // Not mixed in the last block.
+  int streaming_num;
+  int64_t stolen_num;  // Voices stopped to play new ones.
+  int64_t underrun_num;  // Of the streams playing.
+  int64_t mixed_frames;
+  int64_t late_num;  // Voices started after the start frame.
+  int64_t late_frames;  // Sum of the frames they were late.
+  SoundTimeStats mix_time;  // Of a call of the mixing thread.
+  SoundTimeStats decode_time;  // Of a piece of streaming.
+  SoundStats() :
+    voice_num(0),
+    active_voice_num(0),
+    virtual_voice_num(0),
+    streaming_num(0),
+    stolen_num(0),
+    underrun_num(0),
+    mixed_frames(0),
+    late_num(0),
+    late_frames(0),
+    mix_time(),
+    decode_time() { }
 };
 
   //
   // These are public functions related to sound
   //
 bool CreateWave(const WaveDesc& desc, int* wave_id);
+bool CreateWaveAsync(const WaveDesc& desc, int* wave_id,
+                     LoadCallback callback, void* data);
+bool CreateWaveAsync(const WaveDesc& desc, int* wave_id);  // Overloaded.
+SYS_LOADSTATE GetWaveLoadState(int wave_id);
 bool ReleaseWave(int wave_id);
+bool GetWaveStats(int wave_id, WaveStats* stats);
+bool GetWaveCacheStats(WaveCacheStats* stats);
 bool PlayWave(int wave_id);
-bool StopWave(int wave_id);
+bool PlayWave(int wave_id, const VoiceDesc& desc, int* voice_id);
+bool StopWave(int wave_id);  // All voices of the wave.
+bool StopVoice(int voice_id);
+bool SetVoiceGain(int voice_id, float gain);
+bool IsVoicePlaying(int voice_id);
+  // Voices quieter than the audible gain are virtual, they are not mixed but
+  // they go on, and they are mixed again when they are loud enough.
+bool SetVoiceCategory(int category, const VoiceCategoryDesc& desc);
+bool SetVoiceAudibleGain(float gain);
+  // The effect at the index is replaced, NONE removes it. The master chain
+  // is applied to the mixed sound.
+bool SetVoiceEffect(int voice_id, int index, const EffectDesc& desc);
+bool SetMasterEffect(int index, const EffectDesc& desc);
+bool GetEffectStats(SYS_EFFECTTYPE type, EffectStats* stats);
+  // Buses are processed once in a block, the ones nothing is mixed to are
+  // skipped.
+bool SetBus(int bus, const BusDesc& desc);
+bool SetBusGain(int bus, float gain, float ramp_ms);
+bool SetBusMute(int bus, bool is_muted);
+  // The chain of a bus is applied before the gain, it has no delay. The
+  // master bus uses SetMasterEffect.
+bool SetBusEffect(int bus, int index, const EffectDesc& desc);
+bool GetBusStats(int bus, BusStats* stats);
+  // The sound clock counts the frames mixed. Times are of GetNanoSecond and
+  // GetFrameNanoSecond, and a frame is mapped to the time it is heard.
+int64_t GetSoundFrame();  // The next frame mixed.
+int64_t GetSoundFrameAt(int64_t ns);
+int64_t GetSoundNanoSecond(int64_t frame);
+  // The functions without the id play one stream, and any number of streams
+  // are played with the ids.
 bool PlayStreaming(const StreamingDesc& desc);
+bool PlayStreaming(const StreamingDesc& desc, int* streaming_id);
 bool PauseStreaming();
+bool PauseStreaming(int streaming_id);
 bool ContinueStreaming();
+bool ContinueStreaming(int streaming_id);
+bool SeekStreaming(int frame);  // Of the wave.
+bool SeekStreaming(int streaming_id, int frame);
 bool StopStreaming();
+bool StopStreaming(int streaming_id);
+bool GetStreamingStats(StreamingStats* stats);
+bool GetStreamingStats(int streaming_id, StreamingStats* stats);
+  // For waves created and streaming played after it.
+  // The times are collected in UpdateSystem and RenderSound.
+bool GetSoundStats(SoundStats* stats);
+void ResetSoundStats();
+bool DumpSoundStats(const wchar_t* file_name);
+void SetResampleQuality(SYS_RESAMPLEQUALITY quality);
+void SetSoundBackend(SYS_SOUNDBACKEND backend);
+void SetSoundRenderFile(const wchar_t* file_name);  // nullptr for memory.
+bool RenderSound(int frame_num);
+bool GetRenderedSound(const int16_t** samples, int* frame_num);
 }  // namespace sys
 #endif  // SOUND_H_
@@ -6,15 +6,27 @@
 #ifndef SOUND_INTERNAL_H_
 #define SOUND_INTERNAL_H_
 #include <dsound.h>
-#include <process.h>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include "./common.h"
 #include "./common_internal.h"
+#include "./load.h"
+#include "./load_internal.h"
+#include "./mixer_internal.h"
+#include "./profile_internal.h"
+#include "./slot_map_internal.h"
 #include "./sound.h"
+#include "./streaming_internal.h"
   //
   // These are internal macros related to sound
   //
-#define SYS_STREAMING_READ_BYTES  (100000)
+#define SYS_SOUND_RING_FRAMES     (8192)  // The output buffer, 186 ms.
+#define SYS_SOUND_LATENCY_FRAMES  (2048)  // Mixed ahead of the play cursor.
+#define SYS_SOUND_CACHE_PRUNE_NUM (64)  // Entries kept before any is pruned.
 
   //
   // These are internal enumerations and constants related to sound
@@ -25,28 +37,87 @@ namespace sys {
   // These are internal structures related to sound
   //
 struct WaveData {
-  IDirectSoundBuffer* buffer;
+  std::shared_ptr<const SampleBuffer> samples;  // Shared with the voices.
+  SYS_LOADSTATE load_state;
+  LoadRequest* load_request;  // Canceled when released.
   WaveData();
   void Release();
   bool IsNull();
 };
-struct StreamingData {
-  ResourceDesc resource_desc;
-  HANDLE hthread;
-  bool stop_request;
-  bool in_pause;
-  bool in_use;
-  bool in_loop;
-  WaveData wave_data;
-  StreamingData();
-  void Reset();
+  // Samples decoded from wave data, with the data they are shared for.
+struct DecodedSamples {
+  SampleBuffer samples;
+  std::vector<uint8_t> source;
+  DecodedSamples();
+};
+  // Samples are shared by the waves of the same resource or the same data,
+  // so a sound created for many entities is decoded and kept once. Entries
+  // are weak, and the samples are freed when the last wave and voice release
+  // them. Data is keyed by a 64 bit hash, and the source kept with the
+  // samples is compared, so a collision is decoded again. Workers decode
+  // waves, so the cache is locked.
+class SampleCache {
+ public:
+  SampleCache();
+  std::shared_ptr<const SampleBuffer> Find(const std::wstring& key);
+  // Only the samples added with the same source are found.
+  std::shared_ptr<const SampleBuffer> Find(const std::wstring& key,
+                                           const void* source, size_t size);
+  // The samples are added with the keys, and the ones already added with
+  // the first key and the same source are returned instead. The second key
+  // may be empty. The source is null for the samples found with the key.
+  std::shared_ptr<const SampleBuffer> Add(
+      const std::wstring& key, const std::wstring& alias_key,
+      const std::shared_ptr<const SampleBuffer>& samples,
+      const std::shared_ptr<const std::vector<uint8_t>>& source);
+  void Clear();
+  WaveCacheStats GetStats();
+ private:
+  struct Entry {
+    std::weak_ptr<const SampleBuffer> samples;
+    std::weak_ptr<const std::vector<uint8_t>> source;
+  };
+  SampleCache(const SampleCache&);
+  SampleCache& operator=(const SampleCache&);
+  void Prune();
+  std::mutex mutex_;
+  std::unordered_map<std::wstring, Entry> entries_;
+  size_t prune_num_;  // Expired entries are removed at this size.
+  int64_t hit_num_;
+  int64_t decoded_num_;
+};
+  // A looping buffer is filled ahead of the play cursor. If the cursor
+  // passes the written frames, writing restarts from the write cursor.
+class DirectSoundSink : public AudioSink {
+ public:
+  DirectSoundSink();
+  bool Open();
+  void Close();
+  int GetWritableFrames();
+  bool Write(const int16_t* samples, int frame_num);
+  int GetLatencyFrames() {
+    return SYS_SOUND_LATENCY_FRAMES - SYS_MIXER_BLOCK_FRAMES;
+  }
+ private:
+  IDirectSoundBuffer* buffer_;
+  int write_frame_;  // In the ring.
 };
 struct SoundData {
   IDirectSound8* direct_sound8;
-  HANDLE hmutex;
-  std::vector<WaveData> wave_buffer;
-  StreamingData streaming_data;
-  IdServer wave_id_server;
+  SlotMap<WaveData> wave_buffer;
+  SampleCache sample_cache;
+  // Shared with the scheduler, which may read a stopped one once more.
+  SlotMap<std::shared_ptr<StreamingData>> streaming_buffer;
+  int default_streaming_id;  // Played by the functions without the id.
+  StreamingScheduler streaming_scheduler;
+  LogHistogram decode_histogram;  // Of pieces of all streams.
+  Mixer mixer;
+  std::unique_ptr<AudioSink> sink;
+  MemorySink* memory_sink;  // The sink of the offline backend in memory.
+  MixerThread mixer_thread;
+  SYS_RESAMPLEQUALITY resample_quality;
+  SYS_SOUNDBACKEND backend;
+  std::wstring render_file_name;  // Empty for memory.
   SoundData();
 };
 extern SoundData sound_data;
@@ -0,0 +1,235 @@
+﻿  // @file streaming
+  // @brief Definitions of streaming related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 23:12:40
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include <limits.h>
+#include <chrono>
+#include "./clock_internal.h"
+#include "./streaming_internal.h"
+namespace sys {
+  //
+  // These are internal structures related to streaming
+  //
+StreamingData::StreamingData() : file_name(), mem(nullptr), mem_size(0),
+    in_loop(false), loop_start(0), loop_end(0), start_frame(0),
+    resample_quality(SYS_RESAMPLEQUALITY_MEDIUM),
+    buffer(new StreamBuffer(SYS_STREAM_RING_FRAMES)), stop_request(false),
+    is_opened_(false), keeps_loop_(false), in_resident_loop_(false),
+    first_frame_(0), end_frame_(0), frame_bytes_(0), resident_position_(0),
+    loop_samples_(), file_(), decoder_(), converter_(), converted_() { }
+  // Compressed waves are decoded a piece at a time. The converter keeps the
+  // frames between pieces, so the loop end is followed by the loop start
+  // without a gap.
+bool StreamingData::ReadPiece() {
+  if (!is_opened_ && !in_resident_loop_ && !Open()) {
+    buffer->end.store(true);
+    buffer->ready.store(true);
+    return false;
+  }
+  const int frame_num =
+    converter_.GetSourceFrames(SYS_STREAMING_PIECE_FRAMES);
+  const void* pcm = nullptr;
+  int source_frame_num = 0;
+  if (in_resident_loop_) {
+    const int left = end_frame_ - first_frame_ - resident_position_;
+    source_frame_num = (frame_num < left) ? frame_num : left;
+    pcm = &loop_samples_[static_cast<size_t>(resident_position_) *
+                         frame_bytes_];
+    resident_position_ += source_frame_num;
+    if (source_frame_num == left) resident_position_ = 0;
+  } else {
+    const int position = decoder_.GetPosition();
+    const int left = end_frame_ - position;
+    source_frame_num = decoder_.Read((frame_num < left) ? frame_num : left,
+                                     &pcm);
+    if (keeps_loop_ && (position + source_frame_num > first_frame_)) {
+      // The loop region is kept while it is read first.
+      const int skip = (first_frame_ > position) ? first_frame_ - position : 0;
+      const uint8_t* src = static_cast<const uint8_t*>(pcm) +
+        static_cast<size_t>(skip) * frame_bytes_;
+      loop_samples_.insert(
+          loop_samples_.end(), src,
+          src + static_cast<size_t>(source_frame_num - skip) * frame_bytes_);
+    }
+  }
+  if (source_frame_num == 0) {
+    // The frames held by the resampler are the last ones.
+    const int flushed_frame_num = converter_.Flush(&converted_);
+    if (flushed_frame_num > 0) {
+      buffer->Write(&converted_[0], flushed_frame_num);
+    }
+    file_.Close();
+    is_opened_ = false;
+    buffer->end.store(true);
+    buffer->ready.store(true);
+    return false;
+  }
+  const int converted_frame_num = converter_.Convert(pcm, source_frame_num,
+                                                     &converted_);
+  if (converted_frame_num > 0) {
+    buffer->Write(&converted_[0], converted_frame_num);
+  }
+  if (in_loop && !in_resident_loop_ &&
+      (decoder_.GetPosition() >= end_frame_)) {
+    if (keeps_loop_) {
+      // The samples were converted, so the file is closed.
+      file_.Close();
+      is_opened_ = false;
+      in_resident_loop_ = true;
+      resident_position_ = 0;
+    } else {
+      decoder_.Seek(first_frame_);
+    }
+  }
+  return true;
+}
+bool StreamingData::Open() {
+  const bool is_mapped =
+      mem ? file_.Open(mem, mem_size) : file_.Open(file_name);
+  if (!is_mapped || !decoder_.Reset(file_.GetView()) ||
+      !converter_.Reset(file_.GetView().format, resample_quality)) {
+    file_.Close();
+    return false;
+  }
+  const WaveView& view = file_.GetView();
+  first_frame_ = 0;
+  end_frame_ = view.frame_num;
+  if (in_loop) {
+    GetWaveLoop(view, loop_start, loop_end, &first_frame_, &end_frame_);
+  }
+  // A start in the loop or after it is taken into the loop.
+  int start = start_frame;
+  if (start >= end_frame_) {
+    start = (in_loop && (end_frame_ > first_frame_)) ?
+      first_frame_ + (start - first_frame_) % (end_frame_ - first_frame_) :
+      end_frame_;
+  }
+  if (!decoder_.Seek(start)) {
+    file_.Close();
+    return false;
+  }
+  frame_bytes_ = view.frame_bytes;
+  const int64_t loop_bytes = static_cast<int64_t>(end_frame_ - first_frame_) *
+    frame_bytes_;
+  // The loop is kept only if it is read from the loop start.
+  keeps_loop_ = in_loop && (loop_bytes <= SYS_STREAMING_RESIDENT_BYTES) &&
+    (start <= first_frame_);
+  loop_samples_.clear();
+  if (keeps_loop_) loop_samples_.reserve(static_cast<size_t>(loop_bytes));
+  is_opened_ = true;
+  return true;
+}
+StreamingScheduler::StreamingScheduler() : thread_(), mutex_(), cv_(),
+    streamings_(), is_added_(false), quit_(false),
+    decode_times_(SYS_STREAMING_TIME_NUM) { }
+StreamingScheduler::~StreamingScheduler() {
+  Stop();
+}
+bool StreamingScheduler::Start() {
+  assert(!thread_.joinable());
+  quit_ = false;
+  thread_ = std::thread(&StreamingScheduler::ScheduleProc, this);
+  return true;
+}
+void StreamingScheduler::Stop() {
+  if (!thread_.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+  streamings_.clear();
+}
+void StreamingScheduler::Add(
+    const std::shared_ptr<StreamingData>& streaming) {
+  assert(streaming);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streamings_.push_back(streaming);
+    is_added_ = true;
+  }
+  cv_.notify_one();
+}
+void StreamingScheduler::Remove(const StreamingData* streaming) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < streamings_.size(); ++i) {
+    if (streamings_[i].get() != streaming) continue;
+    streamings_[i] = streamings_.back();
+    streamings_.pop_back();
+    return;
+  }
+}
+void StreamingScheduler::Fill(int frame_num) {
+  assert(!thread_.joinable());
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& streaming : streamings_) {
+    StreamBuffer& buffer = *streaming->buffer;
+    while (!streaming->stop_request.load() && !buffer.end.load() &&
+           (buffer.GetReadableFrames() < frame_num) &&
+           (buffer.GetWritableFrames() >= SYS_STREAMING_PIECE_FRAMES)) {
+      Read(streaming.get());
+    }
+    buffer.ready.store(true);
+  }
+}
+void StreamingScheduler::ScheduleProc() {
+  // Filled streams are checked 4 times while a piece is played.
+  const std::chrono::nanoseconds wait_time(
+      1000000000LL * SYS_STREAMING_PIECE_FRAMES / SYS_MIXER_SAMPLE_RATE / 4);
+  std::vector<std::shared_ptr<StreamingData>> streamings;
+  while (true) {
+    {
+      // The streams are held while they are read, so they can be removed.
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (quit_) break;
+      streamings = streamings_;
+    }
+    StreamingData* next = nullptr;
+    int least_fill = INT_MAX;
+    for (auto& streaming : streamings) {
+      StreamBuffer& buffer = *streaming->buffer;
+      if (streaming->stop_request.load() || buffer.end.load()) continue;
+      if (buffer.GetWritableFrames() < SYS_STREAMING_PIECE_FRAMES) {
+        // Filled, the mixer can start.
+        buffer.ready.store(true);
+        continue;
+      }
+      const int fill = buffer.GetReadableFrames();
+      if (fill < least_fill) {
+        least_fill = fill;
+        next = streaming.get();
+      }
+    }
+    if (next != nullptr) {
+      Read(next);
+      continue;
+    }
+    // All streams are filled.
+    streamings.clear();
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait_for(lock, wait_time, [this] { return quit_ || is_added_; });
+    is_added_ = false;
+  }
+}
+int StreamingScheduler::ReadDecodeTimes(int64_t* ns, int num) {
+  assert(ns || (num == 0));
+  return decode_times_.Read(ns, num);
+}
+  // A piece is read and decoded, and the time is counted to the stream.
+void StreamingScheduler::Read(StreamingData* streaming) {
+  assert(streaming);
+  const int64_t start_ns = GetClockNanoSecond();
+  streaming->ReadPiece();
+  const int64_t decode_ns = GetClockNanoSecond() - start_ns;
+  StreamBuffer& buffer = *streaming->buffer;
+  buffer.decoded_pieces.fetch_add(1);
+  buffer.decode_ns.fetch_add(decode_ns);
+  if (decode_ns > buffer.max_decode_ns.load()) {
+    buffer.max_decode_ns.store(decode_ns);
+  }
+  decode_times_.Write(&decode_ns, 1);
+}
+}  // namespace sys
@@ -0,0 +1,98 @@
+﻿  // @file streaming_internal.h
+  // @brief Declaration of streaming related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 23:12:40
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef STREAMING_INTERNAL_H_
+#define STREAMING_INTERNAL_H_
+#include <atomic>
+#include <condition_variable>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "./mixer_internal.h"
+#include "./wave_internal.h"
+  //
+  // These are internal macros related to streaming
+  //
+#define SYS_STREAMING_PIECE_FRAMES    (4096)  // Read at once, 93 ms.
+#define SYS_STREAMING_RESIDENT_BYTES  (16 * 1024 * 1024)  // Of a kept loop.
+#define SYS_STREAMING_TIME_NUM        (1024)  // Read times not collected.
+
+  //
+  // These are internal enumerations and constants related to streaming
+  //
+
+namespace sys {
+  //
+  // These are internal structures related to streaming
+  //
+  // The scheduler reads the wave into the buffer, and the mixer reads the
+  // buffer. The loop region is kept in memory when it is read first, so the
+  // file is closed and loops after it are read without I/O.
+struct StreamingData {
+  std::wstring file_name;
+  const void* mem;  // Read in place of the file if it is not null.
+  size_t mem_size;
+  bool in_loop;
+  int loop_start;  // As StreamingDesc.
+  int loop_end;
+  int start_frame;  // Of the wave, read first. A loop is entered at it.
+  SYS_RESAMPLEQUALITY resample_quality;
+  std::shared_ptr<StreamBuffer> buffer;  // Shared with the mixer.
+  std::atomic<bool> stop_request;
+  StreamingData();
+  bool ReadPiece();  // The scheduler only, false at the end.
+ private:
+  StreamingData(const StreamingData&);
+  StreamingData& operator=(const StreamingData&);
+  bool Open();
+  bool is_opened_;
+  bool keeps_loop_;  // Short enough to be kept.
+  bool in_resident_loop_;  // Read from the kept loop.
+  int first_frame_;  // Of the loop.
+  int end_frame_;  // The loop end, or the wave end without loop.
+  int frame_bytes_;
+  int resident_position_;  // In the kept loop.
+  std::vector<uint8_t> loop_samples_;  // Decoded.
+  WaveFile file_;
+  WaveDecoder decoder_;
+  StreamConverter converter_;
+  std::vector<float> converted_;
+};
+  // One thread reads all streams a piece at a time. The stream with the
+  // least frames ahead of the mixer is read first, so streams cost no
+  // threads. Without the thread, streams are filled by the mixing thread
+  // before each block, so offline rendering doesn't depend on the clock.
+class StreamingScheduler {
+ public:
+  StreamingScheduler();
+  ~StreamingScheduler();
+  bool Start();
+  void Stop();
+  void Add(const std::shared_ptr<StreamingData>& streaming);
+  void Remove(const StreamingData* streaming);  // It may be read once more.
+  void Fill(int frame_num);  // Until frame_num frames are ahead.
+  int ReadDecodeTimes(int64_t* ns, int num);  // Of pieces, the client only.
+ private:
+  StreamingScheduler(const StreamingScheduler&);
+  StreamingScheduler& operator=(const StreamingScheduler&);
+  void ScheduleProc();
+  void Read(StreamingData* streaming);
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::shared_ptr<StreamingData>> streamings_;
+  bool is_added_;
+  bool quit_;
+  SpscRing<int64_t> decode_times_;  // Lost if the client is late.
+};
+
+  //
+  // These are internal functions related to streaming
+  //
+}  // namespace sys
+#endif  // STREAMING_INTERNAL_H_
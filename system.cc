@@ -10,10 +10,18 @@
 #include "./graphic_internal.h"
 #include "./input.h"
 #include "./input_internal.h"
+#include "./job.h"
+#include "./job_internal.h"
+#include "./load.h"
+#include "./load_internal.h"
+#include "./pack.h"
+#include "./pack_internal.h"
 #include "./sound.h"
 #include "./sound_internal.h"
 #include "./system.h"
 #include "./system_internal.h"
+static_assert(SYS_ELEMNUM_FRAMEPHASE == SYS_PROFILE_PHASE_NUM,
+              "Frame phases must match the profiler.");
 namespace sys {
   //
   // These are internal structures related to system
@@ -21,12 +29,14 @@ namespace sys {
 SystemData system_data;
 SystemData::SystemData() : hinstance(nullptr), hwnd(nullptr),
       window_size(640, 480), window_title(L"System"), icon_id(0),
-      fps_last_ms(0), ms(0), timer_int_ms(0), fps(0.0), window_forcus(false),
-      is_stopped(false) { }
+      timer_int_ms(0), frame_pacer(), start_ns(0), frame_ns(0), exit_ns(0),
+      fps(0.0), frame_profiler(), window_forcus(false), is_stopped(false) { }
 
   //
   // These are public structures related to system
   //
+FrameTimeStats::FrameTimeStats() : frame_num(0), mean_ns(0), p50_ns(0),
+    p95_ns(0), p99_ns(0), max_ns(0) { }
 
   //
   // These are private functions related to system
@@ -110,68 +120,56 @@ bool InitTimerPeriod() {
 void FinalizeTimerPeriod() {
   timeEndPeriod(system_data.timer_int_ms);
 }
-void CALLBACK TimerProc(UINT timer_id, UINT msg, DWORD_PTR user,
-                        DWORD_PTR ptr1, DWORD_PTR ptr2) {
-  system_data.ms += 1;
-  // These macro functions are to prevent warnings for unreferenced parameters.
-  UNREFERENCED_PARAMETER(timer_id);
-  UNREFERENCED_PARAMETER(msg);
-  UNREFERENCED_PARAMETER(user);
-  UNREFERENCED_PARAMETER(ptr1);
-  UNREFERENCED_PARAMETER(ptr2);
-}
-bool InitTimer() {
-  system_data.fps_timer_id = timeSetEvent(
-      system_data.timer_int_ms,
-      system_data.timer_int_ms,
-      TimerProc,
-      NULL,
-      TIME_PERIODIC);
-  if (system_data.fps_timer_id == 0) return false;
+bool InitFrameClock() {
+  system_data.start_ns = GetClockNanoSecond();
+  system_data.frame_ns = system_data.start_ns;
+  system_data.exit_ns = system_data.start_ns;
+  system_data.frame_pacer.Reset(system_data.start_ns);
   return true;
 }
-void FinalizeTimer() {
-  if (system_data.fps_timer_id != 0) timeKillEvent(system_data.fps_timer_id);
+void FinalizeFrameClock() {
+  /* No Impl */
 }
 bool ProcessMessage() {
   // This function polls when the function sys::StopSystem is called.
   MSG msg;
   while (true) {
-    while (true) {
-      if ((system_data.ms - system_data.last_ms) >= 16) {
-        system_data.last_ms = system_data.ms;
-        break;
-      }
-      // This sleep is here to reduce the load of the CPU.
-      Sleep(1);
-    }
+    // The pacer sleeps, then spins for the last part of the frame.
+    const int64_t wait_ns = GetClockNanoSecond();
+    system_data.frame_ns = system_data.frame_pacer.Wait();
+    system_data.frame_profiler.AddPhase(
+        SYS_FRAMEPHASE_IDLE,
+        system_data.frame_ns - wait_ns);
+    system_data.frame_profiler.StartFrame(system_data.frame_ns);
     if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
       if (msg.message == WM_QUIT) return false;
       // TranslateMessage(&msg);
       DispatchMessage(&msg);
     }
+    system_data.frame_profiler.AddPhase(
+        SYS_FRAMEPHASE_PUMP,
+        GetClockNanoSecond() - system_data.frame_ns);
     if (!system_data.is_stopped) return true;
   }
 }
 bool InitFPSCnt() {
-  for (int i = SYS_FPS_SAMPLE_NUM; i; --i) {
-    system_data.fps_sample.push_back(0);
-  }
+  system_data.frame_profiler.Reset();
   return true;
 }
 void FinalizeFPSCnt() {
   /* No Impl */
 }
 void UpdateFPSCnt() {
-  double fps = 1000.0 /
-    static_cast<double>(system_data.ms - system_data.fps_last_ms);
-  system_data.fps_last_ms = system_data.ms;
-  // Moving average updated.
-  system_data.fps_sample.pop_front();
-  system_data.fps_sample.push_back(fps);
-  double sum = 0.0;
-  for (auto& it : system_data.fps_sample) sum += it;
-  system_data.fps = sum / SYS_FPS_SAMPLE_NUM;
+  // Moving average of the latest frames.
+  int64_t frame_ns[SYS_FPS_SAMPLE_NUM] = {0};
+  const int num = system_data.frame_profiler.GetHistory(
+      SYS_FRAMEPHASE_FRAME,
+      frame_ns,
+      SYS_FPS_SAMPLE_NUM);
+  int64_t sum = 0;
+  for (int i = 0; i < num; ++i) sum += frame_ns[i];
+  if (sum <= 0) return;
+  system_data.fps = static_cast<double>(SYS_NS_PER_SECOND) * num / sum;
 }
 
   //
@@ -184,8 +182,10 @@ bool InitSystem(HINSTANCE hinstance) {
   if (!MyRegisterWindowClass()) return false;
   if (!MyCreateWindow()) return false;
   if (!InitTimerPeriod()) return false;
-  if (!InitTimer()) return false;
+  if (!InitFrameClock()) return false;
   if (!InitFPSCnt()) return false;
+  if (!InitJob()) return false;
+  if (!InitLoad()) return false;
   //
   if (!InitGraphic()) return false;
   if (!InitInput()) return false;
@@ -193,28 +193,41 @@ bool InitSystem(HINSTANCE hinstance) {
   return true;
 }
 void FinalizeSystem() {
+  FinalizeLoad();  // Before the resources it creates.
   FinalizeSound();
   FinalizeInput();
   FinalizeGraphic();
+  FinalizePack();  // After the resources created from the packs.
   //
+  FinalizeJob();
   FinalizeFPSCnt();
-  FinalizeTimer();
+  FinalizeFrameClock();
   FinalizeTimerPeriod();
   //
   FinalizeCOM();
 }
 bool UpdateSystem() {
+  // The client code since the last call is counted to the update.
+  system_data.frame_profiler.AddPhase(
+      SYS_FRAMEPHASE_UPDATE,
+      GetClockNanoSecond() - system_data.exit_ns);
   if (!ProcessMessage()) return false;
   UpdateFPSCnt();
   //
   if (!UpdateGraphic()) StopSystem();
+  const int64_t update_ns = GetClockNanoSecond();
   if (!UpdateInput()) StopSystem();
   if (!UpdateSound()) StopSystem();
+  if (!UpdateLoad()) StopSystem();
   //
   system_data.window_forcus = true;
   if (GetForegroundWindow() != system_data.hwnd) {
     system_data.window_forcus = false;
   }
+  system_data.exit_ns = GetClockNanoSecond();
+  system_data.frame_profiler.AddPhase(
+      SYS_FRAMEPHASE_UPDATE,
+      system_data.exit_ns - update_ns);
   return true;
 }
 void StopSystem() {
@@ -231,8 +244,19 @@ void SetWindowSize(int x, int y) {
   system_data.window_size.x = x;
   system_data.window_size.y = y;
 }
+void SetFrameRate(int numerator, int denominator) {
+  if ((numerator <= 0) || (denominator <= 0)) return;
+  system_data.frame_pacer.SetRate(numerator, denominator);
+}
 int GetMilliSecond() {
-  return system_data.ms;
+  return static_cast<int>(
+      (GetClockNanoSecond() - system_data.start_ns) / SYS_NS_PER_MILLISECOND);
+}
+int64_t GetNanoSecond() {
+  return GetClockNanoSecond() - system_data.start_ns;
+}
+int64_t GetFrameNanoSecond() {
+  return system_data.frame_ns - system_data.start_ns;
 }
 double GetFPS() {
   return system_data.fps;
@@ -240,4 +264,25 @@ double GetFPS() {
 bool GetForcuse() {
   return system_data.window_forcus;
 }
+bool GetFrameTimeStats(SYS_FRAMEPHASE phase, FrameTimeStats* stats) {
+  assert(stats);
+  if ((phase < 0) || (phase >= SYS_ELEMNUM_FRAMEPHASE)) return false;
+  const LogHistogram& histogram =
+    system_data.frame_profiler.GetHistogram(phase);
+  stats->frame_num = static_cast<int>(histogram.GetCount());
+  stats->mean_ns = histogram.GetMean();
+  stats->p50_ns = histogram.GetPercentile(50.0);
+  stats->p95_ns = histogram.GetPercentile(95.0);
+  stats->p99_ns = histogram.GetPercentile(99.0);
+  stats->max_ns = histogram.GetMax();
+  return true;
+}
+int GetFrameTimeHistory(SYS_FRAMEPHASE phase, int64_t* ns, int size) {
+  assert(ns);
+  if ((phase < 0) || (phase >= SYS_ELEMNUM_FRAMEPHASE)) return 0;
+  return system_data.frame_profiler.GetHistory(phase, ns, size);
+}
+void ResetFrameTimeStats() {
+  system_data.frame_profiler.Reset();
+}
 }  // namespace sys
@@ -10,20 +10,41 @@
 #include "./common.h"
 #include "./graphic.h"
 #include "./input.h"
+#include "./job.h"
+#include "./load.h"
+#include "./pack.h"
 #include "./sound.h"
 #include "./system.h"
   //
   // These are public macros related to system
   //
+#define SYS_ELEMNUM_FRAMEPHASE  (6)
 
   //
   // These are public enumerations and constants related to system
   //
+enum SYS_FRAMEPHASE {
+  SYS_FRAMEPHASE_FRAME,  // The whole frame.
+  SYS_FRAMEPHASE_PUMP,  // Window messages.
+  SYS_FRAMEPHASE_UPDATE,  // Client code, input and sound.
+  SYS_FRAMEPHASE_DRAW,  // Submission of queued draws.
+  SYS_FRAMEPHASE_PRESENT,
+  SYS_FRAMEPHASE_IDLE,  // Waiting for the next frame.
+};
 
 namespace sys {
   //
   // These are public structures related to system
   //
+struct FrameTimeStats {
+  int frame_num;
+  int64_t mean_ns;
+  int64_t p50_ns;
+  int64_t p95_ns;
+  int64_t p99_ns;
+  int64_t max_ns;
+  FrameTimeStats();
+};
 
   //
   // These are public functions related to system
@@ -35,8 +56,14 @@ void StopSystem();
 void SetWindowTitle(const wchar_t* window_title);
 void SetWindowIcon(int icon_id);
 void SetWindowSize(int x, int y);
+void SetFrameRate(int numerator, int denominator);
 int GetMilliSecond();
+int64_t GetNanoSecond();
+int64_t GetFrameNanoSecond();
 double GetFPS();
 bool GetForcuse();
+bool GetFrameTimeStats(SYS_FRAMEPHASE phase, FrameTimeStats* stats);
+int GetFrameTimeHistory(SYS_FRAMEPHASE phase, int64_t* ns, int size);
+void ResetFrameTimeStats();
 }  // namespace sys  // namespace sys
 #endif  // SYSTEM_H_
@@ -18,8 +18,10 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include "./clock_internal.h"
 #include "./common.h"
 #include "./common_internal.h"
+#include "./profile_internal.h"
 #include "./system.h"
   //
   // These are internal macros related to system
@@ -42,13 +44,13 @@ struct SystemData {
   Vector2<int> window_size;
   std::wstring window_title;
   int icon_id;
-  int fps_last_ms;
-  int fps_timer_id;
-  int last_ms;
-  int ms;
   int timer_int_ms;
+  FramePacer frame_pacer;
+  int64_t start_ns;  // The clock when the system is initialized.
+  int64_t frame_ns;  // The clock when the current frame started.
+  int64_t exit_ns;  // The clock when UpdateSystem returned.
   double fps;
-  std::list<double> fps_sample;
+  FrameProfiler frame_profiler;
   bool window_forcus;
   bool is_stopped;
   SystemData();
@@ -0,0 +1,337 @@
+﻿  // @file wave
+  // @brief Definitions of wave related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 21:48:26
+  // Copyright 2026 Mamoru Kaminaga
+#include <assert.h>
+#include <string.h>
+#include "./wave_internal.h"
+namespace sys {
+  //
+  // These are private functions related to wave
+  //
+namespace {
+  // Bytes 2 to 15 of the KSDATAFORMAT_SUBTYPE GUIDs, the first 2 bytes are
+  // the format.
+const uint8_t kSubFormatTail[14] = {
+  0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38,
+  0x9b, 0x71,
+};
+inline uint16_t ReadU16(const uint8_t* p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+inline uint32_t ReadU32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) |
+    (static_cast<uint32_t>(p[3]) << 24);
+}
+  // The steps and the changes of the step index of IMA ADPCM.
+const int16_t kAdpcmSteps[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+  45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209,
+  230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876,
+  963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+  3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493,
+  10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+  27086, 29794, 32767,
+};
+const int8_t kAdpcmIndexChanges[16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8,
+};
+inline int16_t DecodeAdpcmNibble(int nibble, int* predictor, int* index) {
+  const int step = kAdpcmSteps[*index];
+  int diff = step >> 3;
+  if (nibble & 1) diff += step >> 2;
+  if (nibble & 2) diff += step >> 1;
+  if (nibble & 4) diff += step;
+  if (nibble & 8) diff = -diff;
+  int value = *predictor + diff;
+  if (value > 32767) value = 32767;
+  if (value < -32768) value = -32768;
+  *predictor = value;
+  *index += kAdpcmIndexChanges[nibble];
+  if (*index < 0) *index = 0;
+  if (*index > 88) *index = 88;
+  return static_cast<int16_t>(value);
+}
+  // Frames of the last block, which may be cut.
+int GetAdpcmBlockFrames(int channel_num, int block_frames, size_t bytes) {
+  const size_t header_bytes = 4 * channel_num;
+  if (bytes < header_bytes) return 0;
+  // Each channel has 8 samples in 4 bytes after the header.
+  const size_t frame_num = 1 + (bytes - header_bytes) / header_bytes * 8;
+  return (frame_num < static_cast<size_t>(block_frames)) ?
+    static_cast<int>(frame_num) : block_frames;
+}
+bool ParseFormatChunk(const uint8_t* p, uint32_t size, WaveView* view) {
+  assert(view);
+  if (size < 16) return false;
+  uint16_t tag = ReadU16(p);
+  const int channel_num = ReadU16(p + 2);
+  const uint32_t sample_rate = ReadU32(p + 4);
+  const int block_align = ReadU16(p + 12);
+  const int bits = ReadU16(p + 14);
+  uint32_t channel_mask = 0;
+  if (tag == SYS_WAVE_FORMAT_EXTENSIBLE) {
+    // cbSize, wValidBitsPerSample, dwChannelMask and SubFormat follow.
+    if ((size < 40) || (ReadU16(p + 16) < 22)) return false;
+    if (memcmp(p + 26, kSubFormatTail, sizeof(kSubFormatTail)) != 0) {
+      return false;
+    }
+    channel_mask = ReadU32(p + 20);
+    tag = ReadU16(p + 24);
+  }
+  if ((channel_num <= 0) || (sample_rate == 0) ||
+      (sample_rate > 0x7fffffff)) {
+    return false;
+  }
+  view->format.sample_rate = static_cast<int>(sample_rate);
+  view->format.channel_num = channel_num;
+  view->format.channel_mask = channel_mask;
+  if (tag == SYS_WAVE_FORMAT_IMA_ADPCM) {
+    // cbSize and wSamplesPerBlock follow.
+    if ((size < 20) || (ReadU16(p + 16) < 2) || (bits != 4)) return false;
+    if ((channel_num > 2) || (block_align <= 4 * channel_num) ||
+        ((block_align % (4 * channel_num)) != 0)) {
+      return false;
+    }
+    const int block_frames = ReadU16(p + 18);
+    if (block_frames != GetAdpcmBlockFrames(channel_num, 0xffff,
+                                            block_align)) {
+      return false;
+    }
+    view->codec = SYS_WAVECODEC_IMA_ADPCM;
+    view->format.bits = 16;
+    view->format.is_float = false;
+    view->frame_bytes = channel_num * sizeof(int16_t);
+    view->block_bytes = block_align;
+    view->block_frames = block_frames;
+    return true;
+  }
+  if (tag == SYS_WAVE_FORMAT_PCM) {
+    if ((bits != 8) && (bits != 16) && (bits != 24) && (bits != 32)) {
+      return false;
+    }
+  } else if (tag == SYS_WAVE_FORMAT_IEEE_FLOAT) {
+    if (bits != 32) return false;
+  } else {
+    return false;
+  }
+  if (block_align != channel_num * bits / 8) return false;
+  view->codec = SYS_WAVECODEC_PCM;
+  view->format.bits = bits;
+  view->format.is_float = (tag == SYS_WAVE_FORMAT_IEEE_FLOAT);
+  view->frame_bytes = block_align;
+  view->block_bytes = block_align;
+  view->block_frames = 1;
+  return true;
+}
+}  // namespace
+
+  //
+  // These are internal structures related to wave
+  //
+WaveView::WaveView() : codec(SYS_WAVECODEC_PCM), format(), data(nullptr),
+    size(0), frame_bytes(0), frame_num(0), block_bytes(0), block_frames(0),
+    loop_start(0), loop_end(0) { }
+WaveDecoder::WaveDecoder() : view_(), position_(0), block_(-1),
+    block_frame_num_(0), block_samples_(), samples_() { }
+bool WaveDecoder::Reset(const WaveView& view) {
+  if ((view.data == nullptr) || (view.frame_num <= 0)) return false;
+  view_ = view;
+  position_ = 0;
+  block_ = -1;
+  block_frame_num_ = 0;
+  if (view.codec != SYS_WAVECODEC_PCM) {
+    block_samples_.resize(view.block_frames * view.format.channel_num);
+  }
+  return true;
+}
+bool WaveDecoder::Seek(int frame) {
+  if ((frame < 0) || (frame > view_.frame_num)) return false;
+  position_ = frame;
+  return true;
+}
+int WaveDecoder::Read(int frame_num, const void** samples) {
+  assert(samples);
+  if (frame_num > view_.frame_num - position_) {
+    frame_num = view_.frame_num - position_;
+  }
+  if (frame_num <= 0) return 0;
+  if (view_.codec == SYS_WAVECODEC_PCM) {
+    *samples = view_.data + static_cast<size_t>(position_) * view_.frame_bytes;
+    position_ += frame_num;
+    return frame_num;
+  }
+  const int channel_num = view_.format.channel_num;
+  samples_.resize(frame_num * channel_num);
+  int read_num = 0;
+  while (read_num < frame_num) {
+    const int block = position_ / view_.block_frames;
+    if ((block != block_) && (DecodeBlock(block) == 0)) break;
+    const int offset = position_ - block * view_.block_frames;
+    int n = block_frame_num_ - offset;
+    if (n <= 0) break;
+    if (n > frame_num - read_num) n = frame_num - read_num;
+    memcpy(&samples_[read_num * channel_num],
+           &block_samples_[offset * channel_num],
+           n * channel_num * sizeof(int16_t));
+    read_num += n;
+    position_ += n;
+  }
+  *samples = samples_.data();
+  return read_num;
+}
+int WaveDecoder::DecodeBlock(int block) {
+  const size_t head = static_cast<size_t>(block) * view_.block_bytes;
+  block_ = block;
+  block_frame_num_ = 0;
+  if (head >= view_.size) return 0;
+  const size_t rest = view_.size - head;
+  const size_t bytes = (rest < static_cast<size_t>(view_.block_bytes)) ?
+    rest : view_.block_bytes;
+  const int channel_num = view_.format.channel_num;
+  const int frame_num = GetAdpcmBlockFrames(channel_num, view_.block_frames,
+                                            bytes);
+  if (frame_num == 0) return 0;
+  const uint8_t* p = view_.data + head;
+  int16_t* out = block_samples_.data();
+  for (int c = 0; c < channel_num; ++c) {
+    // The header is the first sample and the step index.
+    int predictor = static_cast<int16_t>(ReadU16(p + c * 4));
+    int index = p[c * 4 + 2];
+    if (index > 88) index = 88;
+    out[c] = static_cast<int16_t>(predictor);
+    // Channels take turns every 4 bytes, 8 samples, low nibble first.
+    const uint8_t* src = p + channel_num * 4 + c * 4;
+    for (int frame = 1; frame < frame_num; frame += 8) {
+      const int n = (frame_num - frame < 8) ? (frame_num - frame) : 8;
+      for (int i = 0; i < n; ++i) {
+        const int nibble = (src[i >> 1] >> ((i & 1) * 4)) & 0x0f;
+        out[(frame + i) * channel_num + c] =
+          DecodeAdpcmNibble(nibble, &predictor, &index);
+      }
+      src += channel_num * 4;
+    }
+  }
+  block_frame_num_ = frame_num;
+  return frame_num;
+}
+WaveFile::WaveFile() : mapping_(), view_() { }
+WaveFile::~WaveFile() {
+  Close();
+}
+bool WaveFile::Open(const std::wstring& file_name) {
+  assert(!mapping_.GetData());
+  if (!mapping_.Open(file_name) ||
+      !ParseWave(mapping_.GetData(), mapping_.GetSize(), &view_)) {
+    Close();
+    return false;
+  }
+  return true;
+}
+bool WaveFile::Open(const void* mem, size_t size) {
+  assert(!mapping_.GetData());
+  if (!ParseWave(mem, size, &view_)) {
+    Close();
+    return false;
+  }
+  return true;
+}
+void WaveFile::Close() {
+  mapping_.Close();
+  view_ = WaveView();
+}
+
+  //
+  // These are internal functions related to wave
+  //
+bool ParseWave(const void* mem, size_t size, WaveView* view) {
+  assert(view);
+  const uint8_t* p = static_cast<const uint8_t*>(mem);
+  if (!p || (size < 12)) return false;
+  if ((memcmp(p, "RIFF", 4) != 0) || (memcmp(p + 8, "WAVE", 4) != 0)) {
+    return false;
+  }
+  // The RIFF size is trusted only within the memory.
+  size_t end = size;
+  const uint32_t riff_size = ReadU32(p + 4);
+  if ((riff_size >= 4) && (riff_size - 4 <= size - 12)) {
+    end = 12 + static_cast<size_t>(riff_size - 4);
+  }
+  WaveView parsed;
+  bool has_format = false;
+  bool has_data = false;
+  uint32_t fact_frame_num = 0;  // 0 for no fact chunk.
+  uint32_t loop_start = 0;
+  uint32_t loop_end = 0;  // 0 for no smpl chunk.
+  size_t offset = 12;
+  while ((offset <= end) && (end - offset >= 8)) {
+    const uint8_t* id = p + offset;
+    size_t chunk_size = ReadU32(p + offset + 4);
+    const size_t body = offset + 8;
+    if (chunk_size > end - body) {
+      // A data chunk cut by a broken writer is played up to the end.
+      if (memcmp(id, "data", 4) != 0) return false;
+      chunk_size = end - body;
+    }
+    if (memcmp(id, "fmt ", 4) == 0) {
+      if (!ParseFormatChunk(p + body, static_cast<uint32_t>(chunk_size),
+                            &parsed)) {
+        return false;
+      }
+      has_format = true;
+    } else if ((memcmp(id, "fact", 4) == 0) && (chunk_size >= 4)) {
+      fact_frame_num = ReadU32(p + body);
+    } else if ((memcmp(id, "smpl", 4) == 0) && (chunk_size >= 36 + 24) &&
+               (ReadU32(p + body + 28) > 0)) {
+      // The first loop, the end frame is played.
+      loop_start = ReadU32(p + body + 36 + 8);
+      loop_end = ReadU32(p + body + 36 + 12) + 1;
+    } else if (memcmp(id, "data", 4) == 0) {
+      parsed.data = p + body;
+      parsed.size = chunk_size;
+      has_data = true;
+    }
+    // Chunks are padded to even sizes.
+    offset = body + chunk_size + (chunk_size & 1);
+  }
+  if (!has_format || !has_data) return false;
+  size_t frame_num = 0;
+  if (parsed.codec == SYS_WAVECODEC_PCM) {
+    frame_num = parsed.size / parsed.frame_bytes;
+    parsed.size = frame_num * parsed.frame_bytes;
+  } else {
+    const size_t block_num = parsed.size / parsed.block_bytes;
+    frame_num = block_num * parsed.block_frames +
+      GetAdpcmBlockFrames(parsed.format.channel_num, parsed.block_frames,
+                          parsed.size - block_num * parsed.block_bytes);
+    // The last block is padded, the fact chunk has the real length.
+    if ((fact_frame_num > 0) && (fact_frame_num < frame_num)) {
+      frame_num = fact_frame_num;
+    }
+  }
+  if ((frame_num == 0) || (frame_num > 0x7fffffff)) return false;
+  parsed.frame_num = static_cast<int>(frame_num);
+  if ((loop_end != 0) && (loop_start < loop_end) &&
+      (loop_start < frame_num)) {
+    parsed.loop_start = static_cast<int>(loop_start);
+    parsed.loop_end = (loop_end < frame_num) ?
+      static_cast<int>(loop_end) : parsed.frame_num;
+  }
+  *view = parsed;
+  return true;
+}
+void GetWaveLoop(const WaveView& view, int loop_start, int loop_end,
+                 int* start, int* end) {
+  assert(start);
+  assert(end);
+  if (loop_end <= 0) {
+    loop_start = view.loop_start;
+    loop_end = (view.loop_end > 0) ? view.loop_end : view.frame_num;
+  }
+  if (loop_end > view.frame_num) loop_end = view.frame_num;
+  if ((loop_start < 0) || (loop_start >= loop_end)) loop_start = 0;
+  *start = loop_start;
+  *end = loop_end;
+}
+}  // namespace sys
@@ -0,0 +1,97 @@
+﻿  // @file wave_internal.h
+  // @brief Declaration of wave related structures and functions.
+  // @author Mamoru Kaminaga
+  // @date 2026-10-17 21:48:26
+  // Copyright 2026 Mamoru Kaminaga
+#ifndef WAVE_INTERNAL_H_
+#define WAVE_INTERNAL_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "./file_internal.h"
+#include "./mixer_internal.h"
+  //
+  // These are internal macros related to wave
+  //
+#define SYS_WAVE_FORMAT_PCM         (0x0001)
+#define SYS_WAVE_FORMAT_IEEE_FLOAT  (0x0003)
+#define SYS_WAVE_FORMAT_IMA_ADPCM   (0x0011)
+#define SYS_WAVE_FORMAT_EXTENSIBLE  (0xfffe)  // The format is the sub format.
+
+  //
+  // These are internal enumerations and constants related to wave
+  //
+enum SYS_WAVECODEC {
+  SYS_WAVECODEC_PCM,  // Including float.
+  SYS_WAVECODEC_IMA_ADPCM,  // 4 bit, decoded to 16 bit.
+};
+
+namespace sys {
+  //
+  // These are internal structures related to wave
+  //
+  // The samples of a wave in the memory it was parsed from, nothing is
+  // copied. Frames are interleaved, little endian. Compressed data is made
+  // of blocks, which are decoded independently.
+struct WaveView {
+  SYS_WAVECODEC codec;
+  PcmFormat format;  // Of the decoded samples.
+  const uint8_t* data;
+  size_t size;  // Bytes of whole blocks, and the last part of a block.
+  int frame_bytes;  // Of the decoded samples.
+  int frame_num;
+  int block_bytes;  // 1 frame of PCM.
+  int block_frames;
+  int loop_start;  // Of the smpl chunk.
+  int loop_end;  // The frame after the loop, 0 for no loop.
+  WaveView();
+};
+  // Frames are read from any position in the format of the view. PCM is
+  // pointed in place, compressed blocks are decoded when they are read.
+class WaveDecoder {
+ public:
+  WaveDecoder();
+  bool Reset(const WaveView& view);  // The view outlives the decoder.
+  bool Seek(int frame);
+  int GetPosition() const { return position_; }
+  // The samples are valid until the next call, the frames read are returned.
+  int Read(int frame_num, const void** samples);
+ private:
+  int DecodeBlock(int block);
+  WaveView view_;
+  int position_;  // The next frame.
+  int block_;  // The decoded block, -1 for none.
+  int block_frame_num_;
+  std::vector<int16_t> block_samples_;
+  std::vector<int16_t> samples_;
+};
+  // A wave file is mapped read only, and a wave in memory is used in place.
+  // The view is valid until the file is closed.
+class WaveFile {
+ public:
+  WaveFile();
+  ~WaveFile();
+  bool Open(const std::wstring& file_name);
+  bool Open(const void* mem, size_t size);  // The memory outlives the file.
+  void Close();
+  const WaveView& GetView() const { return view_; }
+ private:
+  WaveFile(const WaveFile&);
+  WaveFile& operator=(const WaveFile&);
+  FileMapping mapping_;
+  WaveView view_;
+};
+
+  //
+  // These are internal functions related to wave
+  //
+  // RIFF chunks are walked in the memory. PCM of 8, 16, 24 and 32 bit, 32
+  // bit float, their extensible forms and IMA ADPCM are taken.
+bool ParseWave(const void* mem, size_t size, WaveView* view);
+  // The loop is given in frames of the wave. If the end is 0, the loop of
+  // the smpl chunk is taken, or the whole wave without it.
+void GetWaveLoop(const WaveView& view, int loop_start, int loop_end,
+                 int* start, int* end);
+}  // namespace sys
+#endif  // WAVE_INTERNAL_H_